@@ -2,16 +2,10 @@ user_dir    := ../../user
 tools_dir   := ../../tools
 INCLUDES    := -I../../include -I$(user_dir)/include
 
-USERLIB              := entry.o \
-			syscall_wrap.o \
-			debugf.o \
-			libos.o \
-			fork.o \
-			syscall_lib.o \
-			ipc.o \
-			user_interrupt.o \
-			user_interrupt_wrap.o
+USERLIB              := entry.o
 
 USERLIB 	:= $(addprefix lib/, $(USERLIB))
-USERLIB     := $(addprefix $(user_dir)/, $(USERLIB)) $(wildcard ../../lib/*.o)
+USERLIB     := $(addprefix $(user_dir)/, $(USERLIB))
+# 共享用户库，只引用其中的符号
+ULIB_IMAGE  := $(user_dir)/ulib.b
 USERAPPS    := $(addprefix $(user_dir)/, $(USERAPPS))
\ No newline at end of file
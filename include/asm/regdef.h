@@ -47,4 +47,8 @@
 
 #define SIE_SEIE GENMASK(9, 9)
 
+#define SIP_STIP GENMASK(5, 5)
+
+#define SIP_SEIP GENMASK(9, 9)
+
 #endif /* __ASM_RISCV64_REGDEF_H */
@@ -53,6 +53,12 @@ struct device_tree {
     struct device_node *root;
 };
 
+// 物理内存区域：[begin, end)
+struct memory_region {
+    u_reg_t begin;
+    u_reg_t end;
+};
+
 struct device_node {
     const char *name;            // 节点名
     struct device_node *parent;  // 父节点
@@ -101,4 +107,30 @@ void print_stringlist(const char *stringlist, size_t total_length);
 struct device_tree parse_tree(void *begin);
 
 void device_tree_init(void *pa);
+
+/*
+ * 概述：
+ *   直接扫描位于`begin`处的FDT，提取物理内存布局，**不使用kmalloc**，
+ *   故可在物理内存管理初始化之前调用。
+ *
+ *   - 物理内存：根节点下名为`memory`（或`memory@...`）的节点的`reg`属性，
+ *     可包含多个区域（多个bank）
+ *   - 保留区域：FDT头中的保留内存表（mem_rsvmap），
+ *     以及`/reserved-memory`节点下各子节点的`reg`属性
+ *
+ *   `reg`按照父节点的`#address-cells`、`#size-cells`解析（缺省为2、1）。
+ *   超出`max_memory_count`、`max_reserved_count`的区域将被忽略。
+ *
+ * Precondition：
+ * - `begin`必须指向可访问的FDT（的虚拟地址）
+ * - 所有指针参数非空
+ *
+ * Postcondition：
+ * - 成功时返回0，`*memory_count`、`*reserved_count`为写入的区域数
+ * - 若FDT的magic不正确，或遇到非法的token，返回-E_INVAL
+ */
+int fdt_scan_memory(const void *begin, struct memory_region *memory_list,
+                    size_t max_memory_count, size_t *memory_count,
+                    struct memory_region *reserved_list,
+                    size_t max_reserved_count, size_t *reserved_count);
 #endif
\ No newline at end of file
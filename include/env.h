@@ -20,12 +20,35 @@
 
 #define MAXENVNAME 32
 
+// `Env::env_fork_flags`的标志位
+// fork时父子进程共享三级页表，在任一方修改其中的映射（包括写时复制）时才复制该页表
+#define FORK_SHARE_TABLES 0x1U
+// 写时复制缺页时，一并复制同一组中仍被共享的相邻CoW页（见`COW_FAULT_AROUND_PAGES`），
+// 适用于子进程将写入大部分继承的内存的情形；未设置时只原地复用已不再共享的相邻页
+#define FORK_COW_COPY_AROUND 0x2U
+#define FORK_FLAGS_ALL (FORK_SHARE_TABLES | FORK_COW_COPY_AROUND)
+
+// 缺页时一次最多填充的页数（`Env::env_fault_around_max`的上限），见`passive_alloc_around`
+#define FAULT_AROUND_MAX_PAGES 64
+
+// 镜像页缓存（见`env_image_fault`）的散列桶数
+#define ICODE_CACHE_BUCKETS 64
+
+// 调度级别数（`Env::env_sched_level`），级别0优先级最高，见`schedule`
+#define SCHED_LEVELS 8
+// 新进程的调度级别，以及周期性恢复时降级进程回到的级别
+#define SCHED_LEVEL_DEFAULT 3
+// 每经过该数目的时钟中断，将降级的进程恢复到SCHED_LEVEL_DEFAULT
+#define SCHED_RESET_TICKS 256
+// EDF调度类中所有进程的CPU利用率之和的上限（千分比），其余留给多级反馈队列中的进程
+#define SCHED_EDF_UTIL_MAX 900
+
 /*
  * 进程创建步骤(`env_create`)
  *
  * 1. 申请一个空闲的 PCB：`env_create` -> `env_alloc`
  *
- * 2. 手工初始化进程控制块：`env_create` -> `env_alloc` -> `asid_alloc`
+ * 2. 手工初始化进程控制块：`env_create` -> `env_alloc`
  *
  * 3. 为新进程初始化页目录：
  *    - 只读的pages、envs、User VPT区域：`env_create` -> `env_alloc` ->
@@ -44,12 +67,43 @@ struct Env {
     LIST_ENTRY(Env) env_link; // 用于空闲Env链表(`env_free_list`)的指针域
     uint32_t
         env_id; // 进程id，注意：即使不同进程复用了同一个Env，他们的`env_id`也不同
-    uint16_t env_asid;      // 该Env的ASID
+    uint16_t env_asid;      // 该Env的ASID，仅当`env_asid_generation`为当前代时有效
     uint32_t env_parent_id; // 该Env父进程的**env_id**
     uint32_t env_status; // 该Env的状态：ENV_FREE/ENV_RUNNABLE/ENV_NOT_RUNNABLE
     Pte *env_pgdir;      // 该Env的页目录地址（虚拟地址）
     TAILQ_ENTRY(Env) env_sched_link; // 用于调度队列(`env_sched_list`)的指针域
-    uint32_t env_pri;                // 调度优先级
+    uint32_t env_pri;                // 调度优先级：每次被调度时可运行的时间片数
+    // 调度级别：所在的调度队列，阻塞等待IPC或中断时提升，用完时间片时降低
+    uint32_t env_sched_level;
+
+    // CPU时间的统计（时钟周期），见`sched_account`
+    uint64_t env_user_time;   // 在用户态运行的时间
+    uint64_t env_kernel_time; // 在内核态（陷阱处理、系统调用）运行的时间
+    // 按优先级加权的CPU时间，同一调度级别的进程按其升序排列
+    uint64_t env_vruntime;
+    // 在当前调度级别已使用的CPU时间，达到`env_pri`个时间片时降级
+    uint64_t env_slice_used;
+
+    // 所属的资源组（见`group_create`），由子进程继承
+    uint32_t env_group;
+    // 计入资源组的物理页数
+    uint32_t env_group_pages;
+
+    // EDF调度类（见`sched_set_edf`），时间均以时钟中断数计
+    // 周期为0时进程属于多级反馈队列调度类
+    uint32_t env_edf_period;    // 周期
+    uint32_t env_edf_budget;    // 每个周期最多可运行的时间
+    uint32_t env_edf_deadline;  // 相对于周期开始的截止时间
+    uint32_t env_edf_remaining; // 当前周期剩余的预算
+    uint32_t env_edf_done;      // 当前周期的作业是否已完成（主动让出）
+    uint64_t env_edf_release;   // 当前周期的开始时刻
+    uint64_t env_edf_misses;    // 错过截止时间的作业数
+    uint64_t env_edf_throttles; // 作业未完成而用完预算的次数
+
+    // 定时器（见`env_timer_set`）：到期时刻（`time` CSR的值），
+    // 及在定时器队列中的下标加1，0表示没有定时器
+    uint64_t env_wakeup_time;
+    uint32_t env_timer_slot;
 
     // 进程是否正在执行系统调用
     uint32_t env_in_syscall;
@@ -77,6 +131,31 @@ struct Env {
     // Lab 6 scheduler counts
     uint64_t env_runs; // number of times we've been env_run'ed
 
+    // `env_asid`所属的ASID代，见`env_asid_refresh`
+    uint64_t env_asid_generation;
+
+    // 上次在`env_free`中拆除该Env的地址空间所用的时间（时钟周期）
+    uint64_t env_teardown_time;
+
+    // fork时的选项：FORK_*，由子进程继承
+    uint32_t env_fork_flags;
+
+    // 写时复制缺页的统计：复制到新物理页的页数，以及因只被该Env引用而直接改为可写的页数
+    uint64_t env_cow_copy;
+    uint64_t env_cow_reuse;
+
+    // 缺页时的fault-around：一次最多填充的页数（不超过1时不填充相邻页），由子进程继承
+    uint32_t env_fault_around_max;
+    // 当前的填充窗口（页数），根据访问模式自适应
+    uint32_t env_fault_around;
+    // 上次填充的范围[begin, end)
+    u_reg_t env_fault_around_begin;
+    u_reg_t env_fault_around_end;
+
+    // 进程的ELF镜像（位于内核中），其PT_LOAD段的页在首次访问时映射，由子进程继承
+    // 为NULL时进程没有按需加载的镜像
+    const void *env_binary;
+
     char env_name[MAXENVNAME];
 };
 
@@ -87,13 +166,48 @@ struct Process {
     uint32_t env_pri;
     uint64_t env_runs;
     uint32_t env_status;
+    uint64_t env_cow_copy;
+    uint64_t env_cow_reuse;
+    uint32_t env_sched_level;
+    uint64_t env_user_time;   // 在用户态运行的时间（纳秒）
+    uint64_t env_kernel_time; // 在内核态运行的时间（纳秒）
+};
+
+// 调度器的状态及统计，见`sys_get_sched_stat`
+struct SchedStat {
+    uint32_t queue_len[SCHED_LEVELS]; // 各级调度队列的长度
+    uint64_t boost;                   // 阻塞时提升级别的次数
+    uint64_t demote;                  // 用完时间片后降低级别的次数
+    uint64_t preempt;                 // 被更高级别进程抢占的次数
+    uint64_t reset;                   // 周期性恢复降级进程的次数
+    uint32_t edf_len;                 // EDF调度类中可运行的进程数
+    uint32_t edf_util;                // EDF调度类已接纳的CPU利用率（千分比）
+    uint64_t edf_misses;              // EDF进程错过截止时间的作业总数
+    uint64_t ticks;                   // 自启动以来的时钟中断数
+    uint64_t idle;                    // 没有可运行进程而进入空闲的次数
+    uint64_t idle_time;               // 空闲的总时间（时钟周期）
+};
+
+// 资源组的最大数量，0号资源组不受限制，初始进程属于该资源组
+#define NGROUP 16
+#define GROUP_ROOT 0
+
+// 资源组的配额及使用情况，见`sys_group_get_stat`
+struct GroupStat {
+    uint32_t nr_envs;     // 组内的进程数
+    uint32_t cpu_quota;   // 每个周期可用的CPU时间（时钟中断间隔数），0表示不限制
+    uint32_t cpu_period;  // 周期（时钟中断数）
+    uint64_t cpu_used;    // 当前周期已用的CPU时间（时钟周期）
+    uint64_t cpu_time;    // 组内进程的CPU时间之和（时钟周期），含已退出的进程
+    uint64_t throttled;   // 用完配额而被停止调度的次数
+    uint32_t page_limit;  // 最多可计入的物理页数，0表示不限制
+    uint32_t page_used;   // 当前计入的物理页数
+    uint64_t page_denied; // 超出限制而拒绝分配物理页的次数
 };
 
 LIST_HEAD(Env_list, Env);
 TAILQ_HEAD(Env_sched_list, Env);
 extern struct Env *curenv; // 当前运行的Env，定义在`env.c`中，由`env_run`修改
-extern struct Env_sched_list
-    env_sched_list; // 调度队列，只应含有`ENV_RUNNABLE`状态的Env，定义在`env.c`中，由`env_init`初始化
 
 /*
  * 概述：
@@ -133,7 +247,6 @@ void env_init(void);
  * - 'env_init'必须已被调用，以初始化Env相关数据结构
  * - 全局变量'env_free_list'必须包含有效的空闲Env链表
  * - 全局变量'envs'数组必须已正确初始化
- * - 'asid_alloc'依赖的ASID管理数据结构必须已初始化（`asid_bitmap`）
  *
  * Postcondition：
  * - 成功时返回0，新Env的以下字段被初始化：
@@ -142,12 +255,10 @@ void env_init(void);
  * - 失败时返回错误码：
  *   -E_NO_FREE_ENV：无空闲Env可用
  *   -E_NO_MEM：内存分配失败（env_setup_vm）
- *   -E_NO_FREE_ENV：ASID分配失败（asid_alloc）
  *   失败时目标Env不会从空闲链表移除
  *
  * 副作用：
  * - 成功时修改全局变量'env_free_list'（移除分配的Env）
- * - 成功时可能修改ASID分配状态（通过asid_alloc）
  * - 成功时可能修改物理页管理状态（通过env_setup_vm分配页目录）
  */
 int env_alloc(struct Env **e, u_int parent_id);
@@ -156,13 +267,15 @@ int env_alloc(struct Env **e, u_int parent_id);
  * 概述：
  *
  *   （含 TLB 操作）释放环境e及其使用的所有内存资源。包括：
- *   - 用户地址空间的所有映射页（只含到UTOP的页不包括映射的pages、envs、User
- * VPT）
+ *   - 用户地址空间的所有映射页（只含到UTOP的页不包括映射的pages、envs）
+ *   - User VPT区域中的映射
  *   - 页表结构
  *   - 页目录结构
- *   - ASID资源
  *   - TLB相关项
  *
+ *   各映射的物理页的引用计数在遍历页表时直接 -1，整个地址空间只清除一次TLB，
+ *   拆除所用时间记录在`env_teardown_time`中。
+ *
  *   将进程从调度队列移除。
  *   最后将环境结构体归还到空闲环境链表。
  *
@@ -178,16 +291,14 @@ int env_alloc(struct Env **e, u_int parent_id);
  * - e的env_status被设为ENV_FREE
  * - e被插入env_free_list头部
  * - e从env_sched_list中移除（如果存在）
- * - 对应的ASID被释放回系统
  * - TLB中所有相关映射被无效化
  *
  * 副作用：
  * - 修改全局变量env_free_list（插入释放的环境）
  * - 修改全局变量env_sched_list（移除环境）
  * - 可能修改物理页管理状态（通过page_decref）
- * - 可能修改ASID分配状态（通过asid_free）
- * - 修改TLB状态（通过tlb_invalidate）
- * - 修改环境结构体的状态字段（env_status）
+ * - 修改TLB状态（通过tlb_flush_asid）
+ * - 修改环境结构体的状态字段（env_status、env_teardown_time）
  */
 void env_free(struct Env *);
 /*
@@ -200,7 +311,6 @@ void env_free(struct Env *);
  * - 'binary'必须指向内存中的有效ELF可执行镜像（通过elf_from校验）
  * - 'size'必须等于ELF文件的实际大小
  * - 'priority'必须为有效优先级值
- * - asid_bitmap必须有可用ASID（asid_alloc）
  * - 物理页管理器必须能分配足够页面（用于页目录和ELF加载）
  * - env_free_list必须已正确初始化（`env_init`）
  * - env_free_list必须包含至少一个空闲Env结构
@@ -210,20 +320,70 @@ void env_free(struct Env *);
  * - 成功时返回新创建Env指针，其状态为ENV_RUNNABLE，并插入调度队列头部
  * - 新Env具有以下特征：
  *   - 父ID为0
- *   - 分配了唯一env_id和ASID
- *   - 页目录包含内核空间映射和ELF段映射
+ *   - 分配了唯一env_id（ASID在首次运行时分配）
+ *   - 页目录只包含内核空间映射，ELF段在首次访问时映射（见`env_image_fault`）
  *   - EPC寄存器设置为ELF入口地址
  * - 失败时返回NULL（可能因无空闲Env或内存不足）
  *
  * 副作用：
  * - 修改全局变量env_free_list（通过env_alloc移出空闲Env）
  * - 修改全局变量env_sched_list（插入新Env）
- * - 可能修改ASID分配状态（通过asid_alloc）
  * - 可能分配物理页（通过env_setup_vm和load_icode）
  * - 若ELF校验失败触发panic（通过load_icode）
  */
 struct Env *env_create(const char *env_name, const void *binary, size_t size,
                        uint32_t priority);
+
+/*
+ * 概述：
+ *   （含 TLB 操作）处理进程`e`在未映射的地址`va`处的缺页：若`va`位于`e->env_binary`的某个PT_LOAD段中，
+ *   映射该段对应的页。
+ *
+ *   含有文件内容的页来自镜像页缓存：同一镜像、同一地址的页只加载一次，由所有进程共享，
+ *   运行该镜像的最后一个进程退出时释放；
+ *   只读段的页以只读方式映射，可写段的页以CoW方式映射，首次写入时复制。
+ *   只含.bss的页映射全局零页（CoW）。
+ *
+ *   [ULIB, ULIB + ULIB_SIZE)中的页来自内核中嵌入的共享用户库（user/ulib.b），同样由所有进程共享，
+ *   其只读段的页额外设置PTE_LIBRARY，.data及.bss为每个进程私有（CoW）。
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - `va`不在`e->env_binary`及共享用户库的任何PT_LOAD段中时返回-E_INVAL
+ * - 内存不足时返回-E_NO_MEM
+ * - 超出`e`所在资源组的物理页限制时返回-E_QUOTA
+ */
+int env_image_fault(struct Env *e, u_reg_t va);
+
+/*
+ * 概述：
+ *   判断`va`是否位于`e->env_binary`或共享用户库的某个PT_LOAD段中，
+ *   即`va`处未映射时是否应由`env_image_fault`映射镜像中的页，而非分配新页。
+ */
+int env_image_contains(struct Env *e, u_reg_t va);
+
+// 输出镜像页缓存的统计信息
+void icode_cache_summarize(void);
+
+/*
+ * 概述：
+ *   （含 TLB 操作）将当前进程地址空间中[binary, binary + size)处的ELF可执行镜像加载到进程`e`中：
+ *   将所有PT_LOAD段的内容复制到新分配的物理页中并映射，不足一页、超出文件内容的部分为0，
+ *   并将`e`的入口地址（EPC）设置为镜像的入口。
+ *
+ *   与`load_icode`不同，镜像位于用户空间中，可能在加载后被修改或释放，故立即复制所有页。
+ *
+ * Precondition：
+ * - `curenv`不为NULL，[binary, binary + size)是`curenv`中已映射的合法用户地址范围
+ * - `e`已通过`env_alloc`分配，其地址空间中[UTEMP, ULIB)尚无映射
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - 镜像不是合法的ELF可执行文件，或程序段超出镜像、不在[UTEMP, ULIB)中时返回-E_INVAL
+ * - 内存不足时返回-E_NO_MEM，此时已映射的页留在`e`中，由调用者释放`e`
+ * - 映射的页计入`e`的资源组，超出其物理页限制时返回-E_QUOTA，同样由调用者释放`e`
+ */
+int load_icode_user(struct Env *e, u_reg_t binary, size_t size);
 /*
  * 概述：
  *
@@ -248,7 +408,6 @@ struct Env *env_create(const char *env_name, const void *binary, size_t size,
  * - 修改全局变量env_free_list（插入释放的Env）
  * - 修改全局变量env_sched_list（移除e）
  * - 可能修改物理页管理状态（通过env_free调用page_decref）
- * - 可能修改ASID分配状态（通过env_free调用asid_free）
  * - 修改TLB状态（通过env_free调用tlb_invalidate）
  * - 若e是当前环境，修改curenv为NULL并触发调度流程
  */
@@ -311,11 +470,29 @@ int envid2env(u_int envid, struct Env **penv, int checkperm);
  *
  * 注意:
  *   - env_pop_tf 是 noreturn 函数：通过恢复 cp0_epc 寄存器、eret跳转到用户模式
- *   - 必须使用 curenv->env_asid 设置 TLB 的 ASID
+ *   - 必须使用 curenv->env_asid 设置 TLB 的 ASID，运行前通过 env_asid_refresh
+ *     确保其属于当前代
  *   - KSTACKTOP 处的陷阱帧布局必须与 struct Trapframe 严格匹配
  */
 void env_run(struct Env *e) __attribute__((noreturn));
 
+/*
+ * 概述：
+ *   确保Env `e`持有当前代的ASID，否则为其分配一个新的ASID（惰性分配）。
+ *   当前代的ASID耗尽时，进入新的一代并刷新整个TLB，其它Env的ASID随之失效，
+ *   在其下次运行时重新分配。
+ *
+ *   ASID在一代中不会被重复分配，故可运行的Env数目不受硬件ASID数目限制。
+ *
+ * Postcondition：
+ * - `e->env_asid`在当前代中唯一，`e->env_asid_generation`为当前代
+ *
+ * 副作用：
+ * - 可能修改ASID分配状态
+ * - 进入新的一代时刷新整个TLB（通过tlb_flush_all）
+ */
+void env_asid_refresh(struct Env *e);
+
 void env_check(void);
 void envid2env_check(void);
 
@@ -330,7 +507,6 @@ void envid2env_check(void);
  * - binary_x_start指向有效的ELF可执行镜像（通过elf_from校验）
  * - binary_x_size必须等于ELF文件的实际大小
  * - 参数y为合法的优先级值（符合调度策略定义）
- * - asid_bitmap中存在可分配的ASID（通过asid_alloc）
  * - env_free_list已正确初始化且包含至少一个空闲Env结构（env_init完成）
  * - 物理页管理器可分配足够页（用于页目录和ELF段映射）
  *
@@ -345,7 +521,6 @@ void envid2env_check(void);
  * 副作用：
  * - 修改env_free_list：移出分配的Env结构
  * - 修改env_sched_list：插入新Env到队列头部
- * - 分配ASID（修改asid_bitmap状态）
  * - 分配物理页（用于页目录和ELF加载）
  * - ELF校验失败触发panic
  */
@@ -50,6 +50,15 @@
 // 没有请求的设备
 #define E_NO_DEV 15
 
+// 实时进程的CPU利用率之和将超出上限（EDF准入控制失败）
+#define E_OVERLOAD 16
+
+// 等待超时
+#define E_TIMEOUT 17
+
+// 超出资源组的配额
+#define E_QUOTA 18
+
 /*
  * A quick wrapper around function calls to propagate errors.
  * Use this with caution, as it leaks resources we've acquired so far.
@@ -3,6 +3,31 @@
 
 #include <mmu.h>
 
-void dup_userspace(Pte *parent_pgdir, Pte *child_pgdir, uint16_t child_asid);
+/*
+ * 概述：
+ *   将父进程用户空间[0, USTACKTOP)的映射复制到子进程中，
+ *   父子进程中的可写页（`PTE_LIBRARY`页除外）均被改为写时复制（CoW）。
+ *
+ *   父进程的每个三级页表只遍历一次：子进程的对应页表只分配一次，512个页表项整体复制，
+ *   之后逐项增加引用计数、将可写页改为CoW。被修改的页表项在复制结束后统一清除TLB。
+ *   巨页映射整体复制到子进程，父子进程共享同一巨页，写入时由`do_cow`复制或拆分。
+ *
+ *   若`share_tables`非 0，完整的三级页表不复制，而是由父子进程共享（见`page_table_share`），
+ *   其中的可写页改为CoW；任一方修改该页表中的映射（包括写时复制）时，才为其复制该页表。
+ *   含有`PTE_LIBRARY`页的三级页表仍然复制。
+ *
+ *   复制或共享给子进程的映射计入子进程的资源组（见`pgdir_charge`）。
+ *
+ * Precondition：
+ * - `child_pgdir`中用户空间的映射为空
+ * - `parent_asid`为`parent_pgdir`对应的地址空间
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - 无法为子进程分配页表时返回-E_NO_MEM，超出子进程的资源组的物理页限制时返回-E_QUOTA；
+ *   此时子进程中只复制了部分映射，调用者应释放子进程，父进程中的可写页可能已被改为CoW
+ */
+int dup_userspace(Pte *parent_pgdir, uint16_t parent_asid, Pte *child_pgdir,
+                  int share_tables);
 
 #endif
\ No newline at end of file
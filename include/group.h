@@ -0,0 +1,126 @@
+#ifndef __GROUP_H__
+#define __GROUP_H__
+
+#include <env.h>
+#include <types.h>
+
+/*
+ * 概述：
+ *   初始化资源组，只有不受限制的0号资源组（GROUP_ROOT）可用。
+ */
+void group_init(void);
+
+/*
+ * 概述：
+ *   创建一个资源组：组内进程每`cpu_period`个时钟中断最多共运行`cpu_quota`个时钟中断
+ *   间隔，最多计入`page_limit`个物理页。`cpu_quota`或`page_limit`为0时不限制相应资源。
+ *
+ *   计入的是组内各进程用户空间中映射的物理页数之和，由映射层维护（见`pgdir_charge`）：
+ *   被多个进程映射的页分别计入各进程，内核持有的页（全局零页、镜像页缓存）不计入。
+ *
+ *   资源组在最后一个进程离开（退出或移入其它资源组）时释放。
+ *
+ * Postcondition：
+ * - 成功时返回资源组编号（大于0），新资源组中没有进程
+ * - -E_INVAL：`cpu_quota`非0，且不满足 `cpu_quota` <= `cpu_period`
+ * - -E_NO_MEM：没有空闲的资源组
+ */
+int group_create(uint32_t cpu_quota, uint32_t cpu_period, uint32_t page_limit);
+
+/*
+ * 概述：
+ *   新进程`e`加入资源组`gid`，由`env_alloc`调用，使子进程继承父进程的资源组。
+ *
+ * Precondition：
+ * - `gid`为已创建的资源组
+ */
+void group_join(struct Env *e, uint32_t gid);
+
+/*
+ * 概述：
+ *   进程`e`离开其资源组，归还其计入的物理页，由`env_free`调用
+ *  （`env_free`直接释放页表，不逐页归还）。
+ *   资源组中没有进程时将其释放（0号资源组除外）。
+ */
+void group_leave(struct Env *e);
+
+/*
+ * 概述：
+ *   将进程`e`移入资源组`gid`，其计入的物理页随之移动（不检查新资源组的限制）。
+ *
+ * Postcondition：
+ * - 成功时返回0
+ * - -E_INVAL：`gid`不是已创建的资源组
+ */
+int group_attach(struct Env *e, uint32_t gid);
+
+/*
+ * 概述：
+ *   为进程`e`映射`count`个物理页前调用，将其计入`e`的资源组。
+ *   通常由映射层调用（见`pgdir_charge`），只有直接填写页表项时才需显式调用。
+ *
+ * Postcondition：
+ * - 成功时返回0
+ * - -E_QUOTA：计入后将超出资源组的物理页限制，此时不计入
+ *   （`group_limit_suspend`期间不检查限制，总是成功）
+ */
+int group_charge_pages(struct Env *e, uint32_t count);
+
+/*
+ * 概述：
+ *   暂停/恢复物理页限制的检查（可嵌套）：内核代其它进程访问其内存（如向其用户异常栈
+ *   投递中断）时无法向该进程报告错误，期间分配的页只计入、不受限制。
+ */
+void group_limit_suspend(void);
+void group_limit_resume(void);
+
+/*
+ * 概述：
+ *   归还`group_charge_pages`计入的`count`个物理页（映射失败或解除映射时），
+ *   最多归还`e`已计入的页数。
+ */
+void group_uncharge_pages(struct Env *e, uint32_t count);
+
+/*
+ * 概述：
+ *   进程`e`在缺页等无法返回错误的路径中超出资源组的物理页限制时调用：
+ *   输出原因并销毁`e`。
+ *
+ * Postcondition：
+ * - 若`e`为当前进程，不会返回
+ */
+void group_page_limit_exceeded(struct Env *e, u_reg_t va);
+
+/*
+ * 概述：
+ *   将进程`e`运行的`cycles`个时钟周期计入其资源组，由`sched_account`调用。
+ *   当前周期的用量达到配额时，资源组被停止调度，直到下一个周期开始。
+ */
+void group_charge_cpu(struct Env *e, uint64_t cycles);
+
+// 进程`e`所在的资源组在当前周期是否已用完CPU配额
+int group_throttled(struct Env *e);
+
+// 是否存在当前周期已用完CPU配额的资源组，不存在时调度器无需逐个检查`group_throttled`
+int group_any_throttled(void);
+
+/*
+ * 概述：
+ *   在时钟中断数为`ticks`时调用，为进入新周期的资源组清零用量，恢复调度。
+ */
+void group_tick(uint64_t ticks);
+
+// 已用完配额的资源组中，最早进入新周期的时刻（时钟中断数），没有时返回0
+uint64_t group_next_replenish(void);
+
+/*
+ * 概述：
+ *   将资源组`gid`的配额及使用情况写入`stat`。
+ *
+ * Postcondition：
+ * - 成功时返回0
+ * - -E_INVAL：`gid`不是已创建的资源组
+ */
+int group_get_stat(uint32_t gid, struct GroupStat *stat);
+
+#endif /* __GROUP_H__ */
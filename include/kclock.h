@@ -5,6 +5,7 @@
 
 #define TIMER_INTERVAL (100000) // WARNING: DO NOT MODIFY THIS LINE!
 
+#ifdef __ASSEMBLER__
 // clang-format off
 /*
  * RESET_KCLOCK 宏：
@@ -36,5 +37,6 @@
 
 .endm
 // clang-format on
+#endif /* __ASSEMBLER__ */
 
 #endif
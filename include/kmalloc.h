@@ -3,33 +3,101 @@
 
 #include <mmu.h>
 #include <pmap.h>
+#include <queue.h>
 
-// MBLOCK_SIZE：40字节
-#define MBLOCK_SIZE sizeof(struct MBlock)
+// 分配的内存的对齐要求（字节）
+#define KMALLOC_ALIGN 16
 
-#define MBLOCK_PREV(elm, field)                                                \
-    (struct MBlock *)((elm)->field.le_prev) // place entry at first
+// 大小类的数目：16、32、64、128、256、512、1024字节
+#define KMALLOC_CLASS_COUNT 7
+// 最小的大小类（字节）
+#define KMALLOC_MIN_CLASS_SIZE 16
+// 最大的大小类（字节），更大的请求按页分配
+#define KMALLOC_MAX_CLASS_SIZE                                                 \
+    (KMALLOC_MIN_CLASS_SIZE << (KMALLOC_CLASS_COUNT - 1))
 
-LIST_HEAD(MBlock_list, MBlock);
-typedef LIST_ENTRY(MBlock) MBlock_LIST_entry_t;
+// 单次分配的最大字节数：大块内存须是伙伴系统的一个块（最多`1 << PAGE_MAX_ORDER`页），
+// 且首部占用其中`KMALLOC_LARGE_DATA_OFFSET`字节
+#define KMALLOC_MAX_SIZE                                                       \
+    ((PAGE_SIZE << PAGE_MAX_ORDER) - KMALLOC_LARGE_DATA_OFFSET)
 
-struct MBlock {
-    MBlock_LIST_entry_t
-        mb_link; // 注意：若要MBLOCK_PREV宏正常工作，mb_link属性必须放在结构体开始处！16字节
+// 位于slab页/大块内存首部的魔数，用于`kfree`区分二者并检查指针合法性
+#define KMALLOC_SLAB_MAGIC 0x51AB51ABU
+#define KMALLOC_LARGE_MAGIC 0x1A26E1A2U
 
-    uint64_t size; // size of the available space, if allocated, is the size of
-                   // allocated space，8字节
-    void *ptr; // pointer to the begin of block, as a magic number to check for
-               // validity，8字节
-    uint32_t free;    // 1 if block is free, 0 if the block is allocated，4字节
-    uint32_t padding; // padding to make size of block multiple of 8，4字节
-    char data[];      // data of the block, allocated for user，0字节
+LIST_HEAD(KmallocSlab_list, KmallocSlab);
+typedef LIST_ENTRY(KmallocSlab) KmallocSlab_LIST_entry_t;
+
+// slab：一个物理页，首部为本结构体，其后为若干个大小相同的对象
+struct KmallocSlab {
+    uint32_t magic;       // KMALLOC_SLAB_MAGIC
+    uint16_t class_index; // 所属大小类
+    uint16_t in_use;      // 已分配的对象数
+    uint16_t capacity;    // 对象总数
+    uint16_t unused;      // 从未分配过的对象数（位于slab尾部）
+    uint32_t padding;
+    void *free;           // 已释放对象组成的单向链表（对象首8字节存储后继）
+    KmallocSlab_LIST_entry_t slab_link; // 所属大小类的未满slab链表
+};
+
+// 大块内存：连续的物理页，首部为本结构体，其后为分配给调用者的内存
+struct KmallocLarge {
+    uint32_t magic;      // KMALLOC_LARGE_MAGIC
+    uint32_t page_count; // 占用的物理页数
+    uint64_t size;       // 请求的大小（字节）
+};
+
+// 大块内存中分配给调用者的内存相对于首部的偏移
+#define KMALLOC_LARGE_DATA_OFFSET                                              \
+    ROUND(sizeof(struct KmallocLarge), KMALLOC_ALIGN)
+
+// 一个大小类的状态及统计
+struct KmallocClass {
+    struct KmallocSlab_list partial; // 仍有空闲对象的slab
+    size_t slab_count;               // slab总数
+    size_t in_use;                   // 已分配的对象数
+    size_t alloc_count;              // 累计分配次数
+    size_t requested_bytes;          // 累计请求的字节数
 };
 
+/*
+ * 概述：
+ *   初始化内核堆：初始化各大小类的slab链表。
+ *   slab及大块内存直接从伙伴系统分配，通过直接映射区域访问，无需单独的堆地址空间。
+ *
+ * Precondition：
+ * - `page_init`已被调用
+ */
 void kmalloc_init(void);
+
+/*
+ * 概述：
+ *   分配`size`字节的内核内存，按`KMALLOC_ALIGN`对齐，**不保证清零**。
+ *
+ *   不超过`KMALLOC_MAX_CLASS_SIZE`的请求，从对应大小类的slab中以 O(1) 分配；
+ *   更大的请求，直接从伙伴系统分配所需的整数个物理页。
+ *
+ *   大块内存必须物理连续，而伙伴系统单次最多分配`1 << PAGE_MAX_ORDER`个连续物理页，
+ *   因此`size`不能超过`KMALLOC_MAX_SIZE`（略小于 4 MiB）；需要更多内存的调用者
+ *   应自行分配物理页并映射。
+ *
+ * Postcondition：
+ * - 成功时返回位于直接映射区域中的地址
+ * - 内存不足或`size`超过`KMALLOC_MAX_SIZE`时返回NULL
+ */
 void *kmalloc(size_t size);
+
+/*
+ * 概述：
+ *   释放由`kmalloc`分配的内存`p`，O(1)（大块内存为所占物理页数）。
+ *   slab中的对象全部被释放后，若该大小类还有其它未满的slab，归还该slab所在的物理页。
+ *
+ * Panics：
+ * - `p`不是由`kmalloc`分配的内存
+ */
 void kfree(void *p);
 
+// 输出内核堆的使用情况，包括各大小类的碎片直方图
 void allocation_summarize();
 
 #endif
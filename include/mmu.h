@@ -14,22 +14,32 @@
 #define BASE_ADDR_IMM 0xFFFFFFC000200000ULL
 #define KERNEL_END_ADDR_BEFORE_PAGING_IMM 0x81000000ULL
 
-#define KMALLOC_BEGIN_VA 0xFFFFFFC0A0000000ULL
-#define KMALLOC_END_VA 0xFFFFFFC0E0000000ULL
-
-#define KMALLOC_HEAP_SIZE (KMALLOC_END_VA - KMALLOC_BEGIN_VA)
+// 直接映射区域的最大大小（128 GiB）：
+// [0xFFFFFFC000000000, 0xFFFFFFE000000000) 直接映射到从0x80000000开始的物理内存
+// 实际映射的大小由`riscv64_detect_memory`根据设备树中的物理内存大小决定
+#define DIRECT_MAP_MAX_SIZE 0x2000000000ULL
 
 #define HIGH_ADDR_OFFSET ((HIGH_ADDR_IMM) - (LOW_ADDR_IMM))
 
-#define DTB_BEGIN_VA 0xFFFFFFC040000000ULL
+#define DTB_BEGIN_VA 0xFFFFFFE040000000ULL
 
-#define KMMAP_BEGIN_VA 0xFFFFFFC0E0000000ULL
-#define KMMAP_END_VA 0xFFFFFFC120000000ULL
+#define KMMAP_BEGIN_VA 0xFFFFFFE0E0000000ULL
+#define KMMAP_END_VA 0xFFFFFFE120000000ULL
 
 #define KMMAP_SIZE (KMMAP_END_VA - KMMAP_BEGIN_VA)
 
-// 可用的 ASID 数量
-#define NASID 256
+// 内核共享区域：[KERNEL_SHARED_BEGIN_VA, KERNEL_SHARED_END_VA)，包含设备树、MMIO及kmmap区域
+// 该区域的二级页表在启动时（`riscv64_vm_init`）预先分配，所有进程的页目录引用同一组二级页表，
+// 从而修改该区域的映射（`kmap`/`kunmap`）时只需修改内核页表
+#define KERNEL_SHARED_BEGIN_VA DTB_BEGIN_VA
+#define KERNEL_SHARED_END_VA KMMAP_END_VA
+
+// 按虚拟地址逐页清除TLB条目时的最大页数，超过该页数时刷新整个TLB
+#define TLB_RANGE_INVALIDATE_MAX_PAGES 64
+
+// satp中ASID字段的位置，硬件实际实现的位数由`asid_probe_max`探测
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK 0xFFFF
 // 页大小
 #define PAGE_SIZE 4096
 #define PAGE_SHIFT 12
@@ -49,6 +59,14 @@
 // 一个三级页表项映射的地址范围大小（4KB）
 #define P3MAP (4 * 1024)
 
+// 页表级数：第`level`级页表项（1 <= level <= 3）映射的地址范围大小为`PLEVEL_SIZE(level)`
+// 1级、2级页表项可以是叶页表项（巨页），分别映射1 GiB、2 MiB
+#define PLEVEL_SHIFT(level) (P3SHIFT + 9 * (3 - (level)))
+#define PLEVEL_SIZE(level) (1UL << PLEVEL_SHIFT(level))
+// 给定一个虚拟地址，返回其第`level`级页表偏移量，9 位，高位为 0
+#define PLEVELX(level, va)                                                     \
+    ((((u_reg_t)(va) & GENMASK(38, 0)) >> PLEVEL_SHIFT(level)) & GENMASK(8, 0))
+
 // 获取一级页表偏移量（需要再取低 9 位）需要右移的位数
 #define P1SHIFT 30
 // 获取二级页表偏移量（需要再取低 9 位）需要右移的位数
@@ -143,6 +161,11 @@
 
 #define PTE_LIBRARY (1U << 8)
 
+// `sys_mem_alloc`、`sys_mem_map`的`perm`参数中的标志位（不是页表项标志位）：
+// 以2 MiB / 1 GiB巨页为单位分配/映射，虚拟地址须对齐到巨页大小
+#define MEM_HUGE_2M (1U << 16)
+#define MEM_HUGE_1G (1U << 17)
+
 /*
  * Part 2.  Our conventions.
  */
@@ -210,6 +233,11 @@
 // 用户栈：0x003E 3FFF E000
 #define USTACKTOP (UTOP - 2 * P3MAP)
 
+// 共享用户库：[0x7000 0000, 0x7100 0000) 16MB，须与`user/lib/ulib.lds`一致
+// 位于 2GB 以下，从而程序可通过pc相对寻址调用库函数
+#define ULIB 0x70000000ULL
+#define ULIB_SIZE (8 * P2MAP)
+
 // 代码区：0x0040 0000
 #define UTEXT (2 * P2MAP)
 // 用户COW异常处理的临时页：[0x003F F000, 0x0040 0000) 4KB
@@ -232,30 +260,28 @@ extern u_reg_t npage;
 // 表示一个页表项，64 位
 typedef u_reg_t Pte;
 
-// 将直接映射区域[0xFFFFFFC000000000, 0xFFFFFFC040000000)
+// 将直接映射区域[0xFFFFFFC000000000, 0xFFFFFFC000000000 + 物理内存大小)
 // 的虚拟地址转化为DRAM偏移地址
 // Precondition：传入直接映射区域范围内的
 #define DRAMADDR(kva) ((u_reg_t)(kva) - HIGH_ADDR_IMM)
 
-// 将直接映射区域[0xFFFFFFC000000000, 0xFFFFFFC040000000)
+// 将直接映射区域[0xFFFFFFC000000000, 0xFFFFFFC000000000 + 物理内存大小)
 // 的虚拟地址转化为物理地址（从0x80000000开始）
 // Precondition：传入直接映射区域范围内的
 #define PADDR(kva) ((u_reg_t)(kva) - HIGH_ADDR_OFFSET)
 
-// 将DRAM偏移地址地址转化直接映射区域[0xFFFFFFC000000000, 0xFFFFFFC040000000)
+// 将DRAM偏移地址地址转化直接映射区域[0xFFFFFFC000000000, 0xFFFFFFC000000000 + 物理内存大小)
 // 的虚拟地址
 // Precondition：
 // - 传入的地址在物理内存空间之内（小于总计物理内存容量）
-// - 传入的地址 < 1GB
 // Panics：
 // - 若输入的物理地址超出物理内存空间
 #define D2KADDR(pa) ((pa) + HIGH_ADDR_IMM)
 
-// 将物理地址地址转化直接映射区域[0xFFFFFFC000000000, 0xFFFFFFC040000000)
+// 将物理地址地址转化直接映射区域[0xFFFFFFC000000000, 0xFFFFFFC000000000 + 物理内存大小)
 // 的虚拟地址
 // Precondition：
 // - 传入的地址在物理内存空间之内（小于总计物理内存容量）
-// - 传入的地址 < 1GB
 // Panics：
 // - 若输入的物理地址超出物理内存空间
 #define P2KADDR(pa) ((pa) + HIGH_ADDR_OFFSET)
@@ -306,7 +332,16 @@ typedef u_reg_t Pte;
  * - 若无匹配条目，TLB 内容保持不变。
  *
  */
-extern void tlb_invalidate(uint16_t asid, uint16_t va);
+extern void tlb_invalidate(uint16_t asid, u_reg_t va);
+
+/*
+ * 概述：
+ *
+ * 清除TLB中所有地址空间关于虚拟地址va的映射，包括全局映射（PTE_GLOBAL）
+ *
+ * 注意：`tlb_invalidate`指定了ASID，不会清除全局映射，修改内核映射时应当使用本函数
+ */
+extern void tlb_invalidate_global(u_reg_t va);
 /* 概述:
  *
  * 使ASID对应的虚拟地址空间中的 TLB 条目失效。
@@ -327,5 +362,12 @@ extern void tlb_flush_asid(u_int asid);
 
 extern void tlb_flush_all();
 
+/*
+ * 概述：
+ *   向satp的ASID字段写入全1并读回，得到硬件支持的最大ASID，随后恢复satp。
+ *   未实现的ASID位读回为0；不支持ASID时返回0。
+ */
+extern uint16_t asid_probe_max(void);
+
 #endif //!__ASSEMBLER__
 #endif // !_MMU_H_
@@ -11,31 +11,226 @@ extern Pte *cur_pgdir;
 
 extern Pte *kernel_boot_pgdir;
 
-LIST_HEAD(Page_list, Page);
-typedef LIST_ENTRY(Page) Page_LIST_entry_t;
-
+// 页框号（`pages`数组下标）所占的位数，可描述128 GiB物理内存
+#define PAGE_INDEX_BITS 25
+// 表示“无”的页框号：空链表的首元素、链表尾元素的后继/首元素的前驱
+#define PAGE_INDEX_NULL ((1U << PAGE_INDEX_BITS) - 1)
+
+// `Page::pp_order`的取值：该页不是伙伴系统中某个空闲块的首页
+#define PAGE_ORDER_NONE 0xFU
+
+// `Page::pp_flags`的标志位
+// 该页内容已知全为0（如预清零页池中的页）
+#define PAGE_FLAG_ZERO 0x1U
+// 该页由内核持有（如全局零页）：引用计数降为0时不释放，写时复制时也不可直接复用
+#define PAGE_FLAG_PINNED 0x2U
+// 该页是巨页的首页
+#define PAGE_FLAG_HUGE 0x4U
+
+// 描述一个物理页框，共8字节
 struct Page {
-    Page_LIST_entry_t pp_link; /* free list link */
+    union {
+        // Ref is the count of pointers (usually in page table entries)
+        // to this page.  This only holds for pages allocated using
+        // page_alloc.  Pages allocated at boot time using pmap.c's "alloc"
+        // do not have valid reference count fields.
+        uint32_t pp_ref;
+
+        // 页位于空闲块链表/预清零页池中时（此时引用计数一定为0），
+        // 复用该字段作为链表中前驱元素的页框号
+        // 因此空闲页的`pp_ref`没有意义，不应读取；页被取出时将其重置为0
+        uint32_t pp_prev;
+    };
+
+    // 页位于空闲块链表/预清零页池中时，链表中后继元素的页框号
+    // 页为巨页的首页（`PAGE_FLAG_HUGE`）时，复用该字段记录巨页的阶数
+    // 页为页表时，复用该字段记录额外共享该页表的页表项数目（见`page_table_share`）
+    // 页为进程的页目录时，复用该字段记录该进程在`envs`中的下标 + 1（见`pgdir_charge`）
+    uint32_t pp_next : PAGE_INDEX_BITS;
+
+    // 若该页是伙伴系统中某个空闲块的首页，记录该块的阶数（块大小为`1 << pp_order`页）
+    // 否则为`PAGE_ORDER_NONE`
+    uint32_t pp_order : 4;
+
+    // 标志位：PAGE_FLAG_*
+    uint32_t pp_flags : 3;
+};
 
-    // Ref is the count of pointers (usually in page table entries)
-    // to this page.  This only holds for pages allocated using
-    // page_alloc.  Pages allocated at boot time using pmap.c's "alloc"
-    // do not have valid reference count fields.
+_Static_assert(sizeof(struct Page) == 8, "struct Page must be 8 bytes");
 
-    u_short pp_ref;
+// 以页框号链接的双向链表的链表头
+struct Page_list {
+    uint32_t pl_first; // 首元素的页框号，空链表为`PAGE_INDEX_NULL`
 };
 
+// 伙伴系统的最大阶数，单次最多可分配`1 << PAGE_MAX_ORDER`个连续物理页（4 MiB）
+#define PAGE_MAX_ORDER 10
+
+// 第`level`级叶页表项映射的巨页的阶数：2级为9（2 MiB），1级为18（1 GiB）
+#define PAGE_HUGE_ORDER(level) (PLEVEL_SHIFT(level) - PAGE_SHIFT)
+
+// 预清零页池的最大页数
+#define PAGE_ZERO_POOL_SIZE 64
+// 每次在空闲时（`sched_idle`）最多清零并放入预清零页池的页数
+#define PAGE_ZERO_POOL_REFILL_BATCH 8
+
+// 预清零页池的命中统计
+struct PageZeroPoolStat {
+    // `page_alloc`直接取得预清零页的次数
+    uint64_t zero_hit;
+    // `page_alloc`因预清零页池为空而同步清零的次数
+    uint64_t zero_miss;
+    // `page_alloc_nozero`的调用次数（无需清零）
+    uint64_t nozero_alloc;
+    // 空闲时清零并放入预清零页池的页数
+    uint64_t refilled;
+};
+
+// 在`pmap.c`中定义
+extern struct PageZeroPoolStat page_zero_pool_stat;
+
+// 物理页结构体分批初始化时，每个块组的页数（16 MiB），须为`1 << PAGE_MAX_ORDER`的整数倍
+#define PAGE_INIT_CHUNK_PAGES (4UL << PAGE_MAX_ORDER)
+// 启动时（`page_init`）在已分配内存之后初始化的块组数
+#define PAGE_INIT_BOOT_CHUNKS 4
+// 每次在空闲时（`sched_idle`）最多初始化的块组数
+#define PAGE_INIT_IDLE_CHUNKS 1
+
+// 物理页结构体初始化的统计
+struct PageInitStat {
+    // 启动时初始化的页数
+    uint64_t boot_pages;
+    // 启动时初始化的页中空闲页的数目
+    uint64_t boot_free_pages;
+    // 启动后分批初始化的块组数
+    uint64_t deferred_chunks;
+    // 其中因空闲页不足而在分配时同步初始化的块组数
+    uint64_t shortage_chunks;
+    // 启动后分批初始化的页中空闲页的数目
+    uint64_t deferred_free_pages;
+};
+
+// 在`pmap.c`中定义
+extern struct PageInitStat page_init_stat;
+
 // 描述物理页的结构体的列表，在`pmap.c`中定义，由`mips_vm_init`初始化
 extern struct Page *pages;
-// 存储空闲物理页链表的链表头，在`pmap.c`中定义，由`page_init`初始化
-extern struct Page_list page_free_list;
+// 各阶空闲块链表的链表头，`page_free_list[k]`中每个元素是大小为`1 << k`页的空闲块的首页
+// 在`pmap.c`中定义，由`page_init`初始化
+extern struct Page_list page_free_list[PAGE_MAX_ORDER + 1];
+
+// 返回物理页`pp`的页框号（`pages`数组下标）
+static inline uint32_t page2index(struct Page *pp) {
+    return (uint32_t)(pp - pages);
+}
+
+// 返回页框号`index`对应的物理页，`PAGE_INDEX_NULL`对应NULL
+static inline struct Page *index2page(uint32_t index) {
+    return index == PAGE_INDEX_NULL ? NULL : &pages[index];
+}
 
 // 返回物理页`pp`的物理页号
 // 注意：DRAM从0x80000000（物理地址）开始映射
 static inline u_reg_t page2ppn(struct Page *pp) {
-    return (u_reg_t)(pp - pages) + PPN(0x80000000ULL);
+    return (u_reg_t)page2index(pp) + PPN(LOW_ADDR_IMM);
+}
+
+// 初始化链表`head`为空链表
+static inline void page_list_init(struct Page_list *head) {
+    head->pl_first = PAGE_INDEX_NULL;
+}
+
+static inline int page_list_empty(struct Page_list *head) {
+    return head->pl_first == PAGE_INDEX_NULL;
+}
+
+// 返回链表`head`的首元素，空链表返回NULL
+static inline struct Page *page_list_first(struct Page_list *head) {
+    return index2page(head->pl_first);
+}
+
+// 返回链表中`pp`的后继元素，若`pp`为尾元素，返回NULL
+static inline struct Page *page_list_next(struct Page *pp) {
+    return index2page(pp->pp_next);
+}
+
+// 将`pp`插入链表`head`的头部
+static inline void page_list_insert_head(struct Page_list *head,
+                                         struct Page *pp) {
+    uint32_t index = page2index(pp);
+
+    pp->pp_next = head->pl_first;
+    pp->pp_prev = PAGE_INDEX_NULL;
+
+    if (head->pl_first != PAGE_INDEX_NULL) {
+        pages[head->pl_first].pp_prev = index;
+    }
+
+    head->pl_first = index;
+}
+
+// 将`pp`插入到链表中元素`listelm`之后
+static inline void page_list_insert_after(struct Page *listelm,
+                                          struct Page *pp) {
+    uint32_t index = page2index(pp);
+
+    pp->pp_next = listelm->pp_next;
+    pp->pp_prev = page2index(listelm);
+
+    if (listelm->pp_next != PAGE_INDEX_NULL) {
+        pages[listelm->pp_next].pp_prev = index;
+    }
+
+    listelm->pp_next = index;
+}
+
+// 将`pp`从链表`head`中移除，并将其引用计数置为0
+// Precondition：`pp`位于链表`head`中
+static inline void page_list_remove(struct Page_list *head, struct Page *pp) {
+    if (pp->pp_prev == PAGE_INDEX_NULL) {
+        head->pl_first = pp->pp_next;
+    } else {
+        pages[pp->pp_prev].pp_next = pp->pp_next;
+    }
+
+    if (pp->pp_next != PAGE_INDEX_NULL) {
+        pages[pp->pp_next].pp_prev = pp->pp_prev;
+    }
+
+    pp->pp_next = PAGE_INDEX_NULL;
+    // `pp_prev`与`pp_ref`共用存储
+    pp->pp_ref = 0;
 }
 
+#define page_list_foreach(var, head)                                           \
+    for ((var) = page_list_first(head); (var) != NULL;                         \
+         (var) = page_list_next(var))
+
+// 返回以`pp`为首页的巨页的阶数，`pp`不是巨页的首页时返回 0
+static inline u_int page_huge_order(struct Page *pp) {
+    return (pp->pp_flags & PAGE_FLAG_HUGE) != 0 ? pp->pp_next : 0;
+}
+
+// 返回物理页`pp`所在巨页的首页，`pp`不属于巨页时返回`pp`
+// 巨页对齐到其大小：依次检查`pp`向下对齐到 2 MiB、1 GiB 的页是否为相应阶数的巨页首页
+static inline struct Page *page_head(struct Page *pp) {
+    uint32_t index = page2index(pp);
+
+    for (u_int level = 2; level >= 1; level--) {
+        u_int order = PAGE_HUGE_ORDER(level);
+        struct Page *head = &pages[index & ~((1U << order) - 1)];
+
+        if (page_huge_order(head) == order) {
+            return head;
+        }
+    }
+
+    return pp;
+}
+
+// 增加物理页`pp`的引用计数：巨页中的物理页（如拆分被共享的巨页映射后）计入巨页的首页
+static inline void page_incref(struct Page *pp) { page_head(pp)->pp_ref++; }
+
 // 返回物理页（Page 结构体的指针）`pp`的物理地址（低 12 位为
 // 0）
 static inline u_reg_t page2pa(struct Page *pp) {
@@ -113,7 +308,7 @@ static inline u_reg_t va2pa(Pte *pgdir, u_long va) {
 
     if (PTE_IS_NON_LEAF(p2Entry) == 0) {
         // 二级巨页
-        return PTE_ADDR(p1Entry) | (va & GENMASK(20, 0));
+        return PTE_ADDR(p2Entry) | (va & GENMASK(20, 0));
     }
 
     p = (Pte *)P2KADDR(PTE_ADDR(p2Entry));
@@ -129,18 +324,23 @@ static inline u_reg_t va2pa(Pte *pgdir, u_long va) {
 
 /* 概述：
  *
- *   使用入参`_memsize`（来自 bootloader）设置`memsize`、`npage`
+ *   从设备树（`/memory`节点、保留内存表及`/reserved-memory`节点）中获取物理内存布局，
+ *   设置`memsize`、`npage`，并将全部物理内存直接映射到内核地址空间。
+ *
+ *   物理内存区域之间的空洞、保留区域及设备树本身所在的物理内存不会被分配。
+ *   若无法读取设备树，假定物理内存为从0x80000000开始的2 GiB。
  *
- *   Use '_memsize' from bootloader to initialize 'memsize' and
- *   calculate the corresponding 'npage' value.
+ * Precondition：
+ * - `dtb_address`为bootloader传入的设备树的物理地址
  *
  * 副作用：
  *
  * - 设置全局变量 memsize：最大可用的物理地址
  * - 设置全局变量 npage：最大可用的物理页数
+ * - 修改内核页表`kernel_boot_pgdir`中直接映射区域的一级页表项
  * - 输出日志：Memory size: %lu KiB, number of pages: %lu\n
  */
-void riscv64_detect_memory();
+void riscv64_detect_memory(void *dtb_address);
 
 /* 概述：
  *
@@ -162,25 +362,51 @@ void riscv64_vm_init(void);
 /*
  * 概述：
  *
- *   初始化物理页管理：初始化空闲物理页链表、标注占用的物理页，物理页将通过引用计数管理
+ *   初始化物理页管理：初始化各阶空闲块链表、标注占用的物理页，物理页将通过引用计数管理
  *
  *   具体地，将内核映像占用的物理页、
  *   之前使用 alloc 分配/部分分配的物理页
- *  （全局变量 freemem 的值，向上对齐到页大小），标注为占用（引用计数为 1）
- *   并将剩余未占用的物理页插入到空闲物理页链表。
+ *  （全局变量 freemem 的值，向上对齐到页大小）、物理内存区域之间的空洞，
+ *   以及保留区域，标注为占用（引用计数为 1），
+ *   并将剩余未占用的物理页切分为尽可能大的对齐块，插入到对应阶的空闲块链表。
+ *
+ *   启动时只初始化前`PAGE_INIT_BOOT_CHUNKS`个块组（位于已分配内存之后），
+ *   其余物理页由`page_init_deferred`分批初始化。
  *
  * Precondition：
  * - 全局变量`freemem`必须正确指向下一处空闲物理内存的虚拟地址（kseg0)
+ * - `riscv64_detect_memory`已被调用
  *
  * 副作用：
  *
  * - 根据占用情况修改`pages`中的物理页结构体
  * - 设置全局变量`freemem`：原值向上对齐到页面大小
- * - 设置全局变量`page_free_list`：为合法的空闲物理页链表头
+ * - 设置全局变量`page_free_list`：为合法的各阶空闲块链表头
  *
  */
 void page_init(void);
 
+/*
+ * 概述：
+ *   继续初始化`page_init`未初始化的物理页结构体，最多初始化`max_chunks`个块组，
+ *   并将其中的空闲页插入空闲块链表。
+ *
+ *   在分配时空闲页不足（`page_alloc_order`、`page_alloc_nozero`），
+ *   或系统空闲（`sched_idle`）时被调用。
+ *
+ * Postcondition：
+ * - 返回实际初始化的块组数，所有物理页均已初始化时返回 0
+ *
+ * 副作用：
+ * - 修改`pages`中的物理页结构体
+ * - 修改全局变量`page_free_list`
+ * - 修改`page_init_stat`
+ */
+u_int page_init_deferred(u_int max_chunks);
+
+// 输出物理页结构体初始化的统计
+void page_init_summarize(void);
+
 /* 概述：
  *
  *   分配`n`字节物理内存（对齐到`align`字节），若`clear`为真，将分配的内存填 0
@@ -213,12 +439,13 @@ void *alloc(u_int n, u_int align, int clear);
  *
  *   从空闲物理内存中分配一个物理页，并将该页内容清零。
  *
- *   具体地，移除空闲物理页链表的首元素，
- *   并将该元素的地址（struct Page *）写入到调用者指定的位置。
+ *   具体地，若预清零页池非空，直接取出其中的一页（无需清零）；
+ *   否则调用`page_alloc_order`分配一个 0 阶块并清零。
+ *   将该页的地址（struct Page *）写入到调用者指定的位置。
  *
  * Precondition：
  * - 参数`new`必须是指向有效`struct Page*`内存位置的**非空指针**
- * - 全局变量`page_free_list`必须是合法的空闲物理页链表的首节点
+ * - 全局变量`page_free_list`必须已由`page_init`初始化
  *
  * Postcondition：
  * -
@@ -232,6 +459,105 @@ void *alloc(u_int n, u_int align, int clear);
  */
 int page_alloc(struct Page **pp);
 
+/*
+ * 概述：
+ *
+ *   从空闲物理内存中分配一个物理页，**不清零**该页内容。
+ *   仅应当用于随后会完整覆盖该页内容的调用者（如`do_cow`的整页复制），
+ *   以免将其他进程的残留数据泄露到用户空间。
+ *
+ *   优先从伙伴系统中分配，从而保留预清零页池供`page_alloc`使用；
+ *   若伙伴系统中已无空闲页，则使用预清零页池中的页。
+ *
+ * Precondition：
+ * - 参数`new`必须是指向有效`struct Page*`内存位置的**非空指针**
+ *
+ * Postcondition：
+ * - 若无空闲页，返回-E_NO_MEM，不修改调用者指定的位置。
+ * - 否则，将分配的'Page'地址设置到调用者指定的位置，并返回 0。
+ *
+ * 注意：
+ *   本函数不会增加物理页的引用计数'pp_ref'
+ */
+int page_alloc_nozero(struct Page **new);
+
+/*
+ * 概述：
+ *
+ *   在系统空闲时填充预清零页池：从伙伴系统中取出至多`max_count`个页，清零后放入池中，
+ *   直到池中页数达到`PAGE_ZERO_POOL_SIZE`或伙伴系统中无空闲页。
+ *
+ *   池中的页在内存紧张时（`page_alloc_order`失败）会被归还伙伴系统。
+ *
+ * 副作用：
+ * - 修改全局变量`page_free_list`
+ * - 修改`page_zero_pool_stat.refilled`
+ */
+void page_zero_pool_refill(u_int max_count);
+
+// 输出预清零页池的状态及命中统计
+void page_zero_pool_summarize(void);
+
+/*
+ * 概述：
+ *
+ *   使用伙伴系统分配`1 << order`个物理地址连续的物理页，并将这些页内容清零。
+ *   分配的块的首地址对齐到`1 << order`页。
+ *
+ *   具体地，从阶数不小于`order`的最小非空空闲块链表中取出一个块，
+ *   若该块大于所需大小，则逐次对半拆分，将拆出的高地址一半插入低一阶的空闲块链表。
+ *
+ * Precondition：
+ * - 参数`new`必须是指向有效`struct Page*`内存位置的**非空指针**
+ * - `order`不大于`PAGE_MAX_ORDER`
+ * - 全局变量`page_free_list`必须已由`page_init`初始化
+ *
+ * Postcondition：
+ * - 若`order`非法，返回-E_INVAL；
+ *   若无足够大的空闲块（即使将预清零页池中的页归还伙伴系统后），返回-E_NO_MEM，
+ *   均不修改调用者指定的位置
+ * - 否则，将块的首页（`Page`地址）设置到调用者指定的位置，并返回 0。
+ *   块中第`i`页为`(*new) + i`。
+ *
+ * 注意：
+ *   本函数不会增加物理页的引用计数'pp_ref'——必要时
+ *   必须由调用者自行处理（显式操作或通过 page_insert）
+ */
+int page_alloc_order(u_int order, struct Page **new);
+
+/*
+ * 概述：
+ *   分配一个阶数为`order`的巨页（`PAGE_HUGE_ORDER(level)`），若`clear`为真，将其内容清零。
+ *   巨页的首页被标记为`PAGE_FLAG_HUGE`，整个巨页的引用计数记录在首页中。
+ *
+ *   2 MiB巨页由伙伴系统分配；1 GiB巨页超过伙伴系统的最大阶数，
+ *   从全部空闲的、对齐的物理页范围中取出（所有物理页结构体均须先初始化）。
+ *
+ * Postcondition：
+ * - 成功时返回 0，将巨页的首页设置到`*new`
+ * - `order`不是巨页的阶数时返回-E_INVAL，无足够的连续空闲内存时返回-E_NO_MEM
+ *
+ * 注意：
+ *   本函数不会增加物理页的引用计数'pp_ref'
+ */
+int page_alloc_huge(u_int order, int clear, struct Page **new);
+
+/*
+ * 概述：
+ *   释放以`pp`为首页的巨页，将其按对齐的块归还伙伴系统。
+ *
+ * Precondition：
+ * - `pp`是巨页的首页，且引用计数为 0
+ */
+void page_free_huge(struct Page *pp);
+
+/*
+ * 概述：
+ *   将从`pp`开始的`count`个已分配的物理页归还伙伴系统，贪心地切分为对齐的块。
+ *   各页的引用计数被清零。
+ */
+void page_free_range(struct Page *pp, size_t count);
+
 /* 概述：
  *   释放页面'pp'并将其标记为空闲。
  *
@@ -246,9 +572,27 @@ int page_alloc(struct Page **pp);
  */
 void page_free(struct Page *pp);
 
+/* 概述：
+ *   释放以'pp'为首页、大小为`1 << order`页的块，并将其标记为空闲。
+ *   若该块的伙伴块也空闲，则逐级与伙伴合并为更高阶的空闲块。
+ *
+ * Precondition:
+ *
+ * - `pp`必须指向`pages`中的一个有效页面，且页号对齐到`1 << order`
+ * - 该块必须由`page_alloc_order(order, ...)`分配（或是其中按相同方式对齐的子块）
+ * - 'pp->pp_ref'的值为'0'。
+ *
+ * Panics:
+ *
+ * - `pp->pp_ref`的值不为 0
+ * - `order`大于`PAGE_MAX_ORDER`，或`pp`未对齐到`1 << order`页
+ */
+void page_free_order(struct Page *pp, u_int order);
+
 /* 概述：
  *   减少`pp`对应的物理页的引用计数，
- *   若引用计数为 0，将该页面插入空闲物理页链表。
+ *   若引用计数为 0，将该页面插入空闲物理页链表（巨页的首页则释放整个巨页）。
+ *   设置了`PAGE_FLAG_PINNED`的页引用计数为 0 时不释放。
  *
  *   注意，调用此函数后无需再调用`page_free`!
  *
@@ -278,6 +622,8 @@ void page_decref(struct Page *pp);
  *
  * 在所有情况下，TLB 中的相关表项（若有），都将被移除，以使得新的映射生效。
  *
+ * 若`pgdir`属于某个进程，新映射计入该进程的资源组，被替换的映射同时归还（见`pgdir_charge`）。
+ *
  * Precondition：
  *
  * - `pgdir`必须是指向有效页目录结构的指针
@@ -291,6 +637,7 @@ void page_decref(struct Page *pp);
  *
  * - 成功时返回 0
  * - 若无法分配页表，返回-E_NO_MEM
+ * - 若超出所属进程的资源组的物理页限制，返回-E_QUOTA，此时映射不变
  *
  */
 int page_insert(Pte *pgdir, uint16_t asid, struct Page *pp, u_reg_t va,
@@ -318,6 +665,103 @@ int page_insert(Pte *pgdir, uint16_t asid, struct Page *pp, u_reg_t va,
  */
 struct Page *page_lookup(Pte *pgdir, u_long va, Pte **ppte);
 
+/*
+ * 概述：
+ *   同`page_lookup`，若`va`存在有效映射，将其叶页表项所在的级数（1~3）写入`*plevel`。
+ *
+ *   对于巨页映射（级数小于 3），返回该映射的第一个物理页（通常为巨页的首页），而非`va`所在的物理页：
+ *   需要引用其中单个物理页时，应当先调用`page_split`。
+ *   巨页中只有首页记录引用计数，读取引用计数时应使用`page_head`。
+ */
+struct Page *page_lookup_level(Pte *pgdir, u_reg_t va, Pte **ppte,
+                               u_int *plevel);
+
+/*
+ * 概述：
+ *   （含 TLB 操作）在虚拟地址空间`asid`中，将巨页`pp`映射到虚拟地址`va`，
+ *   使用第`level`级（1 或 2）叶页表项，并增加巨页的引用计数。
+ *
+ *   - 若`va`已映射同一巨页，仅更新标志位
+ *   - 若该范围内已有其它映射（巨页或下级页表），移除这些映射并释放下级页表
+ *   - 若`va`位于更大的巨页映射中，先拆分该映射
+ *
+ *   新映射及被移除的映射计入/归还所属进程的资源组，同`page_insert`。
+ *
+ * Precondition：
+ * - `pp`对齐到`PLEVEL_SIZE(level)`，且位于阶数不小于`PAGE_HUGE_ORDER(level)`的巨页中
+ *  （巨页的首页，或拆分被共享的 1 GiB 巨页映射后得到的 2 MiB 映射）
+ * - `va`对齐到`PLEVEL_SIZE(level)`
+ * - `perm`的要求同`page_insert`
+ *
+ * Postcondition：
+ * - 成功时返回 0，无法分配页表时返回-E_NO_MEM
+ * - 超出所属进程的资源组的物理页限制时返回-E_QUOTA
+ */
+int page_insert_huge(Pte *pgdir, uint16_t asid, struct Page *pp, u_reg_t va,
+                     u_int level, uint32_t perm);
+
+/*
+ * 概述：
+ *   （含 TLB 操作）若`va`位于巨页映射中，将该映射逐级拆分，直到`va`由三级页表项映射。
+ *   拆分后各页表项的标志位与原巨页映射相同。
+ *
+ *   - 若巨页只被该映射引用，直接将其拆分为下一级的物理页/巨页
+ *   - 否则（如`PTE_LIBRARY`或fork后共享的巨页），下一级的各页表项仍指向原巨页中的物理页，
+ *     各计入原巨页首页的一个引用，从而保持共享
+ *
+ *   两种情况均不复制内容，只需分配下一级页表。
+ *
+ * Postcondition：
+ * - 成功（包括`va`未映射或不在巨页映射中）时返回 0
+ * - 无法分配页表时返回-E_NO_MEM，已完成的拆分仍然有效
+ */
+int page_split(Pte *pgdir, uint16_t asid, u_reg_t va);
+
+/*
+ * 概述：
+ *   移除第`level`级（1 或 2）非叶页表项`entry`指向的页表中的所有映射，
+ *   直接将各叶映射的物理页/巨页的引用计数 -1，释放该页表及其下级页表，并将`entry`清零。
+ *
+ *   与逐页调用`page_remove`不同，本函数不重新遍历页表，也不清除TLB，也不归还资源组的计数；
+ *   调用者须在之后自行清除相关TLB条目（例如`tlb_flush_asid`）。
+ *   被共享的页表（见`page_table_share`）不释放，只解除`entry`对它的引用。
+ *
+ * Precondition：
+ * - `*entry`是有效的非叶页表项
+ */
+void pte_table_free(Pte *entry, u_int level);
+
+/*
+ * 概述：
+ *   使`pgdir`中`va`所在的2 MiB区域共享三级页表`table_page`（不复制页表项），
+ *   该页表的引用计数 +1，共享者数目（`pp_next`）+1。
+ *
+ *   共享的页表中不应含有可写的映射：修改共享页表中的映射前，须先调用`page_unshare`。
+ *   `page_insert`、`page_remove`会自动进行该操作。
+ *
+ * Precondition：
+ * - `pgdir`中`va`所在的2 MiB区域未映射
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - 无法分配二级页表时返回-E_NO_MEM
+ * - 该区域已映射时返回-E_INVAL
+ */
+int page_table_share(Pte *pgdir, u_reg_t va, struct Page *table_page);
+
+/*
+ * 概述：
+ *   （含 TLB 操作）若`pgdir`中`va`所在的三级页表与其它页目录共享，为`pgdir`复制一份该页表：
+ *   复制全部页表项，页表中各物理页的引用计数 +1，原页表的引用计数及共享者数目 -1。
+ *   若原页表被映射到`pgdir`的User VPT中，改为映射副本。
+ *
+ *   副本中的地址转换与原页表相同，无需清除TLB。
+ *
+ * Postcondition：
+ * - 成功（包括该页表未被共享）时返回 0，内存不足时返回-E_NO_MEM
+ */
+int page_unshare(Pte *pgdir, uint16_t asid, u_reg_t va);
+
 /* 概述：
  *   （含 TLB 操作）在虚拟地址空间`asid`中，移除虚拟地址`va`的映射`。
  *
@@ -327,14 +771,135 @@ struct Page *page_lookup(Pte *pgdir, u_long va, Pte **ppte);
  *
  *   注意：如果引用计数减少后等于0，则该物理页将被加入空闲链表！
  *
+ *   若`va`位于巨页映射中，先拆分该映射（见`page_split`），其余页的映射保持不变；
+ *   若`va`所在的三级页表被共享，先为`pgdir`复制该页表（见`page_unshare`）。
+ *   被移除的映射从所属进程的资源组中归还（见`pgdir_charge`）。
+ *
  * Precondition：
  *
  * - `pgdir`必须是指向有效页目录结构的指针
  * - `va`无需按页对齐
  * - `asid`必须是有效的地址空间标识符
  *
+ * Postcondition：
+ *
+ * - 成功（包括`va`未映射）时返回 0
+ * - 拆分巨页映射或复制共享的页表时无法分配页表，返回-E_NO_MEM，此时`va`的映射不变
+ *
  */
-void page_remove(Pte *pgdir, u_int asid, u_long va);
+int page_remove(Pte *pgdir, u_int asid, u_long va);
+
+/*
+ * 概述：
+ *   以第`level`级（1~3）页表项映射物理页`pp`时，该映射计入资源组的物理页数：
+ *   `PLEVEL_SIZE(level) / PAGE_SIZE`，内核持有的页（`PAGE_FLAG_PINNED`）为 0。
+ */
+uint32_t page_mapped_pages(struct Page *pp, u_int level);
+
+/*
+ * 概述：
+ *   `pgdir`中`va`处的映射由`refund`个物理页变为`charge`个物理页（见`page_mapped_pages`）时调用，
+ *   将差值计入（或归还）`pgdir`所属进程的资源组（见`group_charge_pages`）。
+ *
+ *   资源组限制的是组内各进程映射的物理页数之和：被多个进程映射的页分别计入各进程，
+ *   写时复制以新页替换原页的映射，计数不变。
+ *   `page_insert`、`page_insert_huge`、`page_remove`会自动进行该操作；
+ *   直接填写页表项时（如fork复制页表），须由调用者调用。
+ *
+ *   只计入用户空间（`va` < UTOP）中的映射；`pgdir`不属于任何进程（如内核页目录）时不计入。
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - -E_QUOTA：差值为正，且计入后将超出资源组的物理页限制，此时不计入
+ */
+int pgdir_charge(Pte *pgdir, u_reg_t va, uint32_t charge, uint32_t refund);
+
+/*
+ * 概述：
+ *   mmu-gather：在修改页表的过程中收集需要从TLB中清除的虚拟地址，
+ *   修改结束后（`tlb_gather_finish`）统一清除，而非每修改一个页表项就执行一次`sfence.vma`。
+ *
+ *   收集到的虚拟地址范围不超过`TLB_RANGE_INVALIDATE_MAX_PAGES`页时，按页清除；
+ *   否则清除整个地址空间`asid`（全局映射则刷新整个TLB）。
+ *
+ * 注意：被移除映射的物理页在清除TLB之前就可能被释放。
+ *       由于只有一个处理器核心，且内核在返回用户态前完成清除，这不会导致问题。
+ */
+struct TlbGather {
+    uint16_t asid;  // 地址空间
+    uint8_t global; // 是否为全局映射（内核映射），若是，清除所有地址空间中的条目
+    u_reg_t start;  // 收集到的虚拟地址范围[start, end)
+    u_reg_t end;
+    size_t count; // 收集到的页数
+};
+
+// 初始化`tlb`，开始收集地址空间`asid`（`global`为真时为全局映射）中的虚拟地址
+void tlb_gather_init(struct TlbGather *tlb, uint16_t asid, int global);
+
+// 记录[va, va + len)需要从TLB中清除
+void tlb_gather_add(struct TlbGather *tlb, u_reg_t va, size_t len);
+
+// 清除收集到的TLB条目，并重新初始化`tlb`
+void tlb_gather_finish(struct TlbGather *tlb);
+
+// 同`page_insert`，但需要清除的TLB条目记录到`tlb`中，由调用者调用`tlb_gather_finish`清除
+int page_insert_gather(Pte *pgdir, struct TlbGather *tlb, struct Page *pp,
+                       u_reg_t va, uint32_t perm);
+
+// 同`page_remove`，但需要清除的TLB条目记录到`tlb`中，由调用者调用`tlb_gather_finish`清除
+int page_remove_gather(Pte *pgdir, struct TlbGather *tlb, u_reg_t va);
+
+// 同`page_insert_huge`，但需要清除的TLB条目记录到`tlb`中，由调用者调用`tlb_gather_finish`清除
+int page_insert_huge_gather(Pte *pgdir, struct TlbGather *tlb, struct Page *pp,
+                            u_reg_t va, u_int level, uint32_t perm);
+
+/*
+ * `pgdir_walk_range`的回调函数：处理同一个三级页表中连续的`count`个页表项
+ * `pte[0, count)`，它们对应的虚拟地址从`va`开始
+ * 返回非 0 值时，遍历终止，`pgdir_walk_range`返回该值
+ */
+typedef int (*pte_range_func)(Pte *pte, u_reg_t va, size_t count, void *arg);
+
+/*
+ * 概述：
+ *   遍历`pgdir`中[va, va + len)对应的三级页表项，每个三级页表只从页目录查找一次，
+ *   对其中位于该范围的连续页表项调用一次`func`。
+ *
+ * Precondition：
+ * - `va`按页对齐
+ * - 范围内不存在巨页映射（否则使用`pgdir_walk_range_huge`）
+ *
+ * Postcondition：
+ * - `create`为 0 时，跳过未分配三级页表的部分（不调用`func`）
+ * - `create`为 1 时，按需分配页表，内存不足时返回-E_NO_MEM
+ * - `func`返回非 0 值时，立即返回该值
+ * - 否则返回 0
+ *
+ * 注意：本函数不清除TLB，修改页表项后，调用者应当使用`TlbGather`清除
+ *
+ * Panics：
+ * - `va`未按页对齐
+ * - 范围内存在巨页映射
+ */
+int pgdir_walk_range(Pte *pgdir, u_reg_t va, size_t len, int create,
+                     pte_range_func func, void *arg);
+
+/*
+ * `pgdir_walk_range_huge`的回调函数：处理第`level`级（1 或 2）的叶页表项`pte`，
+ * 其映射的巨页从`va`（对齐到`PLEVEL_SIZE(level)`）开始
+ * 返回非 0 值时，遍历终止
+ */
+typedef int (*pte_huge_func)(Pte *pte, u_reg_t va, u_int level, void *arg);
+
+/*
+ * 概述：
+ *   同`pgdir_walk_range`，但遇到巨页映射时，对其叶页表项调用一次`huge_func`，
+ *   并跳过该巨页映射的范围（巨页可能只有一部分位于[va, va + len)中）。
+ *   `huge_func`为NULL时，遇到巨页映射将panic。
+ */
+int pgdir_walk_range_huge(Pte *pgdir, u_reg_t va, size_t len, int create,
+                          pte_range_func func, pte_huge_func huge_func,
+                          void *arg);
 
 void map_mem(Pte *pgdir, u_reg_t va, u_reg_t pa, size_t len, uint32_t perm);
 void unmap_mem(Pte *pgdir, u_reg_t va, size_t len);
@@ -346,10 +911,92 @@ extern struct Page *pages;
 
 void physical_memory_manage_check(void);
 void page_check(void);
+void buddy_check(void);
+
+int passive_alloc(u_reg_t va, Pte *pgdir, uint16_t asid);
 
-void passive_alloc(u_reg_t va, Pte *pgdir, uint16_t asid);
+struct Env;
 
-void kernel_passive_alloc(u_reg_t va);
+/*
+ * 概述：
+ *   （含 TLB 操作）处理进程`env`在未映射的地址`va`处的缺页：同`passive_alloc`分配并映射`va`所在的页，
+ *   并按需填充相邻的未映射页（fault-around），减少顺序访问新内存时的缺页次数。
+ *
+ *   填充的页数（窗口）根据访问模式自适应：若缺页地址紧接上次填充的范围（向上或向下），
+ *   视为顺序访问，窗口加倍，但不超过`env->env_fault_around_max`；否则窗口重置为 1 页。
+ *   相邻页沿访问方向填充，不跨越三级页表，遇到已映射的页、镜像中的页（见`env_image_contains`）
+ *   或[UTEMP, USTACKTOP)的边界时停止。
+ *
+ *   分配的页计入`env`的资源组（见`pgdir_charge`），相邻页超出限制时不再填充。
+ *
+ * Precondition：
+ * - `va`的要求同`passive_alloc`
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - -E_NO_MEM：内存不足，此时`va`未被映射
+ * - -E_QUOTA：超出`env`所在资源组的物理页限制，此时`va`未被映射
+ *
+ * 副作用：
+ * - 修改`env`的fault-around状态（`env_fault_around`、`env_fault_around_begin`、`env_fault_around_end`）
+ */
+int passive_alloc_around(struct Env *env, u_reg_t va);
+
+// 全局只读零页：内容全为0，由所有进程以CoW方式共享，设置了`PAGE_FLAG_PINNED`，永不释放
+// 首次使用时分配，分配前为NULL
+extern struct Page *zero_page;
+
+// 返回全局零页，首次调用时分配；内存不足时返回NULL
+struct Page *zero_page_get(void);
+
+/*
+ * 概述：
+ *   （含 TLB 操作）处理进程`env`在未映射的地址`va`处的读缺页：
+ *   将全局零页以只读、CoW方式（PTE_RO | PTE_USER | PTE_COW）映射到`va`所在的页，
+ *   首次写入时由`cow_fault`分配私有的物理页。
+ *
+ *   `va`不在[UTEMP, USTACKTOP)中，或无法分配零页时，同`passive_alloc_around`处理。
+ *   不修改`env`的fault-around状态。
+ *
+ * Precondition：
+ * - `va`的要求同`passive_alloc`
+ *
+ * Postcondition：
+ * - 同`passive_alloc_around`
+ */
+int passive_map_zero(struct Env *env, u_reg_t va);
+
+/*
+ * 概述：
+ *   （含 TLB 操作）若进程`env`中`va`所在的页设置了`PAGE_FLAG_PINNED`（全局零页、镜像页缓存中的页），
+ *   且以CoW方式映射，由`cow_fault`将其替换为私有的可写页。
+ *   用于将该页以可写方式共享给其它进程（`sys_mem_map`、`sys_ipc_try_send`）之前，
+ *   以免所有进程共享的页被写入。
+ *
+ * Postcondition：
+ * - 成功或`va`未映射此类页时返回 0
+ * - -E_INVAL：该页不是CoW页（只读镜像段的页），不可被以可写方式映射
+ * - 内存不足时返回-E_NO_MEM，超出资源组的物理页限制时返回-E_QUOTA，此时映射不变
+ */
+int pinned_page_privatize(struct Env *env, u_reg_t va);
+
+/*
+ * 概述：
+ *   （含 TLB 操作）解除进程`env`中`va`所在的CoW页（含巨页）的写时复制，使其可写：
+ *   - 若该页只被`env`引用，直接改为可写
+ *   - 若该页是全局零页，映射新的已清零的物理页
+ *   - 否则复制该页
+ *   同一组中相邻的CoW页（见`COW_FAULT_AROUND_PAGES`）若只被`env`引用，一并改为可写；
+ *   `env`设置了`FORK_COW_COPY_AROUND`时，仍被共享的相邻页也一并复制
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - `va`未映射或不是CoW页时返回-E_INVAL
+ * - 内存不足时返回-E_NO_MEM
+ * - -E_QUOTA：以新页替换全局零页等不计入资源组的页（见`page_mapped_pages`）时，
+ *   超出`env`所在资源组的物理页限制
+ */
+int cow_fault(struct Env *env, u_reg_t va);
 
 void set_satp(u_reg_t asid, u_reg_t p1_ppn);
 
@@ -1,33 +1,153 @@
 #ifndef __SCHED_H__
 #define __SCHED_H__
 
+#include <env.h>
+
+/*
+ * 概述：
+ *   初始化各调度级别的调度队列及非空队列位图。
+ *
+ * Postcondition：
+ * - 所有调度队列为空
+ */
+void sched_init(void);
+
+/*
+ * 概述：
+ *   将可运行的进程`e`插入其当前调度级别（`e->env_sched_level`）的队列，
+ *   并维护非空队列位图及队列长度。
+ *
+ *   `sched_insert_head`插入队列头部，O(1)；`sched_insert_tail`按`env_vruntime`升序插入，
+ *   排在`env_vruntime`不大于`e`的进程之后，O(n)。
+ *   插入前将`e->env_vruntime`提高到不低于最近调度的进程，以免长期阻塞或新创建的进程
+ *   积累过多的CPU时间份额。
+ *
+ * Precondition：
+ * - `e`不在任何调度队列中
+ */
+void sched_insert_head(struct Env *e);
+void sched_insert_tail(struct Env *e);
+
+/*
+ * 概述：
+ *   将进程`e`从其所在的调度队列中移除，O(1)。`e`不在调度队列中时无操作。
+ */
+void sched_remove(struct Env *e);
+
+/*
+ * 概述：
+ *   进程`e`因等待IPC或中断而阻塞时调用，将其调度级别提升一级（不超过级别0），
+ *   从而被唤醒后能先于计算密集型进程运行。
+ *
+ * Precondition：
+ * - `e`已通过`sched_remove`移出调度队列
+ *
+ * Panics：
+ * - `e`仍在调度队列中
+ */
+void sched_boost(struct Env *e);
+
+/*
+ * 概述：
+ *   将进程`e`加入EDF（最早截止时间优先）调度类，或在`period`为0时将其移回多级反馈队列。
+ *   时间均以时钟中断数计：每个长为`period`的周期开始时，进程获得`budget`的预算，
+ *   其作业应在周期开始后`deadline`内完成（主动让出，即`schedule(1)`）。
+ *   用完预算的进程直到下一周期开始前不会被调度；
+ *   作业在截止时间后才完成，或到下一周期开始时仍未完成（且进程可运行），计为错过截止时间。
+ *
+ *   准入控制：所有EDF进程的密度（`budget` / `deadline`）之和不超过SCHED_EDF_UTIL_MAX，
+ *   此时EDF调度类中的进程均能在截止时间前完成。
+ *
+ * Postcondition：
+ * - 成功时返回0，进程的当前周期从现在开始
+ * - -E_INVAL：`period`非0，且不满足 0 < `budget` <= `deadline` <= `period`
+ * - -E_OVERLOAD：接纳后CPU利用率之和将超过SCHED_EDF_UTIL_MAX，进程的调度类不变
+ *
+ * 副作用：
+ * - 若`e`在调度队列中，将其移至新调度类的队列
+ */
+int sched_set_edf(struct Env *e, uint32_t period, uint32_t budget,
+                  uint32_t deadline);
+
+/*
+ * 概述：
+ *   CPU时间记账：将上次记账以来经过的时间计入进程`e`的用户态（`user`非0）或内核态
+ *   CPU时间，并按优先级加权计入其`env_vruntime`（优先级为`n`的进程增长速度为1/n）。
+ *   `e`为NULL时（空闲、首次调度、进程已销毁）只更新记账时刻。
+ *
+ *   在陷阱入口（用户态时间）、陷阱返回及`env_run`切换进程时（内核态时间）调用。
+ */
+void sched_account(struct Env *e, int user);
+
 /*
  * 概述：
- *   实现时间片轮转调度算法，从可运行环境列表中选择一个环境并使用'env_run'调度运行。
+ *   将各级调度队列的长度及调度统计写入`stat`。
+ */
+void sched_get_stat(struct SchedStat *stat);
+
+// 输出各级调度队列的长度、提升、降级、抢占的次数，及EDF调度类的状态
+void sched_summarize(void);
+
+/*
+ * 概述：
+ *   实现EDF及多级反馈队列调度算法，从可运行环境中选择一个环境并使用'env_run'调度运行。
+ *
+ *   EDF调度类（见`sched_set_edf`）优先于多级反馈队列：只要存在仍有预算的EDF进程，
+ * 就运行其中截止时间最早者。每次时钟中断扣除当前EDF进程的预算，并为进入新周期的
+ * EDF进程补充预算。
+ *
+ *   可运行的进程按调度级别（`env_sched_level`，0最高）位于SCHED_LEVELS个调度队列中，
+ * 非空队列位图的最低位给出最高的非空级别，从而选择下一个进程为 O(1)；存在用完CPU配额的
+ * 资源组时，须跳过队列中属于这些资源组的进程，选择下一个进程最坏为 O(NENV)。
  *
- *   当需要切换进程时（如主动让出、时间片耗尽、当前进程不可运行等），从调度队列头部
- * 选取新进程，设置其优先级对应的时间片。若原进程仍可运行，将其移至队列尾部以保证
- * 公平性。非可运行进程的移除由其他函数保证。
+ *   同一级别的队列按`env_vruntime`（按优先级加权的实际CPU时间，见`sched_account`）
+ * 升序排列：频繁阻塞的进程只计入实际运行的时间，被唤醒时排在计算密集型进程之前。
  *
- *   当无需切换进程时（时间片未用完、未让出、仍可运行），继续运行当前进程，并
- * 减少其可运行的时间片。
+ *   当需要切换进程时（如主动让出、时间片耗尽、当前进程不可运行、更高级别的队列
+ * 非空等），从最高非空级别队列头部选取新进程。时间片按实际CPU时间计算：进程在当前
+ * 级别累计运行`env_pri`个时钟中断间隔后用完时间片，主动让出不会重置其用量。若原进程
+ * 用完了时间片，将其降低一级并按`env_vruntime`移入新级别队列；若原进程主动让出，
+ * 将其移至所在级别队列尾部；若原进程被更高级别的进程抢占，其位置不变。
+ * 非可运行进程的移除由其他函数保证。
+ *
+ *   所在资源组（见`group_create`）在当前周期用完CPU配额的进程不被调度，直到下一个
+ * 周期开始。
+ *
+ *   调度前唤醒定时器到期的进程（见`env_timer_expire`）。定时器使时钟中断提前到来时，
+ * 只唤醒进程并允许抢占，不计为一个时间片。
+ *
+ *   没有可运行的进程时，停止周期性的时钟中断，只在下一个EDF周期开始、资源组进入新
+ * 周期或最早的定时器到期时产生时钟中断，并执行wfi直到外部中断或时钟中断使得有进程可运行，期间完成
+ * 推迟的物理页初始化及预清零页池的填充。
+ *
+ *   每经过SCHED_RESET_TICKS次时钟中断，将级别低于SCHED_LEVEL_DEFAULT的进程恢复到
+ * SCHED_LEVEL_DEFAULT，以免计算密集型进程饥饿。
+ *
+ *   当无需切换进程时（时间片未用完、未让出、仍可运行、没有更高级别的进程），
+ * 继续运行当前进程。
  *
  *   **不要在本函数中修改`curenv`的值，其值应当通过`env_run`函数修改**
  *
  * Precondition：
- * - 全局变量'env_sched_list'仅包含且必须包含所有ENV_RUNNABLE状态的进程
+ * - 调度队列仅包含且必须包含所有ENV_RUNNABLE状态的进程
  * - 全局变量'curenv'在首次调度前应为NULL
  * - 非可运行进程的移除由其他函数维护（如env_destroy/env_block等）
  *
  * Postcondition：
- * - 若yield非零，当前进程不会（在当前轮次）被再次调度（除非是唯一可运行进程）
+ * - 若yield非零，当前进程不会（在当前轮次）被再次调度（除非其所在级别及更高级别
+ *   中没有其它可运行进程）
  * - 调度队列中所有进程保持ENV_RUNNABLE状态（需由其他函数维护）
- * - 新调度进程的时间片计数被初始化为其优先级值减1，其将可以运行“优先级”次
+ * - 进程在同一级别累计运行`env_pri`个时钟中断间隔后降级
  *
  * 副作用：
- * - 修改静态变量count（当前进程剩余时间片）
+ * - 修改静态变量ticks（距上次恢复级别的时钟中断数）
+ * - 修改EDF进程的预算及错过截止时间的统计
+ * - 空闲时可能将`curenv`置为NULL，修改时钟中断的时间，处理外部中断
  * - 修改全局变量curenv（通过env_run）
- * - 可能调整env_sched_list队列结构（移动可运行进程至队尾）
+ * - 可能调整调度队列结构及进程的调度级别
+ *
+ * Panics：
+ * - 没有可运行的进程，且所有进程均已退出
  */
 void schedule(int yield) __attribute__((noreturn));
 
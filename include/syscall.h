@@ -352,7 +352,7 @@ enum {
      * - 如果'srcva'不为0，可能修改目标环境的页表（通过page_insert）
      *
      * 注意事项：
-     * - 若srcva != 0但非法，将返回`-E_INVAL`，但此时接收者已被唤醒并继续执行
+     * - 若srcva != 0但未映射，将返回`-E_INVAL`，此时不修改目标环境，接收者仍在等待
      * - 若srcva != 0但合法，dstva = 0，将导致接收者的[0x00000000,
      * 0x00000FFF]被映射 这被认为是系统设计缺陷，但保留该效果
      */
@@ -459,6 +459,28 @@ enum {
     // 若地址未映射，返回0
     SYS_is_dirty,
     SYS_pageref,
+    // 设置进程fork时的选项（FORK_*），见`env_fork_flags`
+    SYS_set_fork_flags,
+    // 设置进程缺页时一次最多填充的页数，见`passive_alloc_around`
+    SYS_set_fault_around,
+    // 不复制地址空间，由ELF镜像直接创建子进程
+    SYS_spawn,
+    // 获取各级调度队列的长度及调度统计，见`schedule`
+    SYS_get_sched_stat,
+    // 将进程加入EDF调度类或移回多级反馈队列，见`sched_set_edf`
+    SYS_set_edf,
+    // 阻塞直到指定时刻，见`env_timer_set`
+    SYS_sleep_until,
+    // 带超时的IPC接收
+    SYS_ipc_recv_timeout,
+    // 获取自启动以来经过的纳秒数
+    SYS_get_time,
+    // 创建资源组，见`group_create`
+    SYS_group_create,
+    // 将进程移入资源组
+    SYS_group_attach,
+    // 获取资源组的配额及使用情况
+    SYS_group_get_stat,
     MAX_SYSNO,
 };
 
@@ -1,4 +1,132 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
 #include <sbi.h>
+#include <stdint.h>
 #include <types.h>
 
-void set_next_timer_interrupt(u_reg_t next_tick);
\ No newline at end of file
+// 设备树中没有`timebase-frequency`时使用的`time` CSR计数频率（QEMU virt平台为10 MHz）
+#define TIMER_FREQUENCY 10000000ULL
+
+// `time` CSR的计数频率（Hz），由`timer_frequency_init`从设备树读取
+extern uint64_t timer_frequency;
+
+/*
+ * 概述：
+ *   从设备树`/cpus`节点的`timebase-frequency`属性读取`time` CSR的计数频率，
+ *   写入`timer_frequency`。属性不存在或无效时保留默认值`TIMER_FREQUENCY`。
+ *
+ *   此前的时间换算均按`TIMER_FREQUENCY`进行。
+ *
+ * Precondition：
+ * - 已调用`device_tree_init`
+ */
+void timer_frequency_init(void);
+
+/*
+ * 概述：
+ *   设置下一次周期性时钟中断的时刻为`next_tick`。
+ *   实际设置的时刻为`next_tick`与定时器队列中最早到期时刻的较小者，
+ *   从而没有周期性时钟中断时（`next_tick`为~0UL）也能按时唤醒定时的进程。
+ */
+void set_next_timer_interrupt(u_reg_t next_tick);
+
+// 读取`time` CSR，返回自启动以来经过的时钟周期数
+static inline uint64_t read_time(void) {
+    uint64_t time;
+
+    asm volatile("rdtime %0" : "=r"(time));
+
+    return time;
+}
+
+#define US_PER_SEC 1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
+// 将时钟周期数转换为微秒，按秒拆分以免溢出
+static inline uint64_t time_to_us(uint64_t ticks) {
+    return ticks / timer_frequency * US_PER_SEC +
+           ticks % timer_frequency * US_PER_SEC / timer_frequency;
+}
+
+// 将时钟周期数转换为纳秒，按秒拆分以免溢出
+static inline uint64_t time_to_ns(uint64_t ticks) {
+    return ticks / timer_frequency * NS_PER_SEC +
+           ticks % timer_frequency * NS_PER_SEC / timer_frequency;
+}
+
+// 将纳秒转换为时钟周期数（向上取整），按秒拆分以免溢出，结果超出范围时返回UINT64_MAX
+static inline uint64_t ns_to_time(uint64_t ns) {
+    uint64_t secs = ns / NS_PER_SEC;
+    uint64_t rem = (ns % NS_PER_SEC * timer_frequency + NS_PER_SEC - 1) /
+                   NS_PER_SEC;
+
+    if (secs > (UINT64_MAX - rem) / timer_frequency) {
+        return UINT64_MAX;
+    }
+
+    return secs * timer_frequency + rem;
+}
+
+struct Env;
+
+/*
+ * 概述：
+ *   设置进程`e`的定时器，使其在`time` CSR达到`expire`时被唤醒。
+ *   定时器队列是以到期时刻为键的最小堆，插入、删除均为 O(log NENV)。
+ *   若`e`已有定时器，以新的到期时刻代替。
+ *
+ *   定时器不会自行阻塞进程：调用者应随后将`e`置为ENV_NOT_RUNNABLE并移出调度队列。
+ *   到期时，若`e`仍为ENV_NOT_RUNNABLE，则将其唤醒（见`env_timer_expire`）。
+ *
+ * Postcondition：
+ * - 下一次设置时钟中断时（`set_next_timer_interrupt`），中断时刻不晚于`expire`
+ */
+void env_timer_set(struct Env *e, uint64_t expire);
+
+/*
+ * 概述：
+ *   取消进程`e`的定时器。`e`没有定时器时无操作。
+ *   进程因其它原因被唤醒（收到IPC、中断）或被销毁时调用。
+ */
+void env_timer_cancel(struct Env *e);
+
+/*
+ * 概述：
+ *   唤醒所有定时器已到期的进程：将其置为ENV_RUNNABLE并加入调度队列尾部。
+ *   若进程阻塞在`sys_ipc_recv_timeout`中，其系统调用返回-E_TIMEOUT。
+ *
+ * 副作用：
+ * - 修改被唤醒进程的状态、IPC字段及系统调用返回值
+ * - 修改调度队列
+ */
+void env_timer_expire(void);
+
+/*
+ * 概述：
+ *   判断周期性的时钟中断（最近一次`set_next_timer_interrupt`设置的时刻）是否已到。
+ *   定时器队列中的定时器可能使时钟中断提前到来，此时不应计为一个时间片。
+ */
+int timer_tick_due(void);
+
+// 启动阶段计时最多记录的阶段数
+#define BOOT_STAGE_MAX 16
+
+/*
+ * 概述：
+ *   记录启动阶段`stage`结束的时间。
+ *   该阶段的耗时为本次调用与上一次调用之间的时间，
+ *   第一个阶段的耗时从机器复位（`time` CSR为 0）时开始计算。
+ *
+ * Precondition：
+ * - `stage`指向的字符串在整个内核运行期间有效（通常为字符串字面量）
+ *
+ * 副作用：
+ * - 超出`BOOT_STAGE_MAX`个阶段后，后续的阶段被忽略
+ */
+void boot_stage_mark(const char *stage);
+
+// 输出各启动阶段的耗时，以及从机器复位到最后一次记录的总耗时
+void boot_stage_summarize(void);
+
+#endif
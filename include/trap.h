@@ -20,6 +20,16 @@ struct Trapframe {
     u_reg_t sie;
 };
 
+// `scause`中的异常号：缺页异常
+#define EXC_INST_PAGE_FAULT 12
+#define EXC_LOAD_PAGE_FAULT 13
+#define EXC_STORE_PAGE_FAULT 15
+
+// 写时复制缺页时，一并处理的相邻页数：包含缺页地址、按该页数对齐的一组页（不跨越三级页表）
+// 相邻页只在可原地复用时处理，设置`FORK_COW_COPY_AROUND`时也复制仍被共享的页
+// 为 1 时只处理缺页地址所在的页
+#define COW_FAULT_AROUND_PAGES 16
+
 void print_tf(struct Trapframe *tf);
 
 void exception_init();
@@ -19,6 +19,13 @@ typedef uint64_t u_reg_t;
         __a <= __b ? __a : __b;                                                \
     })
 
+#define MAX(_a, _b)                                                            \
+    ({                                                                         \
+        typeof(_a) __a = (_a);                                                 \
+        typeof(_b) __b = (_b);                                                 \
+        __a >= __b ? __a : __b;                                                \
+    })
+
 // 查找大于等于`a`的、最近的是`n`的倍数的整数，要求`n`必须是 2 的正整数幂
 #define ROUND(a, n)                                                            \
     (((((u_reg_t)(a)) + ((u_reg_t)n) - 1)) & ~(((u_reg_t)n) - 1))
@@ -13,6 +13,8 @@ extern char _user_buffer_end[];
 void allow_access_user_space();
 void disallow_access_user_space();
 
+int user_range_check(u_reg_t va, size_t len);
+
 void copy_user_space(const void *restrict src, void *restrict dst, size_t len);
 
 void copy_user_space_to_env(struct Env *env, const void *restrict src,
@@ -5,7 +5,7 @@
 #define VIRTIO_COUNT 8
 #define VIRTIO_ADDRESS_SPACE_SIZE 0x01FF
 
-#define MMIO_BEGIN_VA 0xFFFFFFC080000000ULL
+#define MMIO_BEGIN_VA 0xFFFFFFE080000000ULL
 #define MMIO_END_VA ((MMIO_BEGIN_VA) + (VIRTIO_COUNT) * (PAGE_SIZE))
 
 #define MMIO_VA_OFFSET (MMIO_BEGIN_VA - VIRTIO_BEGIN_ADDRESS)
@@ -10,6 +10,7 @@
 #include <printk.h>
 #include <sbi.h>
 #include <sched.h>
+#include <timer.h>
 #include <trap.h>
 #include <types.h>
 #include <virtio.h>
@@ -27,15 +28,23 @@
 void riscv64_init(u_reg_t hart_id, void *dtb_address) __attribute__((noreturn));
 
 void riscv64_init(u_reg_t hart_id, void *dtb_address) {
+    boot_stage_mark("firmware");
+
     printk("init.c:\triscv64_init() is called\n");
 
     exception_init();
 
-    riscv64_detect_memory();
+    riscv64_detect_memory(dtb_address);
+    boot_stage_mark("detect_memory");
+
     riscv64_vm_init();
+    boot_stage_mark("vm_init");
+
     page_init();
+    boot_stage_mark("page_init");
 
     kmalloc_init();
+    boot_stage_mark("kmalloc_init");
 
     // physical_memory_manage_check();
 
@@ -46,11 +55,14 @@ void riscv64_init(u_reg_t hart_id, void *dtb_address) {
     // envid2env_check();
 
     env_check();
+    boot_stage_mark("env_init");
 
     // Device
 
     device_tree_init(dtb_address);
 
+    timer_frequency_init();
+
     plic_init();
 
     virtio_init();
@@ -58,15 +70,23 @@ void riscv64_init(u_reg_t hart_id, void *dtb_address) {
     serial_init();
 
     dump_device();
+    boot_stage_mark("device_init");
 
     allocation_summarize();
 
+    page_zero_pool_summarize();
+
+    page_init_summarize();
+
     ENV_CREATE_NAME("serial", user_serial);
     ENV_CREATE_NAME("virtio", user_virtio);
     ENV_CREATE_NAME("fs_serv", fs_serv);
     ENV_CREATE_NAME("serial_test", user_serialtest);
     ENV_CREATE_NAME("virtio_test", user_virtiotest);
     ENV_CREATE_NAME("process_test", user_processtest);
+    boot_stage_mark("env_create");
+
+    boot_stage_summarize();
 
     printk("My life for Super Earth!\n");
     // lab2:
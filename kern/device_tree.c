@@ -2,6 +2,7 @@
 #include "types.h"
 #include <device_tree.h>
 #include <endian.h>
+#include <error.h>
 #include <kmalloc.h>
 #include <printk.h>
 #include <string.h>
@@ -595,4 +596,227 @@ int get_reg_item(struct device_node *node, uint32_t idx, u_reg_t *address,
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+// 从`ptr`处读取`cells`个大端序32位数，组合为一个数
+// 注意：FDT中的值只保证4字节对齐，故不能直接按64位读取
+static u_reg_t fdt_read_cells(const uint32_t *ptr, uint32_t cells) {
+    u_reg_t result = 0;
+
+    for (uint32_t i = 0; i < cells; i++) {
+        result = (result << 32) | be32toh(ptr[i]);
+    }
+
+    return result;
+}
+
+// 将`reg`属性中的所有区域追加到`list`中
+static void fdt_append_reg(const uint32_t *reg, uint32_t reg_len,
+                           uint32_t address_cells, uint32_t size_cells,
+                           struct memory_region *list, size_t max_count,
+                           size_t *count) {
+    uint32_t item_len = (address_cells + size_cells) * sizeof(uint32_t);
+
+    if (item_len == 0 || address_cells > 2 || size_cells > 2) {
+        debugk("fdt_scan_memory",
+               "unsupported cells count: address %u size %u\n", address_cells,
+               size_cells);
+        return;
+    }
+
+    for (uint32_t offset = 0; offset + item_len <= reg_len;
+         offset += item_len) {
+        const uint32_t *item = reg + offset / sizeof(uint32_t);
+
+        u_reg_t address = fdt_read_cells(item, address_cells);
+        u_reg_t size = fdt_read_cells(item + address_cells, size_cells);
+
+        if (size == 0) {
+            continue;
+        }
+
+        if (*count >= max_count) {
+            debugk("fdt_scan_memory",
+                   "too many regions, ignore 0x%016lx - 0x%016lx\n", address,
+                   address + size);
+            continue;
+        }
+
+        list[*count].begin = address;
+        list[*count].end = address + size;
+        (*count)++;
+    }
+}
+
+// `fdt_scan_memory`中节点的分类
+#define FDT_NODE_OTHER 0
+#define FDT_NODE_MEMORY 1
+#define FDT_NODE_RESERVED_MEMORY 2
+#define FDT_NODE_RESERVED_CHILD 3
+
+int fdt_scan_memory(const void *begin, struct memory_region *memory_list,
+                    size_t max_memory_count, size_t *memory_count,
+                    struct memory_region *reserved_list,
+                    size_t max_reserved_count, size_t *reserved_count) {
+    const struct fdt_header *header = (const struct fdt_header *)begin;
+
+    *memory_count = 0;
+    *reserved_count = 0;
+
+    if (be32toh(header->magic) != FDT_MAGIC) {
+        debugk("fdt_scan_memory", "invalid fdt magic: 0x%08x\n",
+               be32toh(header->magic));
+        return -E_INVAL;
+    }
+
+    /* Step 1: Memory reservation block. */
+    const struct fdt_reserve_entry *reserve_entry =
+        (const struct fdt_reserve_entry *)((size_t)begin +
+                                           be32toh(header->off_mem_rsvmap));
+
+    // 保留内存表中的条目可能未8字节对齐，按32位读取
+    while (1) {
+        u_reg_t address = fdt_read_cells((const uint32_t *)reserve_entry, 2);
+        u_reg_t size = fdt_read_cells((const uint32_t *)reserve_entry + 2, 2);
+
+        if (address == 0 && size == 0) {
+            break;
+        }
+
+        if (*reserved_count < max_reserved_count) {
+            reserved_list[*reserved_count].begin = address;
+            reserved_list[*reserved_count].end = address + size;
+            (*reserved_count)++;
+        }
+
+        reserve_entry++;
+    }
+
+    /* Step 2: Walk the structure block. */
+    const char *struct_ptr =
+        (const char *)((size_t)begin + be32toh(header->off_dt_struct));
+    const char *string_ptr =
+        (const char *)((size_t)begin + be32toh(header->off_dt_strings));
+
+    // 以下数组均以节点深度为下标，根节点深度为0
+    // 节点为其子节点定义的`#address-cells`、`#size-cells`
+    uint32_t address_cells[MAX_STACK_DEPTH];
+    uint32_t size_cells[MAX_STACK_DEPTH];
+    // 节点的分类
+    int node_kind[MAX_STACK_DEPTH];
+    // 节点的`reg`属性，在节点结束时处理（`reg`可能先于`device_type`出现）
+    const uint32_t *reg[MAX_STACK_DEPTH];
+    uint32_t reg_len[MAX_STACK_DEPTH];
+
+    // 当前节点的深度 + 1，为0表示尚未进入根节点
+    size_t depth = 0;
+
+    const char *current_ptr = struct_ptr;
+
+    while (1) {
+        uint32_t current_token = be32toh(*(const uint32_t *)current_ptr);
+
+        current_ptr += sizeof(uint32_t);
+
+        const char *name = NULL;
+        const struct fdt_prop_header *prop_header = NULL;
+        size_t d = 0;
+
+        switch (current_token) {
+        case 0:
+            // padding
+            break;
+        case FDT_BEGIN_NODE:
+            name = current_ptr;
+
+            current_ptr += strlen(name) + 1;
+            current_ptr = (const char *)(ROUND((size_t)current_ptr, 4));
+
+            if (depth >= MAX_STACK_DEPTH) {
+                debugk("fdt_scan_memory", "Device tree to deep!\n");
+                return -E_INVAL;
+            }
+
+            d = depth;
+
+            address_cells[d] = 2;
+            size_cells[d] = 1;
+            reg[d] = NULL;
+            reg_len[d] = 0;
+            node_kind[d] = FDT_NODE_OTHER;
+
+            if (d == 1 && is_type_equal(name, "memory")) {
+                node_kind[d] = FDT_NODE_MEMORY;
+            } else if (d == 1 && is_type_equal(name, "reserved-memory")) {
+                node_kind[d] = FDT_NODE_RESERVED_MEMORY;
+            } else if (d == 2 &&
+                       node_kind[d - 1] == FDT_NODE_RESERVED_MEMORY) {
+                node_kind[d] = FDT_NODE_RESERVED_CHILD;
+            }
+
+            depth++;
+            break;
+        case FDT_END_NODE:
+            if (depth == 0) {
+                debugk("fdt_scan_memory", "unbalanced FDT_END_NODE\n");
+                return -E_INVAL;
+            }
+
+            depth--;
+            d = depth;
+
+            if (reg[d] != NULL && d > 0) {
+                if (node_kind[d] == FDT_NODE_MEMORY) {
+                    fdt_append_reg(reg[d], reg_len[d], address_cells[d - 1],
+                                   size_cells[d - 1], memory_list,
+                                   max_memory_count, memory_count);
+                } else if (node_kind[d] == FDT_NODE_RESERVED_CHILD) {
+                    fdt_append_reg(reg[d], reg_len[d], address_cells[d - 1],
+                                   size_cells[d - 1], reserved_list,
+                                   max_reserved_count, reserved_count);
+                }
+            }
+            break;
+        case FDT_PROP:
+            prop_header = (const struct fdt_prop_header *)current_ptr;
+
+            uint32_t prop_len = be32toh(prop_header->len);
+            const char *prop_name =
+                string_ptr + be32toh(prop_header->nameoff);
+            const uint32_t *value =
+                (const uint32_t *)(current_ptr + sizeof(struct fdt_prop_header));
+
+            current_ptr += sizeof(struct fdt_prop_header) + prop_len;
+            current_ptr = (const char *)(ROUND((size_t)current_ptr, 4));
+
+            if (depth == 0) {
+                debugk("fdt_scan_memory",
+                       "No current node when encounter FDT_PROP\n");
+                return -E_INVAL;
+            }
+
+            d = depth - 1;
+
+            if (strcmp(prop_name, "#address-cells") == 0) {
+                address_cells[d] = be32toh(*value);
+            } else if (strcmp(prop_name, "#size-cells") == 0) {
+                size_cells[d] = be32toh(*value);
+            } else if (strcmp(prop_name, "reg") == 0) {
+                reg[d] = value;
+                reg_len[d] = prop_len;
+            } else if (strcmp(prop_name, "device_type") == 0 && d == 1 &&
+                       strcmp((const char *)value, "memory") == 0) {
+                node_kind[d] = FDT_NODE_MEMORY;
+            }
+            break;
+        case FDT_NOP:
+            break;
+        case FDT_END:
+            return 0;
+        default:
+            debugk("fdt_scan_memory", "invalid token: 0x%08x\n",
+                   current_token);
+            return -E_INVAL;
+        }
+    }
+}
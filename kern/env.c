@@ -2,12 +2,17 @@
 #include <elf.h>
 #include <env.h>
 #include <error.h>
+#include <group.h>
+#include <kmalloc.h>
 #include <mmu.h>
 #include <pmap.h>
 #include <printk.h>
 #include <queue.h>
 #include <sched.h>
+#include <string.h>
+#include <timer.h>
 #include <types.h>
+#include <userspace.h>
 
 // 所有Env组成的列表，静态分配(bss段)
 struct Env envs[NENV] __attribute__((aligned(PAGE_SIZE))); // All environments
@@ -16,50 +21,100 @@ struct Env *curenv = NULL; // 当前正在运行的环境，由`env_run`修改
 static struct Env_list
     env_free_list; // 空闲Env链表，只应含有`ENV_FREE`状态的Env，由`env_init`初始化
 
-// Invariant: 'env' in 'env_sched_list' iff. 'env->env_status' is 'RUNNABLE'.
-// 调度队列，只应含有`ENV_RUNNABLE`状态的Env，由`env_init`初始化
-// 调度队列头部的进程将在下次进程上下文切换时（schedule函数）运行
-struct Env_sched_list env_sched_list;
-
 static Pte *
     base_pgdir; // 用户程序页目录模板，含有`pages`、`envs`的只读映射，由`env_init`初始化
 
-static uint32_t asid_bitmap[NASID / 32] = {
-    0}; // 每一位表示对应的ASID的占用情况，1表示占用，静态初始化为0
+// 镜像页缓存中的一项：某个二进制镜像中，加载到虚拟地址`va`处的一页的内容
+struct IcodeFrame {
+    const void *binary;
+    u_reg_t va;
+    struct Page *pp;
+    LIST_ENTRY(IcodeFrame) link;
+};
+
+LIST_HEAD(IcodeFrame_list, IcodeFrame);
+
+// 镜像页缓存：按(binary, va)散列
+static struct IcodeFrame_list icode_cache[ICODE_CACHE_BUCKETS];
+
+// 镜像页缓存的统计：缓存的页数，查找命中及未命中的次数，释放的页数
+static size_t icode_cache_frames = 0;
+static size_t icode_cache_hits = 0;
+static size_t icode_cache_misses = 0;
+static size_t icode_cache_released = 0;
+
+// 共享用户库（user/ulib.b），嵌入在内核中；未链接时为NULL
+extern u_char binary_user_ulib_start[] __attribute__((weak));
+extern u_int binary_user_ulib_size __attribute__((weak));
+
+// 映射到每个进程的[ULIB, ULIB + ULIB_SIZE)中的共享用户库镜像，由`env_init`初始化
+static const void *ulib_binary = NULL;
+
+static const Elf64_Ehdr *icode_check(const void *binary, size_t size,
+                                     u_reg_t begin, u_reg_t end);
+
+// ASID分配采用“代”（generation）方案：
+// - 每个Env记录其ASID所属的代，只有属于当前代的ASID才有效
+// - 在一代中，ASID从1开始（0保留给内核启动页表）依次分配，Env被释放时不归还
+// - ASID耗尽时，进入新的一代并刷新整个TLB，已有Env的ASID全部失效，
+//   在下次运行（`env_run`）时重新分配
+// 从而可运行的Env数目不受ASID数目限制，且同一代中的Env切换时无需刷新TLB
+
+// 硬件支持的最大ASID，由`asid_init`探测
+static uint16_t asid_max = 0;
+// 当前代，从1开始，从而Env结构体中清零的代必然已失效
+static uint64_t asid_generation = 1;
+// 当前代中下一个待分配的ASID
+static uint32_t asid_next = 1;
+
+// 当前代的起始ASID：不支持ASID时，所有Env共用ASID 0
+static inline uint32_t asid_first(void) {
+    return asid_max == 0 ? 0 : 1;
+}
 
-/* Overview:
- *  Allocate an unused ASID.
+/*
+ * 概述：
+ *   通过satp探测硬件实现的ASID位数，初始化ASID分配状态。
  *
- * Post-Condition:
- *   return 0 and set '*asid' to the allocated ASID on success.
- *   return -E_NO_FREE_ENV if no ASID is available.
+ * Precondition：
+ * - 内核页表已启用
  */
-static int asid_alloc(uint16_t *asid) {
-    for (uint16_t i = 0; i < NASID; ++i) {
-        uint16_t index = (uint16_t)(i >> 5);
-        uint16_t inner = (uint16_t)(i & 31);
-        if ((asid_bitmap[index] & (1 << inner)) == 0) {
-            asid_bitmap[index] |= 1 << inner;
-            *asid = i;
-            return 0;
-        }
-    }
-    return -E_NO_FREE_ENV;
+static void asid_init(void) {
+    asid_max = asid_probe_max();
+    asid_generation = 1;
+    asid_next = asid_first();
+
+    printk("asid_init: max asid = %u\n", (u_int)asid_max);
 }
 
-/* Overview:
- *  Free an ASID.
+/*
+ * 概述：
+ *   确保Env `e`持有当前代的ASID，否则为其分配一个新的ASID。
+ *   若当前代的ASID已耗尽，进入新的一代并刷新整个TLB。
  *
- * Pre-Condition:
- *  The ASID is allocated by 'asid_alloc'.
+ * Postcondition：
+ * - `e->env_asid`在当前代中唯一
  *
- * Post-Condition:
- *  The ASID is freed and may be allocated again later.
+ * 副作用：
+ * - 可能修改ASID分配状态
+ * - 进入新的一代时刷新整个TLB
  */
-static void asid_free(uint16_t asid) {
-    uint16_t index = (uint16_t)(asid >> 5);
-    uint16_t inner = (uint16_t)(asid & 31);
-    asid_bitmap[index] &= (uint32_t)(~(1 << inner));
+void env_asid_refresh(struct Env *e) {
+    if (e->env_asid_generation == asid_generation) {
+        return;
+    }
+
+    if (asid_next > asid_max) {
+        asid_generation++;
+        asid_next = asid_first();
+
+        tlb_flush_all();
+
+        debugk("env_asid_refresh", "asid generation %lu\n", asid_generation);
+    }
+
+    e->env_asid = (uint16_t)asid_next++;
+    e->env_asid_generation = asid_generation;
 }
 
 /*
@@ -237,7 +292,20 @@ void env_init(void) {
     /* Exercise 3.1: Your code here. (1/2) */
 
     LIST_INIT(&env_free_list);
-    TAILQ_INIT(&env_sched_list);
+    sched_init();
+    group_init();
+
+    for (size_t i = 0; i < ICODE_CACHE_BUCKETS; i++) {
+        LIST_INIT(&icode_cache[i]);
+    }
+
+    if (binary_user_ulib_start != NULL) {
+        icode_check(binary_user_ulib_start, binary_user_ulib_size, ULIB,
+                    ULIB + ULIB_SIZE);
+        ulib_binary = binary_user_ulib_start;
+    }
+
+    asid_init();
 
     /* Step 2: Traverse the elements of 'envs' array, set their status to
      * 'ENV_FREE' and insert them into the 'env_free_list'. Make sure, after the
@@ -271,7 +339,7 @@ void env_init(void) {
     // 将内核空间的映射复制到模板中
     memcpy(base_pgdir + P1X(HIGH_ADDR_IMM),
            kernel_boot_pgdir + P1X(HIGH_ADDR_IMM),
-           0x1FF - P1X(HIGH_ADDR_IMM) + 1);
+           sizeof(Pte) * (0x1FF - P1X(HIGH_ADDR_IMM) + 1));
 
     // 映射Pages区域
     map_segment(base_pgdir, 0, PADDR(pages), UPAGES,
@@ -321,6 +389,8 @@ static int env_setup_vm(struct Env *e) {
     /* Exercise 3.3: Your code here. */
 
     p->pp_ref++;
+    // 记录页目录所属的进程，映射的物理页据此计入其资源组（见`pgdir_charge`）
+    p->pp_next = (uint32_t)(e - envs) + 1;
 
     e->env_pgdir = (Pte *)page2kva(p);
 
@@ -335,9 +405,10 @@ static int env_setup_vm(struct Env *e) {
            sizeof(Pte) * (P1X(UVPT) - P1X(UTOP)));
 
     // 将内核空间的映射复制到每个用户进程中
+    // 内核共享区域的一级页表项指向预先分配的二级页表，从而所有进程共享这些二级页表
     memcpy(e->env_pgdir + P1X(HIGH_ADDR_IMM),
            kernel_boot_pgdir + P1X(HIGH_ADDR_IMM),
-           0x1FF - P1X(HIGH_ADDR_IMM) + 1);
+           sizeof(Pte) * (0x1FF - P1X(HIGH_ADDR_IMM) + 1));
 
     return 0;
 }
@@ -355,7 +426,6 @@ static int env_setup_vm(struct Env *e) {
  * - 'env_init'必须已被调用，以初始化Env相关数据结构
  * - 全局变量'env_free_list'必须包含有效的空闲Env链表
  * - 全局变量'envs'数组必须已正确初始化
- * - 'asid_alloc'依赖的ASID管理数据结构必须已初始化（`asid_bitmap`）
  *
  * Postcondition：
  * - 成功时返回0，新Env的以下字段被初始化：
@@ -364,12 +434,10 @@ static int env_setup_vm(struct Env *e) {
  * - 失败时返回错误码：
  *   -E_NO_FREE_ENV：无空闲Env可用
  *   -E_NO_MEM：内存分配失败（env_setup_vm）
- *   -E_NO_FREE_ENV：ASID分配失败（asid_alloc）
  *   失败时目标Env不会从空闲链表移除
  *
  * 副作用：
  * - 成功时修改全局变量'env_free_list'（移除分配的Env）
- * - 成功时可能修改ASID分配状态（通过asid_alloc）
  * - 成功时可能修改物理页管理状态（通过env_setup_vm分配页目录）
  */
 int env_alloc(struct Env **new, u_int parent_id) {
@@ -400,8 +468,8 @@ int env_alloc(struct Env **new, u_int parent_id) {
      * 'env_asid' (lab3), 'env_parent_id' (lab3)
      *
      * Hint:
-     *   Use 'asid_alloc' to allocate a free asid.
      *   Use 'mkenvid' to allocate a free envid.
+     *   The ASID is allocated lazily by 'env_asid_refresh' in 'env_run'.
      */
     e->env_user_tlb_mod_entry = 0; // for lab4
     e->env_runs = 0;               // for lab6
@@ -409,14 +477,44 @@ int env_alloc(struct Env **new, u_int parent_id) {
 
     e->env_id = mkenvid(e);
 
-    r = asid_alloc(&e->env_asid);
-
-    if (r < 0) {
-        return r;
-    }
+    // 新Env的ASID尚未分配：代0必然已失效
+    e->env_asid = 0;
+    e->env_asid_generation = 0;
+    e->env_teardown_time = 0;
+    e->env_fork_flags = 0;
+    e->env_cow_copy = 0;
+    e->env_cow_reuse = 0;
+    e->env_fault_around_max = 1;
+    e->env_fault_around = 1;
+    e->env_fault_around_begin = 0;
+    e->env_fault_around_end = 0;
+    e->env_binary = NULL;
+    e->env_sched_level = SCHED_LEVEL_DEFAULT;
+    e->env_user_time = 0;
+    e->env_kernel_time = 0;
+    // 加入调度队列时提高到当前的最小值，见`sched_insert_tail`
+    e->env_vruntime = 0;
+    e->env_slice_used = 0;
+    e->env_edf_period = 0;
+    e->env_edf_budget = 0;
+    e->env_edf_deadline = 0;
+    e->env_edf_remaining = 0;
+    e->env_edf_done = 0;
+    e->env_edf_release = 0;
+    e->env_edf_misses = 0;
+    e->env_edf_throttles = 0;
+    // 进程释放时已取消其定时器，`env_timer_slot`为0
+    e->env_wakeup_time = 0;
 
     e->env_parent_id = parent_id;
 
+    // 由当前进程创建的子进程（fork、spawn）继承其资源组
+    if (parent_id != 0 && curenv != NULL && curenv->env_id == parent_id) {
+        group_join(e, curenv->env_group);
+    } else {
+        group_join(e, GROUP_ROOT);
+    }
+
     e->env_in_syscall = 0;
     e->handler_function_va = 0;
     e->env_ipc_recv_from = 0;
@@ -448,7 +546,8 @@ int env_alloc(struct Env **new, u_int parent_id) {
     e->env_tf.sie = SIE_STIE | SIE_SEIE;
 
     // 初始化sp寄存器（regs[2]），在栈顶为'argc'、'argv'参数预留空间
-    e->env_tf.regs[2] = USTACKTOP - sizeof(int) - sizeof(char **);
+    // 二者各占 8 字节，从而sp按 16 字节对齐（见`user/lib/entry.S`）
+    e->env_tf.regs[2] = USTACKTOP - 2 * sizeof(u_reg_t);
 
     /* Step 5: Remove the new Env from env_free_list. */
     /* Exercise 3.4: Your code here. (4/4) */
@@ -459,116 +558,405 @@ int env_alloc(struct Env **new, u_int parent_id) {
     return 0;
 }
 
-/* 概述:
- *   （含 TLB 操作）映射`env`对应的用户地址空间中的一页。
- *    将页权限设置为`perm | PTE_V`。
- *    若`src`不为空，将`src`起始，长度为`len`的数据复制到页中偏移量为`offset`的位置。
+static inline u_int icode_cache_hash(const void *binary, u_reg_t va) {
+    return (u_int)((((u_reg_t)binary >> 4) ^ (va >> PAGE_SHIFT)) %
+                   ICODE_CACHE_BUCKETS);
+}
+
+/*
+ * 概述：
+ *   查找`binary`中加载到页对齐的虚拟地址`va`处的页的内容，未缓存时分配新的物理页，
+ *   将覆盖该页的所有PT_LOAD段的文件内容复制到页中，其余部分为0，并加入缓存。
  *
- * Precondition:
- * - 'offset + len'不能大于'PAGE_SIZE' (由调用者保证)
- * - 每次调用必须传入对应**不同的的页**虚拟地址`va` (由调用者保证)
- * - `data` 必须指向有效的`struct Env`实例（即env结构体）
- * - `perm` 参数不得包含 PTE_V（由函数显式添加）
- * - 全局变量`page_free_list`必须为合法的空闲物理页链表
+ *   缓存中的页设置`PAGE_FLAG_PINNED`，从而映射该页的进程均退出后，该页仍可被之后创建的进程复用，
+ *   直到运行`binary`的进程均退出时由`icode_cache_release`释放；
+ *   缓存中的页不可被写入，可写段的页以CoW方式映射（见`pinned_page_privatize`）。
  *
- * Postcondition:
- * - 成功时返回0：
- *   - 物理页被插入到`env->env_pgdir`的`va`处
- *   - 若`src`不为NULL，数据被复制到物理页的`offset`位置
- *   - 页表项权限为`perm | PTE_V`
- * - 失败时返回错误码：
- *   - E_NO_MEM: 物理页分配失败、页表项分配失败
+ * Postcondition：
+ * - 成功时返回 0，`*out`为缓存的物理页
+ * - 内存不足时返回-E_NO_MEM
+ */
+static int icode_cache_get(const void *binary, u_reg_t va,
+                           struct Page **out) {
+    struct IcodeFrame_list *bucket = &icode_cache[icode_cache_hash(binary, va)];
+    struct IcodeFrame *frame;
+
+    LIST_FOREACH(frame, bucket, link) {
+        if (frame->binary == binary && frame->va == va) {
+            icode_cache_hits++;
+            *out = frame->pp;
+            return 0;
+        }
+    }
+
+    if ((frame = kmalloc(sizeof(struct IcodeFrame))) == NULL) {
+        return -E_NO_MEM;
+    }
+
+    struct Page *pp = NULL;
+
+    if (page_alloc(&pp) < 0) {
+        kfree(frame);
+        return -E_NO_MEM;
+    }
+
+    const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)binary;
+    size_t ph_off;
+
+    ELF_FOREACH_PHDR_OFF(ph_off, ehdr) {
+        Elf64_Phdr *ph = (Elf64_Phdr *)((size_t)binary + ph_off);
+
+        if (ph->p_type != PT_LOAD) {
+            continue;
+        }
+
+        u_reg_t file_begin = MAX(va, ph->p_vaddr);
+        u_reg_t file_end = MIN(va + PAGE_SIZE, ph->p_vaddr + ph->p_filesz);
+
+        if (file_begin < file_end) {
+            memcpy((void *)(page2kva(pp) + (file_begin - va)),
+                   (void *)((size_t)binary + ph->p_offset +
+                            (file_begin - ph->p_vaddr)),
+                   file_end - file_begin);
+        }
+    }
+
+    pp->pp_flags |= PAGE_FLAG_PINNED;
+
+    frame->binary = binary;
+    frame->va = va;
+    frame->pp = pp;
+    LIST_INSERT_HEAD(bucket, frame, link);
+
+    icode_cache_frames++;
+    icode_cache_misses++;
+
+    *out = pp;
+    return 0;
+}
+
+/*
+ * 概述：
+ *   合并镜像`binary`中覆盖页对齐的`page_va`处的页的所有PT_LOAD段的权限。
  *
- * 副作用：
- * - 可能修改全局变量`page_free_list`（通过page_alloc）
- * - 可能修改页表`env->env_pgdir`的内容
- * - 可能修改物理页`pp`的引用计数（通过page_insert）
- * - 可能使TLB条目失效（通过page_insert）
+ * Postcondition：
+ * - 返回该页的权限，`page_va`不在任何PT_LOAD段中时返回 0
+ * - `has_file`不为NULL时，`*has_file`表示该页是否含有文件内容
  */
-static int load_icode_mapper(void *data, u_long va, size_t offset, u_int perm,
-                             const void *src, size_t len) {
-    struct Env *env = (struct Env *)data;
-    struct Page *p;
-    int r;
+static uint32_t image_page_perm(const void *binary, u_reg_t page_va,
+                                int *has_file) {
+    const Elf64_Ehdr *ehdr = (const Elf64_Ehdr *)binary;
+    uint32_t perm = 0;
+    size_t ph_off;
+
+    if (has_file != NULL) {
+        *has_file = 0;
+    }
+
+    ELF_FOREACH_PHDR_OFF(ph_off, ehdr) {
+        Elf64_Phdr *ph = (Elf64_Phdr *)((size_t)binary + ph_off);
+
+        if (ph->p_type != PT_LOAD || page_va >= ph->p_vaddr + ph->p_memsz ||
+            page_va + PAGE_SIZE <= ph->p_vaddr) {
+            continue;
+        }
+
+        perm |= PTE_R | PTE_USER;
+
+        if (ph->p_flags & PF_W) {
+            perm |= PTE_W;
+        }
+
+        if (ph->p_flags & PF_X) {
+            perm |= PTE_X;
+        }
+
+        if (has_file != NULL && page_va < ph->p_vaddr + ph->p_filesz) {
+            *has_file = 1;
+        }
+    }
+
+    return perm;
+}
+
+/*
+ * 概述：
+ *   （含 TLB 操作）若页对齐前的`va`位于镜像`binary`的某个PT_LOAD段中，将对应的页映射到进程`e`中，
+ *   只读段的页额外设置`ro_perm`。
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - `va`不在任何PT_LOAD段中时返回-E_INVAL
+ * - 内存不足时返回-E_NO_MEM
+ * - 超出`e`所在资源组的物理页限制时返回-E_QUOTA（只可能发生在无法分配全局零页时）
+ */
+static int image_fault(struct Env *e, const void *binary, u_reg_t va,
+                       uint32_t ro_perm) {
+    u_reg_t page_va = ROUNDDOWN(va, PAGE_SIZE);
+    int has_file = 0;
+    uint32_t perm = image_page_perm(binary, page_va, &has_file);
+
+    if (perm == 0) {
+        return -E_INVAL;
+    }
+
+    struct Page *pp = NULL;
+
+    if (has_file) {
+        try(icode_cache_get(binary, page_va, &pp));
+    } else if ((pp = zero_page_get()) == NULL) {
+        // 只含.bss的页映射全局零页；无法分配零页时，直接分配已清零的页
+        try(page_alloc(&pp));
 
-    /* Step 1: Allocate a page with 'page_alloc'. */
-    /* Exercise 3.5: Your code here. (1/2) */
+        int r = page_insert(e->env_pgdir, e->env_asid, pp, page_va, perm);
 
-    r = page_alloc(&p);
+        if (r < 0) {
+            page_free(pp);
+        }
 
-    if (r < 0) {
         return r;
     }
 
-    /* Step 2: If 'src' is not NULL, copy the 'len' bytes started at 'src' into
-     * 'offset' at this page. */
-    // Hint: You may want to use 'memcpy'.
-    if (src != NULL) {
-        /* Exercise 3.5: Your code here. (2/2) */
+    // 可写段的页初始内容与缓存相同，首次写入时由`cow_fault`复制
+    if ((perm & PTE_W) != 0) {
+        perm = (perm & ~PTE_W) | PTE_COW;
+    } else {
+        perm |= ro_perm;
+    }
 
-        memcpy((void *)(page2kva(p) + offset), src, len);
+    return page_insert(e->env_pgdir, e->env_asid, pp, page_va, perm);
+}
+
+/*
+ * 概述：
+ *   从镜像页缓存中移除`binary`的所有页：仍被映射的页成为普通的页，由最后一个引用释放，
+ *   其余的页立即释放。在运行`binary`的最后一个进程退出时调用。
+ *
+ *   共享用户库被所有进程映射，其页不会被释放。
+ */
+static void icode_cache_release(const void *binary) {
+    for (u_int i = 0; i < ICODE_CACHE_BUCKETS; i++) {
+        struct IcodeFrame *frame = LIST_FIRST(&icode_cache[i]);
+
+        while (frame != NULL) {
+            struct IcodeFrame *next = LIST_NEXT(frame, link);
+
+            if (frame->binary == binary) {
+                struct Page *pp = frame->pp;
+
+                pp->pp_flags &= ~PAGE_FLAG_PINNED;
+
+                if (pp->pp_ref == 0) {
+                    page_free(pp);
+                }
+
+                LIST_REMOVE(frame, link);
+                kfree(frame);
+
+                icode_cache_frames--;
+                icode_cache_released++;
+            }
+
+            frame = next;
+        }
     }
+}
 
-    /* Step 3: Insert 'p' into 'env->env_pgdir' at 'va' with 'perm'. */
-    return page_insert(env->env_pgdir, env->env_asid, p, va, perm);
+// 除`e`外，是否还有进程运行镜像`binary`
+static int icode_in_use(struct Env *e, const void *binary) {
+    for (u_int i = 0; i < NENV; i++) {
+        if (&envs[i] != e && envs[i].env_status != ENV_FREE &&
+            envs[i].env_binary == binary) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int env_image_fault(struct Env *e, u_reg_t va) {
+    if (e->env_binary != NULL) {
+        int r = image_fault(e, e->env_binary, va, 0);
+
+        if (r != -E_INVAL) {
+            return r;
+        }
+    }
+
+    // 共享用户库的代码在fork时也保持共享（PTE_LIBRARY）
+    if (ulib_binary != NULL && va >= ULIB && va < ULIB + ULIB_SIZE) {
+        return image_fault(e, ulib_binary, va, PTE_LIBRARY);
+    }
+
+    return -E_INVAL;
+}
+
+int env_image_contains(struct Env *e, u_reg_t va) {
+    u_reg_t page_va = ROUNDDOWN(va, PAGE_SIZE);
+
+    if (e->env_binary != NULL &&
+        image_page_perm(e->env_binary, page_va, NULL) != 0) {
+        return 1;
+    }
+
+    return ulib_binary != NULL && va >= ULIB && va < ULIB + ULIB_SIZE &&
+           image_page_perm(ulib_binary, page_va, NULL) != 0;
+}
+
+void icode_cache_summarize(void) {
+    debugk("icode_cache_summarize",
+           "frames = %lu hits = %lu misses = %lu released = %lu\n",
+           icode_cache_frames, icode_cache_hits, icode_cache_misses,
+           icode_cache_released);
+}
+
+/*
+ * 概述：
+ *   校验ELF可执行镜像`binary`：程序头表及所有PT_LOAD段的文件内容均位于镜像内，
+ *   且所有PT_LOAD段均位于[begin, end)中。
+ *
+ * Postcondition：
+ * - 返回镜像的ELF头
+ *
+ * Panics：
+ * - 校验失败
+ */
+static const Elf64_Ehdr *icode_check(const void *binary, size_t size,
+                                     u_reg_t begin, u_reg_t end) {
+    /* Step 1: Use 'elf_from' to parse an ELF header from 'binary'. */
+    const Elf64_Ehdr *ehdr = elf_from(binary, size);
+    if (!ehdr) {
+        panic("bad elf at %x", binary);
+    }
+
+    if (ehdr->e_phoff + (size_t)ehdr->e_phnum * ehdr->e_phentsize > size) {
+        panic("bad program headers in elf at %x", binary);
+    }
+
+    /* Step 2: Check the loadable segments using 'ELF_FOREACH_PHDR_OFF'. The
+     * pages are mapped lazily by 'env_image_fault'.
+     */
+    size_t ph_off;
+    ELF_FOREACH_PHDR_OFF(ph_off, ehdr) {
+        Elf64_Phdr *ph = (Elf64_Phdr *)((size_t)binary + ph_off);
+        if (ph->p_type == PT_LOAD) {
+            if (ph->p_offset + ph->p_filesz > size ||
+                ph->p_filesz > ph->p_memsz || ph->p_vaddr < begin ||
+                ph->p_vaddr + ph->p_memsz > end) {
+                panic("bad segment in elf at %x", binary);
+            }
+        }
+    }
+
+    return ehdr;
 }
 
 /*
  * 概述：
- *   将 ELF 可执行镜像加载到用户环境 'e' 的地址空间中。
- *   解析 ELF 文件头，加载所有可加载段（PT_LOAD）到用户空间，并设置入口地址。
+ *   将 ELF 可执行镜像关联到用户环境 'e'，并设置入口地址，只解析文件头及程序头表，
+ *   不分配、不映射任何页。
  *   具体步骤包括：
  *     1. 验证并解析 ELF 头。
- *     2. 遍历程序头表，加载所有类型为 PT_LOAD 的段。
- *     3. 设置用户环境的入口地址：保存到进程上下文的EPC寄存器中，以便`sret`后
+ *     2. 检查所有类型为 PT_LOAD 的段均位于镜像内、且位于[UTEMP, ULIB)中。
+ *     3. 记录镜像`binary`，各段的页在首次访问时由`env_image_fault`映射。
+ *     4. 设置用户环境的入口地址：保存到进程上下文的EPC寄存器中，以便`sret`后
  *        从此处开始执行。
  *
  * Precondition：
  * - `binary` 必须指向有效的 ELF 可执行文件（e_type 为 ET_EXEC），且通过
  * `elf_from` 的校验。
  * - `size` 为ELF 可执行文件的大小。
+ * - `binary` 在进程及其子进程的整个生命周期中保持有效（如内核镜像中嵌入的二进制文件）。
  * - 环境 `e` 必须已通过 `env_alloc` 分配。
- * - 全局物理页管理器（如 `page_free_list`）处于有效状态，能够分配所需物理页。
  *
  * Postcondition：
- * - ELF 文件中的所有 PT_LOAD 段被加载到用户空间的对应虚拟地址。
+ * - `e->env_binary`为`binary`。
  * - 用户环境 `e` 的寄存器上下文中EPC（`e->env_tf.cp0_epc`） 被设置为 ELF
  * 头的入口地址 `ehdr->e_entry`。
- * - 用户环境的页目录 `e->env_pgdir` 包含新加载段的映射关系。
  *
  * 副作用：
- * - 修改用户环境 `e`
- * 的页目录和页表、寄存器上下文（EPC），可能分配新的物理页（通过
- * `load_icode_mapper`）。
- * - 修改全局物理页管理结构（如 `page_free_list` 的物理页被分配）。
- * - 若 ELF 校验失败（如魔数错误或非可执行类型），触发 panic。
+ * - 修改用户环境 `e` 的寄存器上下文（EPC）。
+ * - 若 ELF 校验失败（如魔数错误、非可执行类型或段超出镜像），触发 panic。
  */
 static void load_icode(struct Env *e, const void *binary, size_t size) {
-    /* Step 1: Use 'elf_from' to parse an ELF header from 'binary'. */
-    const Elf64_Ehdr *ehdr = elf_from(binary, size);
-    if (!ehdr) {
-        panic("bad elf at %x", binary);
+    // 程序不可覆盖共享用户库
+    const Elf64_Ehdr *ehdr = icode_check(binary, size, UTEMP, ULIB);
+
+    e->env_binary = binary;
+
+    /* Step 3: Set 'e->env_tf.cp0_epc' to 'ehdr->e_entry'. */
+    /* Exercise 3.6: Your code here. */
+    e->env_tf.sepc = ehdr->e_entry;
+}
+
+/* 概述:
+ *   （含 TLB 操作）`load_icode_user`的`elf_mapper_t`回调：分配已清零的物理页，
+ *   将当前进程地址空间中`src`起始，长度为`len`的数据复制到页中偏移量为`offset`的位置，
+ *   并映射到`data`对应的进程中的`va`处。
+ *
+ * Postcondition:
+ * - 成功时返回0
+ * - 失败时返回-E_NO_MEM或-E_QUOTA（超出`data`对应的进程的资源组的物理页限制），
+ *   此时不会泄漏物理页
+ */
+static int load_icode_user_mapper(void *data, u_long va, size_t offset,
+                                  u_int perm, const void *src, size_t len) {
+    struct Env *env = (struct Env *)data;
+    struct Page *p;
+    int r;
+
+    try(page_alloc(&p));
+
+    if (src != NULL) {
+        copy_user_space(src, (void *)(page2kva(p) + offset), len);
+    }
+
+    if ((r = page_insert(env->env_pgdir, env->env_asid, p, va, perm)) < 0) {
+        page_free(p);
+        return r;
+    }
+
+    return 0;
+}
+
+int load_icode_user(struct Env *e, u_reg_t binary, size_t size) {
+    Elf64_Ehdr ehdr;
+    Elf64_Phdr ph;
+
+    if (size < sizeof(Elf64_Ehdr)) {
+        return -E_INVAL;
+    }
+
+    copy_user_space((void *)binary, &ehdr, sizeof(Elf64_Ehdr));
+
+    if (elf_from(&ehdr, size) == NULL ||
+        ehdr.e_phoff + (size_t)ehdr.e_phnum * ehdr.e_phentsize > size ||
+        ehdr.e_phentsize < sizeof(Elf64_Phdr)) {
+        return -E_INVAL;
     }
 
-    /* Step 2: Load the segments using 'ELF_FOREACH_PHDR_OFF' and
-     * 'elf_load_seg'. As a loader, we just care about loadable segments, so
-     * parse only program headers here.
-     */
     size_t ph_off;
-    ELF_FOREACH_PHDR_OFF(ph_off, ehdr) {
-        Elf64_Phdr *ph = (Elf64_Phdr *)((size_t)binary + ph_off);
-        if (ph->p_type == PT_LOAD) {
-            // 'elf_load_seg' is defined in lib/elfloader.c
-            // 'load_icode_mapper' defines the way in which a page in this
-            // segment should be mapped.
-            panic_on(elf_load_seg(ph, (void *)((size_t)binary + ph->p_offset),
-                                  load_icode_mapper, e));
+    ELF_FOREACH_PHDR_OFF(ph_off, &ehdr) {
+        // 程序头位于用户空间中，逐个复制到内核中后再检查、使用
+        copy_user_space((void *)(binary + ph_off), &ph, sizeof(Elf64_Phdr));
+
+        if (ph.p_type != PT_LOAD) {
+            continue;
         }
+
+        if (ph.p_offset > size || ph.p_filesz > size - ph.p_offset ||
+            ph.p_filesz > ph.p_memsz || ph.p_vaddr < UTEMP ||
+            ph.p_vaddr > ULIB || ph.p_memsz > ULIB - ph.p_vaddr) {
+            return -E_INVAL;
+        }
+
+        try(elf_load_seg(&ph, (void *)(binary + ph.p_offset),
+                         load_icode_user_mapper, e));
     }
 
-    /* Step 3: Set 'e->env_tf.cp0_epc' to 'ehdr->e_entry'. */
-    /* Exercise 3.6: Your code here. */
-    e->env_tf.sepc = ehdr->e_entry;
+    e->env_tf.sepc = ehdr.e_entry;
+
+    return 0;
 }
 
 /*
@@ -581,7 +969,6 @@ static void load_icode(struct Env *e, const void *binary, size_t size) {
  * - 'binary'必须指向内存中的有效ELF可执行镜像（通过elf_from校验）
  * - 'size'必须等于ELF文件的实际大小
  * - 'priority'必须为有效优先级值
- * - asid_bitmap必须有可用ASID（asid_alloc）
  * - 物理页管理器必须能分配足够页面（用于页目录和ELF加载）
  * - env_free_list必须已正确初始化（`env_init`）
  * - env_free_list必须包含至少一个空闲Env结构
@@ -591,15 +978,14 @@ static void load_icode(struct Env *e, const void *binary, size_t size) {
  * - 成功时返回新创建Env指针，其状态为ENV_RUNNABLE，并插入调度队列头部
  * - 新Env具有以下特征：
  *   - 父ID为0
- *   - 分配了唯一env_id和ASID
- *   - 页目录包含内核空间映射和ELF段映射
+ *   - 分配了唯一env_id（ASID在首次运行时分配）
+ *   - 页目录只包含内核空间映射，ELF段在首次访问时映射（见`env_image_fault`）
  *   - EPC寄存器设置为ELF入口地址
  * - 失败时返回NULL（可能因无空闲Env或内存不足）
  *
  * 副作用：
  * - 修改全局变量env_free_list（通过env_alloc移出空闲Env）
  * - 修改全局变量env_sched_list（插入新Env）
- * - 可能修改ASID分配状态（通过asid_alloc）
  * - 可能分配物理页（通过env_setup_vm和load_icode）
  * - 若ELF校验失败触发panic（通过load_icode）
  */
@@ -624,11 +1010,11 @@ struct Env *env_create(const char *env_name, const void *binary, size_t size,
     strcpy(e->env_name, env_name);
 
     /* Step 3: Use 'load_icode' to load the image from 'binary', and insert 'e'
-     * into 'env_sched_list' using 'TAILQ_INSERT_HEAD'. */
+     * into 'env_sched_list' using 'sched_insert_head'. */
     /* Exercise 3.7: Your code here. (3/3) */
 
     load_icode(e, binary, size);
-    TAILQ_INSERT_HEAD(&env_sched_list, e, env_sched_link);
+    sched_insert_head(e);
 
     return e;
 }
@@ -637,13 +1023,15 @@ struct Env *env_create(const char *env_name, const void *binary, size_t size,
  * 概述：
  *
  *   （含 TLB 操作）释放环境e及其使用的所有内存资源。包括：
- *   - 用户地址空间的所有映射页（只含到UTOP的页不包括映射的pages、envs、User
- * VPT）
+ *   - 用户地址空间的所有映射页（只含到UTOP的页不包括映射的pages、envs）
+ *   - User VPT区域中的映射
  *   - 页表结构
  *   - 页目录结构
- *   - ASID资源
  *   - TLB相关项
  *
+ *   各映射的物理页的引用计数在遍历页表时直接 -1，整个地址空间只清除一次TLB，
+ *   拆除所用时间记录在`env_teardown_time`中。
+ *
  *   将进程从调度队列移除。
  *   最后将环境结构体归还到空闲环境链表。
  *
@@ -659,32 +1047,27 @@ struct Env *env_create(const char *env_name, const void *binary, size_t size,
  * - e的env_status被设为ENV_FREE
  * - e被插入env_free_list头部
  * - e从env_sched_list中移除（如果存在）
- * - 对应的ASID被释放回系统
  * - TLB中所有相关映射被无效化
  *
  * 副作用：
  * - 修改全局变量env_free_list（插入释放的环境）
  * - 修改全局变量env_sched_list（移除环境）
  * - 可能修改物理页管理状态（通过page_decref）
- * - 可能修改ASID分配状态（通过asid_free）
- * - 修改TLB状态（通过tlb_invalidate）
- * - 修改环境结构体的状态字段（env_status）
+ * - 修改TLB状态（通过tlb_flush_asid）
+ * - 修改环境结构体的状态字段（env_status、env_teardown_time）
  */
 void env_free(struct Env *e) {
-    Pte *p2;
-    Pte *p3;
-    u_reg_t p1no, p2no, p3no, p1pa, p2pa;
+    uint64_t teardown_begin = read_time();
 
     /* Hint: Note the environment's demise.*/
     printk("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
 
     /* Hint: Flush all mapped pages in the user portion of the address space */
     // 释放该进程中用户空间映射的所有页，注意，这只含到UTOP的页
-    // 不包括映射的pages、envs、User VPT
-    // 具体的，先检查页目录，对于页目录中有效的目录项
-    // 再检查对应的二级页表，对于二级页表中的有效项
-    // 再检查对应的三级页表
-    for (p1no = 0; p1no < P1X(UTOP); p1no++) {
+    // 不包括映射的pages、envs（所有进程共享）
+    // 直接在已持有的页表上将各映射的物理页引用计数 -1，而非逐页调用`page_remove`：
+    // 后者会重新遍历页表并逐页清除TLB，而该进程的TLB条目在最后统一清除
+    for (u_reg_t p1no = 0; p1no < P1X(UTOP); p1no++) {
         Pte *p1_entry = &e->env_pgdir[p1no];
 
         /* Hint: only look at mapped page tables. */
@@ -692,72 +1075,50 @@ void env_free(struct Env *e) {
             continue;
         }
 
-        // 一级巨页
+        // 一级巨页：巨页的引用计数记录在其首页中
         if (PTE_IS_NON_LEAF(*p1_entry) == 0) {
-            panic("Huge page is not supported, level = %d env = %08x va = "
-                  "0x%016lx\n",
-                  1, e->env_id, p1no << P1SHIFT);
-        }
-
-        /* Hint: find the pa and va of the page table. */
-        // 对应二级页表的物理地址
-        p1pa = PTE_ADDR(*p1_entry);
-        p2 = (Pte *)P2KADDR(p1pa);
-
-        /* Hint: Unmap all PTEs in this page table. */
-        for (p2no = 0; p2no <= P2X(~0ULL); p2no++) {
-            Pte *p2_entry = &p2[p2no];
-
-            if (!(*p2_entry & PTE_V)) {
-                continue;
-            }
-
-            if (PTE_IS_NON_LEAF(*p2_entry) == 0) {
-                panic("Huge page is not supported, level = %d env = %08x va = "
-                      "0x%016lx\n",
-                      2, e->env_id, (p1no << P1SHIFT) | (p2no << P2SHIFT));
-            }
-
-            p2pa = PTE_ADDR(*p2_entry);
-            p3 = (Pte *)P2KADDR(p2pa);
-
-            for (p3no = 0; p3no <= P3X(~0ULL); p3no++) {
-                Pte *p3_entry = &p3[p3no];
-
-                if (!(*p3_entry & PTE_V)) {
-                    continue;
-                }
-
-                page_remove(e->env_pgdir, e->env_asid,
-                            (p1no << P1SHIFT) | (p2no << P2SHIFT) |
-                                (p3no << P3SHIFT));
-            }
-
-            // 将二级页表项设置为无效
-            *p2_entry = 0;
-
-            // 将三级页表自身的物理页取消映射
-            page_decref(pa2page(p2pa));
+            page_decref(pa2page(PTE_ADDR(*p1_entry)));
+            *p1_entry = 0;
+            continue;
         }
 
         /* Hint: free the page table itself. */
-        // 将目录项设置为无效
-        *p1_entry = 0;
-        // 将二级页表自身的物理页取消映射（引用计数-1）
-        page_decref(pa2page(p1pa));
+        pte_table_free(p1_entry, 1);
+    }
+
+    // User VPT区域为该进程私有，其中的映射指向该进程自身的页表，
+    // 若用户未调用`unmap_user_vpt`，在此一并释放，使这些页表的引用计数归零
+    if (e->env_pgdir[P1X(UVPT)] & PTE_V) {
+        pte_table_free(&e->env_pgdir[P1X(UVPT)], 1);
     }
+
     /* Hint: free the page directory. */
     page_decref(pa2page(PADDR(e->env_pgdir)));
-    /* Hint: free the ASID */
-    asid_free(e->env_asid);
+
+    // 镜像页已全部解除映射，若没有其它进程运行同一镜像，释放其缓存的页
+    if (e->env_binary != NULL && !icode_in_use(e, e->env_binary)) {
+        icode_cache_release(e->env_binary);
+    }
     /* Hint: invalidate page directory in TLB */
+    // 整个地址空间只清除一次TLB
+    // ASID在当前代中不会被重新分配，无需归还；
+    // 若ASID已失效，其TLB条目已在进入新的一代时被刷新
+    if (e->env_asid_generation == asid_generation) {
+        tlb_flush_asid(e->env_asid);
+    }
 
-    tlb_flush_asid(e->env_asid);
+    e->env_teardown_time = read_time() - teardown_begin;
+    debugk("env_free", "env %08x teardown %lu us\n", e->env_id,
+           time_to_us(e->env_teardown_time));
 
     /* Hint: return the environment to the free list. */
     e->env_status = ENV_FREE;
     LIST_INSERT_HEAD((&env_free_list), (e), env_link);
-    TAILQ_REMOVE(&env_sched_list, (e), env_sched_link);
+    sched_remove(e);
+    env_timer_cancel(e);
+    group_leave(e);
+    // 归还EDF调度类中已接纳的CPU利用率
+    sched_set_edf(e, 0, 0, 0);
 }
 
 /*
@@ -784,7 +1145,6 @@ void env_free(struct Env *e) {
  * - 修改全局变量env_free_list（插入释放的Env）
  * - 修改全局变量env_sched_list（移除e）
  * - 可能修改物理页管理状态（通过env_free调用page_decref）
- * - 可能修改ASID分配状态（通过env_free调用asid_free）
  * - 修改TLB状态（通过env_free调用tlb_invalidate）
  * - 若e是当前环境，修改curenv为NULL并触发调度流程
  */
@@ -852,6 +1212,7 @@ extern void env_pop_tf(struct Trapframe *tf, uint16_t asid, u_reg_t p1_ppn)
  *   - 修改全局页目录指针 cur_pgdir
  *   - 增加 e->env_runs 的计数器值
  *   - 可能修改原 curenv 的 env_tf 字段（当 curenv != NULL 时）
+ *   - 将此前在内核中的时间计入原 curenv 及 e 的内核态CPU时间（见`sched_account`）
  *   - 设置/重置时钟中断
  *
  * 实现步骤:
@@ -878,6 +1239,9 @@ void env_run(struct Env *e) {
      *   If not, we may be switching from a previous env, so save its context
      * into 'curenv->env_tf' first.
      */
+    // 此前在内核中的时间计入原进程
+    sched_account(curenv, 0);
+
     if (curenv) {
         curenv->env_tf = *(((struct Trapframe *)KSTACKTOP) - 1);
     }
@@ -892,6 +1256,9 @@ void env_run(struct Env *e) {
 
     cur_pgdir = curenv->env_pgdir;
 
+    // 惰性分配ASID：新Env或ASID属于旧代的Env
+    env_asid_refresh(curenv);
+
     /* Step 4: Use 'env_pop_tf' to restore the curenv's saved context
      * (registers) and return/go to user mode.
      *
@@ -903,6 +1270,8 @@ void env_run(struct Env *e) {
      */
     /* Exercise 3.8: Your code here. (2/2) */
 
+    sched_account(curenv, 0);
+
     env_pop_tf(&curenv->env_tf, curenv->env_asid,
                PADDR(cur_pgdir) >> PAGE_SHIFT);
 }
@@ -959,17 +1328,69 @@ void env_check() {
 
     assert(pe2->env_pgdir[P1X(UTOP)] == base_pgdir[P1X(UTOP)]);
     assert(pe2->env_pgdir[P1X(UTOP) - 1] == 0);
+
+    // 内核共享区域的二级页表应当被引用，而非复制
+    for (u_reg_t p1no = P1X(KERNEL_SHARED_BEGIN_VA);
+         p1no <= P1X(KERNEL_SHARED_END_VA - 1); p1no++) {
+        assert(pe2->env_pgdir[p1no] & PTE_V);
+        assert(pe2->env_pgdir[p1no] == kernel_boot_pgdir[p1no]);
+    }
+
+    // 在内核共享区域中的映射，应当立即在已有进程的地址空间中可见
+    kmap(KMMAP_BEGIN_VA, PADDR(pages), PAGE_SIZE, PTE_RO | PTE_GLOBAL);
+    assert(va2pa(pe2->env_pgdir, KMMAP_BEGIN_VA) == PADDR(pages));
+    kunmap(KMMAP_BEGIN_VA, PAGE_SIZE);
+    assert(va2pa(pe2->env_pgdir, KMMAP_BEGIN_VA) == ~0ULL);
+
     printk("env_setup_vm passed!\n");
 
     printk("pe2`s sp register 0x%016lx\n", pe2->env_tf.regs[2]);
 
+    // ASID在首次运行时惰性分配，且在同一代中唯一
+    assert(pe0->env_asid_generation != asid_generation);
+    env_asid_refresh(pe0);
+    env_asid_refresh(pe1);
+    assert(asid_max == 0 || pe0->env_asid_generation == asid_generation);
+    assert(asid_max == 0 || pe0->env_asid != pe1->env_asid);
+
+    // 模拟ASID耗尽：进入新的一代，已有Env的ASID失效并在下次运行时重新分配
+    uint64_t generation = asid_generation;
+    uint16_t asid = pe0->env_asid;
+    env_asid_refresh(pe0);
+    assert(pe0->env_asid == asid);
+
+    asid_next = (uint32_t)asid_max + 1;
+    env_asid_refresh(pe2);
+    assert(asid_generation == generation + 1);
+    assert(pe2->env_asid == asid_first());
+    assert(pe0->env_asid_generation != asid_generation);
+    env_asid_refresh(pe0);
+    assert(pe0->env_asid_generation == asid_generation);
+    assert(asid_max == 0 || pe0->env_asid != pe2->env_asid);
+
+    printk("asid generation passed!\n");
+
+    // 拆除地址空间时，共享页只应被减少一次引用计数，另一进程的映射不受影响
+    struct Page *shared;
+    assert(page_alloc(&shared) == 0);
+    assert(page_insert(pe1->env_pgdir, 0, shared, UTEXT, PTE_RW | PTE_USER) ==
+           0);
+    assert(page_insert(pe2->env_pgdir, 0, shared, UTEXT, PTE_RO | PTE_USER) ==
+           0);
+    assert(shared->pp_ref == 2);
+
+    sched_insert_tail(pe1);
+    env_free(pe1);
+    assert(shared->pp_ref == 1);
+    assert(va2pa(pe2->env_pgdir, UTEXT) == page2pa(shared));
+
+    printk("env teardown passed!\n");
+
     /* free all env allocated in this function */
-    TAILQ_INSERT_TAIL(&env_sched_list, pe0, env_sched_link);
-    TAILQ_INSERT_TAIL(&env_sched_list, pe1, env_sched_link);
-    TAILQ_INSERT_TAIL(&env_sched_list, pe2, env_sched_link);
+    sched_insert_tail(pe0);
+    sched_insert_tail(pe2);
 
     env_free(pe2);
-    env_free(pe1);
     env_free(pe0);
 
     printk("env_check() succeeded!\n");
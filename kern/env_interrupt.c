@@ -4,6 +4,8 @@
 #include <mmu.h>
 #include <plic.h>
 #include <printk.h>
+#include <sched.h>
+#include <timer.h>
 #include <trap.h>
 #include <userspace.h>
 
@@ -93,8 +95,9 @@ void handle_env_interrupt(struct Trapframe *tf, uint32_t interrupt_code) {
             }
 
             // 唤醒进程
+            env_timer_cancel(env);
             env->env_status = ENV_RUNNABLE;
-            TAILQ_INSERT_HEAD(&env_sched_list, env, env_sched_link);
+            sched_insert_head(env);
         }
 
         // 将当前进程上下文保存到用户异常栈
@@ -1,16 +1,10 @@
 #include "printk.h"
 #include <fork.h>
 #include <pmap.h>
+#include <string.h>
 
-static void duppage(Pte *entry, Pte *child_pgdir, uint16_t child_asid,
-                    u_reg_t vpn) {
-    int r;
-    u_reg_t addr;
-    uint32_t perm;
-
-    perm = PTE_FLAGS(*entry);
-    addr = (vpn << PAGE_SHIFT);
-
+// 返回父进程中标志位为`perm`的映射在fork后，父子进程中共同的标志位
+static uint32_t dup_perm(uint32_t perm) {
     /* Step 2: If the page is writable, and not shared with children, and not
      * marked as COW yet, then map it as copy-on-write, both in the parent (0)
      * and the child (envid). */
@@ -28,7 +22,7 @@ static void duppage(Pte *entry, Pte *child_pgdir, uint16_t child_asid,
      */
     /* Exercise 4.10: Your code here. (2/2) */
 
-    u_int new_perm = 0;
+    uint32_t new_perm = 0;
 
     // 注意，应当使用`!= 0`而非`==
     // 1`检查，因为运算的结果位于`PTE_LIBRARY`对应的位上，而非最低位
@@ -43,62 +37,170 @@ static void duppage(Pte *entry, Pte *child_pgdir, uint16_t child_asid,
         new_perm = perm;
     }
 
-    void *va = (void *)addr;
+    return new_perm;
+}
 
-    /* 关键点：必须先映射子进程再重映射父进程，避免竞争条件 */
+// 取得子进程中对应的页表项
+static int get_child_pte(Pte *pte, u_reg_t va, size_t count, void *arg) {
+    *(Pte **)arg = pte;
+
+    return 0;
+}
+
+// `dup_userspace`的遍历参数
+struct dup_userspace_arg {
+    Pte *child_pgdir;
+    struct TlbGather *parent_tlb; // 父进程中被改为CoW的页
+    int share_tables;             // 是否与子进程共享三级页表
+};
+
+// 使子进程共享父进程中覆盖[va, va + P2MAP)的三级页表`pte`
+// 若该页表不能共享（含有共享库页），返回 0，由调用者复制该页表；成功共享时返回 1
+// 超出资源组的物理页限制或内存不足时返回负的错误码
+static int dup_userspace_share(Pte *pte, u_reg_t va,
+                               struct dup_userspace_arg *dup_arg) {
+    struct Page *table_page = pa2page(PADDR(pte));
+    size_t count = PAGE_SIZE / sizeof(Pte);
+    uint32_t charge = 0;
+    int r;
+
+    // 已被共享的页表中不含可写的映射及共享库页，无需再次检查
+    if (table_page->pp_next == 0) {
+        // 共享库页的引用计数须反映实际映射它的进程数（例如，`pipe_is_closed`依赖于此）
+        for (size_t i = 0; i < count; i++) {
+            if ((pte[i] & PTE_V) != 0 && (pte[i] & PTE_LIBRARY) != 0) {
+                return 0;
+            }
+        }
 
-    if ((r = page_insert(child_pgdir, child_asid, pa2page(PTE_ADDR(*entry)),
-                         (vpn << 12), new_perm)) < 0) {
-        panic("duppage: failed to insert page for child vpn = 0x%016lx: %d\n",
-              vpn, r);
+        // 非叶页表项不含权限位，只能将共享的页表中的可写页逐项改为CoW
+        for (size_t i = 0; i < count; i++) {
+            if ((pte[i] & PTE_V) != 0 && (pte[i] & PTE_W) != 0) {
+                pte[i] = (pte[i] & ~PTE_W) | PTE_COW;
+
+                tlb_gather_add(dup_arg->parent_tlb, va + i * PAGE_SIZE,
+                               PAGE_SIZE);
+            }
+        }
     }
 
-    // 清除原有标志位
-    *entry &= ~GENMASK(9, 0);
-    *entry |= new_perm;
-}
+    // 共享的页表中的映射同样计入子进程的资源组
+    for (size_t i = 0; i < count; i++) {
+        if ((pte[i] & PTE_V) != 0) {
+            charge += page_mapped_pages(pa2page(PTE_ADDR(pte[i])), 3);
+        }
+    }
 
-void dup_userspace(Pte *parent_pgdir, Pte *child_pgdir, uint16_t child_asid) {
-    uint32_t pte_count_per_page = (PAGE_SIZE / sizeof(Pte));
+    try(pgdir_charge(dup_arg->child_pgdir, va, charge, 0));
 
-    u_reg_t current_vpn = 0;
+    if ((r = page_table_share(dup_arg->child_pgdir, va, table_page)) < 0) {
+        pgdir_charge(dup_arg->child_pgdir, va, 0, charge);
+        return r;
+    }
 
-    for (uint32_t p1x = 0; p1x <= P1X(USTACKTOP); p1x++) {
-        Pte current_p1entry = parent_pgdir[p1x];
+    return 1;
+}
 
-        if ((current_p1entry & PTE_V) != 0) {
-            Pte *p2 = (Pte *)P2KADDR(PTE_ADDR(current_p1entry));
+// 复制父进程同一个三级页表中连续的`count`个页表项到子进程
+// 子进程的三级页表只查找（分配）一次，页表项整体复制后，再逐项调整标志位及引用计数
+static int dup_userspace_range(Pte *pte, u_reg_t va, size_t count, void *arg) {
+    struct dup_userspace_arg *dup_arg = (struct dup_userspace_arg *)arg;
+    // 子进程中对应`pte[0]`的页表项
+    Pte *child_pte = NULL;
+    size_t first = 0;
+    uint32_t charge = 0;
+    int r;
 
-            for (uint32_t p2x = 0; p2x < pte_count_per_page; p2x++) {
+    // 父进程的三级页表可能已不含有效映射，此时无需为子进程分配页表
+    while (first < count && (pte[first] & PTE_V) == 0) {
+        first++;
+    }
 
-                current_vpn = (p1x << 18) || (p2x << 9);
+    if (first == count) {
+        return 0;
+    }
 
-                if (current_vpn >= VPN(USTACKTOP)) {
-                    break;
-                }
+    // 共享整个三级页表，页表项及物理页的引用计数均不复制
+    if (dup_arg->share_tables && count == PAGE_SIZE / sizeof(Pte) &&
+        (r = dup_userspace_share(pte, va, dup_arg)) != 0) {
+        return r < 0 ? r : 0;
+    }
 
-                Pte current_p2entry = p2[p2x];
+    // 复制的映射计入子进程的资源组
+    for (size_t i = first; i < count; i++) {
+        if ((pte[i] & PTE_V) != 0) {
+            charge += page_mapped_pages(pa2page(PTE_ADDR(pte[i])), 3);
+        }
+    }
 
-                if ((current_p2entry & PTE_V) != 0) {
-                    Pte *p3 = (Pte *)P2KADDR(PTE_ADDR(current_p2entry));
+    try(pgdir_charge(dup_arg->child_pgdir, va, charge, 0));
 
-                    for (uint32_t p3x = 0; p3x < pte_count_per_page; p3x++) {
+    // 子进程的三级页表是新建的，与父进程的覆盖相同的2 MiB
+    if ((r = pgdir_walk_range(dup_arg->child_pgdir, va, PAGE_SIZE, 1,
+                              get_child_pte, &child_pte)) < 0) {
+        pgdir_charge(dup_arg->child_pgdir, va, 0, charge);
+        return r;
+    }
 
-                        current_vpn = (p1x << 18) | (p2x << 9) | p3x;
+    /* 关键点：必须先映射子进程再重映射父进程，避免竞争条件 */
+    memcpy(child_pte + first, pte + first, (count - first) * sizeof(Pte));
 
-                        if (current_vpn >= VPN(USTACKTOP)) {
-                            break;
-                        }
+    for (size_t i = first; i < count; i++) {
+        if ((pte[i] & PTE_V) == 0) {
+            continue;
+        }
 
-                        Pte current_p3entry = p3[p3x];
+        page_incref(pa2page(PTE_ADDR(pte[i])));
 
-                        if ((current_p3entry & PTE_V) != 0) {
-                            duppage(&p3[p3x], child_pgdir, child_asid,
-                                    current_vpn);
-                        }
-                    }
-                }
-            }
+        uint32_t perm = PTE_FLAGS(pte[i]);
+        uint32_t new_perm = dup_perm(perm);
+
+        if (new_perm != perm) {
+            // 清除原有标志位
+            pte[i] = (pte[i] & ~GENMASK(9, 0)) | new_perm;
+            child_pte[i] = pte[i];
+
+            tlb_gather_add(dup_arg->parent_tlb, va + i * PAGE_SIZE, PAGE_SIZE);
         }
     }
-}
\ No newline at end of file
+
+    return 0;
+}
+
+// 复制父进程中第`level`级的巨页映射`pte`到子进程，巨页整体被共享（写时复制）
+static int dup_userspace_huge(Pte *pte, u_reg_t va, u_int level, void *arg) {
+    struct dup_userspace_arg *dup_arg = (struct dup_userspace_arg *)arg;
+    uint32_t perm = PTE_FLAGS(*pte);
+    uint32_t new_perm = dup_perm(perm);
+
+    // 子进程尚未运行，无需清除其TLB
+    // 巨页映射由`page_insert_huge`计入子进程的资源组
+    try(page_insert_huge(dup_arg->child_pgdir, 0, pa2page(PTE_ADDR(*pte)), va,
+                         level, new_perm & ~PTE_V));
+
+    if (new_perm != perm) {
+        *pte = (*pte & ~GENMASK(9, 0)) | new_perm;
+
+        tlb_gather_add(dup_arg->parent_tlb, va, PLEVEL_SIZE(level));
+    }
+
+    return 0;
+}
+
+int dup_userspace(Pte *parent_pgdir, uint16_t parent_asid, Pte *child_pgdir,
+                  int share_tables) {
+    struct TlbGather parent_tlb;
+    struct dup_userspace_arg arg = {.child_pgdir = child_pgdir,
+                                    .parent_tlb = &parent_tlb,
+                                    .share_tables = share_tables};
+
+    tlb_gather_init(&parent_tlb, parent_asid, 0);
+
+    int r = pgdir_walk_range_huge(parent_pgdir, 0, USTACKTOP, 0,
+                                  dup_userspace_range, dup_userspace_huge, &arg);
+
+    // 父进程中被改为CoW的页，统一清除TLB（失败时已修改的页表项同样需要清除）
+    tlb_gather_finish(&parent_tlb);
+
+    return r;
+}
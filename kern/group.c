@@ -0,0 +1,222 @@
+#include <env.h>
+#include <error.h>
+#include <group.h>
+#include <kclock.h>
+#include <printk.h>
+
+// 资源组，0号资源组（GROUP_ROOT）不受限制，由`group_init`初始化
+static struct EnvGroup {
+    uint32_t used;          // 是否已创建
+    uint32_t throttled;     // 当前周期是否已用完CPU配额
+    uint64_t period_start;  // 当前周期开始的时刻（时钟中断数）
+    struct GroupStat stat;
+} groups[NGROUP];
+
+// `group_limit_suspend`的嵌套层数，非0时不检查物理页限制
+static uint32_t group_limit_suspended;
+
+// 当前周期已用完CPU配额的资源组数，为0时调度器无需跳过任何进程
+static uint32_t group_throttled_count;
+
+static inline struct EnvGroup *group_of(struct Env *e) {
+    return &groups[e->env_group];
+}
+
+static inline int group_valid(uint32_t gid) {
+    return gid < NGROUP && groups[gid].used;
+}
+
+void group_init(void) {
+    for (u_int i = 0; i < NGROUP; i++) {
+        groups[i].used = 0;
+    }
+
+    groups[GROUP_ROOT] = (struct EnvGroup){.used = 1};
+}
+
+int group_create(uint32_t cpu_quota, uint32_t cpu_period, uint32_t page_limit) {
+    if (cpu_quota != 0 && cpu_quota > cpu_period) {
+        return -E_INVAL;
+    }
+
+    for (u_int gid = 1; gid < NGROUP; gid++) {
+        struct EnvGroup *g = &groups[gid];
+
+        if (g->used) {
+            continue;
+        }
+
+        *g = (struct EnvGroup){.used = 1};
+        g->stat.cpu_quota = cpu_quota;
+        g->stat.cpu_period = cpu_period;
+        g->stat.page_limit = page_limit;
+
+        return (int)gid;
+    }
+
+    return -E_NO_MEM;
+}
+
+void group_join(struct Env *e, uint32_t gid) {
+    if (!group_valid(gid)) {
+        panic("group_join: invalid group %u", gid);
+    }
+
+    e->env_group = gid;
+    e->env_group_pages = 0;
+
+    groups[gid].stat.nr_envs++;
+}
+
+void group_leave(struct Env *e) {
+    struct EnvGroup *g = group_of(e);
+
+    g->stat.page_used -= e->env_group_pages;
+    g->stat.nr_envs--;
+
+    e->env_group_pages = 0;
+
+    if (g->stat.nr_envs == 0 && e->env_group != GROUP_ROOT) {
+        if (g->throttled) {
+            group_throttled_count--;
+        }
+
+        g->used = 0;
+    }
+}
+
+int group_attach(struct Env *e, uint32_t gid) {
+    if (!group_valid(gid)) {
+        return -E_INVAL;
+    }
+
+    if (gid == e->env_group) {
+        return 0;
+    }
+
+    uint32_t pages = e->env_group_pages;
+
+    group_leave(e);
+    group_join(e, gid);
+
+    e->env_group_pages = pages;
+    groups[gid].stat.page_used += pages;
+
+    return 0;
+}
+
+int group_charge_pages(struct Env *e, uint32_t count) {
+    struct EnvGroup *g = group_of(e);
+
+    if (g->stat.page_limit != 0 && group_limit_suspended == 0 &&
+        (uint64_t)g->stat.page_used + count > g->stat.page_limit) {
+        g->stat.page_denied++;
+        return -E_QUOTA;
+    }
+
+    g->stat.page_used += count;
+    e->env_group_pages += count;
+
+    return 0;
+}
+
+void group_limit_suspend(void) { group_limit_suspended++; }
+
+void group_limit_resume(void) {
+    if (group_limit_suspended == 0) {
+        panic("group_limit_resume: not suspended");
+    }
+
+    group_limit_suspended--;
+}
+
+void group_uncharge_pages(struct Env *e, uint32_t count) {
+    if (count > e->env_group_pages) {
+        count = e->env_group_pages;
+    }
+
+    group_of(e)->stat.page_used -= count;
+    e->env_group_pages -= count;
+}
+
+void group_page_limit_exceeded(struct Env *e, u_reg_t va) {
+    printk("[%08x] resident page limit of group %u exceeded at va = "
+           "0x%016lx\n",
+           e->env_id, e->env_group, va);
+
+    env_destroy(e);
+}
+
+void group_charge_cpu(struct Env *e, uint64_t cycles) {
+    struct EnvGroup *g = group_of(e);
+
+    g->stat.cpu_time += cycles;
+
+    if (g->stat.cpu_quota == 0) {
+        return;
+    }
+
+    g->stat.cpu_used += cycles;
+
+    if (!g->throttled &&
+        g->stat.cpu_used >= (uint64_t)g->stat.cpu_quota * TIMER_INTERVAL) {
+        g->throttled = 1;
+        g->stat.throttled++;
+        group_throttled_count++;
+    }
+}
+
+int group_throttled(struct Env *e) { return group_of(e)->throttled != 0; }
+
+int group_any_throttled(void) { return group_throttled_count != 0; }
+
+void group_tick(uint64_t ticks) {
+    for (u_int gid = 1; gid < NGROUP; gid++) {
+        struct EnvGroup *g = &groups[gid];
+
+        if (!g->used || g->stat.cpu_quota == 0 ||
+            ticks < g->period_start + g->stat.cpu_period) {
+            continue;
+        }
+
+        // 空闲期间可能跨过多个周期
+        g->period_start =
+            ticks - (ticks - g->period_start) % g->stat.cpu_period;
+        g->stat.cpu_used = 0;
+
+        if (g->throttled) {
+            g->throttled = 0;
+            group_throttled_count--;
+        }
+    }
+}
+
+uint64_t group_next_replenish(void) {
+    uint64_t next = 0;
+
+    for (u_int gid = 1; gid < NGROUP; gid++) {
+        struct EnvGroup *g = &groups[gid];
+
+        if (!g->used || !g->throttled) {
+            continue;
+        }
+
+        uint64_t replenish = g->period_start + g->stat.cpu_period;
+
+        if (next == 0 || replenish < next) {
+            next = replenish;
+        }
+    }
+
+    return next;
+}
+
+int group_get_stat(uint32_t gid, struct GroupStat *stat) {
+    if (!group_valid(gid)) {
+        return -E_INVAL;
+    }
+
+    *stat = groups[gid].stat;
+
+    return 0;
+}
@@ -1,157 +1,308 @@
 #include "pmap.h"
+#include <error.h>
 #include <kmalloc.h>
 #include <printk.h>
 
-struct MBlock_list mblock_list;
+// slab中第一个对象相对于slab首部的偏移
+#define KMALLOC_SLAB_OBJECT_OFFSET                                             \
+    ROUND(sizeof(struct KmallocSlab), KMALLOC_ALIGN)
+
+static struct KmallocClass kmalloc_class[KMALLOC_CLASS_COUNT];
 
 size_t total_requested_bytes = 0;
 size_t total_free_bytes = 0;
 
-void kmalloc_init() {
-    int ret = 0;
+// 当前分配的大块内存的数目及所占物理页数
+static size_t large_count = 0;
+static size_t large_page_count = 0;
 
-    printk("kmalloc_init: begin\n");
+static inline size_t class_size(u_int class_index) {
+    return (size_t)KMALLOC_MIN_CLASS_SIZE << class_index;
+}
 
-    // 分配一页用于二级页表，并将其映射到一级页表项中
-    // 该映射将被复制到所有进程的地址空间中
+// 返回能容纳`size`字节的最小大小类
+// Precondition：`size <= KMALLOC_MAX_CLASS_SIZE`
+static inline u_int size_to_class(size_t size) {
+    if (size <= KMALLOC_MIN_CLASS_SIZE) {
+        return 0;
+    }
 
-    struct Page *p2page = NULL;
+    // size - 1 的最高位决定大小类：(8, 16] -> 0，(16, 32] -> 1，...
+    return (u_int)(64 - __builtin_clzl(size - 1)) - 4;
+}
 
-    if ((ret = page_alloc(&p2page)) < 0) {
-        panic("kmalloc_init: failed to allocate page: %d\n", ret);
+void kmalloc_init() {
+    printk("kmalloc_init: begin\n");
+
+    for (u_int i = 0; i < KMALLOC_CLASS_COUNT; i++) {
+        LIST_INIT(&kmalloc_class[i].partial);
+        kmalloc_class[i].slab_count = 0;
+        kmalloc_class[i].in_use = 0;
+        kmalloc_class[i].alloc_count = 0;
+        kmalloc_class[i].requested_bytes = 0;
     }
 
-    p2page->pp_ref++;
+    printk("kmalloc_init: %d size classes, %lu - %lu bytes\n",
+           KMALLOC_CLASS_COUNT, (size_t)KMALLOC_MIN_CLASS_SIZE,
+           (size_t)KMALLOC_MAX_CLASS_SIZE);
 
-    kernel_boot_pgdir[P1X(KMALLOC_BEGIN_VA)] = (page2ppn(p2page) << 10) | PTE_V;
+    printk("kmalloc_init: end\n");
+}
 
-    LIST_INIT(&mblock_list);
+// 为大小类`class_index`分配一个新的slab，并插入其未满slab链表
+// 内存不足时返回NULL
+static struct KmallocSlab *slab_create(u_int class_index) {
+    struct Page *pp = NULL;
 
-    struct MBlock *heap_begin = (struct MBlock *)KMALLOC_BEGIN_VA;
+    if (page_alloc_nozero(&pp) < 0) {
+        return NULL;
+    }
 
-    printk("kmalloc_init: heap_begin: 0x%016lx\n", heap_begin);
+    pp->pp_ref++;
 
-    heap_begin->size = KMALLOC_HEAP_SIZE - MBLOCK_SIZE;
-    heap_begin->ptr = (void *)heap_begin->data;
-    heap_begin->free = 1;
+    struct KmallocSlab *slab = (struct KmallocSlab *)page2kva(pp);
 
-    LIST_INSERT_HEAD(&mblock_list, heap_begin, mb_link);
+    slab->magic = KMALLOC_SLAB_MAGIC;
+    slab->class_index = (uint16_t)class_index;
+    slab->in_use = 0;
+    slab->capacity = (uint16_t)((PAGE_SIZE - KMALLOC_SLAB_OBJECT_OFFSET) /
+                                class_size(class_index));
+    slab->unused = slab->capacity;
+    slab->padding = 0;
+    slab->free = NULL;
 
-    printk("kmalloc_init: end\n");
+    LIST_INSERT_HEAD(&kmalloc_class[class_index].partial, slab, slab_link);
+    kmalloc_class[class_index].slab_count++;
+
+    return slab;
 }
 
-void *kmalloc(size_t size) {
-    total_requested_bytes += size;
+// 归还slab所在的物理页
+// Precondition：slab中没有已分配的对象，且已从未满slab链表中移除
+static void slab_destroy(struct KmallocSlab *slab) {
+    struct Page *pp = pa2page(PADDR(slab));
 
-    size = ROUND(size, 8);
+    kmalloc_class[slab->class_index].slab_count--;
+    slab->magic = 0;
 
-    struct MBlock *cur_block = NULL;
+    page_decref(pp);
+}
 
-    LIST_FOREACH(cur_block, &mblock_list, mb_link) {
-        if (cur_block->free == 0) {
-            continue;
-        }
-        if (size <= cur_block->size) {
-            size_t remain_size = cur_block->size - size;
+static void *slab_alloc(u_int class_index) {
+    struct KmallocClass *cls = &kmalloc_class[class_index];
+    struct KmallocSlab *slab = LIST_FIRST(&cls->partial);
 
-            if (remain_size < (MBLOCK_SIZE + 8)) {
-                size += remain_size;
+    if (slab == NULL && (slab = slab_create(class_index)) == NULL) {
+        return NULL;
+    }
 
-                cur_block->size = size;
-                cur_block->free = 0;
+    void *obj;
+
+    if (slab->free != NULL) {
+        obj = slab->free;
+        slab->free = *(void **)obj;
+    } else {
+        // 取尾部从未分配过的对象，从而创建slab时无需构造空闲链表
+        obj = (void *)((u_reg_t)slab + KMALLOC_SLAB_OBJECT_OFFSET +
+                       (size_t)(slab->capacity - slab->unused) *
+                           class_size(class_index));
+        slab->unused--;
+    }
 
-            } else {
-                size_t next_node_addr =
-                    (size_t)(cur_block) + MBLOCK_SIZE + size;
-                struct MBlock *next_node = (struct MBlock *)next_node_addr;
+    slab->in_use++;
+    cls->in_use++;
 
-                next_node->size = remain_size - MBLOCK_SIZE;
-                next_node->ptr = (void *)(next_node_addr + MBLOCK_SIZE);
-                next_node->free = 1;
+    if (slab->in_use == slab->capacity) {
+        LIST_REMOVE(slab, slab_link);
+    }
 
-                cur_block->free = 0;
-                cur_block->size = size;
+    return obj;
+}
 
-                LIST_INSERT_AFTER(cur_block, next_node, mb_link);
-            }
+static void slab_free(struct KmallocSlab *slab, void *p) {
+    struct KmallocClass *cls = &kmalloc_class[slab->class_index];
+    size_t offset = (u_reg_t)p - (u_reg_t)slab;
+    size_t size = class_size(slab->class_index);
+
+    if (offset < KMALLOC_SLAB_OBJECT_OFFSET ||
+        (offset - KMALLOC_SLAB_OBJECT_OFFSET) % size != 0 ||
+        (offset - KMALLOC_SLAB_OBJECT_OFFSET) / size >=
+            (size_t)(slab->capacity - slab->unused) ||
+        slab->in_use == 0) {
+        panic("kmalloc: free: invalid pointer: 0x%016lx\n", (u_reg_t)p);
+    }
 
-            return cur_block->ptr;
-        }
+    total_free_bytes += size;
+
+    // 将slab移至未满slab链表头部，使得刚释放的对象最先被复用
+    // 注意：满slab不在未满slab链表中
+    if (slab->in_use != slab->capacity) {
+        LIST_REMOVE(slab, slab_link);
     }
+    LIST_INSERT_HEAD(&cls->partial, slab, slab_link);
+
+    *(void **)p = slab->free;
+    slab->free = p;
+
+    slab->in_use--;
+    cls->in_use--;
 
-    return NULL;
+    // 保留最后一个未满slab，以免反复分配、释放物理页
+    if (slab->in_use == 0 && LIST_NEXT(slab, slab_link) != NULL) {
+        LIST_REMOVE(slab, slab_link);
+        slab_destroy(slab);
+    }
 }
 
-void kfree(void *p) {
+static void *large_alloc(size_t size) {
+    if (size > KMALLOC_MAX_SIZE) {
+        debugk("kmalloc",
+               "request too large: %lu bytes, at most %lu bytes (order %u)\n",
+               size, (size_t)KMALLOC_MAX_SIZE, PAGE_MAX_ORDER);
+        return NULL;
+    }
 
-    size_t ptr_addr = (size_t)p;
+    size_t page_count =
+        ROUND(size + KMALLOC_LARGE_DATA_OFFSET, PAGE_SIZE) / PAGE_SIZE;
+    u_int order = 0;
 
-    if ((ptr_addr < (KMALLOC_BEGIN_VA + MBLOCK_SIZE)) ||
-        (ptr_addr > KMALLOC_END_VA)) {
+    while ((1UL << order) < page_count) {
+        order++;
+    }
 
-        panic("kmalloc: free: invalid pointer: 0x%016lx\n", ptr_addr);
-        return;
+    struct Page *pp = NULL;
+
+    if (page_alloc_order(order, &pp) < 0) {
+        return NULL;
+    }
+
+    // 归还超出所需页数的部分，从而大块内存只占用整数个物理页
+    page_free_range(pp + page_count, (1UL << order) - page_count);
+
+    for (size_t i = 0; i < page_count; i++) {
+        pp[i].pp_ref = 1;
     }
 
-    size_t node_addr = ptr_addr - MBLOCK_SIZE;
+    struct KmallocLarge *large = (struct KmallocLarge *)page2kva(pp);
 
-    struct MBlock *cur_node = (struct MBlock *)node_addr;
+    large->magic = KMALLOC_LARGE_MAGIC;
+    large->page_count = (uint32_t)page_count;
+    large->size = size;
 
-    if (((size_t)cur_node->ptr) != ((size_t)(cur_node->data))) {
-        panic("kmalloc: free: invalid node structure: node = 0x%016lx "
-              "node->ptr = 0x%016lx node->data = 0x%016lx\n",
-              cur_node, (size_t)cur_node->ptr, (size_t)(cur_node->data));
-        return;
+    large_count++;
+    large_page_count += page_count;
+
+    return (void *)((u_reg_t)large + KMALLOC_LARGE_DATA_OFFSET);
+}
+
+static void large_free(struct KmallocLarge *large, void *p) {
+    if ((u_reg_t)p != (u_reg_t)large + KMALLOC_LARGE_DATA_OFFSET) {
+        panic("kmalloc: free: invalid pointer: 0x%016lx\n", (u_reg_t)p);
     }
 
-    total_free_bytes += cur_node->size;
+    struct Page *pp = pa2page(PADDR(large));
+    size_t page_count = large->page_count;
+
+    total_free_bytes += large->size;
+
+    large_count--;
+    large_page_count -= page_count;
+
+    large->magic = 0;
 
-    struct MBlock *next_node = LIST_NEXT(cur_node, mb_link);
-    struct MBlock *prev_node = NULL;
+    page_free_range(pp, page_count);
+}
+
+void *kmalloc(size_t size) {
+    total_requested_bytes += size;
 
-    if (LIST_FIRST(&mblock_list) != cur_node) {
-        prev_node = MBLOCK_PREV(cur_node, mb_link);
+    if (size > KMALLOC_MAX_CLASS_SIZE) {
+        return large_alloc(size);
     }
 
-    if (next_node != NULL) {
-        if (next_node->free == 1) {
-            cur_node->size += (next_node->size + MBLOCK_SIZE);
-            LIST_REMOVE(next_node, mb_link);
-        }
+    u_int class_index = size_to_class(size);
+    void *obj = slab_alloc(class_index);
+
+    if (obj != NULL) {
+        kmalloc_class[class_index].alloc_count++;
+        kmalloc_class[class_index].requested_bytes += size;
     }
 
-    if (prev_node != NULL) {
-        if (prev_node->free == 1) {
-            prev_node->size += (cur_node->size + MBLOCK_SIZE);
-            LIST_REMOVE(cur_node, mb_link);
-        }
+    return obj;
+}
+
+void kfree(void *p) {
+    u_reg_t ptr_addr = (u_reg_t)p;
+
+    if (ptr_addr < HIGH_ADDR_IMM ||
+        ptr_addr >= HIGH_ADDR_IMM + (npage << PAGE_SHIFT) ||
+        (ptr_addr & (KMALLOC_ALIGN - 1)) != 0) {
+        panic("kmalloc: free: invalid pointer: 0x%016lx\n", ptr_addr);
     }
 
-    cur_node->free = 1;
+    // slab及大块内存的首部均位于`p`所在的物理页开始处
+    void *header = (void *)ROUNDDOWN(ptr_addr, PAGE_SIZE);
+
+    switch (*(uint32_t *)header) {
+    case KMALLOC_SLAB_MAGIC:
+        slab_free((struct KmallocSlab *)header, p);
+        break;
+    case KMALLOC_LARGE_MAGIC:
+        large_free((struct KmallocLarge *)header, p);
+        break;
+    default:
+        panic("kmalloc: free: invalid block header: ptr = 0x%016lx header = "
+              "0x%08x\n",
+              ptr_addr, *(uint32_t *)header);
+    }
 }
 
+// 碎片直方图中每个柱的最大长度（字符数）
+#define HISTOGRAM_WIDTH 32
+
 void allocation_summarize() {
     size_t allocated = 0;
     size_t left = 0;
-    size_t block_count = 0;
+    size_t slab_count = 0;
 
-    struct MBlock *cur_block = NULL;
+    debugk("allocation_summarize",
+           "class   size  slabs  in use / total  free bytes  avg req  "
+           "free slots\n");
+
+    for (u_int i = 0; i < KMALLOC_CLASS_COUNT; i++) {
+        struct KmallocClass *cls = &kmalloc_class[i];
+        size_t size = class_size(i);
+        size_t capacity =
+            cls->slab_count * ((PAGE_SIZE - KMALLOC_SLAB_OBJECT_OFFSET) / size);
+        size_t free_slots = capacity - cls->in_use;
+
+        // 外部碎片：已分配给slab但未使用的对象，按其在slab中所占比例绘制
+        char bar[HISTOGRAM_WIDTH + 1];
+        size_t bar_len =
+            capacity == 0 ? 0 : free_slots * HISTOGRAM_WIDTH / capacity;
+
+        for (size_t j = 0; j < HISTOGRAM_WIDTH; j++) {
+            bar[j] = j < bar_len ? '#' : '.';
+        }
+        bar[HISTOGRAM_WIDTH] = '\0';
 
-    LIST_FOREACH(cur_block, &mblock_list, mb_link) {
-        block_count++;
+        // 内部碎片：请求大小的平均值与大小类之差
+        size_t avg_requested =
+            cls->alloc_count == 0 ? 0 : cls->requested_bytes / cls->alloc_count;
 
-        allocated += sizeof(struct MBlock);
+        debugk("allocation_summarize",
+               "%5u %6lu %6lu %7lu / %-5lu %10lu %8lu  [%s]\n", i, size,
+               cls->slab_count, cls->in_use, capacity, free_slots * size,
+               avg_requested, bar);
 
-        if (cur_block->free == 0) {
-            allocated += cur_block->size;
-        } else {
-            left += cur_block->size;
-        }
+        slab_count += cls->slab_count;
+        allocated += cls->in_use * size;
+        left += free_slots * size;
     }
 
     debugk("allocation_summarize",
-           "block = %lu total = %lu allocated = %lu left = %lu total requested "
-           "= %lu total freed = %lu\n",
-           block_count, allocated + left, allocated, left,
+           "slab = %lu large = %lu (%lu pages) allocated = %lu left = %lu "
+           "total requested = %lu total freed = %lu\n",
+           slab_count, large_count, large_page_count, allocated, left,
            total_requested_bytes, total_free_bytes);
-}
\ No newline at end of file
+}
@@ -1,10 +1,14 @@
 #include <bitops.h>
+#include <device_tree.h>
+#include <endian.h>
 #include <env.h>
 #include <error.h>
+#include <group.h>
 #include <mmu.h>
 #include <pmap.h>
 #include <printk.h>
 #include <queue.h>
+#include <string.h>
 #include <types.h>
 
 extern struct Env envs[NENV];
@@ -19,34 +23,197 @@ struct Page *pages; /* 描述物理页的结构体的列表，由`mips_vm_init`
 
 // 用于`alloc`分配器，指向下一个可用物理内存的虚拟地址（kseg0），由`alloc`初始化
 static u_long freemem;
-// 存储空闲物理页链表的链表头，由`page_init`初始化
-struct Page_list page_free_list;
+// 各阶空闲块链表的链表头，由`page_init`初始化
+struct Page_list page_free_list[PAGE_MAX_ORDER + 1];
+
+// 下一个尚未初始化的物理页的页框号，页框号在[0, page_init_next)中的物理页结构体已初始化
+static size_t page_init_next = 0;
+
+// 物理页结构体初始化的统计
+struct PageInitStat page_init_stat;
+
+// 预清零页池：其中的页已从伙伴系统中取出（`pp_ref`为 0），且内容已清零
+// 由`page_zero_pool_refill`在系统空闲时填充
+static struct Page_list page_zero_pool = {PAGE_INDEX_NULL};
+// 预清零页池中的页数
+static u_int page_zero_pool_count = 0;
+
+// 预清零页池的命中统计
+struct PageZeroPoolStat page_zero_pool_stat;
 
 extern char _kernel_end[];
 
 Pte *kernel_boot_pgdir = (Pte *)(0xFFFFFFC001000000ULL);
 
+// 设备树中物理内存区域、保留区域的最大数量
+#define MAX_MEMORY_REGION_COUNT 16
+#define MAX_RESERVED_REGION_COUNT 32
+
+// 设备树不可用时，假定的物理内存大小
+#define DEFAULT_MEMORY_SIZE 0x80000000ULL
+
+// 物理内存区域（物理地址，按起始地址升序），由`riscv64_detect_memory`初始化
+static struct memory_region memory_list[MAX_MEMORY_REGION_COUNT];
+static size_t memory_count;
+// 不可分配的保留区域（物理地址，含设备树本身），由`riscv64_detect_memory`初始化
+static struct memory_region reserved_list[MAX_RESERVED_REGION_COUNT];
+static size_t reserved_count;
+
+// 在内核页表中，将DRAM中第`index`个1 GiB直接映射到
+// [HIGH_ADDR_IMM + index * 1 GiB, HIGH_ADDR_IMM + (index + 1) * 1 GiB)
+// 第0个1 GiB已在`start.S`中映射
+static void direct_map_gigapage(u_reg_t index) {
+    u_reg_t pa = LOW_ADDR_IMM + index * P1MAP;
+
+    kernel_boot_pgdir[P1X(HIGH_ADDR_IMM) + index] =
+        (PPN(pa) << FLAG_SHIFT) | PTE_V | PTE_RWX | PTE_GLOBAL;
+}
+
 /* 概述：
  *
- *   使用入参`_memsize`（来自 bootloader）设置`memsize`、`npage`
+ *   从设备树（`/memory`节点、保留内存表及`/reserved-memory`节点）中获取物理内存布局，
+ *   设置`memsize`、`npage`，并将全部物理内存直接映射到内核地址空间。
  *
- *   Use '_memsize' from bootloader to initialize 'memsize' and
- *   calculate the corresponding 'npage' value.
+ *   - 支持多个物理内存区域，区域之间的空洞不会被分配
+ *   - 物理页号从DRAM起始处（0x80000000）开始计算，低于该地址的内存将被忽略；
+ *     超出直接映射区域最大大小（`DIRECT_MAP_MAX_SIZE`）的内存也将被忽略
+ *   - 保留区域及设备树本身所在的物理内存不会被分配（见`page_init`）
+ *   - 若无法读取设备树，假定物理内存为[0x80000000, 0x80000000 +
+ * DEFAULT_MEMORY_SIZE)
+ *
+ * Precondition：
+ * - `dtb_address`为bootloader传入的设备树的物理地址
+ * - 内核页表中DRAM的第一个1 GiB已被直接映射（`start.S`）
  *
  * 副作用：
  *
- * - 设置全局变量 memsize：最大可用的物理地址
+ * - 设置全局变量 memsize：最大可用的物理地址（相对于DRAM起始处）
  * - 设置全局变量 npage：最大可用的物理页数
- * - 输出日志：Memory size: %lu KiB, number of pages: %lu\n
+ * - 设置`memory_list`、`reserved_list`
+ * - 修改内核页表`kernel_boot_pgdir`中直接映射区域的一级页表项，刷新TLB
+ * - 输出日志：Memory size: %lu MiB, number of pages: %lu\n
  */
-void riscv64_detect_memory() {
-    /* Step 1: Initialize memsize. */
-    memsize = 0x80000000;
+void riscv64_detect_memory(void *dtb_address) {
+    u_reg_t dtb_pa = (u_reg_t)dtb_address;
+    u_reg_t max_gigapage_count = DIRECT_MAP_MAX_SIZE / P1MAP;
+    int r = -E_INVAL;
+
+    /* Step 1: Scan the device tree. */
+    // 设备树可能位于尚未映射的物理内存中，先映射其所在的（至多）两个1 GiB
+    if (dtb_pa >= LOW_ADDR_IMM &&
+        dtb_pa - LOW_ADDR_IMM + sizeof(struct fdt_header) <
+            DIRECT_MAP_MAX_SIZE) {
+        u_reg_t dtb_gigapage = (dtb_pa - LOW_ADDR_IMM) / P1MAP;
+
+        direct_map_gigapage(dtb_gigapage);
+        if (dtb_gigapage + 1 < max_gigapage_count) {
+            direct_map_gigapage(dtb_gigapage + 1);
+        }
+        tlb_flush_all();
+
+        r = fdt_scan_memory((void *)P2KADDR(dtb_pa), memory_list,
+                            MAX_MEMORY_REGION_COUNT, &memory_count,
+                            reserved_list, MAX_RESERVED_REGION_COUNT,
+                            &reserved_count);
+    }
+
+    if (r == 0 && memory_count > 0) {
+        const struct fdt_header *header =
+            (const struct fdt_header *)P2KADDR(dtb_pa);
+
+        // 设备树本身也不能被分配
+        if (reserved_count < MAX_RESERVED_REGION_COUNT) {
+            reserved_list[reserved_count].begin = dtb_pa;
+            reserved_list[reserved_count].end =
+                dtb_pa + be32toh(header->totalsize);
+            reserved_count++;
+        } else {
+            panic("too many reserved memory regions");
+        }
+    } else {
+        printk("Cannot get memory layout from device tree at 0x%016lx, "
+               "assume %lu MiB\n",
+               dtb_pa, DEFAULT_MEMORY_SIZE / 1024 / 1024);
+
+        memory_list[0].begin = LOW_ADDR_IMM;
+        memory_list[0].end = LOW_ADDR_IMM + DEFAULT_MEMORY_SIZE;
+        memory_count = 1;
+        reserved_count = 0;
+    }
+
+    /* Step 2: Clip, align and sort memory regions. */
+    size_t valid_count = 0;
+
+    // 页框号须能以`PAGE_INDEX_BITS`位表示（且不等于`PAGE_INDEX_NULL`）
+    u_reg_t max_end =
+        MIN(LOW_ADDR_IMM + DIRECT_MAP_MAX_SIZE,
+            LOW_ADDR_IMM + ((u_reg_t)PAGE_INDEX_NULL << PAGE_SHIFT));
+
+    for (size_t i = 0; i < memory_count; i++) {
+        u_reg_t begin = ROUND(memory_list[i].begin, PAGE_SIZE);
+        u_reg_t end = ROUNDDOWN(memory_list[i].end, PAGE_SIZE);
+
+        if (begin < LOW_ADDR_IMM || end > max_end) {
+            printk("Memory region 0x%016lx - 0x%016lx is partially outside "
+                   "the direct map, clipped\n",
+                   memory_list[i].begin, memory_list[i].end);
 
-    /* Step 2: Calculate the corresponding 'npage' value. */
+            begin = MAX(begin, LOW_ADDR_IMM);
+            end = MIN(end, max_end);
+        }
+
+        if (begin >= end) {
+            continue;
+        }
+
+        // 插入排序，按起始地址升序
+        size_t j = valid_count;
+        while (j > 0 && memory_list[j - 1].begin > begin) {
+            memory_list[j] = memory_list[j - 1];
+            j--;
+        }
+        memory_list[j].begin = begin;
+        memory_list[j].end = end;
+
+        valid_count++;
+    }
+
+    memory_count = valid_count;
+
+    panic_on(memory_count == 0);
+
+    /* Step 3: Initialize memsize and npage. */
+    memsize = 0;
+    for (size_t i = 0; i < memory_count; i++) {
+        memsize = MAX(memsize, memory_list[i].end - LOW_ADDR_IMM);
+    }
 
     npage = memsize >> PAGE_SHIFT;
 
+    /* Step 4: Direct map all physical memory. */
+    u_reg_t gigapage_count = ROUND(memsize, P1MAP) / P1MAP;
+
+    for (u_reg_t i = 1; i < max_gigapage_count; i++) {
+        if (i < gigapage_count) {
+            direct_map_gigapage(i);
+        } else {
+            // 取消为读取设备树而建立的、超出物理内存的映射
+            kernel_boot_pgdir[P1X(HIGH_ADDR_IMM) + i] = 0;
+        }
+    }
+
+    tlb_flush_all();
+
+    for (size_t i = 0; i < memory_count; i++) {
+        printk("Memory region: 0x%016lx - 0x%016lx\n", memory_list[i].begin,
+               memory_list[i].end);
+    }
+
+    for (size_t i = 0; i < reserved_count; i++) {
+        printk("Reserved region: 0x%016lx - 0x%016lx\n",
+               reserved_list[i].begin, reserved_list[i].end);
+    }
+
     printk("Memory size: %lu MiB, number of pages: %lu\n",
            memsize / 1024 / 1024, npage);
 }
@@ -111,9 +278,24 @@ void *alloc(u_int n, u_int align, int clear) {
 }
 /* End of Key Code "alloc" */
 
+// 为内核共享区域[KERNEL_SHARED_BEGIN_VA, KERNEL_SHARED_END_VA)预先分配二级页表，
+// 此后复制内核页目录的进程将引用同一组二级页表
+static void kernel_shared_table_init(void) {
+    for (u_reg_t p1no = P1X(KERNEL_SHARED_BEGIN_VA);
+         p1no <= P1X(KERNEL_SHARED_END_VA - 1); p1no++) {
+        Pte *p1_entry = &kernel_boot_pgdir[p1no];
+
+        panic_on(*p1_entry & PTE_V);
+
+        Pte *p2 = (Pte *)alloc(PAGE_SIZE, PAGE_SIZE, 1);
+
+        *p1_entry = (PPN(PADDR(p2)) << FLAG_SHIFT) | PTE_V;
+    }
+}
+
 /* 概述：
  *
- *   分配存储物理页信息的`Page`结构体数组
+ *   分配存储物理页信息的`Page`结构体数组，并为内核共享区域预先分配二级页表
  *
  * Precondition：
  *
@@ -122,6 +304,7 @@ void *alloc(u_int n, u_int align, int clear) {
  * 副作用：
  *
  * - 设置全局变量 pages：存储物理页信息的`Page`结构体数组
+ * - 修改内核页表`kernel_boot_pgdir`中内核共享区域的一级页表项
  * - 输出日志："to memory 0x%016lx for struct
  * Pages.\n"（对应`Page`结构体数组顶端的虚拟地址（kseg0）
  * - 输出日志："pmap.c:\t riscv64 vm init success\n"
@@ -131,80 +314,236 @@ void riscv64_vm_init() {
      * for physical memory management. Then, map virtual address `UPAGES` to
      * physical address `pages` allocated before. For consideration of
      * alignment, you should round up the memory size before map. */
-    pages = (struct Page *)alloc(npage * sizeof(struct Page), PAGE_SIZE, 1);
+    // 无需清零：`page_init`/`page_init_deferred`将逐页初始化
+    pages = (struct Page *)alloc(npage * sizeof(struct Page), PAGE_SIZE, 0);
+
+    kernel_shared_table_init();
 
     printk("to memory 0x%016lx for struct Pages.\n", freemem);
     printk("pmap.c:\t riscv64 vm init success\n");
 }
 
+// 若物理页`pa`与某个保留区域重叠，返回该区域的结束地址；否则返回0
+static u_reg_t reserved_region_end(u_reg_t pa) {
+    for (size_t i = 0; i < reserved_count; i++) {
+        if (reserved_list[i].begin < pa + PAGE_SIZE &&
+            reserved_list[i].end > pa) {
+            return reserved_list[i].end;
+        }
+    }
+
+    return 0;
+}
+
+// 返回大于`pa`的、最近的保留区域起始地址；若不存在，返回~0
+static u_reg_t next_reserved_begin(u_reg_t pa) {
+    u_reg_t result = ~0ULL;
+
+    for (size_t i = 0; i < reserved_count; i++) {
+        if (reserved_list[i].begin > pa) {
+            result = MIN(result, reserved_list[i].begin);
+        }
+    }
+
+    return result;
+}
+
+// 将物理页号在[begin, end)中的物理页标记为空闲
+// 贪心地切分：每次取以当前页开始的、对齐且不越界的最大块，插入对应阶的链表尾部
+// `order_tail`为各阶链表当前的尾元素
+static void page_init_free_range(size_t begin, size_t end,
+                                 struct Page **order_tail) {
+    size_t i = begin;
+
+    while (i < end) {
+        u_int order = PAGE_MAX_ORDER;
+
+        while ((i & ((1UL << order) - 1)) != 0 || i + (1UL << order) > end) {
+            order--;
+        }
+
+        for (size_t j = i; j < i + (1UL << order); j++) {
+            pages[j].pp_ref = 0;
+        }
+
+        struct Page *pp = &pages[i];
+
+        pp->pp_order = order;
+
+        if (order_tail[order] == NULL) {
+            page_list_insert_head(&page_free_list[order], pp);
+        } else {
+            page_list_insert_after(order_tail[order], pp);
+        }
+        order_tail[order] = pp;
+
+        i += 1UL << order;
+    }
+}
+
 /*
  * 概述：
+ *   初始化页框号在[begin, end)中的物理页结构体。
+ *
+ *   先将这些页全部标注为占用（引用计数为 1），再将其中位于物理内存区域内、
+ *   且不属于保留区域及`freemem`之前已分配内存的页，按地址从低到高，
+ *   切分为尽可能大的、对齐的块，插入到对应阶的空闲块链表尾部。
  *
- *   初始化物理页管理：初始化空闲物理页链表、标注占用的物理页，物理页将通过引用计数管理
+ * Precondition：
+ * - `begin`、`end`均为`1 << PAGE_MAX_ORDER`的整数倍，或`end`等于`npage`
+ *  （从而块及其伙伴不会跨越已初始化与未初始化的页）
+ * - `order_tail`为各阶链表当前的尾元素（链表为空时为NULL）
+ *
+ * Postcondition：
+ * - 返回其中空闲页的数目
+ */
+static size_t page_init_range(size_t begin, size_t end,
+                              struct Page **order_tail) {
+    for (size_t i = begin; i < end; i++) {
+        pages[i].pp_ref = 1;
+        pages[i].pp_next = PAGE_INDEX_NULL;
+        pages[i].pp_order = PAGE_ORDER_NONE;
+        pages[i].pp_flags = 0;
+    }
+
+    size_t free_page_count = 0;
+    u_reg_t range_begin = LOW_ADDR_IMM + (begin << PAGE_SHIFT);
+    u_reg_t range_end = LOW_ADDR_IMM + (end << PAGE_SHIFT);
+
+    for (size_t i = 0; i < memory_count; i++) {
+        u_reg_t pa = MAX(memory_list[i].begin, PADDR(freemem));
+        pa = MAX(pa, range_begin);
+        u_reg_t region_end = MIN(memory_list[i].end, range_end);
+
+        while (pa < region_end) {
+            u_reg_t reserved_end = reserved_region_end(pa);
+
+            if (reserved_end != 0) {
+                pa = ROUND(reserved_end, PAGE_SIZE);
+                continue;
+            }
+
+            u_reg_t run_end =
+                MIN(region_end, ROUNDDOWN(next_reserved_begin(pa), PAGE_SIZE));
+
+            page_init_free_range(PPN(pa - LOW_ADDR_IMM),
+                                 PPN(run_end - LOW_ADDR_IMM), order_tail);
+
+            free_page_count += PPN(run_end - pa);
+
+            pa = run_end;
+        }
+    }
+
+    return free_page_count;
+}
+
+/*
+ * 概述：
+ *
+ *   初始化物理页管理：初始化各阶空闲块链表、标注占用的物理页，物理页将通过引用计数管理
  *
  *   具体地，将内核映像占用的物理页、
  *   之前使用 alloc 分配/部分分配的物理页
- *  （全局变量 freemem 的值，向上对齐到页大小），标注为占用（引用计数为 1）
- *   并将剩余未占用的物理页插入到空闲物理页链表。
+ *  （全局变量 freemem 的值，向上对齐到页大小）、
+ *   物理内存区域之间的空洞，以及保留区域（含设备树），标注为占用（引用计数为 1），
+ *   并将剩余未占用的物理页按地址从低到高，切分为尽可能大的、对齐的块，
+ *   插入到对应阶的空闲块链表尾部（从而低地址的块位于链表头部，优先被分配）。
+ *
+ *   为缩短启动时间，本函数只初始化已分配内存之后的`PAGE_INIT_BOOT_CHUNKS`个块组
+ *  （每组`PAGE_INIT_CHUNK_PAGES`页），其余物理页的结构体留待`page_init_deferred`
+ *   在内存不足或系统空闲时分批初始化。
  *
  * Precondition：
  * - 全局变量`freemem`必须正确指向下一处空闲物理内存的虚拟地址
+ * - `riscv64_detect_memory`已被调用
  *
  * 副作用：
  *
  * - 根据占用情况修改`pages`中的物理页结构体
  * - 设置全局变量`freemem`：原值向上对齐到页面大小
- * - 设置全局变量`page_free_list`：为合法的空闲物理页链表头
+ * - 设置全局变量`page_free_list`：为合法的各阶空闲块链表头
  *
  */
 void page_init(void) {
     /* Step 1: Initialize page_free_list. */
-    /* Hint: Use macro `LIST_INIT` defined in include/queue.h. */
+    /* Hint: Use `page_list_init` defined in include/pmap.h. */
     /* Exercise 2.3: Your code here. (1/4) */
 
-    LIST_INIT(&page_free_list);
+    // 各阶链表当前的尾元素，用于将块按地址顺序插入链表尾部
+    struct Page *order_tail[PAGE_MAX_ORDER + 1];
+
+    for (u_int order = 0; order <= PAGE_MAX_ORDER; order++) {
+        page_list_init(&page_free_list[order]);
+        order_tail[order] = NULL;
+    }
 
     /* Step 2: Align `freemem` up to multiple of PAGE_SIZE. */
     /* Exercise 2.3: Your code here. (2/4) */
 
     freemem = ROUND(freemem, PAGE_SIZE);
 
-    /* Step 3: Mark all memory below `freemem` as used (set `pp_ref` to 1) */
+    /* Step 3: Mark memory as used (set `pp_ref` to 1) */
     /* Exercise 2.3: Your code here. (3/4) */
 
     // 注意：`freemem`指向的是下一处空闲物理内存的**虚拟地址**（kseg0)
     size_t used_page_count = DRAMADDR(freemem) / PAGE_SIZE;
 
-    printk("free memory starts at 0x%016lx, page: %ld / %ld (used / total)\n",
-           freemem, used_page_count, npage);
+    // 启动时初始化的页：已分配内存所在的块组，及其后的若干块组
+    size_t boot_page_count =
+        MIN(ROUND(used_page_count, PAGE_INIT_CHUNK_PAGES) +
+                PAGE_INIT_BOOT_CHUNKS * PAGE_INIT_CHUNK_PAGES,
+            npage);
 
-    for (size_t i = 0; i < used_page_count; i++) {
-        pages[i].pp_ref = 1;
-    }
-
-    /* Step 4: Mark the other memory as free. */
+    /* Step 4: Mark the free memory in each memory region as free. */
     /* Exercise 2.3: Your code here. (4/4) */
 
-    for (size_t i = npage - 1; i >= used_page_count; i--) {
-        pages[i].pp_ref = 0;
+    size_t free_page_count = page_init_range(0, boot_page_count, order_tail);
 
-        LIST_INSERT_HEAD(&page_free_list, &pages[i], pp_link);
-    }
+    page_init_next = boot_page_count;
+    page_init_stat.boot_pages = boot_page_count;
+    page_init_stat.boot_free_pages = free_page_count;
+
+    printk("free memory starts at 0x%016lx, page: %ld / %ld / %ld / %ld (used "
+           "/ free / deferred / total)\n",
+           freemem, used_page_count, free_page_count, npage - boot_page_count,
+           npage);
 
     printk("pmap.c:\t page init success\n");
 }
 
+u_int page_init_deferred(u_int max_chunks) {
+    u_int chunk_count = 0;
+
+    while (chunk_count < max_chunks && page_init_next < npage) {
+        // 新初始化的块插入各阶链表头部，无需维护链表尾元素
+        struct Page *order_tail[PAGE_MAX_ORDER + 1] = {NULL};
+
+        size_t end = MIN(page_init_next + PAGE_INIT_CHUNK_PAGES, npage);
+
+        page_init_stat.deferred_free_pages +=
+            page_init_range(page_init_next, end, order_tail);
+        page_init_stat.deferred_chunks++;
+
+        page_init_next = end;
+        chunk_count++;
+    }
+
+    return chunk_count;
+}
+
 /*
  * 概述：
  *
  *   从空闲物理内存中分配一个物理页，并将该页内容清零。
  *
- *   具体地，移除空闲物理页链表的首元素，
- *   并将该元素的地址（struct Page *）写入到调用者指定的位置。
+ *   具体地，若预清零页池非空，直接取出其中的一页（无需清零）；
+ *   否则调用`page_alloc_order`分配一个 0 阶块并清零。
+ *   将该页的地址（struct Page *）写入到调用者指定的位置。
  *
  * Precondition：
  * - 参数`new`必须是指向有效`struct Page*`内存位置的**非空指针**
- * - 全局变量`page_free_list`必须是合法的空闲物理页链表的首节点
+ * - 全局变量`page_free_list`必须已由`page_init`初始化
  *
  * Postcondition：
  * -
@@ -217,40 +556,269 @@ void page_init(void) {
  *
  */
 int page_alloc(struct Page **new) {
-    /* Step 1: Get a page from free memory. If fails, return the error code.*/
+    struct Page *pp = page_list_first(&page_zero_pool);
+
+    // 优先使用预清零页池中的页，从而无需在此处清零
+    if (pp != NULL) {
+        page_list_remove(&page_zero_pool, pp);
+        pp->pp_flags &= ~PAGE_FLAG_ZERO;
+        page_zero_pool_count--;
+        page_zero_pool_stat.zero_hit++;
+
+        *new = pp;
+        return 0;
+    }
+
+    page_zero_pool_stat.zero_miss++;
+
+    return page_alloc_order(0, new);
+}
+
+/*
+ * 概述：
+ *   将预清零页池中的所有页归还伙伴系统。
+ *
+ * 副作用：
+ * - 修改`page_zero_pool`、`page_zero_pool_count`
+ * - 修改全局变量`page_free_list`
+ */
+static void page_zero_pool_drain(void) {
     struct Page *pp;
-    /* Exercise 2.4: Your code here. (1/2) */
 
-    // Precondition: `head` must point to a valid linked list
-    pp = LIST_FIRST(&page_free_list);
+    while ((pp = page_list_first(&page_zero_pool)) != NULL) {
+        page_list_remove(&page_zero_pool, pp);
+        pp->pp_flags &= ~PAGE_FLAG_ZERO;
+        page_free_order(pp, 0);
+    }
 
-    if (pp == NULL) {
+    page_zero_pool_count = 0;
+}
+
+/*
+ * 概述：
+ *   从伙伴系统中取出`1 << order`个连续物理页，**不清零**。
+ *
+ *   具体地，从阶数不小于`order`的最小非空空闲块链表中取出一个块，
+ *   若该块大于所需大小，则逐次对半拆分，将拆出的高地址一半插入低一阶的空闲块链表。
+ *
+ * Postcondition：
+ * - 成功时返回 0，将块的首页设置到`*new`
+ * - 失败时返回-E_INVAL（`order`非法）或-E_NO_MEM，不修改`*new`
+ */
+static int buddy_alloc(u_int order, struct Page **new) {
+    struct Page *pp;
+
+    if (order > PAGE_MAX_ORDER) {
+        return -E_INVAL;
+    }
+
+    /* Step 1: Find the smallest non-empty free list of order >= `order`. */
+    u_int current_order = order;
+
+    while (current_order <= PAGE_MAX_ORDER &&
+           page_list_empty(&page_free_list[current_order])) {
+        current_order++;
+    }
+
+    if (current_order > PAGE_MAX_ORDER) {
         return -E_NO_MEM;
     }
 
-    // Precondition:
-    // - `pp` is a non-NULL pointer to a valid list element
-    // - `pp` is already part of the linked list
-    // - `pp_link` is the name of the list entry structure within 'elm' that
-    // contains 'le_prev' and 'le_next' members.
-    // - 'pp->field.le_prev' must point to a valid pointer,
-    // this is guaranteed by `LIST_INSERT_HEAD`, which holds even for the first
-    // node of the linked list in which case its le_prev points to the header's
-    // lh_first field
-    LIST_REMOVE(pp, pp_link);
-
-    /* Step 2: Initialize this page with zero.
-     * Hint: use `memset`. */
-    /* Exercise 2.4: Your code here. (2/2) */
-    // 注意，所有访存使用的都是虚拟地址
-    u_long page_begin_vaddr = page2kva(pp);
+    pp = page_list_first(&page_free_list[current_order]);
+
+    page_list_remove(&page_free_list[current_order], pp);
+    pp->pp_order = PAGE_ORDER_NONE;
+
+    /* Step 2: Split the block until it has the requested size. */
+    // 保留低地址的一半，高地址的一半作为伙伴块插入低一阶的链表
+    while (current_order > order) {
+        current_order--;
+
+        struct Page *buddy = pp + (1UL << current_order);
+
+        buddy->pp_order = current_order;
+
+        page_list_insert_head(&page_free_list[current_order], buddy);
+    }
+
+    *new = pp;
+    return 0;
+}
+
+// 从伙伴系统中取出`1 << order`个连续物理页，**不清零**
+// 若空闲页不足，逐个初始化尚未初始化的块组后重试
+static int buddy_alloc_deferred(u_int order, struct Page **new) {
+    int r;
+
+    while ((r = buddy_alloc(order, new)) == -E_NO_MEM) {
+        if (page_init_deferred(1) == 0) {
+            break;
+        }
+
+        page_init_stat.shortage_chunks++;
+    }
+
+    return r;
+}
+
+// 从伙伴系统中取出`1 << order`个连续物理页，**不清零**
+// 空闲页不足时，初始化尚未初始化的块组，并回收预清零页池中的页
+static int buddy_alloc_reclaim(u_int order, struct Page **new) {
+    int r = buddy_alloc_deferred(order, new);
+
+    // 内存紧张时，预清零页池中的页应当可被回收
+    if (r == -E_NO_MEM && page_zero_pool_count > 0) {
+        page_zero_pool_drain();
+
+        r = buddy_alloc(order, new);
+    }
+
+    return r;
+}
+
+/*
+ * 概述：
+ *   从伙伴系统中取出一个对齐到`count`页、全部空闲的物理页范围[base, base + count)，
+ *   用于分配超过伙伴系统最大阶数的巨页，**不清零**。
+ *
+ * Precondition：
+ * - `count`是`1 << PAGE_MAX_ORDER`的整数倍，且是 2 的整数幂
+ */
+static int buddy_alloc_range(size_t count, struct Page **new) {
+    // 范围内的所有页都必须位于空闲块链表中：
+    // 尚未初始化的页及预清零页池中的页不在空闲块链表中
+    page_init_deferred(~0U);
+    page_zero_pool_drain();
+
+    for (size_t base = 0; base + count <= npage; base += count) {
+        size_t i = base;
+
+        // 空闲块对齐到其大小，且不超过`1 << PAGE_MAX_ORDER`页，不会跨越范围的边界
+        while (i < base + count && pages[i].pp_order != PAGE_ORDER_NONE) {
+            i += 1UL << pages[i].pp_order;
+        }
+
+        if (i < base + count) {
+            continue;
+        }
+
+        for (i = base; i < base + count;) {
+            u_int order = pages[i].pp_order;
+
+            page_list_remove(&page_free_list[order], &pages[i]);
+            pages[i].pp_order = PAGE_ORDER_NONE;
+
+            i += 1UL << order;
+        }
+
+        *new = &pages[base];
+        return 0;
+    }
+
+    return -E_NO_MEM;
+}
+
+int page_alloc_huge(u_int order, int clear, struct Page **new) {
+    struct Page *pp;
+    int r;
+
+    if (order == PAGE_HUGE_ORDER(2)) {
+        r = buddy_alloc_reclaim(order, &pp);
+    } else if (order == PAGE_HUGE_ORDER(1)) {
+        r = buddy_alloc_range(1UL << order, &pp);
+    } else {
+        return -E_INVAL;
+    }
+
+    if (r != 0) {
+        return r;
+    }
+
+    if (clear) {
+        memset((void *)page2kva(pp), 0, PAGE_SIZE << order);
+    }
 
-    memset((void *)page_begin_vaddr, 0, PAGE_SIZE);
+    pp->pp_flags |= PAGE_FLAG_HUGE;
+    pp->pp_next = order;
 
     *new = pp;
     return 0;
 }
 
+int page_alloc_order(u_int order, struct Page **new) {
+    struct Page *pp;
+    int r = buddy_alloc_reclaim(order, &pp);
+
+    if (r != 0) {
+        return r;
+    }
+
+    // 注意，所有访存使用的都是虚拟地址
+    memset((void *)page2kva(pp), 0, PAGE_SIZE << order);
+
+    *new = pp;
+    return 0;
+}
+
+int page_alloc_nozero(struct Page **new) {
+    struct Page *pp;
+
+    page_zero_pool_stat.nozero_alloc++;
+
+    if (buddy_alloc_deferred(0, new) == 0) {
+        return 0;
+    }
+
+    // 伙伴系统中已无空闲页，使用预清零页池中的页
+    if ((pp = page_list_first(&page_zero_pool)) != NULL) {
+        page_list_remove(&page_zero_pool, pp);
+        pp->pp_flags &= ~PAGE_FLAG_ZERO;
+        page_zero_pool_count--;
+
+        *new = pp;
+        return 0;
+    }
+
+    return -E_NO_MEM;
+}
+
+void page_zero_pool_refill(u_int max_count) {
+    struct Page *pp;
+
+    for (u_int i = 0; i < max_count; i++) {
+        if (page_zero_pool_count >= PAGE_ZERO_POOL_SIZE) {
+            return;
+        }
+
+        if (buddy_alloc(0, &pp) != 0) {
+            return;
+        }
+
+        memset((void *)page2kva(pp), 0, PAGE_SIZE);
+
+        pp->pp_flags |= PAGE_FLAG_ZERO;
+        page_list_insert_head(&page_zero_pool, pp);
+        page_zero_pool_count++;
+        page_zero_pool_stat.refilled++;
+    }
+}
+
+void page_init_summarize(void) {
+    printk("page init: %lu pages at boot (%lu free), %lu deferred chunks "
+           "(%lu on shortage, %lu free pages), %lu / %lu pages initialized\n",
+           page_init_stat.boot_pages, page_init_stat.boot_free_pages,
+           page_init_stat.deferred_chunks, page_init_stat.shortage_chunks,
+           page_init_stat.deferred_free_pages, page_init_next, npage);
+}
+
+void page_zero_pool_summarize(void) {
+    printk("page zero pool: %u / %u pages, page_alloc hit %lu miss %lu, "
+           "page_alloc_nozero %lu, refilled %lu\n",
+           page_zero_pool_count, PAGE_ZERO_POOL_SIZE,
+           page_zero_pool_stat.zero_hit, page_zero_pool_stat.zero_miss,
+           page_zero_pool_stat.nozero_alloc, page_zero_pool_stat.refilled);
+}
+
 /* 概述：
  *   释放页面'pp'并将其标记为空闲。
  *
@@ -263,12 +831,146 @@ int page_alloc(struct Page **new) {
  *
  * - `pp->pp_ref`的值不为 0
  */
-void page_free(struct Page *pp) {
+void page_free(struct Page *pp) { page_free_order(pp, 0); }
+
+void page_free_order(struct Page *pp, u_int order) {
+    assert(pp->pp_ref == 0);
+
+    size_t index = (size_t)(pp - pages);
+
+    panic_on(order > PAGE_MAX_ORDER);
+    panic_on((index & ((1UL << order) - 1)) != 0);
+
+    // 逐级尝试与伙伴块合并
+    // 伙伴块必须是同阶的空闲块首页，否则停止合并
+    while (order < PAGE_MAX_ORDER) {
+        size_t buddy_index = index ^ (1UL << order);
+
+        if (buddy_index >= npage) {
+            break;
+        }
+
+        struct Page *buddy = &pages[buddy_index];
+
+        if (buddy->pp_order != order) {
+            break;
+        }
+
+        page_list_remove(&page_free_list[order], buddy);
+        buddy->pp_order = PAGE_ORDER_NONE;
+
+        index = MIN(index, buddy_index);
+        order++;
+    }
+
+    pp = &pages[index];
+
+    pp->pp_order = order;
+
+    page_list_insert_head(&page_free_list[order], pp);
+}
+
+void page_free_range(struct Page *pp, size_t count) {
+    size_t i = page2index(pp);
+    size_t end = i + count;
+
+    while (i < end) {
+        u_int order = PAGE_MAX_ORDER;
+
+        while ((i & ((1UL << order) - 1)) != 0 || i + (1UL << order) > end) {
+            order--;
+        }
+
+        for (size_t j = i; j < i + (1UL << order); j++) {
+            pages[j].pp_ref = 0;
+        }
+
+        page_free_order(&pages[i], order);
+
+        i += 1UL << order;
+    }
+}
+
+void page_free_huge(struct Page *pp) {
+    u_int order = page_huge_order(pp);
+
+    assert(order != 0);
     assert(pp->pp_ref == 0);
-    /* Just insert it into 'page_free_list'. */
-    /* Exercise 2.5: Your code here. */
 
-    LIST_INSERT_HEAD(&page_free_list, pp, pp_link);
+    pp->pp_flags &= ~PAGE_FLAG_HUGE;
+
+    page_free_range(pp, 1UL << order);
+}
+
+// 分配一个用于存储页表项的物理页，该页表尚未被共享（见`page_table_share`）
+static int page_table_alloc(struct Page **new) {
+    try(page_alloc(new));
+
+    (*new)->pp_next = 0;
+
+    return 0;
+}
+
+/* 概述：
+ *   给定指向页目录的指针`pgdir`，返回指向虚拟地址`va`对应的第`level`级（1~3）页表项的指针，
+ *   并将该页表项的级数写入`*plevel`（若非NULL）。
+ *   若途经的页表项是叶页表项（巨页），返回该页表项，此时其级数小于`level`。
+ *
+ *   按需分配页表时，若内存不足，撤销本次新建的页表，使得页目录保持不变。
+ */
+static int pgdir_walk_level(Pte *pgdir, u_reg_t va, u_int level, int create,
+                            Pte **ppte, u_int *plevel) {
+    Pte *table = pgdir;
+    // 本次新建的第一个页表对应的页表项
+    Pte *created = NULL;
+
+    for (u_int current = 1;; current++) {
+        Pte *entry = &table[PLEVELX(current, va)];
+
+        // 到达所需的级数，或遇到巨页
+        if (current == level ||
+            ((*entry & PTE_V) != 0 && PTE_IS_NON_LEAF(*entry) == 0)) {
+            *ppte = entry;
+
+            if (plevel != NULL) {
+                *plevel = current;
+            }
+
+            return 0;
+        }
+
+        if ((*entry & PTE_V) == 0) {
+            if (create == 0) {
+                *ppte = NULL;
+                return 0;
+            }
+
+            struct Page *pp = NULL;
+            int r = page_table_alloc(&pp);
+
+            if (r != 0) {
+                // 新建的页表中只有通向本级的一个页表项，其下级页表尚未分配成功
+                if (created != NULL) {
+                    page_decref(pa2page(PTE_ADDR(*created)));
+                    *created = 0;
+                }
+
+                *ppte = NULL;
+                return r;
+            }
+
+            pp->pp_ref++;
+
+            // 非叶页表项
+            *entry = (page2ppn(pp) << FLAG_SHIFT) | PTE_V;
+
+            if (created == NULL) {
+                created = entry;
+            }
+        }
+
+        table = (Pte *)P2KADDR(PTE_ADDR(*entry));
+    }
 }
 
 /* 概述：
@@ -291,217 +993,477 @@ void page_free(struct Page *pp) {
  *     - 否则分配新的物理页**用于存储页表项**，
  *       将页表条目的虚拟地址存储到*ppte 并返回 0
  *
+ * - 若途经的页表项是叶页表项（巨页），返回该页表项
+ *
  * 注意：本函数只为**页表项**分配物理页（若需要），不实际建立虚拟地址到物理地址的映射
  */
 static int pgdir_walk(Pte *pgdir, u_reg_t va, int create, Pte **ppte) {
-    /* Step 1: Get the corresponding page directory entry. */
-    /* Exercise 2.6: Your code here. (1/3) */
+    return pgdir_walk_level(pgdir, va, 3, create, ppte, NULL);
+}
+
+// 返回`va`之后（不含）第一个按`size`对齐的地址，若超出地址空间，返回`end`
+static inline u_reg_t next_boundary(u_reg_t va, u_reg_t size, u_reg_t end) {
+    u_reg_t next = ROUNDDOWN(va, size) + size;
+
+    return (next == 0 || next > end) ? end : next;
+}
 
-    Pte *p1_entry = &pgdir[P1X(va)];
+int pgdir_walk_range(Pte *pgdir, u_reg_t va, size_t len, int create,
+                     pte_range_func func, void *arg) {
+    return pgdir_walk_range_huge(pgdir, va, len, create, func, NULL, arg);
+}
+
+int pgdir_walk_range_huge(Pte *pgdir, u_reg_t va, size_t len, int create,
+                          pte_range_func func, pte_huge_func huge_func,
+                          void *arg) {
+    int r;
+
+    if (va % PAGE_SIZE != 0) {
+        panic("pgdir_walk_range: va 0x%016lx not aligned to PAGE_SIZE", va);
+    }
+
+    u_reg_t end = va + ROUND(len, PAGE_SIZE);
+
+    while (va < end) {
+        Pte p1_entry = pgdir[P1X(va)];
+
+        // 整个一级页表项未映射，直接跳过其对应的1 GiB
+        if ((p1_entry & PTE_V) == 0 && create == 0) {
+            va = next_boundary(va, P1MAP, end);
+            continue;
+        }
+
+        Pte *pte = NULL;
+        u_int level = 3;
+
+        // 先不分配页表，检查是否为巨页映射
+        try(pgdir_walk_level(pgdir, va, 3, 0, &pte, &level));
+
+        if (pte != NULL && level < 3) {
+            if (huge_func == NULL) {
+                panic("pgdir_walk_range: huge page is not supported, level = "
+                      "%u va = 0x%016lx\n",
+                      level, va);
+            }
+
+            if ((r = huge_func(pte, ROUNDDOWN(va, PLEVEL_SIZE(level)), level,
+                               arg)) != 0) {
+                return r;
+            }
+
+            va = next_boundary(va, PLEVEL_SIZE(level), end);
+            continue;
+        }
+
+        // 一个三级页表对应2 MiB
+        u_reg_t run_end = next_boundary(va, P2MAP, end);
+
+        if (pte == NULL && create != 0) {
+            try(pgdir_walk(pgdir, va, 1, &pte));
+        }
+
+        if (pte != NULL) {
+            if ((r = func(pte, va, PPN(run_end - va), arg)) != 0) {
+                return r;
+            }
+        }
+
+        va = run_end;
+    }
+
+    return 0;
+}
+
+void tlb_gather_init(struct TlbGather *tlb, uint16_t asid, int global) {
+    tlb->asid = asid;
+    tlb->global = global ? 1 : 0;
+    tlb->start = ~0ULL;
+    tlb->end = 0;
+    tlb->count = 0;
+}
+
+void tlb_gather_add(struct TlbGather *tlb, u_reg_t va, size_t len) {
+    va = ROUNDDOWN(va, PAGE_SIZE);
+    len = ROUND(len, PAGE_SIZE);
+
+    tlb->start = MIN(tlb->start, va);
+    tlb->end = MAX(tlb->end, va + len);
+    tlb->count += len / PAGE_SIZE;
+}
+
+void tlb_gather_finish(struct TlbGather *tlb) {
+    if (tlb->count == 0) {
+        return;
+    }
+
+    // 收集到的范围较小时按页清除，否则清除整个地址空间
+    if (tlb->end - tlb->start <= TLB_RANGE_INVALIDATE_MAX_PAGES * PAGE_SIZE) {
+        for (u_reg_t va = tlb->start; va < tlb->end; va += PAGE_SIZE) {
+            if (tlb->global) {
+                tlb_invalidate_global(va);
+            } else {
+                tlb_invalidate(tlb->asid, va);
+            }
+        }
+    } else if (tlb->global) {
+        tlb_flush_all();
+    } else {
+        tlb_flush_asid(tlb->asid);
+    }
+
+    tlb_gather_init(tlb, tlb->asid, tlb->global);
+}
+
+// `map_mem`的遍历参数
+struct map_mem_arg {
+    u_reg_t va;    // 映射的起始虚拟地址
+    u_reg_t pa;    // 映射的起始物理地址
+    uint32_t perm; // 标志位
+};
+
+static int map_mem_range(Pte *pte, u_reg_t va, size_t count, void *arg) {
+    struct map_mem_arg *map_arg = (struct map_mem_arg *)arg;
+    u_reg_t pa = map_arg->pa + (va - map_arg->va);
+
+    for (size_t i = 0; i < count; i++) {
+        pte[i] = (PPN(pa + i * PAGE_SIZE) << FLAG_SHIFT) | map_arg->perm;
+    }
+
+    return 0;
+}
+
+static int unmap_mem_range(Pte *pte, u_reg_t va, size_t count, void *arg) {
+    for (size_t i = 0; i < count; i++) {
+        pte[i] = 0;
+    }
+
+    return 0;
+}
+
+// 在`pgdir`对应的页表中，从`va`开始，映射长度为`len`，标志位为`perm`的内存，指向物理地址`pa`
+// 该函数仅应当用于不受空闲链表管理的内存（例如，MMIO）
+// `perm`仅应当设置低10位
+void map_mem(Pte *pgdir, u_reg_t va, u_reg_t pa, size_t len, uint32_t perm) {
+    len = ROUND(len, PAGE_SIZE);
+
+    if (va % PAGE_SIZE != 0) {
+        panic("va 0x%016lx not aligned to PAGE_SIZE", va);
+    }
+
+    if (pa % PAGE_SIZE != 0) {
+        panic("pa 0x%016lx not aligned to PAGE_SIZE", pa);
+    }
+
+    struct map_mem_arg arg = {.va = va, .pa = pa, .perm = perm};
+    struct TlbGather tlb;
+    int r;
+
+    if ((r = pgdir_walk_range(pgdir, va, len, 1, map_mem_range, &arg)) != 0) {
+        panic("failed to map va 0x%016lx - 0x%016lx: %d\n", va, va + len, r);
+    }
+
+    tlb_gather_init(&tlb, 0, 1);
+    tlb_gather_add(&tlb, va, len);
+    tlb_gather_finish(&tlb);
+}
+
+// 在`pgdir`对应的页表中，从`va`开始，取消映射长度为`len`的内存
+// 该函数仅应当用于不受空闲链表管理的内存（例如，MMIO）
+// 若对应虚拟地址未映射，本函数静默成功
+void unmap_mem(Pte *pgdir, u_reg_t va, size_t len) {
+    len = ROUND(len, PAGE_SIZE);
+
+    if (va % PAGE_SIZE != 0) {
+        panic("unmap_mem: va 0x%016lx not aligned to PAGE_SIZE", va);
+    }
+
+    struct TlbGather tlb;
+
+    pgdir_walk_range(pgdir, va, len, 0, unmap_mem_range, NULL);
+
+    tlb_gather_init(&tlb, 0, 1);
+    tlb_gather_add(&tlb, va, len);
+    tlb_gather_finish(&tlb);
+}
+
+// 在内核共享区域中，从`va`开始，映射长度为`len`，标志位为`perm`的内存，指向物理地址`pa`
+// 该函数仅应当用于不受空闲链表管理的内存（例如，MMIO）
+// `perm`仅应当设置低10位
+//
+// 内核共享区域的二级页表被所有进程的页目录引用，故只需修改内核页表，
+// 并按虚拟地址清除TLB中的相关条目
+//
+// Panics：[va, va + len)不在内核共享区域中
+void kmap(u_reg_t va, u_reg_t pa, size_t len, uint32_t perm) {
+    if (va < KERNEL_SHARED_BEGIN_VA || va + len > KERNEL_SHARED_END_VA) {
+        panic("kmap: 0x%016lx - 0x%016lx is outside the kernel shared area",
+              va, va + len);
+    }
 
-    /* Step 2: If the corresponding page table is not existent (valid) then:
-     *   * If parameter `create` is set, create one. Set the permission bits
-     * 'PTE_C_CACHEABLE | PTE_V' for this new page in the page directory. If
-     * failed to allocate a new page (out of memory), return the error.
-     *   * Otherwise, assign NULL to '*ppte' and return 0.
-     */
-    /* Exercise 2.6: Your code here. (2/3) */
+    map_mem(kernel_boot_pgdir, va, pa, len, perm);
+}
 
-    int ret = 0;
+// 在内核共享区域中，从`va`开始，取消映射长度为`len`的内存
+// 该函数仅应当用于不受空闲链表管理的内存（例如，MMIO）
+//
+// Panics：[va, va + len)不在内核共享区域中
+void kunmap(u_reg_t va, size_t len) {
+    if (va < KERNEL_SHARED_BEGIN_VA || va + len > KERNEL_SHARED_END_VA) {
+        panic("kunmap: 0x%016lx - 0x%016lx is outside the kernel shared area",
+              va, va + len);
+    }
 
-    if ((*p1_entry & PTE_V) == 0) {
-        if (create == 0) {
-            *ppte = 0;
-            return 0;
-        } else {
-            // 需要创建两级页表
+    unmap_mem(kernel_boot_pgdir, va, len);
+}
 
-            struct Page *p2_page = NULL;
-            struct Page *p3_page = NULL;
+void pte_table_free(Pte *entry, u_int level) {
+    struct Page *table_page = pa2page(PTE_ADDR(*entry));
+    Pte *table = (Pte *)page2kva(table_page);
 
-            ret = page_alloc(&p2_page);
+    // 页表被共享时，其中的映射仍被其它页表项使用，只解除本页表项对它的引用
+    if (table_page->pp_next != 0) {
+        table_page->pp_next--;
+        page_decref(table_page);
+        *entry = 0;
+        return;
+    }
 
-            if (ret == 0) {
-                ret = page_alloc(&p3_page);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(Pte); i++) {
+        if ((table[i] & PTE_V) == 0) {
+            continue;
+        }
 
-                if (ret == 0) {
-                    p2_page->pp_ref++;
-                    p3_page->pp_ref++;
+        if (level + 1 < 3 && PTE_IS_NON_LEAF(table[i])) {
+            pte_table_free(&table[i], level + 1);
+        } else {
+            page_decref(pa2page(PTE_ADDR(table[i])));
+            table[i] = 0;
+        }
+    }
 
-                    u_reg_t p2_base_physical_addr = page2pa(p2_page);
-                    u_reg_t p3_base_physical_addr = page2pa(p3_page);
+    page_decref(table_page);
+    *entry = 0;
+}
 
-                    // 非叶页表项
-                    *p1_entry = (page2ppn(p2_page) << FLAG_SHIFT) | PTE_V;
+// 返回页目录`pgdir`所属的进程，不属于任何进程（如内核页目录、测试用的页目录）时返回NULL
+// 进程的页目录所在物理页的`pp_next`记录该进程在`envs`中的下标 + 1（见`env_setup_vm`）
+static struct Env *pgdir_env(Pte *pgdir) {
+    uint32_t index = pa2page(PADDR((u_reg_t)pgdir))->pp_next;
 
-                    Pte *p2_entry =
-                        &((Pte *)P2KADDR(p2_base_physical_addr))[P2X(va)];
+    if (index == 0 || index > NENV || envs[index - 1].env_pgdir != pgdir) {
+        return NULL;
+    }
 
-                    // 要使得映射生效，至少还需要增加PTE_R标志位
-                    *p2_entry = (page2ppn(p3_page) << FLAG_SHIFT) | PTE_V;
+    return &envs[index - 1];
+}
 
-                    Pte *p3_entry =
-                        &((Pte *)P2KADDR(p3_base_physical_addr))[P3X(va)];
+uint32_t page_mapped_pages(struct Page *pp, u_int level) {
+    // 内核持有的页（如全局零页、镜像页缓存）不随映射的解除而释放
+    if ((pp->pp_flags & PAGE_FLAG_PINNED) != 0) {
+        return 0;
+    }
 
-                    *ppte = p3_entry;
-                } else {
-                    page_free(p2_page);
+    return PLEVEL_SIZE(level) / PAGE_SIZE;
+}
 
-                    *ppte = NULL;
-                    return ret;
-                }
+// 第`level`级的有效页表项`pte`（叶页表项或页表）中的映射计入资源组的物理页数
+static uint32_t pte_mapped_pages(Pte *pte, u_int level) {
+    if (level == 3 || PTE_IS_NON_LEAF(*pte) == 0) {
+        return page_mapped_pages(pa2page(PTE_ADDR(*pte)), level);
+    }
 
-            } else {
-                *ppte = NULL;
+    Pte *table = (Pte *)page2kva(pa2page(PTE_ADDR(*pte)));
+    uint32_t count = 0;
 
-                return ret;
-            }
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(Pte); i++) {
+        if ((table[i] & PTE_V) != 0) {
+            count += pte_mapped_pages(&table[i], level + 1);
         }
-    } else {
-        // 二级页表项有效
-
-        // 一级巨页
-        if (PTE_IS_NON_LEAF(*p1_entry) == 0) {
-            *ppte = p1_entry;
-        } else {
-            // 二级页表
-            u_reg_t p2_base_physical_addr = PTE_ADDR(*p1_entry);
-
-            Pte *p2_entry = &((Pte *)P2KADDR(p2_base_physical_addr))[P2X(va)];
+    }
 
-            if ((*p2_entry & PTE_V) == 0) {
-                struct Page *new = NULL;
+    return count;
+}
 
-                ret = page_alloc(&new);
+int pgdir_charge(Pte *pgdir, u_reg_t va, uint32_t charge, uint32_t refund) {
+    struct Env *e = pgdir_env(pgdir);
 
-                if (ret == 0) {
-                    new->pp_ref++;
+    // User VPT等内核建立的映射不计入
+    if (e == NULL || va >= UTOP) {
+        return 0;
+    }
 
-                    u_reg_t p3_base_physical_addr = page2pa(new);
+    if (charge > refund) {
+        return group_charge_pages(e, charge - refund);
+    }
 
-                    // 非叶页表项
-                    *p2_entry = (page2ppn(new) << FLAG_SHIFT) | PTE_V;
+    group_uncharge_pages(e, refund - charge);
 
-                    Pte *p3_entry =
-                        &((Pte *)P2KADDR(p3_base_physical_addr))[P3X(va)];
+    return 0;
+}
 
-                    *ppte = p3_entry;
-                } else {
-                    *ppte = NULL;
-                    return ret;
-                }
+int page_table_share(Pte *pgdir, u_reg_t va, struct Page *table_page) {
+    Pte *entry;
+    u_int level;
 
-            } else {
-                // 二级页表项有效
+    try(pgdir_walk_level(pgdir, va, 2, 1, &entry, &level));
 
-                if (PTE_IS_NON_LEAF(*p2_entry) == 0) {
-                    *ppte = p2_entry;
-                } else {
-                    u_reg_t p3_base_physical_addr = PTE_ADDR(*p2_entry);
+    if (level != 2 || (*entry & PTE_V) != 0) {
+        return -E_INVAL;
+    }
 
-                    Pte *p3_entry =
-                        &((Pte *)P2KADDR(p3_base_physical_addr))[P3X(va)];
+    // 非叶页表项
+    *entry = (page2ppn(table_page) << FLAG_SHIFT) | PTE_V;
 
-                    *ppte = p3_entry;
-                }
-            }
-        }
-    }
+    table_page->pp_ref++;
+    table_page->pp_next++;
 
     return 0;
 }
 
-// 在`pgdir`对应的页表中，从`va`开始，映射长度为`len`，标志位为`perm`的内存，指向物理地址`pa`
-// 该函数仅应当用于不受空闲链表管理的内存（例如，MMIO）
-// `perm`仅应当设置低10位
-void map_mem(Pte *pgdir, u_reg_t va, u_reg_t pa, size_t len, uint32_t perm) {
-    len = ROUND(len, PAGE_SIZE);
+// 同`page_unshare`，但需要清除的TLB条目记录到`tlb`中
+static int page_unshare_gather(Pte *pgdir, struct TlbGather *tlb, u_reg_t va) {
+    Pte *entry;
+    u_int level;
 
-    if (va % PAGE_SIZE != 0) {
-        panic("va 0x%016lx not aligned to PAGE_SIZE", va);
+    pgdir_walk_level(pgdir, va, 2, 0, &entry, &level);
+
+    if (entry == NULL || level != 2 || (*entry & PTE_V) == 0 ||
+        PTE_IS_NON_LEAF(*entry) == 0) {
+        return 0;
     }
 
-    if (pa % PAGE_SIZE != 0) {
-        panic("pa 0x%016lx not aligned to PAGE_SIZE", pa);
+    struct Page *shared = pa2page(PTE_ADDR(*entry));
+
+    if (shared->pp_next == 0) {
+        return 0;
     }
 
-    for (u_reg_t offset = 0; offset < len; offset += PAGE_SIZE) {
-        u_reg_t current_va = va + offset;
-        u_reg_t current_pa = pa + offset;
+    struct Page *table_page = NULL;
 
-        Pte *pte = NULL;
+    try(page_table_alloc(&table_page));
+
+    Pte *table = (Pte *)page2kva(table_page);
 
-        pgdir_walk(pgdir, current_va, 1, &pte);
+    memcpy(table, (void *)page2kva(shared), PAGE_SIZE);
 
-        if (pte == NULL) {
-            panic("failed to get page table entry for va 0x%016lx\n",
-                  current_va);
+    // 副本中的映射与原页表相同，但各物理页多了一个引用者
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(Pte); i++) {
+        if ((table[i] & PTE_V) != 0) {
+            page_incref(pa2page(PTE_ADDR(table[i])));
         }
+    }
+
+    table_page->pp_ref++;
+    shared->pp_next--;
+    page_decref(shared);
 
-        *pte = ((PPN(pa + offset) << 10) | perm);
+    // 地址转换不变，无需清除TLB
+    *entry = (page2ppn(table_page) << FLAG_SHIFT) | PTE_V;
+
+    // 若该页表被映射到User VPT中，使其指向副本
+    u_reg_t vpt_va = UVPT + (va >> P2SHIFT) * PAGE_SIZE;
+    Pte *vpt_pte;
+
+    if (page_lookup(pgdir, vpt_va, &vpt_pte) == shared) {
+        try(page_insert_gather(pgdir, tlb, table_page, vpt_va,
+                               PTE_FLAGS(*vpt_pte) & ~PTE_V));
     }
 
-    tlb_flush_all();
+    return 0;
 }
 
-// 在`pgdir`对应的页表中，从`va`开始，取消映射长度为`len`的内存
-// 该函数仅应当用于不受空闲链表管理的内存（例如，MMIO）
-// 若对应虚拟地址未映射，本函数静默成功
-void unmap_mem(Pte *pgdir, u_reg_t va, size_t len) {
-    len = ROUND(len, PAGE_SIZE);
+int page_unshare(Pte *pgdir, uint16_t asid, u_reg_t va) {
+    struct TlbGather tlb;
 
-    if (va % PAGE_SIZE != 0) {
-        panic("unmap_mem: va 0x%016lx not aligned to PAGE_SIZE", va);
-    }
+    tlb_gather_init(&tlb, asid, 0);
 
-    for (u_reg_t offset = 0; offset < len; offset += PAGE_SIZE) {
-        u_reg_t current_va = va + offset;
+    int r = page_unshare_gather(pgdir, &tlb, va);
 
-        Pte *pte = NULL;
+    tlb_gather_finish(&tlb);
 
-        pgdir_walk(pgdir, current_va, 0, &pte);
+    return r;
+}
 
-        if (pte != NULL) {
-            *pte = 0;
+/*
+ * 概述：
+ *   将第`level`级（1 或 2）的巨页映射`*pte`（映射[va, va + PLEVEL_SIZE(level))）
+ *   拆分为下一级页表中的 512 个映射，标志位不变。
+ *
+ *   若巨页只被该映射引用，直接将其拆分为下一级的物理页/巨页；
+ *   否则下一级的映射仍指向原巨页中的物理页，原映射的一个引用变为 512 个，均计入巨页的首页。
+ *
+ * Postcondition：
+ * - 成功时返回 0，无法分配页表时返回-E_NO_MEM，此时映射不变
+ */
+static int pte_huge_split(Pte *pte, struct TlbGather *tlb, u_reg_t va,
+                          u_int level) {
+    struct Page *pp = pa2page(PTE_ADDR(*pte));
+    struct Page *head = page_head(pp);
+    u_int sub_order = PAGE_HUGE_ORDER(level + 1);
+    uint32_t perm = PTE_FLAGS(*pte);
+    struct Page *table_page = NULL;
+    size_t count = PAGE_SIZE / sizeof(Pte);
+
+    try(page_table_alloc(&table_page));
+
+    Pte *table = (Pte *)page2kva(table_page);
+
+    // 该映射覆盖整个巨页（而非被共享的更大巨页的一部分），且是其唯一的引用
+    if (head == pp && page_huge_order(pp) == PAGE_HUGE_ORDER(level) &&
+        pp->pp_ref == 1) {
+        pp->pp_flags &= ~PAGE_FLAG_HUGE;
+
+        for (size_t i = 0; i < count; i++) {
+            struct Page *sub = pp + (i << sub_order);
+
+            sub->pp_ref = 1;
+
+            if (sub_order != 0) {
+                sub->pp_flags |= PAGE_FLAG_HUGE;
+                sub->pp_next = sub_order;
+            }
+
+            table[i] = (page2ppn(sub) << FLAG_SHIFT) | perm;
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            table[i] = (page2ppn(pp + (i << sub_order)) << FLAG_SHIFT) | perm;
         }
+
+        head->pp_ref += (uint32_t)count - 1;
     }
 
-    tlb_flush_all();
-}
+    table_page->pp_ref++;
 
-// 在内核启动时所用的页表，以及所有进程的页表中
-// 从`va`开始，映射长度为`len`，标志位为`perm`的内存，指向物理地址`pa`
-// 该函数仅应当用于不受空闲链表管理的内存（例如，MMIO）
-// `perm`仅应当设置低10位
-//
-// Precondition：Env应当已经初始化
-void kmap(u_reg_t va, u_reg_t pa, size_t len, uint32_t perm) {
-    map_mem(kernel_boot_pgdir, va, pa, len, perm);
+    // 非叶页表项
+    *pte = (page2ppn(table_page) << FLAG_SHIFT) | PTE_V;
+    tlb_gather_add(tlb, va, PLEVEL_SIZE(level));
+
+    return 0;
+}
 
-    for (size_t i = 0; i < NENV; i++) {
-        struct Env *current_env = &envs[i];
+// 同`page_split`，但需要清除的TLB条目记录到`tlb`中
+static int page_split_gather(Pte *pgdir, struct TlbGather *tlb, u_reg_t va) {
+    Pte *pte;
+    u_int level;
 
-        if (current_env->env_status != ENV_FREE) {
-            map_mem(current_env->env_pgdir, va, pa, len, perm);
-        }
+    while (page_lookup_level(pgdir, va, &pte, &level) != NULL && level < 3) {
+        try(pte_huge_split(pte, tlb, ROUNDDOWN(va, PLEVEL_SIZE(level)), level));
     }
+
+    return 0;
 }
 
-// 在内核启动时所用的页表，以及所有进程的页表中
-// 从`va`开始，取消映射长度为`len`的内存
-// 该函数仅应当用于不受空闲链表管理的内存（例如，MMIO）
-//
-// Precondition：Env应当已经初始化
-void kunmap(u_reg_t va, size_t len) {
-    unmap_mem(kernel_boot_pgdir, va, len);
+int page_split(Pte *pgdir, uint16_t asid, u_reg_t va) {
+    struct TlbGather tlb;
 
-    for (size_t i = 0; i < NENV; i++) {
-        struct Env *current_env = &envs[i];
+    tlb_gather_init(&tlb, asid, 0);
 
-        if (current_env->env_status != ENV_FREE) {
-            unmap_mem(current_env->env_pgdir, va, len);
-        }
-    }
+    int r = page_split_gather(pgdir, &tlb, va);
+
+    tlb_gather_finish(&tlb);
+
+    return r;
 }
 
 /* 概述：
@@ -535,41 +1497,64 @@ void kunmap(u_reg_t va, size_t len) {
  */
 int page_insert(Pte *pgdir, uint16_t asid, struct Page *pp, u_reg_t va,
                 uint32_t perm) {
+    struct TlbGather tlb;
+
+    tlb_gather_init(&tlb, asid, 0);
+
+    int r = page_insert_gather(pgdir, &tlb, pp, va, perm);
+
+    tlb_gather_finish(&tlb);
+
+    return r;
+}
+
+int page_insert_gather(Pte *pgdir, struct TlbGather *tlb, struct Page *pp,
+                       u_reg_t va, uint32_t perm) {
     Pte *pte;
 
+    // `va`位于巨页映射中时，先将其拆分，使得`va`由三级页表项映射
+    try(page_split_gather(pgdir, tlb, va));
+    // `va`所在的三级页表被共享时，先复制一份，使得修改不影响其它进程
+    try(page_unshare_gather(pgdir, tlb, va));
+
     /* Step 1: Get corresponding page table entry. */
-    pgdir_walk(pgdir, va, 0, &pte);
     // 20250422 2055：超级地球包分配老婆，想要老婆的去填C-01表格 -OHHHH
     // 20250422 2055：超级地球是头猪！ -saitewasreset
-    // 若虚拟地址`va`已经被映射，更新标志位或者删除之前的映射
-    if ((pte != NULL) && ((*pte & PTE_V) != 0)) {
-        // 如果之前的映射和要创建的映射不同（具体地，不对应同一个 Page
-        // 结构体），移除之前的映射
-        if (pa2page(PTE_ADDR(*pte)) != pp) {
-            page_remove(pgdir, asid, va);
-        } else {
-            // 若是同一个映射，只更新标志位
-            // 为了使得新的标志位生效，需要从 TLB 中移除相关条目！
-            tlb_invalidate(asid, va);
-            *pte = (page2ppn(pp) << FLAG_SHIFT) | perm | PTE_V;
-            return 0;
-        }
+    // 若虚拟地址`va`已经被映射，更新标志位或者替换之前的映射
+    struct Page *old = page_lookup(pgdir, va, &pte);
+
+    if (old == pp) {
+        // 若是同一个映射，只更新标志位
+        // 为了使得新的标志位生效，需要从 TLB 中移除相关条目！
+        *pte = (page2ppn(pp) << FLAG_SHIFT) | perm | PTE_V;
+        tlb_gather_add(tlb, va, PAGE_SIZE);
+        return 0;
     }
 
+    // 新映射计入所属进程的资源组，被替换的映射同时归还
+    uint32_t charge = page_mapped_pages(pp, 3);
+
+    try(pgdir_charge(pgdir, va, charge,
+                     old == NULL ? 0 : page_mapped_pages(old, 3)));
+
     /* Step 2: Flush TLB with 'tlb_invalidate'. */
     /* Exercise 2.7: Your code here. (1/3) */
 
     // 为了使得新的标志位生效，需要从 TLB 中移除相关条目！
-    tlb_invalidate(asid, va);
+    tlb_gather_add(tlb, va, PAGE_SIZE);
 
     /* Step 3: Re-get or create the page table entry. */
     /* If failed to create, return the error. */
     /* Exercise 2.7: Your code here. (2/3) */
 
-    int ret = pgdir_walk(pgdir, va, 1, &pte);
+    // 已拆分且已复制页表，有之前的映射时直接替换其页表项
+    if (old == NULL) {
+        int ret = pgdir_walk(pgdir, va, 1, &pte);
 
-    if (ret != 0) {
-        return ret;
+        if (ret != 0) {
+            pgdir_charge(pgdir, va, 0, charge);
+            return ret;
+        }
     }
 
     /* Step 4: Insert the page to the page table entry with 'perm |
@@ -578,7 +1563,78 @@ int page_insert(Pte *pgdir, uint16_t asid, struct Page *pp, u_reg_t va,
 
     *pte = (page2ppn(pp) << FLAG_SHIFT) | perm | PTE_V;
 
-    pp->pp_ref++;
+    // 先增加新页的引用计数：新旧页可能属于同一巨页
+    page_incref(pp);
+
+    if (old != NULL) {
+        page_decref(old);
+    }
+
+    return 0;
+}
+
+int page_insert_huge(Pte *pgdir, uint16_t asid, struct Page *pp, u_reg_t va,
+                     u_int level, uint32_t perm) {
+    struct TlbGather tlb;
+
+    tlb_gather_init(&tlb, asid, 0);
+
+    int r = page_insert_huge_gather(pgdir, &tlb, pp, va, level, perm);
+
+    tlb_gather_finish(&tlb);
+
+    return r;
+}
+
+int page_insert_huge_gather(Pte *pgdir, struct TlbGather *tlb, struct Page *pp,
+                            u_reg_t va, u_int level, uint32_t perm) {
+    Pte *pte;
+    u_int found;
+
+    assert(level == 1 || level == 2);
+    assert(page_huge_order(page_head(pp)) >= PAGE_HUGE_ORDER(level));
+    assert(page2pa(pp) % PLEVEL_SIZE(level) == 0);
+    assert(va % PLEVEL_SIZE(level) == 0);
+
+    // `va`位于更大的巨页映射中，先拆分
+    while (1) {
+        try(pgdir_walk_level(pgdir, va, level, 1, &pte, &found));
+
+        if (found == level) {
+            break;
+        }
+
+        try(pte_huge_split(pte, tlb, ROUNDDOWN(va, PLEVEL_SIZE(found)), found));
+    }
+
+    if ((*pte & PTE_V) != 0 && PTE_IS_NON_LEAF(*pte) == 0 &&
+        pa2page(PTE_ADDR(*pte)) == pp) {
+        // 若是同一个映射，只更新标志位
+        *pte = (page2ppn(pp) << FLAG_SHIFT) | perm | PTE_V;
+        tlb_gather_add(tlb, va, PLEVEL_SIZE(level));
+        return 0;
+    }
+
+    // 新映射计入所属进程的资源组，该范围内原有的映射同时归还
+    try(pgdir_charge(pgdir, va, page_mapped_pages(pp, level),
+                     (*pte & PTE_V) != 0 ? pte_mapped_pages(pte, level) : 0));
+
+    // 先增加新巨页的引用计数：原有的映射可能指向同一巨页
+    page_incref(pp);
+
+    if ((*pte & PTE_V) != 0) {
+        if (PTE_IS_NON_LEAF(*pte)) {
+            // 该范围内已有较小的映射：移除这些映射并释放下级页表
+            pte_table_free(pte, level);
+        } else {
+            page_decref(pa2page(PTE_ADDR(*pte)));
+        }
+    }
+
+    tlb_gather_add(tlb, va, PLEVEL_SIZE(level));
+
+    *pte = (page2ppn(pp) << FLAG_SHIFT) | perm | PTE_V;
+
     return 0;
 }
 
@@ -603,11 +1659,17 @@ int page_insert(Pte *pgdir, uint16_t asid, struct Page *pp, u_reg_t va,
  *
  */
 struct Page *page_lookup(Pte *pgdir, u_long va, Pte **ppte) {
+    return page_lookup_level(pgdir, va, ppte, NULL);
+}
+
+struct Page *page_lookup_level(Pte *pgdir, u_reg_t va, Pte **ppte,
+                               u_int *plevel) {
     struct Page *pp;
     Pte *pte;
+    u_int level;
 
     /* Step 1: Get the page table entry. */
-    pgdir_walk(pgdir, va, 0, &pte);
+    pgdir_walk_level(pgdir, va, 3, 0, &pte, &level);
 
     /* Hint: Check if the page table entry doesn't exist or is not valid. */
     if (pte == NULL || (*pte & PTE_V) == 0) {
@@ -621,6 +1683,10 @@ struct Page *page_lookup(Pte *pgdir, u_long va, Pte **ppte) {
         *ppte = pte;
     }
 
+    if (plevel) {
+        *plevel = level;
+    }
+
     return pp;
 }
 /* End of Key Code "page_lookup" */
@@ -628,6 +1694,8 @@ struct Page *page_lookup(Pte *pgdir, u_long va, Pte **ppte) {
 /* 概述：
  *   减少`pp`对应的物理页的引用计数，
  *   若引用计数为 0，将该页面插入空闲物理页链表。
+ *   设置了`PAGE_FLAG_PINNED`的页引用计数为 0 时不释放。
+ *   巨页中的物理页的引用计数记录在巨页的首页中（见`page_head`）。
  *
  *   注意，调用此函数后无需再调用`page_free`!
  *
@@ -642,11 +1710,18 @@ struct Page *page_lookup(Pte *pgdir, u_long va, Pte **ppte) {
  *
  */
 void page_decref(struct Page *pp) {
+    // 巨页中的物理页的引用计入巨页的首页
+    pp = page_head(pp);
+
     assert(pp->pp_ref > 0);
 
     /* If 'pp_ref' reaches to 0, free this page. */
-    if (--pp->pp_ref == 0) {
-        page_free(pp);
+    if (--pp->pp_ref == 0 && (pp->pp_flags & PAGE_FLAG_PINNED) == 0) {
+        if ((pp->pp_flags & PAGE_FLAG_HUGE) != 0) {
+            page_free_huge(pp);
+        } else {
+            page_free(pp);
+        }
     }
 }
 
@@ -667,23 +1742,41 @@ void page_decref(struct Page *pp) {
  * - `asid`必须是有效的地址空间标识符
  *
  */
-void page_remove(Pte *pgdir, u_int asid, u_long va) {
+int page_remove(Pte *pgdir, u_int asid, u_long va) {
+    struct TlbGather tlb;
+
+    tlb_gather_init(&tlb, (uint16_t)asid, 0);
+
+    int r = page_remove_gather(pgdir, &tlb, va);
+
+    tlb_gather_finish(&tlb);
+
+    return r;
+}
+
+int page_remove_gather(Pte *pgdir, struct TlbGather *tlb, u_reg_t va) {
     Pte *pte;
 
+    // 只移除巨页映射中的一页：先拆分，其余页的映射保持不变
+    try(page_split_gather(pgdir, tlb, va));
+    // 三级页表被共享时，先复制一份，使得移除映射不影响其它进程
+    try(page_unshare_gather(pgdir, tlb, va));
+
     /* Step 1: Get the page table entry, and check if the page table entry is
      * valid. */
     struct Page *pp = page_lookup(pgdir, va, &pte);
     if (pp == NULL) {
-        return;
+        return 0;
     }
 
     /* Step 2: Decrease reference count on 'pp'. */
+    pgdir_charge(pgdir, va, 0, page_mapped_pages(pp, 3));
     page_decref(pp);
 
     /* Step 3: Flush TLB. */
     *pte = 0;
-    tlb_invalidate(asid, va);
-    return;
+    tlb_gather_add(tlb, va, PAGE_SIZE);
+    return 0;
 }
 /* End of Key Code "page_remove" */
 
@@ -695,11 +1788,42 @@ void set_page_table(uint16_t asid, Pte *p1) {
     tlb_flush_all();
 }
 
+// 测试用：暂时取走所有空闲块，保存到`fl`中，使得空闲块链表为空
+// 被取走的块不再标记为空闲，以免测试中释放的页与其合并
+static void steal_free_list(struct Page_list *fl) {
+    struct Page *pp;
+
+    // 尚未初始化的物理页也应被取走，以免测试中分配时被初始化
+    page_init_deferred(~0U);
+
+    // 预清零页池中的页也应被取走
+    page_zero_pool_drain();
+
+    memcpy(fl, page_free_list, sizeof(page_free_list));
+
+    for (u_int order = 0; order <= PAGE_MAX_ORDER; order++) {
+        page_list_foreach(pp, &fl[order]) { pp->pp_order = PAGE_ORDER_NONE; }
+
+        page_list_init(&page_free_list[order]);
+    }
+}
+
+// 测试用：归还由`steal_free_list`取走的空闲块，覆盖当前的空闲块链表
+static void restore_free_list(struct Page_list *fl) {
+    struct Page *pp;
+
+    memcpy(page_free_list, fl, sizeof(page_free_list));
+
+    for (u_int order = 0; order <= PAGE_MAX_ORDER; order++) {
+        page_list_foreach(pp, &page_free_list[order]) { pp->pp_order = order; }
+    }
+}
+
 void physical_memory_manage_check(void) {
     printk("physical_memory_manage_check: test begin\n");
 
     struct Page *pp, *pp0, *pp1, *pp2;
-    struct Page_list fl;
+    struct Page_list fl[PAGE_MAX_ORDER + 1];
     int *temp;
 
     // should be able to allocate three pages
@@ -717,9 +1841,8 @@ void physical_memory_manage_check(void) {
     assert(pp2 && pp2 != pp1 && pp2 != pp0);
 
     // temporarily steal the rest of the free pages
-    fl = page_free_list;
     // now this page_free list must be empty!!!!
-    LIST_INIT(&page_free_list);
+    steal_free_list(fl);
 
     // should be no free memory
     assert(page_alloc(&pp) == -E_NO_MEM);
@@ -746,57 +1869,104 @@ void physical_memory_manage_check(void) {
     // pp0 should be zero
     assert(*temp == 0);
 
-    page_free_list = fl;
+    restore_free_list(fl);
     page_free(pp0);
     page_free(pp1);
     page_free(pp2);
+
+    // 以页框号链接的链表测试：使用真实的物理页
     struct Page_list test_free;
-    struct Page *test_pages;
-    test_pages = (struct Page *)alloc(10 * sizeof(struct Page), PAGE_SIZE, 1);
-    LIST_INIT(&test_free);
-    // LIST_FIRST(&test_free) = &test_pages[0];
-    int i, j = 0;
-    struct Page *p, *q;
+    struct Page *test_pages[11];
+    struct Page *p;
+    int i, j;
+
+    for (i = 0; i < 11; i++) {
+        assert(page_alloc(&test_pages[i]) == 0);
+    }
+
+    page_list_init(&test_free);
+    assert(page_list_empty(&test_free));
+
     for (i = 9; i >= 0; i--) {
-        test_pages[i].pp_ref = i;
-        // test_pages[i].pp_link=NULL;
-        // printk("0x%x  0x%x\n",&test_pages[i], test_pages[i].pp_link.le_next);
-        LIST_INSERT_HEAD(&test_free, &test_pages[i], pp_link);
-        // printk("0x%x  0x%x\n",&test_pages[i], test_pages[i].pp_link.le_next);
+        page_list_insert_head(&test_free, test_pages[i]);
     }
-    p = LIST_FIRST(&test_free);
+
+    // 头插后，顺序应当为test_pages[0..9]
     int answer1[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+    p = page_list_first(&test_free);
+    j = 0;
     assert(p != NULL);
     while (p != NULL) {
-        // printk("%d %d\n",p->pp_ref,answer1[j]);
-        assert(p->pp_ref == answer1[j++]);
-        // printk("ptr: 0x%x v:
-        // %d\n",(p->pp_link).le_next,((p->pp_link).le_next)->pp_ref);
-        p = LIST_NEXT(p, pp_link);
+        assert(p == test_pages[answer1[j++]]);
+        p = page_list_next(p);
     }
+    assert_eq(j, 10);
+
     // insert_after test
-    int answer2[] = {0, 1, 2, 3, 4, 20, 5, 6, 7, 8, 9};
-    q = (struct Page *)alloc(sizeof(struct Page), PAGE_SIZE, 1);
-    q->pp_ref = 20;
-
-    // printk("---%d\n",test_pages[4].pp_ref);
-    LIST_INSERT_AFTER(&test_pages[4], q, pp_link);
-    // printk("---%d\n",LIST_NEXT(&test_pages[4],pp_link)->pp_ref);
-    p = LIST_FIRST(&test_free);
+    int answer2[] = {0, 1, 2, 3, 4, 10, 5, 6, 7, 8, 9};
+    page_list_insert_after(test_pages[4], test_pages[10]);
+    p = page_list_first(&test_free);
+    j = 0;
+    while (p != NULL) {
+        assert(p == test_pages[answer2[j++]]);
+        p = page_list_next(p);
+    }
+    assert_eq(j, 11);
+
+    // remove test：移除头、中间、尾元素
+    int answer3[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    page_list_remove(&test_free, test_pages[0]);
+    page_list_remove(&test_free, test_pages[10]);
+    page_list_remove(&test_free, test_pages[9]);
+    p = page_list_first(&test_free);
     j = 0;
-    // printk("into test\n");
     while (p != NULL) {
-        //      printk("%d %d\n",p->pp_ref,answer2[j]);
-        assert(p->pp_ref == answer2[j++]);
-        p = LIST_NEXT(p, pp_link);
+        assert(p == test_pages[answer3[j++]]);
+        p = page_list_next(p);
+    }
+    assert_eq(j, 8);
+
+    while ((p = page_list_first(&test_free)) != NULL) {
+        page_list_remove(&test_free, p);
+    }
+
+    for (i = 0; i < 11; i++) {
+        // 移除后引用计数应当被重置为0
+        assert_eq(test_pages[i]->pp_ref, 0);
+        page_free(test_pages[i]);
     }
 
     printk("physical_memory_manage_check() succeeded\n");
 }
 
+// 测试用：`stat[0]`记录回调次数，`stat[1]`记录有效页表项数
+static int count_valid_range(Pte *pte, u_reg_t va, size_t count, void *arg) {
+    size_t *stat = (size_t *)arg;
+
+    stat[0]++;
+
+    for (size_t i = 0; i < count; i++) {
+        if (pte[i] & PTE_V) {
+            stat[1]++;
+        }
+    }
+
+    return 0;
+}
+
+// 测试用：`stat[0]`记录回调次数，`stat[1]`记录巨页映射的页数
+static int count_huge_range(Pte *pte, u_reg_t va, u_int level, void *arg) {
+    size_t *stat = (size_t *)arg;
+
+    stat[0]++;
+    stat[1] += PLEVEL_SIZE(level) / PAGE_SIZE;
+
+    return 0;
+}
+
 void page_check(void) {
     struct Page *pp, *pp0, *pp1, *pp2;
-    struct Page_list fl;
+    struct Page_list fl[PAGE_MAX_ORDER + 1];
 
     // should be able to allocate a page for directory
     assert(page_alloc(&pp) == 0);
@@ -818,9 +1988,8 @@ void page_check(void) {
            (u_reg_t)page2pa(pp2));
 
     // temporarily steal the rest of the free pages
-    fl = page_free_list;
     // now this page_free list must be empty!!!!
-    LIST_INIT(&page_free_list);
+    steal_free_list(fl);
 
     // should be no free memory
     assert(page_alloc(&pp) == -E_NO_MEM);
@@ -833,19 +2002,25 @@ void page_check(void) {
 
     assert(page_insert(boot_pgdir, 0, pp1, 0x0, 0) < 0);
 
-    assert(pp0->pp_ref == 0);
     // 第二页分配失败，第一页应当空闲
-    assert(LIST_FIRST(&page_free_list) == pp0);
+    // 注意：空闲页的`pp_ref`与`pp_prev`共用存储，不能用引用计数判断页是否空闲
+    assert(page_list_first(&page_free_list[0]) == pp0);
+    assert_eq(pp0->pp_order, 0);
 
     // free pp0, pp1 and try again: pp0, pp1 should be used for page table
     page_free(pp1);
 
-    // 注意：page_free将空闲页插入链表头部
-    // 因此，对于二级页表，将使用pp1，对于三级页表，将使用pp0
+    // 注意：若pp0、pp1互为伙伴，释放时二者将合并为1阶块，
+    // 此时分配顺序与链表头插顺序不同，故这里只要求二者分别被用作二级、三级页表
     assert_eq(page_insert(boot_pgdir, 0, pp1, 0x0, 0), 0);
     assert_eq(PTE_FLAGS(boot_pgdir[0]), PTE_V);
-    // 二级页表物理地址，应当为pp1的物理地址
-    assert_eq(PTE_ADDR(boot_pgdir[0]), page2pa(pp1));
+
+    // 二级页表、三级页表所在的物理页
+    struct Page *p2_table = pa2page(PTE_ADDR(boot_pgdir[0]));
+    struct Page *p3_table = (p2_table == pp1) ? pp0 : pp1;
+
+    assert(p2_table == pp0 || p2_table == pp1);
+    assert_eq(PTE_ADDR(*(Pte *)page2kva(p2_table)), page2pa(p3_table));
     assert_eq(PTE_FLAGS(*(Pte *)page2kva(pp0)), PTE_V);
     assert_eq(PTE_FLAGS(*(Pte *)page2kva(pp1)), PTE_V);
 
@@ -897,12 +2072,15 @@ void page_check(void) {
               (page2pa(pp1) & (~0xFFFULL)));
     // ... and ref counts should reflect this
     assert(pp1->pp_ref == 3);
-    printk("pp2->pp_ref %d\n", pp2->pp_ref);
-    assert(pp2->pp_ref == 0);
+    // pp2应当已被释放，位于0阶空闲块链表中
+    assert(page_list_first(&page_free_list[0]) == pp2);
+    assert_eq(pp2->pp_order, 0);
     printk("end page_insert\n");
 
     // pp2 should be returned by page_alloc
+    // 取出后其`pp_ref`被重置为0，以下可以再读取其引用计数
     assert(page_alloc(&pp) == 0 && pp == pp2);
+    assert(pp2->pp_ref == 0);
 
     // unmapping pp1 at 0 should keep pp1 at PAGE_SIZE
     page_remove(boot_pgdir, 0, 0x0);
@@ -919,32 +2097,161 @@ void page_check(void) {
     assert(pp1->pp_ref == 1);
     assert(pp2->pp_ref == 0);
 
-    // forcibly take pp0（三级页表） back
+    // forcibly take p3_table（三级页表） back
 
     Pte *p2_entry = (Pte *)P2KADDR(PTE_ADDR(boot_pgdir[0]));
 
-    assert_eq(PTE_ADDR(*p2_entry), page2pa(pp0));
+    assert_eq(PTE_ADDR(*p2_entry), page2pa(p3_table));
     *p2_entry = 0;
 
-    assert_eq(pp0->pp_ref, 1);
-    pp0->pp_ref = 0;
+    assert_eq(p3_table->pp_ref, 1);
+    p3_table->pp_ref = 0;
 
-    page_free(pp0);
+    page_free(p3_table);
 
     // so it should be returned by page_alloc
-    assert(page_alloc(&pp) == 0 && pp == pp0);
+    assert(page_alloc(&pp) == 0 && pp == p3_table);
 
     // should be no free memory
     assert(page_alloc(&pp) == -E_NO_MEM);
 
-    // forcibly take pp1（二级页表） back
-    assert(PTE_ADDR(boot_pgdir[0]) == page2pa(pp1));
+    // forcibly take p2_table（二级页表） back
+    assert(PTE_ADDR(boot_pgdir[0]) == page2pa(p2_table));
     boot_pgdir[0] = 0;
-    assert(pp1->pp_ref == 1);
-    pp1->pp_ref = 0;
+    assert(p2_table->pp_ref == 1);
+    p2_table->pp_ref = 0;
 
     // give free list back
-    page_free_list = fl;
+    restore_free_list(fl);
+
+    // 范围遍历：跨越两个三级页表的映射
+    u_reg_t range_va = P2MAP - PAGE_SIZE;
+    size_t range_stat[2] = {0, 0};
+
+    map_mem(boot_pgdir, range_va, page2pa(pp0), 3 * PAGE_SIZE, PTE_RW | PTE_V);
+    assert_eq(va2pa(boot_pgdir, range_va), page2pa(pp0));
+    assert_eq(va2pa(boot_pgdir, range_va + 2 * PAGE_SIZE),
+              page2pa(pp0) + 2 * PAGE_SIZE);
+
+    assert_eq(pgdir_walk_range(boot_pgdir, 0, 2 * P2MAP, 0, count_valid_range,
+                               range_stat),
+              0);
+    // 两个三级页表各回调一次，共3个有效页表项
+    assert_eq(range_stat[0], 2);
+    assert_eq(range_stat[1], 3);
+
+    unmap_mem(boot_pgdir, range_va, 3 * PAGE_SIZE);
+    assert_eq(va2pa(boot_pgdir, range_va), ~0ULL);
+    assert_eq(va2pa(boot_pgdir, range_va + 2 * PAGE_SIZE), ~0ULL);
+
+    // 未分配页表的部分不应被遍历
+    range_stat[0] = range_stat[1] = 0;
+    assert_eq(pgdir_walk_range(boot_pgdir, P1MAP, P1MAP, 0, count_valid_range,
+                               range_stat),
+              0);
+    assert_eq(range_stat[0], 0);
+
+    // 回收范围遍历分配的页表
+    Pte *range_p2 = (Pte *)P2KADDR(PTE_ADDR(boot_pgdir[0]));
+    page_decref(pa2page(PTE_ADDR(range_p2[0])));
+    page_decref(pa2page(PTE_ADDR(range_p2[1])));
+    range_p2[0] = range_p2[1] = 0;
+    page_decref(pa2page(PTE_ADDR(boot_pgdir[0])));
+    boot_pgdir[0] = 0;
+
+    // 巨页：映射及遍历
+    struct Page *huge = NULL;
+    u_reg_t huge_va = 2 * P2MAP;
+    u_int level = 0;
+
+    assert_eq(page_alloc_huge(PAGE_HUGE_ORDER(2), 1, &huge), 0);
+    assert_eq(page_huge_order(huge), PAGE_HUGE_ORDER(2));
+    assert_eq(page_insert_huge(boot_pgdir, 0, huge, huge_va, 2, PTE_RW), 0);
+    assert_eq(huge->pp_ref, 1);
+    assert_eq(va2pa(boot_pgdir, huge_va + 5 * PAGE_SIZE),
+              page2pa(huge) + 5 * PAGE_SIZE);
+    assert(page_lookup_level(boot_pgdir, huge_va + PAGE_SIZE, NULL, &level) ==
+           huge);
+    assert_eq(level, 2);
+
+    range_stat[0] = range_stat[1] = 0;
+    assert_eq(pgdir_walk_range_huge(boot_pgdir, 0, 4 * P2MAP, 0,
+                                    count_valid_range, count_huge_range,
+                                    range_stat),
+              0);
+    assert_eq(range_stat[0], 1);
+    assert_eq(range_stat[1], P2MAP / PAGE_SIZE);
+
+    // 被共享的巨页：拆分后仍指向原巨页中的物理页，每个三级页表项计入首页的一个引用
+    huge->pp_ref++;
+
+    assert_eq(page_split(boot_pgdir, 0, huge_va + PAGE_SIZE), 0);
+    assert_eq(huge->pp_ref, 1 + P2MAP / PAGE_SIZE);
+    assert_eq(va2pa(boot_pgdir, huge_va + PAGE_SIZE),
+              page2pa(huge) + PAGE_SIZE);
+    assert(page_head(&huge[1]) == huge);
+
+    page_remove(boot_pgdir, 0, huge_va + PAGE_SIZE);
+    assert_eq(huge->pp_ref, P2MAP / PAGE_SIZE);
+    assert_eq(page_huge_order(huge), PAGE_HUGE_ORDER(2));
+    page_decref(huge);
+
+    // 映射巨页时，释放该范围内原有的三级页表及其映射的页
+    assert_eq(page_alloc_huge(PAGE_HUGE_ORDER(2), 1, &huge), 0);
+    assert_eq(page_insert_huge(boot_pgdir, 0, huge, huge_va, 2, PTE_RW), 0);
+    assert(page_lookup_level(boot_pgdir, huge_va, NULL, &level) == huge);
+    assert_eq(level, 2);
+
+    // 只被一个映射引用的巨页：移除其中一页时直接拆分，无需复制
+    page_remove(boot_pgdir, 0, huge_va);
+    assert_eq(va2pa(boot_pgdir, huge_va), ~0ULL);
+    assert_eq(va2pa(boot_pgdir, huge_va + PAGE_SIZE),
+              page2pa(huge) + PAGE_SIZE);
+    assert_eq(page_huge_order(huge), 0);
+    assert_eq(huge[1].pp_ref, 1);
+
+    pte_table_free(&boot_pgdir[0], 1);
+
+    // 共享三级页表：修改其中的映射前，为修改者复制该页表
+    struct Page *share_pgdir_page = NULL;
+    struct Page *shared_data = NULL;
+    Pte *shared_pte = NULL;
+
+    assert_eq(page_alloc(&share_pgdir_page), 0);
+    assert_eq(page_alloc(&shared_data), 0);
+
+    Pte *share_pgdir = (Pte *)page2kva(share_pgdir_page);
+
+    assert_eq(page_insert(boot_pgdir, 0, shared_data, UTEXT, PTE_RO), 0);
+    assert(page_lookup(boot_pgdir, UTEXT, &shared_pte) == shared_data);
+
+    struct Page *shared_table = pa2page(PADDR(shared_pte));
+
+    assert_eq(page_table_share(share_pgdir, UTEXT, shared_table), 0);
+    assert_eq(page_table_share(share_pgdir, UTEXT, shared_table), -E_INVAL);
+    assert_eq(shared_table->pp_ref, 2);
+    assert_eq(shared_table->pp_next, 1);
+    assert_eq(shared_data->pp_ref, 1);
+    assert_eq(va2pa(share_pgdir, UTEXT), page2pa(shared_data));
+
+    page_remove(share_pgdir, 0, UTEXT);
+    assert_eq(va2pa(share_pgdir, UTEXT), ~0ULL);
+    assert_eq(va2pa(boot_pgdir, UTEXT), page2pa(shared_data));
+    assert_eq(shared_table->pp_ref, 1);
+    assert_eq(shared_table->pp_next, 0);
+    assert_eq(shared_data->pp_ref, 1);
+    pte_table_free(&share_pgdir[0], 1);
+
+    // 释放共享的页表时，只解除引用，其中映射的页不受影响
+    assert_eq(page_table_share(share_pgdir, UTEXT, shared_table), 0);
+    pte_table_free(&share_pgdir[0], 1);
+    assert_eq(shared_table->pp_ref, 1);
+    assert_eq(shared_table->pp_next, 0);
+    assert_eq(shared_data->pp_ref, 1);
+    assert_eq(va2pa(boot_pgdir, UTEXT), page2pa(shared_data));
+
+    pte_table_free(&boot_pgdir[0], 1);
+    page_free(share_pgdir_page);
 
     // free the pages we took
     page_free(pp0);
@@ -954,3 +2261,90 @@ void page_check(void) {
 
     printk("page_check() succeeded!\n");
 }
+
+void buddy_check(void) {
+    struct Page *pp, *pp0, *pp1, *pp2;
+    struct Page_list fl[PAGE_MAX_ORDER + 1];
+
+    printk("buddy_check: test begin\n");
+
+    // 非法阶数
+    assert_eq(page_alloc_order(PAGE_MAX_ORDER + 1, &pp), -E_INVAL);
+
+    // should be able to allocate a 2-order block, aligned to 4 pages
+    assert_eq(page_alloc_order(2, &pp0), 0);
+    assert_eq((size_t)(pp0 - pages) & 3, 0);
+
+    for (size_t i = 0; i < 4; i++) {
+        assert_eq(*(u_reg_t *)page2kva(pp0 + i), 0);
+        *(u_reg_t *)page2kva(pp0 + i) = 0x5a5a5a5a;
+    }
+
+    // temporarily steal the rest of the free pages
+    steal_free_list(fl);
+
+    assert_eq(page_alloc(&pp), -E_NO_MEM);
+
+    // 释放整个块，应当位于2阶链表中
+    page_free_order(pp0, 2);
+    assert(page_list_first(&page_free_list[2]) == pp0);
+    assert(page_list_empty(&page_free_list[1]));
+    assert(page_list_empty(&page_free_list[0]));
+
+    // 分配单页：2阶块被拆分为(pp0)(pp0 + 1)(pp0 + 2, pp0 + 3)
+    assert_eq(page_alloc(&pp1), 0);
+    assert(pp1 == pp0);
+    assert(page_list_first(&page_free_list[0]) == pp0 + 1);
+    assert(page_list_first(&page_free_list[1]) == pp0 + 2);
+    assert(page_list_empty(&page_free_list[2]));
+
+    // 分配的页应当已被清零
+    assert_eq(*(u_reg_t *)page2kva(pp1), 0);
+
+    // 分配1阶块：应当直接取得(pp0 + 2, pp0 + 3)
+    assert_eq(page_alloc_order(1, &pp2), 0);
+    assert(pp2 == pp0 + 2);
+    assert_eq(*(u_reg_t *)page2kva(pp2 + 1), 0);
+
+    // 没有足够大的块
+    assert_eq(page_alloc_order(1, &pp), -E_NO_MEM);
+
+    // 释放pp0 + 2开始的1阶块，其伙伴(pp0, pp0 + 1)未完全空闲，不应合并
+    page_free_order(pp2, 1);
+    assert(page_list_first(&page_free_list[1]) == pp2);
+    assert(page_list_empty(&page_free_list[2]));
+
+    // 释放pp0：先与pp0 + 1合并为1阶块，再与pp0 + 2合并为2阶块
+    page_free(pp1);
+    assert(page_list_empty(&page_free_list[0]));
+    assert(page_list_empty(&page_free_list[1]));
+    assert(page_list_first(&page_free_list[2]) == pp0);
+
+    assert_eq(page_alloc_order(2, &pp), 0);
+    assert(pp == pp0);
+
+    // 预清零页池：从伙伴系统中取出两页(pp0)(pp0 + 1)
+    page_free_order(pp0, 2);
+    page_zero_pool_refill(2);
+    assert(page_list_empty(&page_free_list[0]));
+    assert(page_list_first(&page_free_list[1]) == pp0 + 2);
+
+    // page_alloc应当命中预清零页池
+    uint64_t zero_hit = page_zero_pool_stat.zero_hit;
+    assert_eq(page_alloc(&pp1), 0);
+    assert(pp1 == pp0 + 1);
+    assert_eq(page_zero_pool_stat.zero_hit, zero_hit + 1);
+    assert_eq(*(u_reg_t *)page2kva(pp1), 0);
+
+    // 伙伴系统中没有2阶块，应当回收预清零页池中的pp0，并与伙伴合并
+    page_free(pp1);
+    assert_eq(page_alloc_order(2, &pp), 0);
+    assert(pp == pp0);
+
+    // give free list back
+    restore_free_list(fl);
+
+    page_free_order(pp0, 2);
+
+    printk("buddy_check() succeeded!\n");
+}
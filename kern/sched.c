@@ -1,111 +1,664 @@
 #include "queue.h"
+#include <asm/regdef.h>
 #include <env.h>
+#include <error.h>
+#include <group.h>
+#include <kclock.h>
+#include <plic.h>
 #include <pmap.h>
 #include <printk.h>
+#include <sched.h>
+#include <timer.h>
 
-void dump_schedule_list(void) {
+extern struct Env envs[NENV];
+
+// Invariant: 'env' in 'env_sched_list[env->env_sched_level]' iff.
+// 'env->env_status' is 'RUNNABLE'.
+// 各调度级别的调度队列，只应含有`ENV_RUNNABLE`状态的Env，由`sched_init`初始化
+// 不在调度队列中的Env，其`env_sched_link.tqe_prev`为NULL
+static struct Env_sched_list env_sched_list[SCHED_LEVELS];
+
+// 非空队列位图：第i位为1当且仅当第i级调度队列非空
+static uint32_t env_sched_bitmap;
+
+// 各级调度队列的长度
+static uint32_t env_sched_len[SCHED_LEVELS];
+
+// EDF调度类中可运行的进程，按截止时间升序排列，由`sched_init`初始化
+// 用完预算的进程仍在队列中，但在补充预算前不会被选中
+static struct Env_sched_list env_edf_list;
+
+// EDF调度类中可运行的进程数
+static uint32_t env_edf_len;
+
+// EDF调度类已接纳的CPU利用率之和（千分比），见`sched_set_edf`
+static uint32_t edf_util;
+
+// 自启动以来的时钟中断数，EDF调度类的时间均以其为单位
+static uint64_t sched_ticks;
+
+// 最近调度的多级反馈队列进程的`env_vruntime`，只增不减
+static uint64_t sched_min_vruntime;
+
+// 上次CPU时间记账的时刻，见`sched_account`
+static uint64_t account_time;
+
+// 提升、降级、抢占、周期性恢复的次数，EDF进程错过截止时间的作业数，及空闲的统计
+static struct {
+    uint64_t boost;
+    uint64_t demote;
+    uint64_t preempt;
+    uint64_t reset;
+    uint64_t edf_misses;
+    uint64_t idle;
+    uint64_t idle_time;
+} sched_stat;
+
+static inline int env_is_edf(struct Env *e) { return e->env_edf_period != 0; }
+
+// 进程`e`当前作业的绝对截止时间
+static inline uint64_t edf_deadline(struct Env *e) {
+    return e->env_edf_release + e->env_edf_deadline;
+}
+
+// 进程`e`按密度（预算 / 相对截止时间）计算的CPU利用率（千分比，向上取整）
+static inline uint32_t edf_util_of(struct Env *e) {
+    if (!env_is_edf(e)) {
+        return 0;
+    }
+
+    return (uint32_t)(((uint64_t)e->env_edf_budget * 1000 +
+                       e->env_edf_deadline - 1) /
+                      e->env_edf_deadline);
+}
+
+// 若进程`e`已进入新的周期，补充其预算，并将周期开始时刻推进到当前周期
+// `count_miss`非零时，上一个作业未完成即计为错过截止时间
+// 返回是否进入了新的周期
+static int edf_replenish(struct Env *e, int count_miss) {
+    if (sched_ticks < e->env_edf_release + e->env_edf_period) {
+        return 0;
+    }
+
+    if (count_miss && !e->env_edf_done) {
+        e->env_edf_misses++;
+        sched_stat.edf_misses++;
+    }
+
+    e->env_edf_release += (sched_ticks - e->env_edf_release) /
+                          e->env_edf_period * e->env_edf_period;
+    e->env_edf_remaining = e->env_edf_budget;
+    e->env_edf_done = 0;
+
+    return 1;
+}
+
+// 将EDF进程`e`按截止时间插入`env_edf_list`，截止时间相同时排在已有进程之后
+static void edf_insert(struct Env *e) {
     struct Env *cur;
 
-    printk("Dumping schedule list: ");
+    edf_replenish(e, 0);
 
-    uint32_t count = 0;
+    TAILQ_FOREACH(cur, &env_edf_list, env_sched_link) {
+        if (edf_deadline(cur) > edf_deadline(e)) {
+            TAILQ_INSERT_BEFORE(cur, e, env_sched_link);
+            env_edf_len++;
+            return;
+        }
+    }
 
-    TAILQ_FOREACH(cur, &env_sched_list, env_sched_link) {
-        printk("%s ", cur->env_name);
+    TAILQ_INSERT_TAIL(&env_edf_list, e, env_sched_link);
+    env_edf_len++;
+}
 
-        count++;
+// 为进入新周期的EDF进程补充预算，并按新的截止时间重新排序
+static void edf_tick(void) {
+    struct Env *cur = TAILQ_FIRST(&env_edf_list);
 
-        if (count >= 10) {
-            printk("limit_exceed");
-            break;
+    while (cur != NULL) {
+        struct Env *next = TAILQ_NEXT(cur, env_sched_link);
+
+        // 截止时间只会推后，重新插入的进程若被再次遍历，不会再次补充
+        if (edf_replenish(cur, 1)) {
+            sched_remove(cur);
+            edf_insert(cur);
+        }
+
+        cur = next;
+    }
+}
+
+// 返回截止时间最早且仍有预算的EDF进程，没有时返回NULL
+static struct Env *edf_pick(void) {
+    struct Env *cur;
+
+    TAILQ_FOREACH(cur, &env_edf_list, env_sched_link) {
+        if (cur->env_edf_remaining > 0 && !group_throttled(cur)) {
+            return cur;
         }
     }
 
-    printk("\n");
+    return NULL;
+}
+
+// 返回下一个应运行的进程：截止时间最早且仍有预算的EDF进程，
+// 否则为最高非空级别队列中第一个进程；没有可运行的进程时返回NULL
+// 所在资源组已用完CPU配额的进程被跳过：没有这样的资源组时（通常情况）为 O(1)，
+// 否则须逐个检查队列中的进程，最坏为 O(NENV)
+static struct Env *sched_pick(void) {
+    struct Env *e = edf_pick();
+    uint32_t bitmap = env_sched_bitmap;
+
+    if (e == NULL && bitmap != 0 && !group_any_throttled()) {
+        return TAILQ_FIRST(&env_sched_list[__builtin_ctz(bitmap)]);
+    }
+
+    while ((e == NULL) && (bitmap != 0)) {
+        uint32_t level = (uint32_t)__builtin_ctz(bitmap);
+
+        TAILQ_FOREACH(e, &env_sched_list[level], env_sched_link) {
+            if (!group_throttled(e)) {
+                break;
+            }
+        }
+
+        bitmap &= ~(1U << level);
+    }
+
+    return e;
+}
+
+// 是否存在未退出的进程（可能被中断或EDF周期唤醒）
+static int env_alive(void) {
+    for (u_int i = 0; i < NENV; i++) {
+        if (envs[i].env_status != ENV_FREE) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// 返回用完预算的EDF进程中，最早开始下一周期的时刻（时钟中断数）
+// 没有这样的进程时返回0
+static uint64_t edf_next_release(void) {
+    struct Env *cur;
+    uint64_t next = 0;
+
+    TAILQ_FOREACH(cur, &env_edf_list, env_sched_link) {
+        uint64_t release = cur->env_edf_release + cur->env_edf_period;
+
+        if ((next == 0) || (release < next)) {
+            next = release;
+        }
+    }
+
+    return next;
 }
 
 /*
  * 概述：
- *   实现时间片轮转调度算法，从可运行环境列表中选择一个环境并使用'env_run'调度运行。
+ *   没有可运行的进程时调用，直到有进程可运行时返回。
  *
- *   当需要切换进程时（如主动让出、时间片耗尽、当前进程不可运行等），从调度队列头部
- * 选取新进程，设置其优先级对应的时间片。若原进程仍可运行，将其移至队列尾部以保证
- * 公平性。非可运行进程的移除由其他函数保证。
- *
- *   当无需切换进程时（时间片未用完、未让出、仍可运行），继续运行当前进程，并
- * 减少其可运行的时间片。
- *
- *   **不要在本函数中修改`curenv`的值，其值应当通过`env_run`函数修改**
- *
- * Precondition：
- * - 全局变量'env_sched_list'仅包含且必须包含所有ENV_RUNNABLE状态的进程
- * - 全局变量'curenv'在首次调度前应为NULL
- * - 非可运行进程的移除由其他函数维护（如env_destroy/env_block等）
+ *   保存当前进程的上下文并将`curenv`置为NULL，之后循环：
+ *   1. 完成推迟的工作：初始化物理页结构体、填充预清零页池
+ *   2. 停止周期性的时钟中断，只在下一个EDF周期开始、资源组进入新周期或最早的定时器
+ *      到期时产生时钟中断
+ *   3. 在关闭全局中断（sstatus.SIE = 0）的情况下允许时钟及外部中断，执行wfi，
+ *      从而中断只唤醒处理器而不进入异常处理
+ *   4. 按经过的时间推进时钟中断数，处理外部中断（可能直接切换到被唤醒的进程），
+ *      为进入新周期的EDF进程及资源组补充预算，唤醒定时器到期的进程
  *
  * Postcondition：
- * - 若yield非零，当前进程不会（在当前轮次）被再次调度（除非是唯一可运行进程）
- * - 调度队列中所有进程保持ENV_RUNNABLE状态（需由其他函数维护）
- * - 新调度进程的时间片计数被初始化为其优先级值减1，其将可以运行“优先级”次
+ * - 返回时`sched_pick`不为NULL，`curenv`为NULL
  *
- * 副作用：
- * - 修改静态变量count（当前进程剩余时间片）
- * - 修改全局变量curenv（通过env_run）
- * - 可能调整env_sched_list队列结构（移动可运行进程至队尾）
+ * Panics：
+ * - 所有进程均已退出
  */
+static void sched_idle(void) {
+    struct Trapframe *tf = (struct Trapframe *)KSTACKTOP - 1;
+
+    // 之后可能直接运行其它进程，需先保存当前进程的上下文
+    // 空闲的时间不计入任何进程
+    sched_account(curenv, 0);
+
+    if (curenv != NULL) {
+        curenv->env_tf = *tf;
+        curenv = NULL;
+    }
+
+    if (!env_alive()) {
+        panic("`schedule` called while env_sched_list is empty");
+    }
+
+    uint64_t begin = read_time();
+    uint64_t begin_ticks = sched_ticks;
+
+    sched_stat.idle++;
+
+    do {
+        page_init_deferred(PAGE_INIT_IDLE_CHUNKS);
+        page_zero_pool_refill(PAGE_ZERO_POOL_REFILL_BATCH);
+
+        uint64_t release = edf_next_release();
+        uint64_t replenish = group_next_replenish();
+
+        if (replenish != 0 && (release == 0 || replenish < release)) {
+            release = replenish;
+        }
+
+        if (release == 0) {
+            set_next_timer_interrupt(~0UL);
+        } else if (release <= begin_ticks) {
+            set_next_timer_interrupt(begin);
+        } else {
+            set_next_timer_interrupt(begin + (release - begin_ticks) *
+                                                 TIMER_INTERVAL);
+        }
+
+        uint64_t sleep = read_time();
+
+        asm volatile("csrs sie, %0" : : "r"(SIE_STIE | SIE_SEIE));
+        asm volatile("wfi");
+
+        uint64_t now = read_time();
+        u_reg_t sip;
+
+        asm volatile("csrr %0, sip" : "=r"(sip));
+
+        sched_stat.idle_time += now - sleep;
+        sched_ticks = begin_ticks + (now - begin) / TIMER_INTERVAL;
+
+        if (sip & SIP_SEIP) {
+            // 被唤醒的进程的上下文中，sie、sip取自该陷阱帧
+            struct Trapframe frame = {0};
+
+            frame.sie = SIE_STIE | SIE_SEIE;
+            frame.sip = sip;
+
+            handle_plic_interrupt(&frame);
+        }
+
+        edf_tick();
+        group_tick(sched_ticks);
+        env_timer_expire();
+    } while (sched_pick() == NULL);
+}
+
+void sched_init(void) {
+    for (u_int i = 0; i < SCHED_LEVELS; i++) {
+        TAILQ_INIT(&env_sched_list[i]);
+        env_sched_len[i] = 0;
+    }
+
+    env_sched_bitmap = 0;
+
+    TAILQ_INIT(&env_edf_list);
+    env_edf_len = 0;
+    edf_util = 0;
+}
+
+// 维护进程`e`加入第`level`级调度队列后的队列长度及非空队列位图
+static void sched_level_added(uint32_t level) {
+    env_sched_len[level]++;
+    env_sched_bitmap |= 1U << level;
+}
+
+// 长期阻塞或新创建的进程不应积累过多的CPU时间份额
+static void sched_vruntime_clamp(struct Env *e) {
+    if (e->env_vruntime < sched_min_vruntime) {
+        e->env_vruntime = sched_min_vruntime;
+    }
+}
+
+void sched_insert_head(struct Env *e) {
+    if (env_is_edf(e)) {
+        edf_insert(e);
+        return;
+    }
+
+    uint32_t level = e->env_sched_level;
+
+    sched_vruntime_clamp(e);
+
+    TAILQ_INSERT_HEAD(&env_sched_list[level], e, env_sched_link);
+    sched_level_added(level);
+}
+
+void sched_insert_tail(struct Env *e) {
+    if (env_is_edf(e)) {
+        edf_insert(e);
+        return;
+    }
+
+    uint32_t level = e->env_sched_level;
+    struct Env *cur;
+
+    sched_vruntime_clamp(e);
+
+    TAILQ_FOREACH(cur, &env_sched_list[level], env_sched_link) {
+        if (cur->env_vruntime > e->env_vruntime) {
+            TAILQ_INSERT_BEFORE(cur, e, env_sched_link);
+            sched_level_added(level);
+            return;
+        }
+    }
+
+    TAILQ_INSERT_TAIL(&env_sched_list[level], e, env_sched_link);
+    sched_level_added(level);
+}
+
+// 主动让出的多级反馈队列进程`e`移至所在级别队列尾部，而不按`env_vruntime`排序
+static void sched_requeue_last(struct Env *e) {
+    uint32_t level = e->env_sched_level;
+
+    sched_remove(e);
+
+    TAILQ_INSERT_TAIL(&env_sched_list[level], e, env_sched_link);
+    sched_level_added(level);
+}
+
+void sched_remove(struct Env *e) {
+    if (e->env_sched_link.tqe_prev == NULL) {
+        return;
+    }
+
+    if (env_is_edf(e)) {
+        TAILQ_REMOVE(&env_edf_list, e, env_sched_link);
+        e->env_sched_link.tqe_prev = NULL;
+        env_edf_len--;
+        return;
+    }
+
+    uint32_t level = e->env_sched_level;
+
+    TAILQ_REMOVE(&env_sched_list[level], e, env_sched_link);
+    e->env_sched_link.tqe_prev = NULL;
+
+    env_sched_len[level]--;
+    if (env_sched_len[level] == 0) {
+        env_sched_bitmap &= ~(1U << level);
+    }
+}
+
+void sched_boost(struct Env *e) {
+    if (e->env_sched_link.tqe_prev != NULL) {
+        panic("sched_boost: env %08x is still in schedule queue", e->env_id);
+    }
+
+    if (!env_is_edf(e) && e->env_sched_level > 0) {
+        e->env_sched_level--;
+        e->env_slice_used = 0;
+        sched_stat.boost++;
+    }
+}
+
+// 将用完时间片的进程`e`降低一级，并按`env_vruntime`移入新级别队列
+static void sched_demote(struct Env *e) {
+    sched_remove(e);
+
+    if (e->env_sched_level < SCHED_LEVELS - 1) {
+        e->env_sched_level++;
+        sched_stat.demote++;
+    }
+
+    e->env_slice_used = 0;
+
+    sched_insert_tail(e);
+}
+
+// 将级别低于SCHED_LEVEL_DEFAULT的进程移至SCHED_LEVEL_DEFAULT队列尾部
+static void sched_reset(void) {
+    for (u_int level = SCHED_LEVEL_DEFAULT + 1; level < SCHED_LEVELS; level++) {
+        struct Env *e;
+
+        while ((e = TAILQ_FIRST(&env_sched_list[level])) != NULL) {
+            sched_remove(e);
+            e->env_sched_level = SCHED_LEVEL_DEFAULT;
+            e->env_slice_used = 0;
+            sched_insert_tail(e);
+        }
+    }
+
+    sched_stat.reset++;
+}
+
+int sched_set_edf(struct Env *e, uint32_t period, uint32_t budget,
+                  uint32_t deadline) {
+    uint32_t util = 0;
+
+    if (period != 0) {
+        if (budget == 0 || budget > deadline || deadline > period) {
+            return -E_INVAL;
+        }
+
+        util = (uint32_t)(((uint64_t)budget * 1000 + deadline - 1) / deadline);
+    }
+
+    uint32_t old_util = edf_util_of(e);
+
+    if (edf_util - old_util + util > SCHED_EDF_UTIL_MAX) {
+        debugk("sched_set_edf",
+               "env %08x rejected: utilization %u + %u > %u\n", e->env_id,
+               edf_util - old_util, util, SCHED_EDF_UTIL_MAX);
+        return -E_OVERLOAD;
+    }
+
+    // 调度类改变时，进程所在的队列随之改变
+    int queued = e->env_sched_link.tqe_prev != NULL;
+
+    if (queued) {
+        sched_remove(e);
+    }
+
+    edf_util = edf_util - old_util + util;
+
+    e->env_edf_period = period;
+    e->env_edf_budget = budget;
+    e->env_edf_deadline = deadline;
+    e->env_edf_remaining = budget;
+    e->env_edf_done = 0;
+    e->env_edf_release = sched_ticks;
+
+    if (queued) {
+        sched_insert_tail(e);
+    }
+
+    return 0;
+}
+
+void sched_account(struct Env *e, int user) {
+    uint64_t now = read_time();
+    uint64_t delta = now - account_time;
+
+    account_time = now;
+
+    if (e == NULL) {
+        return;
+    }
+
+    if (user) {
+        e->env_user_time += delta;
+    } else {
+        e->env_kernel_time += delta;
+    }
+
+    e->env_slice_used += delta;
+    e->env_vruntime += delta / (e->env_pri > 0 ? e->env_pri : 1);
+
+    group_charge_cpu(e, delta);
+}
+
+void sched_get_stat(struct SchedStat *stat) {
+    for (u_int i = 0; i < SCHED_LEVELS; i++) {
+        stat->queue_len[i] = env_sched_len[i];
+    }
+
+    stat->boost = sched_stat.boost;
+    stat->demote = sched_stat.demote;
+    stat->preempt = sched_stat.preempt;
+    stat->reset = sched_stat.reset;
+    stat->edf_len = env_edf_len;
+    stat->edf_util = edf_util;
+    stat->edf_misses = sched_stat.edf_misses;
+    stat->ticks = sched_ticks;
+    stat->idle = sched_stat.idle;
+    stat->idle_time = sched_stat.idle_time;
+}
+
+void sched_summarize(void) {
+    for (u_int i = 0; i < SCHED_LEVELS; i++) {
+        debugk("sched_summarize", "level %u: %u envs\n", i, env_sched_len[i]);
+    }
+
+    debugk("sched_summarize",
+           "boost = %lu demote = %lu preempt = %lu reset = %lu\n",
+           sched_stat.boost, sched_stat.demote, sched_stat.preempt,
+           sched_stat.reset);
+    debugk("sched_summarize", "edf: %u envs utilization = %u / %u misses = %lu\n",
+           env_edf_len, edf_util, SCHED_EDF_UTIL_MAX, sched_stat.edf_misses);
+    debugk("sched_summarize", "idle = %lu idle time = %lu us\n",
+           sched_stat.idle, time_to_us(sched_stat.idle_time));
+}
+
+void dump_schedule_list(void) {
+    struct Env *cur;
+
+    printk("Dumping schedule list: ");
+
+    uint32_t count = 0;
+
+    TAILQ_FOREACH(cur, &env_edf_list, env_sched_link) {
+        printk("%s(edf) ", cur->env_name);
+
+        count++;
+
+        if (count >= 10) {
+            printk("limit_exceed\n");
+            return;
+        }
+    }
+
+    for (u_int i = 0; i < SCHED_LEVELS; i++) {
+        TAILQ_FOREACH(cur, &env_sched_list[i], env_sched_link) {
+            printk("%s(%u) ", cur->env_name, i);
+
+            count++;
+
+            if (count >= 10) {
+                printk("limit_exceed\n");
+                return;
+            }
+        }
+    }
+
+    printk("\n");
+}
+
+// 进程`e`在当前级别已用完时间片：累计运行了`env_pri`个时钟中断间隔
+static inline int sched_slice_expired(struct Env *e) {
+    return e->env_slice_used >= (uint64_t)e->env_pri * TIMER_INTERVAL;
+}
+
 void schedule(int yield) {
-    static int count = 0; // remaining time slices of current env
+    static uint32_t ticks = 0; // clock interrupts since last `sched_reset`
     struct Env *e = curenv;
 
-    /* We always decrease the 'count' by 1.
-     *
-     * If 'yield' is set, or 'count' has been decreased to 0, or 'e' (previous
-     * 'curenv') is 'NULL', or 'e' is not runnable, then we pick up a new env
-     * from 'env_sched_list' (list of all runnable envs), set 'count' to its
-     * priority, and schedule it with 'env_run'. **Panic if that list is
-     * empty**.
-     *
-     * (Note that if 'e' is still a runnable env, we should move it to the tail
-     * of 'env_sched_list' before picking up another env from its head, or we
-     * will schedule the head env repeatedly.)
-     *
-     * Otherwise, we simply schedule 'e' again.
-     *
-     * You may want to use macros below:
-     *   'TAILQ_FIRST', 'TAILQ_REMOVE', 'TAILQ_INSERT_TAIL'
-     */
-    /* Exercise 3.12: Your code here. */
+    // 唤醒定时器到期的进程
+    env_timer_expire();
+
+    // 定时器队列可能使时钟中断提前到来，此时只唤醒进程，不计为一个时间片
+    int tick = (yield == 0) && timer_tick_due();
+
+    if (tick) {
+        sched_ticks++;
+        ticks++;
+
+        if (ticks >= SCHED_RESET_TICKS) {
+            ticks = 0;
+            sched_reset();
+        }
+
+        // 按时钟中断扣除当前EDF进程的预算
+        if ((e != NULL) && (e->env_status == ENV_RUNNABLE) && env_is_edf(e) &&
+            (e->env_edf_remaining > 0)) {
+            e->env_edf_remaining--;
+
+            if (e->env_edf_remaining == 0) {
+                e->env_edf_throttles++;
+            }
+        }
+
+        edf_tick();
+        group_tick(sched_ticks);
+    }
+
+    // EDF进程主动让出：本周期的作业完成，直到下一周期开始前不再运行
+    if ((yield == 1) && (e != NULL) && (e->env_status == ENV_RUNNABLE) &&
+        env_is_edf(e)) {
+        if (sched_ticks > edf_deadline(e)) {
+            e->env_edf_misses++;
+            sched_stat.edf_misses++;
+        }
+
+        e->env_edf_done = 1;
+        e->env_edf_remaining = 0;
+    }
+
+    struct Env *rt = edf_pick();
+    int need_switch;
 
     // 需要发生进程切换的情况
     // 1. yield == 1
-    // 2. 当前进程时间片已经用完：count == 0
-    // 3. 第一次进程调度：e == NULL
-    // 4. 当前进程不再是`RUNNABLE`状态
-    if ((yield == 1) || (count == 0) || (e == NULL) ||
-        (e->env_status != ENV_RUNNABLE)) {
+    // 2. 第一次进程调度：e == NULL
+    // 3. 当前进程不再是`RUNNABLE`状态
+    // 4. 当前进程为EDF进程：存在截止时间更早的EDF进程，或其用完了预算
+    // 5. 当前进程属于多级反馈队列：存在有预算的EDF进程，或时间片已经用完
+    //    （时钟中断时在当前级别累计运行了`env_pri`个时钟中断间隔），
+    //    或存在级别高于当前进程的可运行进程
+    // 6. 当前进程所在的资源组用完了CPU配额
+    if ((yield == 1) || (e == NULL) || (e->env_status != ENV_RUNNABLE) ||
+        group_throttled(e)) {
+        need_switch = 1;
+    } else if (env_is_edf(e)) {
+        need_switch = (rt != e);
+    } else {
+        need_switch =
+            (rt != NULL) || (tick && sched_slice_expired(e)) ||
+            ((env_sched_bitmap & ((1U << e->env_sched_level) - 1)) != 0);
+    }
 
-        // 若切换前的进程仍是RUNNABLE状态，将其从队列头部移除，并插入队列尾部
+    if (need_switch) {
         // 根据短路逻辑，读取`e->env_status`时，e 一定不为 NULL
-        // 这正确处理了yield == 1，但退让的进程是唯一一个进程的情况
-        // 此时队列头部仍是该进程，该进程继续运行
-        if ((e != NULL) && (e->env_status == ENV_RUNNABLE)) {
-            TAILQ_REMOVE(&env_sched_list, e, env_sched_link);
-            TAILQ_INSERT_TAIL(&env_sched_list, e, env_sched_link);
+        // 若退让的进程是其所在级别及更高级别中唯一的进程，其继续运行
+        // EDF进程在队列中的位置只取决于其截止时间
+        if ((e != NULL) && (e->env_status == ENV_RUNNABLE) && !env_is_edf(e)) {
+            if (yield == 1) {
+                sched_requeue_last(e);
+            } else if (tick && sched_slice_expired(e)) {
+                sched_demote(e);
+            } else {
+                // 被抢占的进程留在原位置，下次轮到其所在级别时优先运行
+                sched_stat.preempt++;
+            }
         }
 
-        struct Env *nextenv = TAILQ_FIRST(&env_sched_list);
+        // EDF调度类优先于多级反馈队列
+        struct Env *nextenv = sched_pick();
 
+        // 没有可运行的进程（包括只有用完预算的EDF进程）时，空闲直到有进程可运行
         if (nextenv == NULL) {
-            panic("`schedule` called while env_sched_list is empty");
+            sched_idle();
+            nextenv = sched_pick();
         }
 
-        count = (int)nextenv->env_pri;
-
-        count--;
+        if (!env_is_edf(nextenv) &&
+            (nextenv->env_vruntime > sched_min_vruntime)) {
+            sched_min_vruntime = nextenv->env_vruntime;
+        }
 
         env_run(nextenv);
     } else {
-        count--;
-
         env_run(curenv);
     }
 }
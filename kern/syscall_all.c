@@ -3,6 +3,7 @@
 #include <env_interrupt.h>
 #include <error.h>
 #include <fork.h>
+#include <group.h>
 #include <kmalloc.h>
 #include <mmu.h>
 #include <plic.h>
@@ -13,6 +14,7 @@
 #include <sbi.h>
 #include <sched.h>
 #include <syscall.h>
+#include <timer.h>
 #include <trap.h>
 #include <types.h>
 #include <userspace.h>
@@ -132,6 +134,8 @@ void __attribute__((noreturn)) sys_yield(void) {
     // `curenv != NULL`在`do_syscall`中检查
     curenv->env_in_syscall = 0;
 
+    // 分批初始化物理页结构体、填充预清零页池只在没有可运行进程时进行（见`sched_idle`），
+    // 不在此进行，以免其耗时计入让出CPU的进程
     schedule(1);
 }
 
@@ -241,6 +245,28 @@ static inline int is_illegal_va_range(u_reg_t va, u_reg_t len) {
     return va + len < va || va < UTEMP || va + len > UTOP;
 }
 
+// 返回`perm`中巨页标志位对应的叶页表项级数（1 或 2），无巨页标志位时返回 3，非法时返回 0
+static inline u_int huge_perm_level(uint32_t perm) {
+    switch (perm & (MEM_HUGE_2M | MEM_HUGE_1G)) {
+    case 0:
+        return 3;
+    case MEM_HUGE_2M:
+        return 2;
+    case MEM_HUGE_1G:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// 检查[va, va + PLEVEL_SIZE(level))是否可以映射巨页：须对齐，且位于用户栈之下
+static inline int is_illegal_huge_va(u_reg_t va, u_int level) {
+    u_reg_t size = PLEVEL_SIZE(level);
+
+    return va % size != 0 || is_illegal_va(va) ||
+           va + size > ROUNDDOWN(USTACKTOP, size);
+}
+
 /*
  * 概述：
  *   （含 TLB 操作）为指定进程分配物理内存页并建立虚拟地址映射。
@@ -249,14 +275,18 @@ static inline int is_illegal_va_range(u_reg_t va, u_reg_t len) {
  *
  *   不默认设置PTE_R，调用者需要手动设置！
  *
+ *   若`perm`中含有`MEM_HUGE_2M`或`MEM_HUGE_1G`，分配一个2 MiB / 1 GiB巨页，
+ *   以一个叶页表项映射到`va`，该范围内原有的映射均被解除。
+ *
  * 实现差异：
- *   - 仅使用用户传入perm参数的低10位
+ *   - 仅使用用户传入perm参数的低10位作为页表项标志位
  *   - 强制移除PTE_V标志（由page_insert内部添加）
  *   - 设置PTE_USER标志
  *
  * Precondition：
  * - envid必须是有效的进程ID（0表示当前进程），且为当前进程或其直接子进程
  * - 'va'必须是用户态虚拟地址（UTEMP <= va < UTOP）
+ * - 分配巨页时，'va'必须对齐到巨页大小，且巨页位于用户栈之下
  * - 依赖全局状态：
  *   - curenv：用于权限校验（当checkperm=1时）
  *   - envs：全局环境控制块数组
@@ -271,6 +301,7 @@ static inline int is_illegal_va_range(u_reg_t va, u_reg_t len) {
  *   - 返回-E_BAD_ENV：envid无效或权限不足
  *   - 返回-E_INVAL：va非法
  *   - 返回-E_NO_MEM：物理内存不足
+ *   - 返回-E_QUOTA：超出目标进程所在资源组的物理页限制
  *
  * 副作用：
  * - 可能修改目标进程的页表结构
@@ -302,6 +333,32 @@ int sys_mem_alloc(uint32_t envid, u_reg_t va, uint32_t perm) {
         return -E_BAD_ENV;
     }
 
+    u_int level = huge_perm_level(perm);
+
+    if (level == 0) {
+        return -E_INVAL;
+    }
+
+    if (level < 3) {
+        if (is_illegal_huge_va(va, level) != 0) {
+            return -E_INVAL;
+        }
+
+        try(page_alloc_huge(PAGE_HUGE_ORDER(level), 1, &pp));
+
+        perm = ((perm & GENMASK(9, 0)) & ~PTE_V) | PTE_USER;
+
+        // 巨页由`page_insert_huge`计入目标进程的资源组
+        int r = page_insert_huge(env->env_pgdir, env->env_asid, pp, va, level,
+                                 perm);
+
+        if (r < 0) {
+            page_free_huge(pp);
+        }
+
+        return r;
+    }
+
     /* Step 3: Allocate a physical page using 'page_alloc'. */
     /* Exercise 4.4: Your code here. (3/3) */
 
@@ -319,8 +376,15 @@ int sys_mem_alloc(uint32_t envid, u_reg_t va, uint32_t perm) {
     /* 关键点：
      * - page_insert会处理引用计数
      * - 若va已映射，会自动解除原映射
-     * - 会触发TLB失效 */
-    return page_insert(env->env_pgdir, env->env_asid, pp, va, perm);
+     * - 会触发TLB失效
+     * - 新页计入目标进程的资源组，被替换的页同时归还 */
+    int r = page_insert(env->env_pgdir, env->env_asid, pp, va, perm);
+
+    if (r < 0) {
+        page_free(pp);
+    }
+
+    return r;
 }
 
 /*
@@ -331,6 +395,10 @@ int sys_mem_alloc(uint32_t envid, u_reg_t va, uint32_t perm) {
  *
  *   不默认设置PTE_R，调用者需要手动设置！
  *
+ *   若`perm`中含有`MEM_HUGE_2M`或`MEM_HUGE_1G`，'srcva'处须为对应大小的巨页映射，
+ *   整个巨页被映射到'dstva'（须对齐到巨页大小）。
+ *   否则，若'srcva'位于巨页映射中，先将源进程中的该映射拆分（`page_split`），再映射其中的一页。
+ *
  * 实现差异：
  * - 仅取用户传入的perm低10位，并手动移除PTE_V标志位，
  *   以满足page_insert函数的Precondition要求
@@ -350,7 +418,8 @@ int sys_mem_alloc(uint32_t envid, u_reg_t va, uint32_t perm) {
  *   - 若'dstva'原有映射，则原映射被清除且引用计数正确修改
  * - 失败时返回相应错误代码：
  *   - -E_BAD_ENV：源或目标进程ID无效或权限检查失败
- *   - -E_INVAL：虚拟地址非法或源地址未映射
+ *   - -E_INVAL：虚拟地址非法、源地址未映射，或以可写方式映射只读镜像段的页
+ *   - -E_QUOTA：超出目标进程所在资源组的物理页限制（映射的页计入目标进程，见`pgdir_charge`）
  *   - 其他：底层函数调用失败时返回原始错误码
  *
  * 副作用：
@@ -394,12 +463,41 @@ int sys_mem_map(uint32_t srcid, u_reg_t srcva, uint32_t dstid, u_reg_t dstva,
     /* Return -E_INVAL if 'srcva' is not mapped. */
     /* Exercise 4.5: Your code here. (4/4) */
 
-    pp = page_lookup(srcenv->env_pgdir, srcva, NULL);
+    u_int level = huge_perm_level(perm);
+    u_int src_level = 3;
+
+    if (level == 0) {
+        return -E_INVAL;
+    }
+
+    if (level == 3) {
+        // 巨页中只有首页记录引用计数，单独映射其中一页前须先拆分
+        try(page_split(srcenv->env_pgdir, srcenv->env_asid, srcva));
+
+        // 全局零页及镜像页缓存中的页不可被写入，可写共享前先替换为私有页
+        if ((perm & PTE_W) != 0) {
+            try(pinned_page_privatize(srcenv, srcva));
+        }
+    }
+
+    pp = page_lookup_level(srcenv->env_pgdir, srcva, NULL, &src_level);
 
     if (pp == NULL) {
         return -E_INVAL;
     }
 
+    if (level < 3) {
+        if (src_level != level || srcva % PLEVEL_SIZE(level) != 0 ||
+            is_illegal_huge_va(dstva, level) != 0) {
+            return -E_INVAL;
+        }
+
+        perm = ((perm & GENMASK(9, 0)) & ~PTE_V) | PTE_USER;
+
+        return page_insert_huge(dstenv->env_pgdir, dstenv->env_asid, pp, dstva,
+                                level, perm);
+    }
+
     /* Step 5: Map the physical page at 'dstva' in the address space of
      * 'dstid'.
      */
@@ -433,12 +531,13 @@ int sys_mem_map(uint32_t srcid, u_reg_t srcva, uint32_t dstid, u_reg_t dstva,
  * - 失败时返回：
  *   - -E_BAD_ENV：envid无效或权限检查失败（通过envid2env检查）
  *   - -E_INVAL：va是非法用户虚拟地址
- *   - 其他底层调用返回的错误码
+ *   - -E_NO_MEM：拆分巨页映射或复制共享的三级页表时无法分配页表，此时映射不变
  *
  * 副作用：
  * - 若va存在有效映射：
  *   - 解除页表映射
  *   - 减少物理页的引用计数(pp_ref)
+ *   - 从进程envid的资源组中归还该映射计入的页（即使该页仍被其它进程映射）
  *   - 无效化TLB中对应条目
  * - 修改进程envid的页表结构（通过page_remove）
  */
@@ -464,8 +563,8 @@ int sys_mem_unmap(uint32_t envid, u_reg_t va) {
 
     /* Step 3: Unmap the physical page at 'va' in the address space of 'envid'.
      */
-    page_remove(e->env_pgdir, e->env_asid, va);
-    return 0;
+    // 被移除的映射由`page_remove`从资源组中归还
+    return page_remove(e->env_pgdir, e->env_asid, va);
 }
 
 /*
@@ -530,7 +629,17 @@ int sys_exofork(void) {
     e->env_tf.regs[10] = 0;
     e->env_in_syscall = 0;
 
-    dup_userspace(curenv->env_pgdir, e->env_pgdir, e->env_asid);
+    e->env_fork_flags = curenv->env_fork_flags;
+    e->env_fault_around_max = curenv->env_fault_around_max;
+    e->env_binary = curenv->env_binary;
+
+    int r = dup_userspace(curenv->env_pgdir, curenv->env_asid, e->env_pgdir,
+                          (curenv->env_fork_flags & FORK_SHARE_TABLES) != 0);
+
+    if (r < 0) {
+        env_free(e);
+        return r;
+    }
 
     /* Step 4: Set up the new env's 'env_status' and 'env_pri'.  */
     /* Exercise 4.9: Your code here. (4/4) */
@@ -538,7 +647,7 @@ int sys_exofork(void) {
 
     e->env_pri = curenv->env_pri;
 
-    TAILQ_INSERT_HEAD(&env_sched_list, e, env_sched_link);
+    sched_insert_head(e);
 
     return (int)e->env_id;
 }
@@ -602,9 +711,10 @@ int sys_set_env_status(uint32_t envid, uint32_t status) {
     if ((pre_status == ENV_NOT_RUNNABLE) && (status == ENV_NOT_RUNNABLE)) {
         // No need to change
     } else if ((pre_status == ENV_NOT_RUNNABLE) && (status == ENV_RUNNABLE)) {
-        TAILQ_INSERT_TAIL(&env_sched_list, env, env_sched_link);
+        env_timer_cancel(env);
+        sched_insert_tail(env);
     } else if ((pre_status == ENV_RUNNABLE) && (status == ENV_NOT_RUNNABLE)) {
-        TAILQ_REMOVE(&env_sched_list, env, env_sched_link);
+        sched_remove(env);
     } else {
         // No need to change
     }
@@ -755,7 +865,8 @@ int sys_ipc_recv(uint32_t dstva, uint32_t from) {
     /* Exercise 4.8: Your code here. (3/8) */
 
     curenv->env_status = ENV_NOT_RUNNABLE;
-    TAILQ_REMOVE(&env_sched_list, curenv, env_sched_link);
+    sched_remove(curenv);
+    sched_boost(curenv);
 
     /* Step 5: Give up the CPU and block until a message is received. */
     // 10 -> a0
@@ -801,7 +912,9 @@ int sys_ipc_recv(uint32_t dstva, uint32_t from) {
  * - 如果'srcva'不为0，可能修改目标环境的页表（通过page_insert）
  *
  * 注意事项：
- * - 若srcva != 0但非法，将返回`-E_INVAL`，但此时接收者已被唤醒并继续执行
+ * - 若srcva != 0但未映射，返回`-E_INVAL`
+ * - 映射的页计入接收者的资源组，超出其物理页限制时返回`-E_QUOTA`
+ * - 映射失败时不修改目标环境，接收者仍在等待，可再次发送
  * - 若srcva != 0但合法，dstva = 0，将导致接收者的[0x00000000, 0x00000FFF]被映射
  *   这被认为是系统设计缺陷，但保留该效果
  */
@@ -846,6 +959,31 @@ int sys_ipc_try_send(uint32_t envid, uint64_t value, u_reg_t srcva,
 
     perm |= PTE_USER;
 
+    /* Step 6: If 'srcva' is not zero, map the page at 'srcva' in 'curenv' to
+     * 'e->env_ipc_dstva' in 'e'. */
+    /* Return -E_INVAL if 'srcva' is not zero and not mapped in 'curenv'. */
+    // 映射可能失败，须在修改目标进程的IPC状态、唤醒目标进程之前完成，
+    // 失败时目标进程仍在等待，不会误认为已收到页
+    if (srcva != 0) {
+        /* Exercise 4.8: Your code here. (8/8) */
+
+        // 巨页中只有首页记录引用计数，发送其中一页前须先拆分
+        try(page_split(curenv->env_pgdir, curenv->env_asid, srcva));
+
+        // 全局零页及镜像页缓存中的页不可被写入，可写共享前先替换为私有页
+        if ((perm & PTE_W) != 0) {
+            try(pinned_page_privatize(curenv, srcva));
+        }
+
+        p = page_lookup(curenv->env_pgdir, srcva, NULL);
+
+        if (p == NULL) {
+            return -E_INVAL;
+        }
+
+        try(page_insert(e->env_pgdir, e->env_asid, p, e->env_ipc_dstva, perm));
+    }
+
     /* Step 4: Set the target's ipc fields. */
     e->env_ipc_value = value;
     e->env_ipc_from = curenv->env_id;
@@ -860,22 +998,9 @@ int sys_ipc_try_send(uint32_t envid, uint64_t value, u_reg_t srcva,
     e->env_status = ENV_RUNNABLE;
     e->env_in_syscall = 0;
 
-    TAILQ_INSERT_TAIL(&env_sched_list, e, env_sched_link);
+    env_timer_cancel(e);
+    sched_insert_tail(e);
 
-    /* Step 6: If 'srcva' is not zero, map the page at 'srcva' in 'curenv' to
-     * 'e->env_ipc_dstva' in 'e'. */
-    /* Return -E_INVAL if 'srcva' is not zero and not mapped in 'curenv'. */
-    if (srcva != 0) {
-        /* Exercise 4.8: Your code here. (8/8) */
-
-        p = page_lookup(curenv->env_pgdir, srcva, NULL);
-
-        if (p == NULL) {
-            return -E_INVAL;
-        }
-
-        try(page_insert(e->env_pgdir, e->env_asid, p, e->env_ipc_dstva, perm));
-    }
     return 0;
 }
 
@@ -1124,7 +1249,8 @@ void sys_sleep(void) {
     }
 
     curenv->env_status = ENV_NOT_RUNNABLE;
-    TAILQ_REMOVE(&env_sched_list, curenv, env_sched_link);
+    sched_remove(curenv);
+    sched_boost(curenv);
 
     // 设置本次系统调用的返回值为0
     // 10 -> a0
@@ -1237,6 +1363,11 @@ int sys_get_process_list(int max_len, u_reg_t out_process_list) {
             buffer[count].env_pri = cur->env_pri;
             buffer[count].env_status = cur->env_status;
             buffer[count].env_runs = cur->env_runs;
+            buffer[count].env_cow_copy = cur->env_cow_copy;
+            buffer[count].env_cow_reuse = cur->env_cow_reuse;
+            buffer[count].env_sched_level = cur->env_sched_level;
+            buffer[count].env_user_time = time_to_ns(cur->env_user_time);
+            buffer[count].env_kernel_time = time_to_ns(cur->env_kernel_time);
             strcpy(buffer[count].env_name, cur->env_name);
             count++;
         }
@@ -1284,13 +1415,357 @@ int sys_pageref(u_reg_t va) {
         panic("sys_get_physical_address called while curenv is NULL");
     }
 
+    // 共享的三级页表中的物理页，其引用计数只计入该页表一次，先为当前进程复制该页表
+    try(page_unshare(curenv->env_pgdir, curenv->env_asid, va));
+
     struct Page *page = page_lookup(curenv->env_pgdir, va, NULL);
 
     if (page != NULL) {
+        // 巨页中的物理页的引用计入巨页的首页
+        return (int)(page_head(page)->pp_ref);
+    }
+
+    return 0;
+}
+
+/*
+ * 概述：
+ *   设置进程envid在fork时的选项`flags`（FORK_*），该选项由其之后创建的子进程继承。
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - envid无效或不是当前进程及其子进程时返回-E_BAD_ENV
+ * - `flags`含有未知的标志位时返回-E_INVAL
+ */
+int sys_set_fork_flags(u_int envid, u_int flags) {
+    struct Env *env;
+
+    if ((flags & ~FORK_FLAGS_ALL) != 0) {
+        return -E_INVAL;
+    }
+
+    try(envid2env(envid, &env, 1));
+
+    env->env_fork_flags = flags;
+
+    return 0;
+}
+
+/*
+ * 概述：
+ *   设置进程envid在缺页时一次最多填充的页数`max_pages`（见`passive_alloc_around`），
+ *   该设置由其之后创建的子进程继承。`max_pages`不超过 1 时，缺页时只分配缺页地址所在的页。
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - envid无效或不是当前进程及其子进程时返回-E_BAD_ENV
+ * - `max_pages`超过`FAULT_AROUND_MAX_PAGES`时返回-E_INVAL
+ */
+int sys_set_fault_around(u_int envid, u_int max_pages) {
+    struct Env *env;
 
-        return (int)(page->pp_ref);
+    if (max_pages > FAULT_AROUND_MAX_PAGES) {
+        return -E_INVAL;
     }
 
+    try(envid2env(envid, &env, 1));
+
+    env->env_fault_around_max = max_pages;
+    env->env_fault_around = 1;
+
+    return 0;
+}
+
+/*
+ * 概述：
+ *   （含 TLB 操作）由当前进程地址空间中[binary, binary + size)处的ELF可执行镜像创建子进程，
+ *   不复制当前进程的地址空间：
+ *   - 将镜像的所有PT_LOAD段复制到子进程中（`load_icode_user`）
+ *   - 将当前进程中`stack`处的页（由调用者填入argc、argv等）**移动**到子进程的
+ *     [USTACKTOP - PAGE_SIZE, USTACKTOP)，并将子进程的sp设置为`sp`
+ *   - 子进程的名称为`name`处的MAXENVNAME字节（截断为以'\0'结尾的字符串）
+ *   子进程继承当前进程的优先级及fork选项，创建后即可运行。
+ *
+ * Precondition：
+ * - 子进程的栈顶（`sp`处）依次为 8 字节的argc及argv（见`user/lib/entry.S`）
+ *
+ * Postcondition：
+ * - 成功时返回子进程的envid，`stack`处的页在当前进程中被取消映射
+ * - 地址非法、`stack`未映射、`sp`不在栈页中或未按 16 字节对齐、镜像非法时返回-E_INVAL
+ * - `stack`处的页在当前进程中既不可写也不是CoW页（如共享库的代码页）时返回-E_INVAL
+ * - `binary`、`name`处的范围中有未映射的页（见`user_range_check`）时返回-E_INVAL
+ * - 无空闲Env时返回-E_NO_FREE_ENV，内存不足时返回-E_NO_MEM
+ * - 子进程映射的镜像中的页与栈页同样计入资源组（见`pgdir_charge`），
+ *   超出当前进程所在资源组的物理页限制时返回-E_QUOTA
+ * - 失败时不创建子进程，`stack`处的页仍映射在当前进程中
+ */
+int sys_spawn(u_reg_t binary, size_t size, u_reg_t stack, u_reg_t sp,
+              u_reg_t name) {
+    struct Env *e;
+    struct Page *pp;
+    Pte *pte = NULL;
+    int r;
+
+    if (size == 0 || is_illegal_va_range(binary, size) ||
+        stack % PAGE_SIZE != 0 || is_illegal_va(stack) ||
+        sp % 16 != 0 || sp < USTACKTOP - PAGE_SIZE || sp >= USTACKTOP ||
+        is_illegal_va_range(name, MAXENVNAME)) {
+        return -E_INVAL;
+    }
+
+    // 镜像及名称由`copy_user_space`读取，其中未映射的页将使内核panic，须预先检查
+    try(user_range_check(binary, size));
+    try(user_range_check(name, MAXENVNAME));
+
+    // 栈页将以可写方式映射到子进程中，当前进程须可写入该页（可写或CoW），
+    // 否则（如共享库、镜像页缓存中的只读代码页）所有进程共享的页将被写入
+    if (page_lookup(curenv->env_pgdir, stack, &pte) == NULL ||
+        (*pte & (PTE_W | PTE_COW)) == 0) {
+        return -E_INVAL;
+    }
+
+    // 栈页须为当前进程私有的普通页
+    try(page_split(curenv->env_pgdir, curenv->env_asid, stack));
+    // 预先复制共享的三级页表，使得之后从当前进程中移除栈页时不会失败
+    try(page_unshare(curenv->env_pgdir, curenv->env_asid, stack));
+    try(pinned_page_privatize(curenv, stack));
+
+    page_lookup(curenv->env_pgdir, stack, &pte);
+
+    if ((*pte & PTE_COW) != 0) {
+        try(cow_fault(curenv, stack));
+    }
+
+    pp = page_lookup(curenv->env_pgdir, stack, NULL);
+
+    try(env_alloc(&e, curenv->env_id));
+
+    // 镜像中的页由`page_insert`计入子进程（与当前进程属于同一资源组）
+    if ((r = load_icode_user(e, binary, size)) < 0) {
+        env_free(e);
+        return r;
+    }
+
+    // 栈页由当前进程移至子进程，资源组的计数不变：映射到子进程时不检查限制
+    group_limit_suspend();
+    r = page_insert(e->env_pgdir, e->env_asid, pp, USTACKTOP - PAGE_SIZE,
+                    PTE_RW | PTE_USER);
+    group_limit_resume();
+
+    if (r < 0) {
+        env_free(e);
+        return r;
+    }
+
+    // 已拆分且已复制页表，不会失败
+    page_remove(curenv->env_pgdir, curenv->env_asid, stack);
+
+    copy_user_space((void *)name, e->env_name, MAXENVNAME);
+    e->env_name[MAXENVNAME - 1] = '\0';
+
+    e->env_tf.regs[2] = sp;
+
+    e->env_fork_flags = curenv->env_fork_flags;
+    e->env_fault_around_max = curenv->env_fault_around_max;
+    e->env_pri = curenv->env_pri;
+    e->env_status = ENV_RUNNABLE;
+
+    sched_insert_tail(e);
+
+    return (int)e->env_id;
+}
+
+/*
+ * 概述：
+ *   将各级调度队列的长度及调度统计（`struct SchedStat`）写入当前进程的`out_stat`处，
+ *   用于调整调度参数。
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - `out_stat`处的地址范围非法时返回-E_INVAL
+ */
+int sys_get_sched_stat(u_reg_t out_stat) {
+    if (curenv == NULL) {
+        panic("sys_get_sched_stat called while curenv is NULL");
+    }
+
+    if (is_illegal_va_range(out_stat, sizeof(struct SchedStat)) == 1) {
+        return -E_INVAL;
+    }
+
+    struct SchedStat stat;
+
+    sched_get_stat(&stat);
+
+    copy_user_space(&stat, (void *)out_stat, sizeof(struct SchedStat));
+
+    return 0;
+}
+
+/*
+ * 概述：
+ *   设置进程envid（0表示当前进程）的EDF调度参数（见`sched_set_edf`）：周期`period`、
+ *   每个周期的预算`budget`、相对截止时间`deadline`，均以时钟中断数计。
+ *   `period`为0时，将进程移回多级反馈队列调度类。
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - envid无效或不是当前进程及其子进程时返回-E_BAD_ENV
+ * - 参数不满足 0 < `budget` <= `deadline` <= `period` 时返回-E_INVAL
+ * - 准入控制失败时返回-E_OVERLOAD
+ */
+int sys_set_edf(u_int envid, u_int period, u_int budget, u_int deadline) {
+    struct Env *env;
+
+    try(envid2env(envid, &env, 1));
+
+    return sched_set_edf(env, period, budget, deadline);
+}
+
+/*
+ * 概述：
+ *   阻塞当前进程，直到自启动以来经过的时间达到`ns`纳秒。
+ *   由定时器队列（见`env_timer_set`）唤醒，而非轮询。
+ *
+ * Postcondition：
+ * - 返回0，此时已到达指定时刻
+ * - 指定时刻已过时立即返回0
+ *
+ * 副作用：
+ * - 可能将当前进程置为ENV_NOT_RUNNABLE，移出调度队列并加入定时器队列
+ */
+int sys_sleep_until(u_reg_t ns) {
+    if (curenv == NULL) {
+        panic("sys_sleep_until called while curenv is NULL");
+    }
+
+    uint64_t expire = ns_to_time(ns);
+
+    if (expire <= read_time()) {
+        return 0;
+    }
+
+    env_timer_set(curenv, expire);
+
+    curenv->env_status = ENV_NOT_RUNNABLE;
+    sched_remove(curenv);
+
+    // 设置本次系统调用的返回值为0
+    // 10 -> a0
+    ((struct Trapframe *)KSTACKTOP - 1)->regs[10] = 0;
+
+    schedule(1);
+}
+
+/*
+ * 概述：
+ *   同`sys_ipc_recv`，但最多等待`timeout_ns`纳秒。
+ *   超时时，当前进程被定时器队列唤醒，本次系统调用返回-E_TIMEOUT。
+ *   超时时刻超出`time` CSR的表示范围时饱和为UINT64_MAX，即不会超时（如`timeout_ns`为UINT64_MAX）。
+ *
+ * Postcondition：
+ * - 在超时前收到消息时返回0，IPC相关字段同`sys_ipc_recv`
+ * - -E_TIMEOUT：超时前未收到消息，`timeout_ns`为0时立即返回
+ * - -E_INVAL：'dstva'既不是0也不是合法地址
+ *
+ * 副作用：
+ * - 同`sys_ipc_recv`，并将当前进程加入定时器队列
+ */
+int sys_ipc_recv_timeout(uint32_t dstva, uint32_t from, u_reg_t timeout_ns) {
+    if (curenv == NULL) {
+        panic("sys_ipc_recv_timeout called while curenv is NULL");
+    }
+
+    if (dstva != 0 && is_illegal_va(dstva)) {
+        return -E_INVAL;
+    }
+
+    if (timeout_ns == 0) {
+        return -E_TIMEOUT;
+    }
+
+    uint64_t now = read_time();
+    uint64_t timeout = ns_to_time(timeout_ns);
+
+    // 到期时刻溢出时饱和，以免回绕到过去而立即超时
+    env_timer_set(curenv, timeout > UINT64_MAX - now ? UINT64_MAX
+                                                     : now + timeout);
+
+    return sys_ipc_recv(dstva, from);
+}
+
+/*
+ * 概述：
+ *   将自启动以来经过的纳秒数写入`out_ns`。
+ *   纳秒数为64位，无法通过返回值（`int`）传递。
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - -E_INVAL：`out_ns`处的地址范围非法
+ */
+int sys_get_time(u_reg_t out_ns) {
+    if (is_illegal_va_range(out_ns, sizeof(uint64_t)) == 1) {
+        return -E_INVAL;
+    }
+
+    uint64_t ns = time_to_ns(read_time());
+
+    copy_user_space(&ns, (void *)out_ns, sizeof(uint64_t));
+
+    return 0;
+}
+
+/*
+ * 概述：
+ *   创建资源组（见`group_create`）：组内进程每`cpu_period`个时钟中断最多共运行
+ *   `cpu_quota`个时钟中断间隔，最多计入`page_limit`个物理页，0表示不限制。
+ *   当前进程不会加入新资源组，需调用`sys_group_attach`。
+ *
+ * Postcondition：
+ * - 成功时返回资源组编号
+ * - -E_INVAL：`cpu_quota`非0且大于`cpu_period`
+ * - -E_NO_MEM：没有空闲的资源组
+ */
+int sys_group_create(u_int cpu_quota, u_int cpu_period, u_int page_limit) {
+    return group_create(cpu_quota, cpu_period, page_limit);
+}
+
+/*
+ * 概述：
+ *   将进程envid（0表示当前进程）移入资源组`gid`，其之后创建的子进程继承该资源组。
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - -E_BAD_ENV：envid无效或不是当前进程及其子进程
+ * - -E_INVAL：`gid`不是已创建的资源组
+ */
+int sys_group_attach(u_int envid, u_int gid) {
+    struct Env *env;
+
+    try(envid2env(envid, &env, 1));
+
+    return group_attach(env, gid);
+}
+
+/*
+ * 概述：
+ *   将资源组`gid`的配额及使用情况写入`out_stat`。
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - -E_INVAL：`gid`不是已创建的资源组，或`out_stat`处的地址范围非法
+ */
+int sys_group_get_stat(u_int gid, u_reg_t out_stat) {
+    if (is_illegal_va_range(out_stat, sizeof(struct GroupStat)) == 1) {
+        return -E_INVAL;
+    }
+
+    struct GroupStat stat;
+
+    try(group_get_stat(gid, &stat));
+
+    copy_user_space(&stat, (void *)out_stat, sizeof(struct GroupStat));
+
     return 0;
 }
 
@@ -1322,7 +1797,18 @@ void *syscall_table[MAX_SYSNO] = {
     [SYS_get_process_list] = sys_get_process_list,
     [SYS_get_physical_address] = sys_get_physical_address,
     [SYS_is_dirty] = sys_is_dirty,
-    [SYS_pageref] = sys_pageref};
+    [SYS_pageref] = sys_pageref,
+    [SYS_set_fork_flags] = sys_set_fork_flags,
+    [SYS_set_fault_around] = sys_set_fault_around,
+    [SYS_spawn] = sys_spawn,
+    [SYS_get_sched_stat] = sys_get_sched_stat,
+    [SYS_set_edf] = sys_set_edf,
+    [SYS_sleep_until] = sys_sleep_until,
+    [SYS_ipc_recv_timeout] = sys_ipc_recv_timeout,
+    [SYS_get_time] = sys_get_time,
+    [SYS_group_create] = sys_group_create,
+    [SYS_group_attach] = sys_group_attach,
+    [SYS_group_get_stat] = sys_group_get_stat};
 
 /*
  * 概述：
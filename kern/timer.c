@@ -1,6 +1,230 @@
+#include <device_tree.h>
+#include <endian.h>
+#include <env.h>
+#include <error.h>
+#include <printk.h>
+#include <sched.h>
 #include <stdint.h>
+#include <string.h>
 #include <timer.h>
 
+uint64_t timer_frequency = TIMER_FREQUENCY;
+
+// 各启动阶段的名称及结束时间
+static struct {
+    const char *stage;
+    uint64_t end_time;
+} boot_stage_list[BOOT_STAGE_MAX];
+
+static u_int boot_stage_count = 0;
+
+// 定时器队列：以`env_wakeup_time`为键的最小堆
+// `env_timer_slot`为进程在堆中的下标加1，0表示没有定时器
+static struct Env *timer_heap[NENV];
+static u_int timer_heap_size = 0;
+
+// 最近一次设置的周期性时钟中断的时刻
+static uint64_t timer_tick_time = 0;
+
+static void timer_heap_place(u_int i, struct Env *e) {
+    timer_heap[i] = e;
+    e->env_timer_slot = i + 1;
+}
+
+static void timer_heap_up(u_int i) {
+    struct Env *e = timer_heap[i];
+
+    while (i > 0) {
+        u_int parent = (i - 1) / 2;
+
+        if (timer_heap[parent]->env_wakeup_time <= e->env_wakeup_time) {
+            break;
+        }
+
+        timer_heap_place(i, timer_heap[parent]);
+        i = parent;
+    }
+
+    timer_heap_place(i, e);
+}
+
+static void timer_heap_down(u_int i) {
+    struct Env *e = timer_heap[i];
+
+    while (2 * i + 1 < timer_heap_size) {
+        u_int child = 2 * i + 1;
+
+        if ((child + 1 < timer_heap_size) &&
+            (timer_heap[child + 1]->env_wakeup_time <
+             timer_heap[child]->env_wakeup_time)) {
+            child++;
+        }
+
+        if (e->env_wakeup_time <= timer_heap[child]->env_wakeup_time) {
+            break;
+        }
+
+        timer_heap_place(i, timer_heap[child]);
+        i = child;
+    }
+
+    timer_heap_place(i, e);
+}
+
+void env_timer_set(struct Env *e, uint64_t expire) {
+    env_timer_cancel(e);
+
+    e->env_wakeup_time = expire;
+
+    timer_heap_place(timer_heap_size, e);
+    timer_heap_size++;
+
+    timer_heap_up(timer_heap_size - 1);
+}
+
+void env_timer_cancel(struct Env *e) {
+    if (e->env_timer_slot == 0) {
+        return;
+    }
+
+    u_int i = e->env_timer_slot - 1;
+
+    e->env_timer_slot = 0;
+    timer_heap_size--;
+
+    if (i == timer_heap_size) {
+        return;
+    }
+
+    // 以堆的最后一个元素填补空位，其可能需要上移或下移
+    struct Env *last = timer_heap[timer_heap_size];
+
+    timer_heap_place(i, last);
+    timer_heap_up(i);
+
+    if (last->env_timer_slot == i + 1) {
+        timer_heap_down(i);
+    }
+}
+
+void env_timer_expire(void) {
+    uint64_t now = read_time();
+
+    while ((timer_heap_size > 0) && (timer_heap[0]->env_wakeup_time <= now)) {
+        struct Env *e = timer_heap[0];
+
+        env_timer_cancel(e);
+
+        if (e->env_status != ENV_NOT_RUNNABLE) {
+            continue;
+        }
+
+        // 阻塞在`sys_ipc_recv_timeout`中：接收超时
+        // 10 -> a0
+        if (e->env_ipc_recving == 1) {
+            e->env_ipc_recving = 0;
+            e->env_tf.regs[10] = (u_reg_t)-E_TIMEOUT;
+        }
+
+        e->env_in_syscall = 0;
+        e->env_status = ENV_RUNNABLE;
+        sched_insert_tail(e);
+    }
+}
+
+int timer_tick_due(void) {
+    return read_time() >= timer_tick_time;
+}
+
 void set_next_timer_interrupt(u_reg_t next_tick) {
-    sbi_timer_set_timer((uint64_t)next_tick);
-}
\ No newline at end of file
+    uint64_t next = (uint64_t)next_tick;
+
+    timer_tick_time = next;
+
+    if ((timer_heap_size > 0) && (timer_heap[0]->env_wakeup_time < next)) {
+        next = timer_heap[0]->env_wakeup_time;
+    }
+
+    sbi_timer_set_timer(next);
+}
+
+void boot_stage_mark(const char *stage) {
+    uint64_t now = read_time();
+
+    if (boot_stage_count >= BOOT_STAGE_MAX) {
+        return;
+    }
+
+    boot_stage_list[boot_stage_count].stage = stage;
+    boot_stage_list[boot_stage_count].end_time = now;
+    boot_stage_count++;
+}
+
+void boot_stage_summarize(void) {
+    // `time` CSR自机器复位起计数，故第一个阶段从 0 开始
+    uint64_t prev = 0;
+
+    printk("boot stages:\n");
+
+    for (u_int i = 0; i < boot_stage_count; i++) {
+        printk("  %-16s %8lu us\n", boot_stage_list[i].stage,
+               time_to_us(boot_stage_list[i].end_time - prev));
+
+        prev = boot_stage_list[i].end_time;
+    }
+
+    printk("  %-16s %8lu us\n", "total",
+           time_to_us(prev));
+}
+
+void timer_frequency_init(void) {
+    struct device_node *cpus = NULL;
+
+    if (device_tree.root != NULL) {
+        for (struct device_node *node = device_tree.root->child; node != NULL;
+             node = node->sibling) {
+            if (strcmp(node->name, "cpus") == 0) {
+                cpus = node;
+                break;
+            }
+        }
+    }
+
+    struct property *property =
+        cpus != NULL ? get_property(cpus, "timebase-frequency") : NULL;
+
+    if (property == NULL) {
+        printk("timer_frequency_init: timebase-frequency not found, use "
+               "default %lu Hz\n",
+               timer_frequency);
+        return;
+    }
+
+    // `timebase-frequency`可以是一个或两个cell
+    uint64_t frequency;
+
+    if (property->length == sizeof(uint32_t)) {
+        frequency = be32toh(*(uint32_t *)property->value);
+    } else if (property->length == 2 * sizeof(uint32_t)) {
+        uint32_t *cells = (uint32_t *)property->value;
+
+        frequency = ((uint64_t)be32toh(cells[0]) << 32) | be32toh(cells[1]);
+    } else {
+        printk("timer_frequency_init: invalid timebase-frequency length %u, "
+               "use default %lu Hz\n",
+               property->length, timer_frequency);
+        return;
+    }
+
+    if (frequency == 0) {
+        printk("timer_frequency_init: timebase-frequency is 0, use default "
+               "%lu Hz\n",
+               timer_frequency);
+        return;
+    }
+
+    timer_frequency = frequency;
+
+    debugk("timer_frequency_init", "timebase-frequency = %lu Hz\n",
+           timer_frequency);
+}
@@ -3,6 +3,8 @@
 #include "types.h"
 #include <bitops.h>
 #include <env.h>
+#include <error.h>
+#include <group.h>
 #include <pmap.h>
 
 /*
@@ -29,13 +31,16 @@
  *
  * Postcondition:
  *
- * - 分配物理页面并插入`pgdir`页目录的`va`映射项
- * - `va`对应的页表项权限设置为 PTE_R | PTE_V |
- *   （若 va < UTOP 则附加 PTE_W）
- * - 移除`va`地址原有的所有映射，原映射的物理页的引用计数将 -1
- * - 已分配页面的`pp_ref`引用计数增加
+ * - 成功时返回 0：
+ *   - 分配物理页面并插入`pgdir`页目录的`va`映射项
+ *   - `va`对应的页表项权限设置为 PTE_R | PTE_V |
+ *     （若 va < UTOP 则附加 PTE_W）
+ *   - 移除`va`地址原有的所有映射，原映射的物理页的引用计数将 -1
+ *   - 已分配页面的`pp_ref`引用计数增加
+ * - 内存不足时返回-E_NO_MEM，超出`pgdir`所属进程的资源组的物理页限制时返回-E_QUOTA，
+ *   此时映射不变
  */
-void passive_alloc(u_reg_t va, Pte *pgdir, uint16_t asid) {
+int passive_alloc(u_reg_t va, Pte *pgdir, uint16_t asid) {
     struct Page *p = NULL;
 
     if (va < UTEMP) {
@@ -62,48 +67,151 @@ void passive_alloc(u_reg_t va, Pte *pgdir, uint16_t asid) {
         panic("kernel address: 0x%016lx", va);
     }
 
-    panic_on(page_alloc(&p));
+    try(page_alloc(&p));
 
     // Postconditon for `page_alloc`: now, p points to the allocated Page
 
-    panic_on(page_insert(pgdir, asid, p, va,
-                         ((va >= UTOP) ? PTE_RO : PTE_RW) | PTE_USER));
+    int r = page_insert(pgdir, asid, p, va,
+                        ((va >= UTOP) ? PTE_RO : PTE_RW) | PTE_USER);
+
+    if (r < 0) {
+        page_free(p);
+    }
+
+    return r;
 }
 
-/*
- * 概述：
- *
- * （含 TLB 操作）在校验指定虚拟地址`va`位于允许的内核空间区域后，
- * 分配一个新的物理页面
- * 将该物理页面映射到该地址并增加该页面的引用计数。
- *
- * 若虚拟地址`va`已经存在有效映射，移除原映射，原映射的物理页的引用计数 -1。
- *
- * 页面权限根据虚拟地址所属区域进行配置：
- * 内核映射的用户区域（UVPT 至 ULIM）不设置 PTE_D 标志（只读访问）。
- *
- * Precondition:
- *
- * - `va` **无需**页面对齐，但必须满足以下条件：
- *    - va >= KMALLOC_BEGIN_VA && va < KMALLOC_END_VA
- *
- * Postcondition:
- *
- * - 分配物理页面并插入`pgdir`页目录的`va`映射项
- * - `va`对应的页表项权限设置为 PTE_RW | PTE_V |
- * - 移除`va`地址原有的所有映射，原映射的物理页的引用计数将 -1
- * - 已分配页面的`pp_ref`引用计数增加
- */
-void kernel_passive_alloc(u_reg_t va) {
-    struct Page *p = NULL;
+int passive_alloc_around(struct Env *env, u_reg_t va) {
+    u_reg_t page_va = ROUNDDOWN(va, PAGE_SIZE);
+    uint32_t window = env->env_fault_around;
+    int descending = 0;
 
-    if (va < KMALLOC_BEGIN_VA || va >= KMALLOC_END_VA) {
-        panic("kernel_passive_alloc: invalid address: 0x%016lx\n", va);
+    try(passive_alloc(va, env->env_pgdir, env->env_asid));
+
+    if (env->env_fault_around_max <= 1 || page_va >= USTACKTOP) {
+        return 0;
     }
 
-    panic_on(page_alloc(&p));
+    // 紧接上次填充的范围的缺页视为顺序访问，窗口加倍；否则重置为 1 页
+    if (page_va == env->env_fault_around_end) {
+        window = MIN(window * 2, env->env_fault_around_max);
+    } else if (page_va + PAGE_SIZE == env->env_fault_around_begin) {
+        window = MIN(window * 2, env->env_fault_around_max);
+        descending = 1;
+    } else {
+        window = 1;
+    }
 
-    // Postconditon for `page_alloc`: now, p points to the allocated Page
+    env->env_fault_around = window;
+
+    Pte *pte = NULL;
+    u_reg_t begin = page_va;
+    u_reg_t end = page_va + PAGE_SIZE;
+    struct TlbGather tlb;
+
+    page_lookup(env->env_pgdir, page_va, &pte);
+    tlb_gather_init(&tlb, env->env_asid, 0);
+
+    // `va`所在的三级页表已由`passive_alloc`建立，且未被共享，可直接填写其中的页表项
+    for (uint32_t i = 1; i < window; i++) {
+        u_reg_t cur_va;
+        Pte *cur_pte;
+
+        if (descending) {
+            if (P3X(page_va) < i || page_va - i * PAGE_SIZE < UTEMP) {
+                break;
+            }
+
+            cur_va = page_va - i * PAGE_SIZE;
+            cur_pte = pte - i;
+        } else {
+            if (P3X(page_va) + i >= PAGE_SIZE / sizeof(Pte) ||
+                page_va + i * PAGE_SIZE >= USTACKTOP) {
+                break;
+            }
+
+            cur_va = page_va + i * PAGE_SIZE;
+            cur_pte = pte + i;
+        }
 
-    panic_on(page_insert(kernel_boot_pgdir, 0, p, va, PTE_RW | PTE_GLOBAL));
-}
\ No newline at end of file
+        struct Page *pp = NULL;
+
+        // 镜像中尚未访问的页同样未映射，其内容来自镜像（`env_image_fault`），不可填充为新页
+        if ((*cur_pte & PTE_V) != 0 || env_image_contains(env, cur_va)) {
+            break;
+        }
+
+        // 直接填写页表项，须自行计入资源组（见`pgdir_charge`）
+        // 内存不足或超出资源组的限制时不再填充，之后的页留待各自的缺页异常处理
+        if (group_charge_pages(env, 1) != 0) {
+            break;
+        }
+
+        if (page_alloc(&pp) != 0) {
+            group_uncharge_pages(env, 1);
+            break;
+        }
+
+        *cur_pte = (page2ppn(pp) << FLAG_SHIFT) | PTE_RW | PTE_USER | PTE_V;
+        pp->pp_ref++;
+
+        tlb_gather_add(&tlb, cur_va, PAGE_SIZE);
+
+        begin = MIN(begin, cur_va);
+        end = MAX(end, cur_va + PAGE_SIZE);
+    }
+
+    tlb_gather_finish(&tlb);
+
+    env->env_fault_around_begin = begin;
+    env->env_fault_around_end = end;
+
+    return 0;
+}
+
+struct Page *zero_page = NULL;
+
+struct Page *zero_page_get(void) {
+    if (zero_page == NULL) {
+        struct Page *pp = NULL;
+
+        if (page_alloc(&pp) < 0) {
+            return NULL;
+        }
+
+        // 映射零页的进程均退出后，零页也不会被释放
+        pp->pp_flags |= PAGE_FLAG_PINNED;
+
+        zero_page = pp;
+    }
+
+    return zero_page;
+}
+
+int passive_map_zero(struct Env *env, u_reg_t va) {
+    struct Page *pp = NULL;
+
+    if (va < UTEMP || va >= USTACKTOP || (pp = zero_page_get()) == NULL) {
+        return passive_alloc_around(env, va);
+    }
+
+    // 全局零页不计入资源组，只可能因无法分配页表而失败
+    return page_insert(env->env_pgdir, env->env_asid, pp,
+                       ROUNDDOWN(va, PAGE_SIZE), PTE_RO | PTE_USER | PTE_COW);
+}
+
+int pinned_page_privatize(struct Env *env, u_reg_t va) {
+    Pte *pte = NULL;
+    struct Page *pp = page_lookup(env->env_pgdir, va, &pte);
+
+    if (pp == NULL || (pp->pp_flags & PAGE_FLAG_PINNED) == 0) {
+        return 0;
+    }
+
+    // 只读镜像段的页（如代码段）不以CoW方式映射，不可被写入
+    if ((*pte & PTE_COW) == 0) {
+        return -E_INVAL;
+    }
+
+    return cow_fault(env, va);
+}
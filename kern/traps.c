@@ -1,9 +1,13 @@
 #include "mmu.h"
 #include "types.h"
+#include <asm/regdef.h>
 #include <backtrace.h>
 #include <env.h>
+#include <error.h>
+#include <group.h>
 #include <pmap.h>
 #include <printk.h>
+#include <sched.h>
 #include <trap.h>
 
 extern char _kernel_end[];
@@ -139,6 +143,27 @@ void do_reserved(struct Trapframe *tf) {
     }
 }
 
+/*
+ * 概述：
+ *   陷阱入口及返回时的CPU时间记账（见`sched_account`），由`BUILD_HANDLER`生成的
+ *   处理函数在调用具体处理函数前后调用。
+ *   入口处将上次返回用户态以来的时间计入当前进程的用户态时间，返回处将陷阱处理的
+ *   时间计入其内核态时间。不返回的处理函数（如切换进程）由`env_run`记账。
+ *
+ *   内核态的陷阱（异常重入）不记账，其时间计入所在的外层陷阱。
+ */
+void trap_account_enter(struct Trapframe *tf) {
+    if ((tf->sstatus & SSTATUS_SPP) == 0) {
+        sched_account(curenv, 1);
+    }
+}
+
+void trap_account_exit(struct Trapframe *tf) {
+    if ((tf->sstatus & SSTATUS_SPP) == 0) {
+        sched_account(curenv, 0);
+    }
+}
+
 void do_clock(struct Trapframe *tf) { schedule(0); }
 
 void do_interrupt(struct Trapframe *tf) {
@@ -155,16 +180,31 @@ void do_interrupt(struct Trapframe *tf) {
     interrupt_handler_map[interrupt_code](tf);
 }
 
+/*
+ * 概述：
+ *   用户进程`e`在`va`处的缺页无法处理（错误码为`r`）时调用：缺页无法向用户返回错误，
+ *   输出原因并销毁`e`，而非使内核panic。
+ *
+ * Postcondition：
+ * - 若`e`为当前进程，不会返回
+ */
+static void page_fault_fail(struct Env *e, u_reg_t va, int r) {
+    if (r == -E_QUOTA) {
+        group_page_limit_exceeded(e, va);
+        return;
+    }
+
+    printk("[%08x] cannot handle page fault at va = 0x%016lx: %d\n",
+           e->env_id, va, r);
+
+    env_destroy(e);
+}
+
 void do_page_fault(struct Trapframe *tf) {
     // 对于内核代码发生的缺页异常，使用do_kernel_exception处理
     if ((tf->sepc) >= BASE_ADDR_IMM && (tf->sepc < (u_reg_t)_kernel_end)) {
-        // 若地址属于允许分配的地址，进行分配
-
-        if (tf->badvaddr >= KMALLOC_BEGIN_VA && tf->badvaddr < KMALLOC_END_VA) {
-            kernel_passive_alloc(tf->badvaddr);
-        } else {
-            do_kernel_exception(tf);
-        }
+        // 内核堆直接使用直接映射区域，不会发生缺页
+        do_kernel_exception(tf);
     } else {
         // 异常发生在用户区域代码
         if (curenv == NULL) {
@@ -174,8 +214,23 @@ void do_page_fault(struct Trapframe *tf) {
         Pte *pte = NULL;
 
         if (page_lookup(curenv->env_pgdir, tf->badvaddr, &pte) == NULL) {
-            // 对于用户程序，若请求的页不存在，直接分配页
-            passive_alloc(tf->badvaddr, curenv->env_pgdir, curenv->env_id);
+            // 对于用户程序，若请求的页不存在：
+            // 位于ELF镜像中时，映射镜像中的页；
+            // 读取时映射全局零页，首次写入时由`do_cow`分配；否则直接分配页
+            int r = env_image_fault(curenv, tf->badvaddr);
+
+            if (r == -E_INVAL) {
+                if (tf->scause == EXC_LOAD_PAGE_FAULT) {
+                    r = passive_map_zero(curenv, tf->badvaddr);
+                } else {
+                    r = passive_alloc_around(curenv, tf->badvaddr);
+                }
+            }
+
+            // 内存不足或超出资源组的物理页限制时销毁进程
+            if (r < 0) {
+                page_fault_fail(curenv, tf->badvaddr, r);
+            }
         } else {
             // 对于用户程序，若请求的页存在，检查是否是CoW页
 
@@ -193,37 +248,174 @@ void do_page_fault(struct Trapframe *tf) {
 
 void exception_init() { set_exception_handler((void *)exc_gen_entry); }
 
-void do_cow(struct Trapframe *tf) {
-    int ret = 0;
+/*
+ * 概述：
+ *   处理进程`env`中对第`level`级（1 或 2）巨页映射`*pte`的写时复制：
+ *   若该巨页只被`env`引用，直接改为可写；
+ *   否则分配新的巨页并复制整个巨页的内容；若无法分配巨页，将该映射拆分后，按普通页处理。
+ */
+static int cow_fault_huge(struct Env *env, u_reg_t va, Pte *pte,
+                          u_int level) {
+    uint32_t perm = (PTE_FLAGS(*pte) & ~PTE_COW & ~PTE_V) | PTE_W;
+    u_reg_t huge_begin_va = ROUNDDOWN(va, PLEVEL_SIZE(level));
+    struct Page *pp = pa2page(PTE_ADDR(*pte));
+    struct Page *new_page = NULL;
 
-    // curenv 已在do_page_fault中检查
-    Pte *pte = NULL;
+    if (page_head(pp)->pp_ref == 1) {
+        // 映射同一巨页，只更新标志位
+        try(page_insert_huge(env->env_pgdir, env->env_asid, pp, huge_begin_va,
+                             level, perm));
+        env->env_cow_reuse++;
+        return 0;
+    }
 
-    page_lookup(curenv->env_pgdir, tf->badvaddr, &pte);
+    // 新巨页将被整体覆盖，无需清零
+    // 新巨页替换原巨页的映射，资源组的计数不变
+    if (page_alloc_huge(PAGE_HUGE_ORDER(level), 0, &new_page) == 0) {
+        memcpy((void *)page2kva(new_page), (void *)page2kva(pp),
+               PLEVEL_SIZE(level));
 
-    if (pte == NULL) {
-        panic("CoW exception at va = 0x%016lx, but page_lookup returned null",
-              tf->badvaddr);
+        try(page_insert_huge(env->env_pgdir, env->env_asid, new_page,
+                             huge_begin_va, level, perm));
+
+        env->env_cow_copy++;
+        return 0;
     }
 
-    uint32_t perm = PTE_FLAGS(*pte);
+    // 无足够的连续内存：拆分后，缺页地址由三级页表项映射，仍为CoW页
+    // 拆分不复制内容（其余页仍共享原巨页），只有缺页所在的一页由`cow_fault`复制
+    try(page_split(env->env_pgdir, env->env_asid, va));
 
-    // 该页一定是CoW页（已在do_page_fault中检查）
+    return cow_fault(env, va);
+}
 
-    perm = (perm & ~PTE_COW) | PTE_W;
+/*
+ * 概述：
+ *   解除进程`env`中`va`处的三级页表项`*pte`（CoW页）的写时复制：
+ *   - 若该页只被`env`引用且未设置`PAGE_FLAG_PINNED`（`cow_reusable`），直接改为可写，无需复制
+ *   - 若该页是全局零页，分配新的已清零的物理页，无需复制
+ *   - 否则分配新的物理页并复制内容，映射到`va`
+ *
+ * Precondition：
+ * - `*pte`所在的三级页表未被共享（已调用`page_unshare`）
+ *
+ * Postcondition：
+ * - 成功时返回 0，内存不足时返回-E_NO_MEM，此时映射不变
+ * - 替换全局零页等内核持有的页时，超出`env`所在资源组的物理页限制，返回-E_QUOTA，此时映射不变
+ */
+// CoW页`pp`是否只被一个进程引用，可直接改为可写
+static inline int cow_reusable(struct Page *pp) {
+    // 内核持有的页（如全局零页）即使只被一个进程映射，也不可被写入
+    // 被共享的巨页拆分后，其中的页的引用计入巨页的首页
+    return page_head(pp)->pp_ref == 1 && (pp->pp_flags & PAGE_FLAG_PINNED) == 0;
+}
 
+static int cow_resolve(struct Env *env, Pte *pte, u_reg_t va,
+                       struct TlbGather *tlb) {
+    struct Page *pp = pa2page(PTE_ADDR(*pte));
+    uint32_t perm = (PTE_FLAGS(*pte) & ~PTE_COW & ~PTE_V) | PTE_W;
     struct Page *new_page = NULL;
+    int r;
 
-    if ((ret = page_alloc(&new_page)) < 0) {
-        panic("Cannot allocate page for CoW for va = 0x%016lx: %d\n",
-              tf->badvaddr, ret);
+    if (cow_reusable(pp)) {
+        *pte = (*pte & ~PTE_COW) | PTE_W;
+        tlb_gather_add(tlb, va, PAGE_SIZE);
+        env->env_cow_reuse++;
+        return 0;
     }
 
-    u_reg_t page_begin_va = ROUNDDOWN(tf->badvaddr, PAGE_SIZE);
+    if (pp == zero_page) {
+        r = page_alloc(&new_page);
+    } else {
+        // 新页将被整页覆盖，无需清零
+        r = page_alloc_nozero(&new_page);
+    }
 
-    memcpy((void *)page2kva(new_page), (void *)P2KADDR(PTE_ADDR(*pte)),
-           PAGE_SIZE);
+    if (r < 0) {
+        return r;
+    }
 
-    page_insert(curenv->env_pgdir, curenv->env_asid, new_page, tf->badvaddr,
-                perm);
-}
\ No newline at end of file
+    if (pp != zero_page) {
+        memcpy((void *)page2kva(new_page), (void *)page2kva(pp), PAGE_SIZE);
+    }
+
+    // 新页替换原页的映射，资源组的计数不变（原页不计入时除外，见`page_mapped_pages`）
+    if ((r = page_insert_gather(env->env_pgdir, tlb, new_page, va, perm)) < 0) {
+        page_free(new_page);
+        return r;
+    }
+
+    env->env_cow_copy++;
+    return 0;
+}
+
+int cow_fault(struct Env *env, u_reg_t va) {
+    Pte *pte = NULL;
+    u_int level = 3;
+
+    // 共享的三级页表中的物理页，其引用计数只计入该页表一次，
+    // 先为`env`复制该页表，使得引用计数为 1 时，该页确实只被`env`引用
+    try(page_unshare(env->env_pgdir, env->env_asid, va));
+
+    page_lookup_level(env->env_pgdir, va, &pte, &level);
+
+    if (pte == NULL || (*pte & PTE_COW) == 0) {
+        return -E_INVAL;
+    }
+
+    if (level < 3) {
+        return cow_fault_huge(env, va, pte, level);
+    }
+
+    struct TlbGather tlb;
+    u_reg_t page_begin_va = ROUNDDOWN(va, PAGE_SIZE);
+    int r;
+
+    tlb_gather_init(&tlb, env->env_asid, 0);
+
+    if ((r = cow_resolve(env, pte, page_begin_va, &tlb)) < 0) {
+        return r;
+    }
+
+    // 一并处理同一组中相邻的CoW页，减少之后的缺页异常
+    // 仍被共享的页只在设置了`FORK_COW_COPY_AROUND`时复制：刚fork后的页大多仍被共享，
+    // 子进程可能只写入其中少数几页，不应为其余的页分配、复制并计入资源组
+    // 映射全局零页的页尚未被写入，不在此分配
+    int copy_around = (env->env_fork_flags & FORK_COW_COPY_AROUND) != 0;
+    u_reg_t around_begin_va =
+        ROUNDDOWN(page_begin_va, COW_FAULT_AROUND_PAGES * PAGE_SIZE);
+    Pte *around = pte - (page_begin_va - around_begin_va) / PAGE_SIZE;
+
+    for (size_t i = 0; i < COW_FAULT_AROUND_PAGES; i++) {
+        u_reg_t cur_va = around_begin_va + i * PAGE_SIZE;
+
+        if (cur_va == page_begin_va || (around[i] & PTE_V) == 0 ||
+            (around[i] & PTE_COW) == 0) {
+            continue;
+        }
+
+        struct Page *pp = pa2page(PTE_ADDR(around[i]));
+
+        if (pp == zero_page || (!copy_around && !cow_reusable(pp))) {
+            continue;
+        }
+
+        // 内存不足时，其余的页留待各自的缺页异常处理
+        if (cow_resolve(env, &around[i], cur_va, &tlb) < 0) {
+            break;
+        }
+    }
+
+    tlb_gather_finish(&tlb);
+
+    return 0;
+}
+
+void do_cow(struct Trapframe *tf) {
+    // curenv 已在do_page_fault中检查，该页一定是CoW页
+    int r = cow_fault(curenv, tf->badvaddr);
+
+    if (r < 0) {
+        page_fault_fail(curenv, tf->badvaddr, r);
+    }
+}
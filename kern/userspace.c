@@ -1,36 +1,110 @@
 #include "env.h"
 #include "types.h"
+#include <error.h>
+#include <group.h>
 #include <mmu.h>
 #include <pmap.h>
 #include <printk.h>
 #include <string.h>
 #include <userspace.h>
 
-void copy_user_space(const void *restrict src, void *restrict dst, size_t len) {
+/*
+ * 概述：
+ *   （含 TLB 操作）确保进程`env`中[va, va + len)的每一页均已映射，从而内核访问时不会发生缺页：
+ *   - 未映射的页：位于ELF镜像中时映射镜像中的页（`env_image_fault`），否则写入时分配新页
+ *   - `write`非零时，解除CoW页（含全局零页、镜像中可写段的页）的写时复制
+ *
+ *   分配的页计入`env`的资源组，超出其物理页限制时销毁`env`（同缺页异常），
+ * 故`env`不是当前进程时，调用者应暂停限制的检查（`group_limit_suspend`）。
+ *
+ * Panics：
+ * - 读取的用户页未映射且不在ELF镜像中
+ * - 内核地址未映射
+ * - 内存不足
+ */
+static void user_range_prepare(struct Env *env, u_reg_t va, size_t len,
+                               int write) {
+    for (u_reg_t page_va = ROUNDDOWN(va, PAGE_SIZE); page_va < va + len;
+         page_va += PAGE_SIZE) {
+        Pte *pte = NULL;
+
+        if (page_lookup(env->env_pgdir, page_va, &pte) == NULL) {
+            if (page_va >= ULIM) {
+                panic("trying to access unmapped kernel va 0x%016lx\n",
+                      page_va);
+            }
 
-    if (curenv == NULL) {
-        panic("copy_user_space called while curenv is NULL");
-    }
+            int r = env_image_fault(env, page_va);
+
+            if (r == -E_INVAL) {
+                if (write == 0) {
+                    panic("trying to copy from unmapped va 0x%016lx\n",
+                          page_va);
+                }
+
+                r = passive_alloc(page_va, env->env_pgdir, env->env_asid);
+            }
 
-    Pte *src_pte = NULL;
-    Pte *dst_pte = NULL;
+            if (r == -E_QUOTA) {
+                group_page_limit_exceeded(env, page_va);
+            }
+
+            panic_on(r);
 
-    page_lookup(curenv->env_pgdir, (u_reg_t)src, &src_pte);
-    page_lookup(curenv->env_pgdir, (u_reg_t)dst, &dst_pte);
+            page_lookup(env->env_pgdir, page_va, &pte);
+        }
 
-    if (src_pte == NULL) {
-        panic("trying to copy from unmapped va 0x%016lx\n", (u_reg_t)src);
+        if (write != 0 && (*pte & PTE_COW) != 0) {
+            // 内核写入CoW页会触发内核态缺页，先解除写时复制
+            int r = cow_fault(env, page_va);
+
+            if (r == -E_QUOTA) {
+                group_page_limit_exceeded(env, page_va);
+            }
+
+            panic_on(r);
+        }
     }
+}
 
-    if (dst_pte == NULL) {
-        if ((u_reg_t)dst >= ULIM) {
-            panic("trying to copy to unmapped kernel va 0x%016lx\n",
-                  (u_reg_t)dst);
-        } else {
-            passive_alloc((u_reg_t)dst, curenv->env_pgdir, curenv->env_asid);
+/*
+ * 概述：
+ *   （含 TLB 操作）检查当前进程中[va, va + len)的每一页是否均可被内核读取：已映射，
+ *   或位于ELF镜像中（此时映射镜像中的页，见`env_image_fault`）。
+ *   内核读取用户指定的地址范围（`copy_user_space`）前调用，使得未映射的地址返回错误，而非panic。
+ *
+ * Precondition：
+ * - [va, va + len)位于[UTEMP, UTOP)中
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - -E_INVAL：存在既未映射、也不在ELF镜像中的页
+ * - 映射镜像中的页时，内存不足返回-E_NO_MEM，超出资源组的物理页限制返回-E_QUOTA
+ */
+int user_range_check(u_reg_t va, size_t len) {
+    if (curenv == NULL) {
+        panic("user_range_check called while curenv is NULL");
+    }
+
+    for (u_reg_t page_va = ROUNDDOWN(va, PAGE_SIZE); page_va < va + len;
+         page_va += PAGE_SIZE) {
+        if (page_lookup(curenv->env_pgdir, page_va, NULL) == NULL) {
+            try(env_image_fault(curenv, page_va));
         }
     }
 
+    return 0;
+}
+
+void copy_user_space(const void *restrict src, void *restrict dst, size_t len) {
+
+    if (curenv == NULL) {
+        panic("copy_user_space called while curenv is NULL");
+    }
+
+    user_range_prepare(curenv, (u_reg_t)src, len, 0);
+    user_range_prepare(curenv, (u_reg_t)dst, len, 1);
+
     allow_access_user_space();
 
     memcpy(dst, src, len);
@@ -50,24 +124,11 @@ void copy_user_space_to_env(struct Env *env, const void *restrict src,
 
     set_page_table(env->env_asid, env->env_pgdir);
 
-    Pte *src_pte = NULL;
-    Pte *dst_pte = NULL;
-
-    page_lookup(env->env_pgdir, (u_reg_t)src, &src_pte);
-    page_lookup(env->env_pgdir, (u_reg_t)dst, &dst_pte);
-
-    if (src_pte == NULL) {
-        panic("trying to copy from unmapped va 0x%016lx\n", (u_reg_t)src);
-    }
-
-    if (dst_pte == NULL) {
-        if ((u_reg_t)dst >= ULIM) {
-            panic("trying to copy to unmapped kernel va 0x%016lx\n",
-                  (u_reg_t)dst);
-        } else {
-            passive_alloc((u_reg_t)dst, env->env_pgdir, env->env_asid);
-        }
-    }
+    // 无法向`env`报告错误，其分配的页不受资源组的限制
+    group_limit_suspend();
+    user_range_prepare(env, (u_reg_t)src, len, 0);
+    user_range_prepare(env, (u_reg_t)dst, len, 1);
+    group_limit_resume();
 
     allow_access_user_space();
 
@@ -92,7 +153,8 @@ void map_user_vpt(struct Env *env) {
     for (size_t p1x = 0; p1x <= P1X(USTACKTOP); p1x++) {
         Pte p1_entry = p1[p1x];
 
-        if ((p1_entry & PTE_V) != 0) {
+        // 巨页映射没有下级页表
+        if ((p1_entry & PTE_V) != 0 && PTE_IS_NON_LEAF(p1_entry)) {
             u_reg_t uvpt_p2_current_va = uvpt_p2_begin_va + p1x * PAGE_SIZE;
 
             if (uvpt_p2_current_va == uvpt_p1_begin_va) {
@@ -111,13 +173,13 @@ void map_user_vpt(struct Env *env) {
     for (size_t p1x = 0; p1x <= P1X(USTACKTOP); p1x++) {
         Pte p1_entry = p1[p1x];
 
-        if ((p1_entry & PTE_V) != 0) {
+        if ((p1_entry & PTE_V) != 0 && PTE_IS_NON_LEAF(p1_entry)) {
             u_reg_t p2_base_addr = P2KADDR(PTE_ADDR(p1_entry));
 
             for (size_t p2x = 0; p2x < (PAGE_SIZE / sizeof(Pte)); p2x++) {
                 Pte p2_entry = ((Pte *)p2_base_addr)[p2x];
 
-                if ((p2_entry & PTE_V) != 0) {
+                if ((p2_entry & PTE_V) != 0 && PTE_IS_NON_LEAF(p2_entry)) {
                     u_reg_t uvpt_p3_current_va =
                         (p1x * (PAGE_SIZE / sizeof(Pte)) + p2x) * PAGE_SIZE +
                         uvpt_p3_begin_va;
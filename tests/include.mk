@@ -16,7 +16,7 @@ INCLUDES    +=  -I$(root_dir)/include -I$(user_dir)/include
 %.b: SHELL := /bin/bash
 %.b: %.o $(libs)
 	shopt -s nullglob && $(LD) -o $@ $(LDFLAGS) -T $(root_dir)/user/user.lds $^ \
-	$(user_dir)/lib/*.o $(fs_dir)/*.o $(lib_dir)/*.o
+	$(user_dir)/lib/entry.o $(fs_dir)/*.o -R $(user_dir)/ulib.b
 
 %.o: %.c
 	$(CC) $(CFLAGS) $(INCLUDES) -c -o $@ $<
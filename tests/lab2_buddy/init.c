@@ -0,0 +1,21 @@
+#include <pmap.h>
+
+void riscv64_init(u_reg_t hart_id, void *dtb_address) {
+    printk("init.c:\triscv64_init() is called\n");
+
+    exception_init();
+
+    riscv64_detect_memory(dtb_address);
+    riscv64_vm_init();
+    page_init();
+
+    physical_memory_manage_check();
+
+    page_check();
+
+    buddy_check();
+
+    printk("My life for Super Earth!\n");
+
+    halt();
+}
@@ -1,5 +1,6 @@
 #include <kmalloc.h>
 #include <pmap.h>
+#include <string.h>
 
 uint64_t address[1000];
 uint64_t end[1000];
@@ -30,7 +31,9 @@ char check(uint64_t a, uint64_t b) {
         return 0;
     }
 
-    if (a < (uint64_t)KMALLOC_BEGIN_VA || b > (uint64_t)(KMALLOC_END_VA)) {
+    // 内核堆位于直接映射区域中
+    if (a < (uint64_t)HIGH_ADDR_IMM ||
+        b > (uint64_t)HIGH_ADDR_IMM + (npage << PAGE_SHIFT)) {
         out_of_range();
         return 0;
     }
@@ -79,15 +82,73 @@ void malloc_test() {
     void *p5 = kmalloc(100);
     assert(check((uint64_t)p5, (uint64_t)p5 + 100));
 
+    kfree(p5);
+    rem((uint64_t)p5, (uint64_t)p5 + 100);
+
+    kfree(p2);
+    rem((uint64_t)p2, (uint64_t)p2 + 0x100000);
+
+    // 释放后的大块内存应当可被再次分配
+    void *p6 = kmalloc(0x100000);
+    assert(check((uint64_t)p6, (uint64_t)p6 + 0x100000));
+
     printk("malloc_test() is done\n");
 }
 
+void slab_test() {
+    void *small[300];
+
+    // 各种大小的小对象，不应相互重叠
+    for (int i = 0; i < 300; i++) {
+        size_t size = (size_t)(1 + (i * 37) % 1024);
+
+        small[i] = kmalloc(size);
+        assert(check((uint64_t)small[i], (uint64_t)small[i] + size - 1));
+        assert(((uint64_t)small[i] & (KMALLOC_ALIGN - 1)) == 0);
+
+        memset(small[i], i & 0xff, size);
+    }
+
+    for (int i = 0; i < 300; i++) {
+        size_t size = (size_t)(1 + (i * 37) % 1024);
+
+        // 其它对象的写入不应破坏本对象
+        for (size_t j = 0; j < size; j++) {
+            assert(((unsigned char *)small[i])[j] == (i & 0xff));
+        }
+    }
+
+    // 释放后立即重新分配同样大小的对象，应当复用刚释放的对象
+    void *obj = kmalloc(48);
+    kfree(obj);
+    assert(kmalloc(48) == obj);
+    kfree(obj);
+
+    for (int i = 0; i < 300; i += 2) {
+        size_t size = (size_t)(1 + (i * 37) % 1024);
+
+        kfree(small[i]);
+        rem((uint64_t)small[i], (uint64_t)small[i] + size - 1);
+    }
+
+    for (int i = 1; i < 300; i += 2) {
+        size_t size = (size_t)(1 + (i * 37) % 1024);
+
+        kfree(small[i]);
+        rem((uint64_t)small[i], (uint64_t)small[i] + size - 1);
+    }
+
+    allocation_summarize();
+
+    printk("slab_test() is done\n");
+}
+
 void riscv64_init(u_reg_t hart_id, void *dtb_address) {
     printk("init.c:\triscv64_init() is called\n");
 
     exception_init();
 
-    riscv64_detect_memory();
+    riscv64_detect_memory(dtb_address);
     riscv64_vm_init();
     page_init();
 
@@ -95,6 +156,8 @@ void riscv64_init(u_reg_t hart_id, void *dtb_address) {
 
     malloc_test();
 
+    slab_test();
+
     printk("My life for Super Earth!\n");
 
     halt();
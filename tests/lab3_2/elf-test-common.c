@@ -5,7 +5,7 @@ void riscv64_init(u_reg_t hart_id, void *dtb_address) {
 
     exception_init();
 
-    riscv64_detect_memory();
+    riscv64_detect_memory(dtb_address);
     riscv64_vm_init();
     page_init();
 
@@ -33,13 +33,23 @@ void mem_eqz(const char *a, u_long size) {
     }
 }
 
-void seg_check(Pte *pgdir, u_long va, const char *std, u_long size) {
+// 段中的页在首次访问时才映射，检查前先按缺页处理映射该页
+Pte *seg_page(struct Env *e, u_long va) {
+    Pte *pte;
+    if (page_lookup(e->env_pgdir, va, &pte) == NULL) {
+        assert(env_image_fault(e, va) == 0);
+        assert(page_lookup(e->env_pgdir, va, &pte));
+    }
+    return pte;
+}
+
+void seg_check(struct Env *e, u_long va, const char *std, u_long size) {
     printk("segment check: %x - %x (%d)\n", va, va + size, size);
     Pte *pte;
     u_long off = va - ROUNDDOWN(va, PAGE_SIZE), i;
     if (off) {
         u_long n = MIN(size, PAGE_SIZE - off);
-        assert(page_lookup(pgdir, va - off, &pte));
+        pte = seg_page(e, va - off);
         if (std) {
             mem_eq((char *)P2KADDR(PTE_ADDR(*pte)) + off, std, n);
             std += n;
@@ -52,7 +62,7 @@ void seg_check(Pte *pgdir, u_long va, const char *std, u_long size) {
 
     for (i = 0; i < size; i += PAGE_SIZE) {
         u_long n = MIN(size - i, PAGE_SIZE);
-        assert(page_lookup(pgdir, va + i, &pte));
+        pte = seg_page(e, va + i);
         if (std) {
             mem_eq((char *)P2KADDR(PTE_ADDR(*pte)), std + i, n);
         } else {
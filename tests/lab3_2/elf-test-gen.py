@@ -33,8 +33,18 @@ if __name__ == '__main__':
         n = len(data)
         std = f'{case}_{va:x}'
         print(f'''    // Segment at 0x{va:x}, memsz={h.p_memsz}, filesz={h.p_filesz}
-    seg_check(e->env_pgdir, 0x{va:x}, {std}, sizeof {std});''')
+    seg_check(e, 0x{va:x}, {std}, sizeof {std});''')
         if h.p_memsz != n:
-            print(f'    seg_check(e->env_pgdir, 0x{va + n:x}, NULL, {h.p_memsz - n});')
+            print(f'    seg_check(e, 0x{va + n:x}, NULL, {h.p_memsz - n});')
+    # 同一镜像的另一个实例共享镜像页缓存中的页
+    va = segs[0][0]
+    print(f'''    struct Env *e2 = ENV_CREATE(test_{case});
+    assert(PTE_ADDR(*seg_page(e2, 0x{va:x})) == PTE_ADDR(*seg_page(e, 0x{va:x})));''')
+    # 运行该镜像的最后一个进程退出时，缓存的页被释放
+    print(f'''    struct Page *text = pa2page(PTE_ADDR(*seg_page(e, 0x{va:x})));
+    env_free(e2);
+    assert((text->pp_flags & PAGE_FLAG_PINNED) != 0);
+    env_free(e);
+    assert((text->pp_flags & PAGE_FLAG_PINNED) == 0);''')
     print(f'''    printk("load_icode test for {case} passed!\\n");
 }}''')
@@ -0,0 +1,80 @@
+#include <lib.h>
+
+#define PERIOD 8
+#define BUDGET 2
+#define DEADLINE 4
+#define JOBS 5
+
+// 自启动以来的时钟中断数
+static uint64_t now(void) {
+    struct SchedStat stat;
+
+    user_assert(syscall_get_sched_stat(&stat) == 0);
+
+    return stat.ticks;
+}
+
+int main() {
+    debugf("edftest begin\n");
+
+    // 计算密集型的进程始终可运行
+    int spin = fork();
+
+    if (spin == 0) {
+        for (;;) {
+        }
+    }
+
+    user_assert(syscall_set_edf(0, PERIOD, 0, DEADLINE) == -E_INVAL);
+    user_assert(syscall_set_edf(0, PERIOD, DEADLINE + 1, DEADLINE) ==
+                -E_INVAL);
+    user_assert(syscall_set_edf(0, PERIOD, BUDGET, PERIOD + 1) == -E_INVAL);
+
+    // 密度 2 / 4 = 500‰
+    user_assert(syscall_set_edf(0, PERIOD, BUDGET, DEADLINE) == 0);
+
+    // 500‰ + 500‰ 超出上限
+    user_assert(syscall_set_edf(spin, PERIOD, BUDGET, DEADLINE) ==
+                -E_OVERLOAD);
+    user_assert(envs[ENVX(spin)].env_edf_period == 0);
+
+    // 每个周期完成一个作业：尽管存在计算密集型进程，每个作业都能在截止时间前开始
+    uint64_t begin = now();
+
+    for (int i = 0; i < JOBS; i++) {
+        syscall_yield();
+    }
+
+    uint64_t elapsed = now() - begin;
+
+    debugf("%d jobs in %lu ticks\n", JOBS, elapsed);
+
+    user_assert(elapsed >= (uint64_t)(JOBS - 1) * PERIOD);
+    user_assert(elapsed <= (uint64_t)(JOBS + 1) * PERIOD);
+    user_assert(env->env_edf_misses == 0);
+
+    // 作业不再让出：用完预算后被限制运行，并错过截止时间
+    begin = now();
+
+    while (now() - begin < 3 * PERIOD) {
+    }
+
+    user_assert(env->env_edf_throttles >= 2);
+    user_assert(env->env_edf_misses >= 2);
+
+    debugf("throttles = %lu misses = %lu\n", env->env_edf_throttles,
+           env->env_edf_misses);
+
+    user_assert(syscall_set_edf(0, 0, 0, 0) == 0);
+    user_assert(syscall_set_edf(spin, PERIOD, BUDGET, DEADLINE) == 0);
+    user_assert(syscall_env_destroy(spin) == 0);
+
+    struct SchedStat stat;
+
+    user_assert(syscall_get_sched_stat(&stat) == 0);
+    user_assert(stat.edf_util == 0);
+    user_assert(stat.edf_len == 0);
+
+    debugf("edftest passed\n");
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <lib.h>
+#include <process.h>
+
+#define MS 1000000ULL
+#define PINGS 20
+
+static struct Process process_list[NENV];
+
+static uint64_t now(void) {
+    uint64_t ns = 0;
+
+    user_assert(syscall_get_time(&ns) == 0);
+
+    return ns;
+}
+
+static struct Process *find(uint32_t envid) {
+    size_t count = get_process_list(NENV, process_list);
+
+    for (size_t i = 0; i < count; i++) {
+        if (process_list[i].env_id == envid) {
+            return &process_list[i];
+        }
+    }
+
+    user_panic("env %08x not found", envid);
+}
+
+// 忙等`ms`毫秒，期间很少陷入内核
+static void spin(uint64_t ms) {
+    uint64_t end = now() + ms * MS;
+
+    do {
+        for (volatile int i = 0; i < 10000; i++) {
+        }
+    } while (now() < end);
+}
+
+int main() {
+    debugf("fairtest begin\n");
+
+    // 用户态及内核态CPU时间
+    uint32_t self = syscall_getenvid();
+    struct Process before = *find(self);
+
+    spin(20);
+
+    struct Process *after = find(self);
+
+    debugf("user %lu ns, kernel %lu ns\n",
+           after->env_user_time - before.env_user_time,
+           after->env_kernel_time - before.env_kernel_time);
+
+    user_assert(after->env_user_time - before.env_user_time >= 10 * MS);
+    user_assert(after->env_kernel_time > before.env_kernel_time);
+
+    // 计算密集型进程
+    int spinner = fork();
+
+    user_assert(spinner >= 0);
+
+    if (spinner == 0) {
+        for (;;) {
+        }
+    }
+
+    // 频繁阻塞的IPC服务进程
+    int server = fork();
+
+    user_assert(server >= 0);
+
+    if (server == 0) {
+        for (;;) {
+            uint64_t value = 0;
+
+            user_assert(ipc_recv(self, NULL, &value, NULL, NULL) == 0);
+            ipc_send(self, value + 1, 0, 0);
+        }
+    }
+
+    spin(30);
+
+    // 服务进程被唤醒时排在计算密集型进程之前，不必等待其用完时间片
+    uint64_t begin = now();
+
+    for (uint64_t i = 0; i < PINGS; i++) {
+        uint64_t value = 0;
+
+        ipc_send(server, i, 0, 0);
+        user_assert(ipc_recv(server, NULL, &value, NULL, NULL) == 0);
+        user_assert(value == i + 1);
+    }
+
+    uint64_t elapsed = now() - begin;
+
+    struct Process spinner_proc = *find(spinner);
+    struct Process server_proc = *find(server);
+
+    debugf("%d pings in %lu ns, spinner user %lu ns, server user %lu ns\n",
+           PINGS, elapsed, spinner_proc.env_user_time,
+           server_proc.env_user_time);
+
+    user_assert(elapsed < PINGS * 10 * MS);
+    user_assert(spinner_proc.env_user_time > server_proc.env_user_time);
+    user_assert(server_proc.env_runs >= PINGS);
+
+    user_assert(syscall_env_destroy(spinner) == 0);
+    user_assert(syscall_env_destroy(server) == 0);
+
+    debugf("fairtest passed\n");
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include <lib.h>
+
+#define PERIOD 8
+#define BUDGET 1
+#define JOBS 3
+
+int main() {
+    debugf("idletest begin\n");
+
+    struct SchedStat before, after;
+
+    user_assert(syscall_get_sched_stat(&before) == 0);
+
+    // 唯一的进程用完预算后没有可运行的进程：空闲直到下一周期开始
+    user_assert(syscall_set_edf(0, PERIOD, BUDGET, PERIOD) == 0);
+
+    for (int i = 0; i < JOBS; i++) {
+        syscall_yield();
+    }
+
+    user_assert(syscall_get_sched_stat(&after) == 0);
+
+    debugf("idle %lu times, %lu ticks, %lu cycles\n", after.idle - before.idle,
+           after.ticks - before.ticks, after.idle_time - before.idle_time);
+
+    user_assert(after.idle - before.idle >= JOBS);
+    user_assert(after.ticks - before.ticks >= (JOBS - 1) * PERIOD);
+    user_assert(after.idle_time > before.idle_time);
+    user_assert(env->env_edf_misses == 0);
+
+    user_assert(syscall_set_edf(0, 0, 0, 0) == 0);
+
+    debugf("idletest passed\n");
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <lib.h>
+
+#define IPC_ROUNDS 8
+
+// 计算密集型：不断用完时间片，被降低调度级别
+static void spinner(void) {
+    while (env->env_sched_level <= SCHED_LEVEL_DEFAULT) {
+    }
+
+    debugf("spinner demoted to level %u\n", env->env_sched_level);
+    ipc_send(env->env_parent_id, env->env_sched_level, NULL, 0);
+}
+
+// 交互型：每次等待IPC时阻塞，被提升调度级别
+static void receiver(void) {
+    for (int i = 0; i < IPC_ROUNDS; i++) {
+        uint64_t value = 0;
+
+        ipc_recv(0, NULL, &value, NULL, NULL);
+        user_assert(value == (uint64_t)i);
+    }
+
+    user_assert(env->env_sched_level == 0);
+
+    debugf("receiver boosted to level %u\n", env->env_sched_level);
+    ipc_send(env->env_parent_id, env->env_sched_level, NULL, 0);
+}
+
+int main() {
+    debugf("mlfqtest begin\n");
+
+    user_assert(env->env_sched_level == SCHED_LEVEL_DEFAULT);
+
+    int spin = fork();
+
+    if (spin == 0) {
+        spinner();
+        return 0;
+    }
+
+    int recv = fork();
+
+    if (recv == 0) {
+        receiver();
+        return 0;
+    }
+
+    user_assert(envs[ENVX(recv)].env_sched_level == SCHED_LEVEL_DEFAULT);
+
+    for (int i = 0; i < IPC_ROUNDS; i++) {
+        ipc_send(recv, (uint64_t)i, NULL, 0);
+    }
+
+    uint64_t level = 0;
+
+    ipc_recv(recv, NULL, &level, NULL, NULL);
+    user_assert(level == 0);
+
+    ipc_recv(spin, NULL, &level, NULL, NULL);
+    user_assert(level > SCHED_LEVEL_DEFAULT);
+
+    struct SchedStat stat;
+
+    user_assert(syscall_get_sched_stat(&stat) == 0);
+    user_assert(stat.boost >= IPC_ROUNDS);
+    user_assert(stat.demote >= 1);
+    user_assert(stat.queue_len[env->env_sched_level] >= 1);
+
+    for (int i = 0; i < SCHED_LEVELS; i++) {
+        debugf("level %d: %u envs\n", i, stat.queue_len[i]);
+    }
+
+    user_assert(syscall_get_sched_stat((struct SchedStat *)ULIM) ==
+                -E_INVAL);
+
+    debugf("mlfqtest passed\n");
+    return 0;
+}
@@ -3,7 +3,7 @@ void riscv64_init(u_reg_t hart_id, void *dtb_address) {
 
     exception_init();
 
-    riscv64_detect_memory();
+    riscv64_detect_memory(dtb_address);
     riscv64_vm_init();
     page_init();
 
@@ -0,0 +1,66 @@
+#include <lib.h>
+
+#define TEST_VA 0x20000000UL
+#define TEST_PAGES (2 * COW_FAULT_AROUND_PAGES)
+
+static volatile uint64_t *page_word(u_reg_t i) {
+    return (volatile uint64_t *)(TEST_VA + i * PAGE_SIZE);
+}
+
+int main() {
+    debugf("cowtest begin\n");
+
+    for (u_reg_t i = 0; i < TEST_PAGES; i++) {
+        user_assert(syscall_mem_alloc(0, (void *)page_word(i), PTE_RW) == 0);
+        *page_word(i) = i;
+    }
+
+    int child = fork();
+
+    if (child == 0) {
+        uint64_t copy = env->env_cow_copy;
+
+        // 默认只复制写入的一页，仍被共享的相邻页不被复制
+        *page_word(0) = 100;
+        user_assert(env->env_cow_copy - copy == 1);
+        user_assert(pageref((void *)page_word(1)) > 1);
+
+        // 设置FORK_COW_COPY_AROUND后，同一组中其余的相邻页被一并复制
+        user_assert(syscall_set_fork_flags(0, FORK_COW_COPY_AROUND) == 0);
+        *page_word(1) = 101;
+        user_assert(env->env_cow_copy - copy == COW_FAULT_AROUND_PAGES);
+
+        for (u_reg_t i = 2; i < COW_FAULT_AROUND_PAGES; i++) {
+            user_assert(*page_word(i) == i);
+            *page_word(i) = 100 + i;
+        }
+
+        user_assert(env->env_cow_copy - copy == COW_FAULT_AROUND_PAGES);
+        debugf("cowtest child done\n");
+        return 0;
+    }
+
+    user_assert(child > 0);
+    wait(child);
+
+    // 子进程复制了前一组页后退出：父进程是这些页唯一的引用者，无需复制
+    uint64_t copy = env->env_cow_copy;
+    uint64_t reuse = env->env_cow_reuse;
+
+    for (u_reg_t i = 0; i < COW_FAULT_AROUND_PAGES; i++) {
+        user_assert(*page_word(i) == i);
+        *page_word(i) = 200 + i;
+    }
+
+    user_assert(env->env_cow_copy == copy);
+    user_assert(env->env_cow_reuse - reuse == COW_FAULT_AROUND_PAGES);
+
+    // 子进程未写入的后一组页同样只被父进程引用
+    *page_word(COW_FAULT_AROUND_PAGES) = 300;
+    user_assert(env->env_cow_copy == copy);
+    user_assert(pageref((void *)page_word(COW_FAULT_AROUND_PAGES)) == 1);
+
+    debugf("cowtest passed: copy %lu reuse %lu\n", env->env_cow_copy,
+           env->env_cow_reuse);
+    return 0;
+}
@@ -0,0 +1 @@
+init-envs := cowtest
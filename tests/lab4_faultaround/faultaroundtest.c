@@ -0,0 +1,79 @@
+#include <lib.h>
+
+#define SEQ_VA 0x30000000UL
+#define RANDOM_VA 0x30400000UL
+
+#define TAIL_WORDS (2 * PAGE_SIZE / sizeof(uint64_t))
+
+// 镜像的结束地址，见user/user.lds
+extern char end[];
+
+// 位于镜像末尾的.data，在fault-around填充到镜像边界之前不被访问
+static volatile uint64_t tail_data[TAIL_WORDS] = {[0 ... TAIL_WORDS - 1] =
+                                                      0x7a11};
+
+static int is_mapped(u_reg_t va) {
+    return syscall_get_physical_address((void *)va) != 0;
+}
+
+// 从镜像末尾之后向下顺序访问：填充的窗口到达镜像时停止，镜像中的页不被替换为新页
+static void image_boundary_test(void) {
+    u_reg_t top = ROUND((u_reg_t)end, PAGE_SIZE);
+    u_reg_t last_page = top - PAGE_SIZE;
+    int was_mapped = is_mapped(last_page);
+
+    user_assert(syscall_set_fault_around(0, 16) == 0);
+
+    // 窗口依次为1、2、4页，最后一次从`top`开始向下填充
+    *(volatile uint64_t *)(top + 3 * PAGE_SIZE) = 1;
+    *(volatile uint64_t *)(top + 2 * PAGE_SIZE) = 1;
+    *(volatile uint64_t *)top = 1;
+
+    user_assert(is_mapped(top + PAGE_SIZE));
+    user_assert(is_mapped(last_page) == was_mapped);
+
+    // 镜像中的页仍由镜像映射
+    user_assert(tail_data[0] == 0x7a11);
+    user_assert(tail_data[TAIL_WORDS - 1] == 0x7a11);
+}
+
+int main() {
+    volatile uint64_t *p = (volatile uint64_t *)SEQ_VA;
+
+    debugf("faultaroundtest begin\n");
+
+    user_assert(syscall_set_fault_around(0, FAULT_AROUND_MAX_PAGES + 1) ==
+                -E_INVAL);
+    user_assert(syscall_set_fault_around(0, 16) == 0);
+    user_assert(env->env_fault_around_max == 16);
+
+    // 顺序访问：每次缺页紧接上次填充的范围，窗口依次为1、2、4、8、16页
+    p[0] = 1;
+    p[1 * PAGE_SIZE / sizeof(uint64_t)] = 1;
+    p[3 * PAGE_SIZE / sizeof(uint64_t)] = 1;
+    p[7 * PAGE_SIZE / sizeof(uint64_t)] = 1;
+    p[15 * PAGE_SIZE / sizeof(uint64_t)] = 1;
+
+    for (u_reg_t i = 0; i < 31; i++) {
+        user_assert(is_mapped(SEQ_VA + i * PAGE_SIZE));
+    }
+    user_assert(!is_mapped(SEQ_VA + 31 * PAGE_SIZE));
+
+    // 填充的页已清零
+    user_assert(p[30 * PAGE_SIZE / sizeof(uint64_t)] == 0);
+
+    // 非顺序访问：窗口重置为1页
+    *(volatile uint64_t *)RANDOM_VA = 1;
+    user_assert(is_mapped(RANDOM_VA));
+    user_assert(!is_mapped(RANDOM_VA + PAGE_SIZE));
+
+    image_boundary_test();
+
+    // 关闭fault-around后，每次缺页只分配一页
+    user_assert(syscall_set_fault_around(0, 0) == 0);
+    *(volatile uint64_t *)(RANDOM_VA + PAGE_SIZE) = 1;
+    user_assert(!is_mapped(RANDOM_VA + 2 * PAGE_SIZE));
+
+    debugf("faultaroundtest passed\n");
+    return 0;
+}
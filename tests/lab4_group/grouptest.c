@@ -0,0 +1,153 @@
+#include <lib.h>
+
+#define MS 1000000ULL
+// QEMU virt平台的`time` CSR为 10 MHz
+#define CYCLES_PER_MS 10000ULL
+
+#define PAGE_LIMIT 64
+#define ALLOC_BASE 0x10000000UL
+
+static uint64_t now(void) {
+    uint64_t ns = 0;
+
+    user_assert(syscall_get_time(&ns) == 0);
+
+    return ns;
+}
+
+static void page_limit_test(void) {
+    uint32_t self = syscall_getenvid();
+    int gid = syscall_group_create(0, 0, PAGE_LIMIT);
+
+    user_assert(gid > 0);
+
+    int child = fork();
+
+    user_assert(child >= 0);
+
+    if (child == 0) {
+        ipc_send(self, 0, 0, 0);
+
+        for (;;) {
+            ipc_recv(self, NULL, NULL, NULL, NULL);
+        }
+    }
+
+    // 子进程已运行，其栈的写时复制已完成
+    user_assert(ipc_recv(child, NULL, NULL, NULL, NULL) == 0);
+    user_assert(syscall_group_attach(child, gid) == 0);
+
+    int allocated = 0;
+    int r;
+
+    while ((r = syscall_mem_alloc(child, (void *)(ALLOC_BASE +
+                                                  allocated * PAGE_SIZE),
+                                  PTE_RW | PTE_USER)) == 0) {
+        allocated++;
+        user_assert(allocated <= PAGE_LIMIT);
+    }
+
+    user_assert(r == -E_QUOTA);
+
+    struct GroupStat stat;
+
+    user_assert(syscall_group_get_stat(gid, &stat) == 0);
+    debugf("group %d: %u envs, %u pages, %d allocated, %lu denied\n", gid,
+           stat.nr_envs, stat.page_used, allocated, stat.page_denied);
+
+    user_assert(stat.nr_envs == 1);
+    user_assert(stat.page_used == PAGE_LIMIT);
+    user_assert(stat.page_denied == 1);
+
+    // 释放的页不再计入资源组
+    user_assert(syscall_mem_unmap(child, (void *)ALLOC_BASE) == 0);
+    user_assert(syscall_group_get_stat(gid, &stat) == 0);
+    user_assert(stat.page_used == PAGE_LIMIT - 1);
+
+    // 反复分配、释放同一地址不会耗尽配额
+    for (int i = 0; i < 4 * PAGE_LIMIT; i++) {
+        user_assert(syscall_mem_alloc(child, (void *)ALLOC_BASE,
+                                      PTE_RW | PTE_USER) == 0);
+        user_assert(syscall_mem_unmap(child, (void *)ALLOC_BASE) == 0);
+    }
+
+    user_assert(syscall_group_get_stat(gid, &stat) == 0);
+    user_assert(stat.page_used == PAGE_LIMIT - 1);
+
+    // 在已映射的地址上重新分配，替换原有的页，不重复计入
+    void *mapped = (void *)(ALLOC_BASE + PAGE_SIZE);
+
+    user_assert(syscall_mem_alloc(child, mapped, PTE_RW | PTE_USER) == 0);
+    user_assert(syscall_group_get_stat(gid, &stat) == 0);
+    user_assert(stat.page_used == PAGE_LIMIT - 1);
+
+    // 仍被其它进程映射的页，解除映射时同样归还
+    user_assert(syscall_mem_map(child, mapped, 0, (void *)ALLOC_BASE,
+                                PTE_RW | PTE_USER) == 0);
+    user_assert(syscall_mem_unmap(child, mapped) == 0);
+    user_assert(syscall_group_get_stat(gid, &stat) == 0);
+    user_assert(stat.page_used == PAGE_LIMIT - 2);
+    user_assert(syscall_mem_unmap(0, (void *)ALLOC_BASE) == 0);
+
+    // 最后一个进程退出后，资源组被释放
+    user_assert(syscall_env_destroy(child) == 0);
+    user_assert(syscall_group_get_stat(gid, &stat) == -E_INVAL);
+}
+
+static void cpu_quota_test(void) {
+    uint32_t self = syscall_getenvid();
+    // 每4个时钟中断最多运行1个时钟中断间隔
+    int gid = syscall_group_create(1, 4, 0);
+
+    user_assert(gid > 0);
+
+    int child = fork();
+
+    user_assert(child >= 0);
+
+    if (child == 0) {
+        uint64_t deadline = 0;
+
+        user_assert(ipc_recv(self, NULL, &deadline, NULL, NULL) == 0);
+
+        // 子进程继承资源组
+        user_assert(fork() >= 0);
+
+        while (now() < deadline) {
+        }
+
+        exit();
+    }
+
+    user_assert(syscall_group_attach(child, gid) == 0);
+
+    uint64_t begin = now();
+
+    ipc_send(child, begin + 300 * MS, 0, 0);
+
+    user_assert(syscall_sleep_until(begin + 200 * MS) == 0);
+
+    struct GroupStat stat;
+
+    user_assert(syscall_group_get_stat(gid, &stat) == 0);
+    debugf("group %d: %u envs, cpu %lu cycles, throttled %lu times\n", gid,
+           stat.nr_envs, stat.cpu_time, stat.throttled);
+
+    user_assert(stat.nr_envs == 2);
+    user_assert(stat.throttled > 0);
+    user_assert(stat.cpu_time > 0);
+    // 两个计算密集型进程共享约25%的CPU时间（用量在时钟中断时检查，可能超出一个间隔）
+    user_assert(stat.cpu_time < 200 * CYCLES_PER_MS * 3 / 4);
+
+    user_assert(syscall_sleep_until(begin + 400 * MS) == 0);
+}
+
+int main() {
+    debugf("grouptest begin\n");
+
+    page_limit_test();
+    cpu_quota_test();
+
+    debugf("grouptest passed\n");
+    return 0;
+}
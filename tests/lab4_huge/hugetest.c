@@ -0,0 +1,88 @@
+#include <lib.h>
+
+#define HUGE_VA 0x20000000UL
+#define SHARE_VA 0x10000000UL
+
+static void check_pattern(volatile uint64_t *p, uint64_t base) {
+    for (u_reg_t i = 0; i < P2MAP / PAGE_SIZE; i++) {
+        user_assert(p[i * PAGE_SIZE / sizeof(uint64_t)] == base + i);
+    }
+}
+
+static void fill_pattern(volatile uint64_t *p, uint64_t base) {
+    for (u_reg_t i = 0; i < P2MAP / PAGE_SIZE; i++) {
+        p[i * PAGE_SIZE / sizeof(uint64_t)] = base + i;
+    }
+}
+
+int main() {
+    volatile uint64_t *p = (volatile uint64_t *)HUGE_VA;
+    int r;
+
+    debugf("hugetest begin\n");
+
+    // 巨页地址须对齐
+    user_assert(syscall_mem_alloc(0, (void *)(HUGE_VA + PAGE_SIZE),
+                                  PTE_RW | MEM_HUGE_2M) == -E_INVAL);
+    user_assert(syscall_mem_alloc(0, (void *)HUGE_VA,
+                                  PTE_RW | MEM_HUGE_2M | MEM_HUGE_1G) ==
+                -E_INVAL);
+
+    user_assert(syscall_mem_alloc(0, (void *)HUGE_VA, PTE_RW | MEM_HUGE_2M) ==
+                0);
+    user_assert(p[0] == 0);
+    fill_pattern(p, 100);
+    user_assert(pageref((void *)(HUGE_VA + 3 * PAGE_SIZE)) == 1);
+
+    // fork后巨页被共享，子进程写入时复制整个巨页
+    int child = fork();
+
+    if (child == 0) {
+        check_pattern(p, 100);
+        fill_pattern(p, 200);
+        check_pattern(p, 200);
+        debugf("hugetest child done\n");
+        return 0;
+    }
+
+    user_assert(child > 0);
+
+    // 只读地映射被共享的巨页中的一页：拆分映射，仍指向原巨页中的物理页，不复制
+    u_reg_t sub_pa =
+        syscall_get_physical_address((void *)(HUGE_VA + 3 * PAGE_SIZE));
+
+    user_assert(syscall_mem_map(0, (void *)(HUGE_VA + 3 * PAGE_SIZE), 0,
+                                (void *)SHARE_VA, PTE_RO) == 0);
+    user_assert(syscall_get_physical_address((void *)SHARE_VA) == sub_pa);
+    user_assert(syscall_get_physical_address(
+                    (void *)(HUGE_VA + 3 * PAGE_SIZE)) == sub_pa);
+    user_assert(*(volatile uint64_t *)SHARE_VA == 103);
+    user_assert(pageref((void *)SHARE_VA) > 1);
+    user_assert(syscall_mem_unmap(0, (void *)SHARE_VA) == 0);
+
+    wait(child);
+
+    check_pattern(p, 100);
+
+    // 解除巨页中一页的映射：巨页被拆分，其余页不变
+    user_assert(syscall_mem_unmap(0, (void *)(HUGE_VA + PAGE_SIZE)) == 0);
+    user_assert(p[0] == 100);
+    user_assert(p[2 * PAGE_SIZE / sizeof(uint64_t)] == 102);
+    user_assert(p[PAGE_SIZE / sizeof(uint64_t)] == 0);
+
+    // 1 GiB巨页需要1 GiB连续的空闲物理内存，可能分配失败
+    r = syscall_mem_alloc(0, (void *)P1MAP, PTE_RW | MEM_HUGE_1G);
+    user_assert(r == 0 || r == -E_NO_MEM);
+
+    if (r == 0) {
+        volatile uint64_t *g = (volatile uint64_t *)P1MAP;
+
+        g[0] = 1;
+        g[(P1MAP - PAGE_SIZE) / sizeof(uint64_t)] = 2;
+        user_assert(g[0] == 1);
+        user_assert(syscall_mem_unmap(0, (void *)P1MAP) == 0);
+    }
+
+    debugf("hugetest passed (1 GiB: %d)\n", r);
+    return 0;
+}
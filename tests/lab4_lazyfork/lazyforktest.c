@@ -0,0 +1,77 @@
+#include <lib.h>
+
+#define TEST_VA 0x20000000UL
+#define TEST_PAGES 16
+
+static void check_pattern(volatile uint64_t *p, uint64_t base) {
+    for (u_reg_t i = 0; i < TEST_PAGES; i++) {
+        user_assert(p[i * PAGE_SIZE / sizeof(uint64_t)] == base + i);
+    }
+}
+
+static void fill_pattern(volatile uint64_t *p, uint64_t base) {
+    for (u_reg_t i = 0; i < TEST_PAGES; i++) {
+        p[i * PAGE_SIZE / sizeof(uint64_t)] = base + i;
+    }
+}
+
+// 映射`va`的三级页表的物理地址，须已调用`syscall_map_user_vpt`
+static u_reg_t leaf_table_pa(u_reg_t va) {
+    return PTE_ADDR(vp2[(P1X(va) << 9) | P2X(va)]);
+}
+
+int main() {
+    volatile uint64_t *p = (volatile uint64_t *)TEST_VA;
+
+    debugf("lazyforktest begin\n");
+
+    user_assert(syscall_set_fork_flags(0, ~FORK_FLAGS_ALL) == -E_INVAL);
+    user_assert(syscall_set_fork_flags(0, FORK_SHARE_TABLES) == 0);
+    user_assert(env->env_fork_flags == FORK_SHARE_TABLES);
+
+    for (u_reg_t i = 0; i < TEST_PAGES; i++) {
+        user_assert(syscall_mem_alloc(0, (void *)(TEST_VA + i * PAGE_SIZE),
+                                      PTE_RW) == 0);
+    }
+
+    fill_pattern(p, 100);
+
+    syscall_map_user_vpt();
+    u_reg_t parent_table = leaf_table_pa(TEST_VA);
+
+    // fork后父子进程共享三级页表，写入时才复制页表及物理页
+    int child = fork();
+
+    if (child == 0) {
+        user_assert(env->env_fork_flags == FORK_SHARE_TABLES);
+
+        // 子进程的页表项指向父进程的同一个三级页表（复制的页表位于其它物理页）
+        syscall_map_user_vpt();
+        user_assert(leaf_table_pa(TEST_VA) == parent_table);
+
+        check_pattern(p, 100);
+        // 共享的页表中的页同时被父子进程映射
+        user_assert(pageref((void *)TEST_VA) == 2);
+        fill_pattern(p, 200);
+        check_pattern(p, 200);
+        user_assert(pageref((void *)TEST_VA) == 1);
+        // 写入时为子进程复制了页表
+        user_assert(leaf_table_pa(TEST_VA) != parent_table);
+        debugf("lazyforktest child done\n");
+        return 0;
+    }
+
+    user_assert(child > 0);
+
+    wait(child);
+
+    check_pattern(p, 100);
+    // 子进程已复制页表，父进程的页表不变
+    user_assert(leaf_table_pa(TEST_VA) == parent_table);
+    fill_pattern(p, 300);
+    check_pattern(p, 300);
+    user_assert(pageref((void *)TEST_VA) == 1);
+
+    debugf("lazyforktest passed\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <lib.h>
+
+#define MS 1000000ULL
+
+static uint64_t now(void) {
+    uint64_t ns = 0;
+
+    user_assert(syscall_get_time(&ns) == 0);
+
+    return ns;
+}
+
+int main() {
+    debugf("timertest begin\n");
+
+    // 睡眠到指定时刻
+    uint64_t begin = now();
+
+    user_assert(syscall_sleep_until(begin + 20 * MS) == 0);
+    user_assert(now() >= begin + 20 * MS);
+
+    // 指定时刻已过：立即返回
+    user_assert(syscall_sleep_until(begin) == 0);
+
+    // 超时为0：立即返回
+    user_assert(ipc_recv_timeout(0, NULL, NULL, NULL, NULL, 0) == -E_TIMEOUT);
+
+    // 没有发送方：超时后返回
+    begin = now();
+    user_assert(ipc_recv_timeout(0, NULL, NULL, NULL, NULL, 10 * MS) ==
+                -E_TIMEOUT);
+    user_assert(now() >= begin + 10 * MS);
+    user_assert(env->env_ipc_recving == 0);
+
+    uint32_t parent = syscall_getenvid();
+    int child = fork();
+
+    user_assert(child >= 0);
+
+    if (child == 0) {
+        user_assert(syscall_sleep_until(now() + 5 * MS) == 0);
+        ipc_send(parent, 0x2333, 0, 0);
+
+        return 0;
+    }
+
+    // 超时前收到消息
+    uint32_t whom = 0;
+    uint64_t value = 0;
+
+    user_assert(ipc_recv_timeout(child, &whom, &value, NULL, NULL, 1000 * MS) ==
+                0);
+    user_assert(whom == (uint32_t)child);
+    user_assert(value == 0x2333);
+
+    child = fork();
+
+    user_assert(child >= 0);
+
+    if (child == 0) {
+        user_assert(syscall_sleep_until(now() + 5 * MS) == 0);
+        ipc_send(parent, 0x4666, 0, 0);
+
+        return 0;
+    }
+
+    // 超时时刻溢出：一直等待，而非立即超时
+    user_assert(ipc_recv_timeout(child, &whom, &value, NULL, NULL,
+                                 UINT64_MAX) == 0);
+    user_assert(whom == (uint32_t)child);
+    user_assert(value == 0x4666);
+
+    debugf("timertest passed\n");
+    return 0;
+}
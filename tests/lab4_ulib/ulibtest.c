@@ -0,0 +1,41 @@
+#include <lib.h>
+
+int main() {
+    debugf("ulibtest begin\n");
+
+    // 库函数及首部位于共享用户库中
+    user_assert((u_reg_t)&ulib_header == ULIB);
+    user_assert((u_reg_t)debugf >= ULIB && (u_reg_t)debugf < ULIB + ULIB_SIZE);
+    user_assert(ulib_header.magic == ULIB_MAGIC);
+    user_assert(ulib_header.version == ULIB_VERSION);
+
+    // 库的代码只读，且在fork时保持共享
+    Pte pte = vp3[VPN(ULIB)];
+
+    user_assert((pte & PTE_V) != 0);
+    user_assert((pte & PTE_W) == 0);
+    user_assert((pte & PTE_LIBRARY) != 0);
+
+    u_reg_t text_pa = syscall_get_physical_address((void *)ULIB);
+    // 镜像页缓存持有一个引用
+    user_assert(pageref((void *)ULIB) >= 2);
+
+    int child = fork();
+
+    if (child == 0) {
+        user_assert(syscall_get_physical_address((void *)ULIB) == text_pa);
+
+        // 库的全局变量为每个进程私有
+        user_assert(env->env_id == (uint32_t)syscall_getenvid());
+        debugf("ulibtest child done\n");
+        return 0;
+    }
+
+    user_assert(child > 0);
+    wait(child);
+
+    user_assert(env->env_id == (uint32_t)syscall_getenvid());
+
+    debugf("ulibtest passed\n");
+    return 0;
+}
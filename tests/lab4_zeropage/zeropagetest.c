@@ -0,0 +1,51 @@
+#include <lib.h>
+
+#define TEST_VA 0x20000000UL
+#define TEST_PAGES 4
+
+static volatile uint64_t *page_word(u_reg_t i) {
+    return (volatile uint64_t *)(TEST_VA + i * PAGE_SIZE);
+}
+
+int main() {
+    debugf("zeropagetest begin\n");
+
+    // 读取未映射的页：映射全局零页，不分配新的物理页
+    for (u_reg_t i = 0; i < TEST_PAGES; i++) {
+        user_assert(*page_word(i) == 0);
+    }
+
+    u_reg_t zero_pa = syscall_get_physical_address((void *)page_word(0));
+
+    for (u_reg_t i = 1; i < TEST_PAGES; i++) {
+        user_assert(syscall_get_physical_address((void *)page_word(i)) ==
+                    zero_pa);
+    }
+
+    // 首次写入时由CoW分配私有页，其余页仍映射零页
+    uint64_t copy = env->env_cow_copy;
+
+    *page_word(0) = 42;
+
+    user_assert(env->env_cow_copy - copy == 1);
+    user_assert(syscall_get_physical_address((void *)page_word(0)) != zero_pa);
+    user_assert(*page_word(0) == 42);
+
+    for (u_reg_t i = 1; i < TEST_PAGES; i++) {
+        user_assert(*page_word(i) == 0);
+        user_assert(syscall_get_physical_address((void *)page_word(i)) ==
+                    zero_pa);
+    }
+
+    // 可写共享前，零页被替换为私有页
+    user_assert(syscall_mem_map(0, (void *)page_word(1), 0,
+                                (void *)page_word(TEST_PAGES), PTE_RW) == 0);
+    user_assert(syscall_get_physical_address((void *)page_word(1)) != zero_pa);
+
+    *page_word(TEST_PAGES) = 7;
+    user_assert(*page_word(1) == 7);
+    user_assert(*page_word(2) == 0);
+
+    debugf("zeropagetest passed\n");
+    return 0;
+}
@@ -0,0 +1,2 @@
+init-envs += spawntest /fs_serv
+fs-files  := $(test_dir)/spawnchild.b
@@ -0,0 +1,18 @@
+#include <lib.h>
+
+// 父进程中的该变量不为0；子进程由ELF镜像创建，不继承父进程的地址空间
+int marker = 0;
+
+int main(int argc, char **argv) {
+    debugf("spawnchild: argc = %d\n", argc);
+
+    user_assert(argc == 3);
+    user_assert(strcmp(argv[0], "spawnchild") == 0);
+    user_assert(strcmp(argv[1], "hello") == 0);
+    user_assert(strcmp(argv[2], "42") == 0);
+    user_assert(argv[3] == NULL);
+    user_assert(marker == 0);
+
+    ipc_send(env->env_parent_id, (uint64_t)argc, NULL, 0);
+    return 0;
+}
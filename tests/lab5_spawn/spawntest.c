@@ -0,0 +1,58 @@
+#include <lib.h>
+
+// 位于用户空间中，但未映射、也不在镜像中的地址
+#define UNMAPPED_VA 0x50000000UL
+
+int marker = 0x5a5a;
+
+static char bad_name[MAXENVNAME] = "bad";
+
+// 镜像或名称未映射时返回-E_INVAL，而非使内核panic
+static void unmapped_test(void) {
+    void *stack = (void *)UTEMP;
+
+    user_assert(syscall_mem_alloc(0, stack, PTE_RW | PTE_USER) == 0);
+
+    user_assert(syscall_spawn((void *)UNMAPPED_VA, PAGE_SIZE, stack,
+                              USTACKTOP - 16, bad_name) == -E_INVAL);
+    user_assert(syscall_spawn(bad_name, sizeof(bad_name), stack,
+                              USTACKTOP - 16,
+                              (const char *)UNMAPPED_VA) == -E_INVAL);
+
+    // 失败时栈页仍映射在当前进程中
+    user_assert(syscall_mem_unmap(0, stack) == 0);
+}
+
+// 只读的共享页（如共享库的代码页）不可作为栈页以可写方式移至子进程
+static void readonly_stack_test(void) {
+    user_assert(syscall_spawn(bad_name, sizeof(bad_name), (void *)ULIB,
+                              USTACKTOP - 16, bad_name) == -E_INVAL);
+    user_assert((vp3[VPN(ULIB)] & (PTE_W | PTE_COW)) == 0);
+}
+
+int main() {
+    debugf("spawntest begin\n");
+
+    user_assert(spawnl("/not_exist.b", "not_exist", NULL) < 0);
+    user_assert(spawnl("/motd", "motd", NULL) == -E_INVAL);
+    unmapped_test();
+    readonly_stack_test();
+
+    int child = spawnl("/spawnchild.b", "spawnchild", "hello", "42", NULL);
+
+    user_assert(child > 0);
+    user_assert(strcmp((const char *)envs[ENVX(child)].env_name,
+                       "spawnchild.b") == 0);
+    user_assert(envs[ENVX(child)].env_parent_id == env->env_id);
+
+    uint32_t whom = 0;
+    uint64_t value = 0;
+
+    ipc_recv(child, &whom, &value, NULL, NULL);
+
+    user_assert(whom == (uint32_t)child);
+    user_assert(value == 3);
+
+    debugf("spawntest passed\n");
+    return 0;
+}
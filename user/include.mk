@@ -2,8 +2,11 @@ lab-ge = $(shell [ "$$(echo $(lab)_ | cut -f1 -d_)" -ge $(1) ] && echo true)
 
 INITAPPS             := tltest.x fktest.x pingpong.x serialtest.x processtest.x virtiotest.x
 
-USERLIB              := entry.o \
-			syscall_wrap.o \
+# 静态链接到每个程序中的部分：程序入口
+USERLIB              := entry.o
+
+# 共享用户库（ulib.b）：链接到固定地址ULIB，由内核映射到每个进程中，程序只引用其中的符号
+ULIB                 := syscall_wrap.o \
 			debugf.o \
 			libos.o \
 			fork.o \
@@ -15,12 +18,15 @@ USERLIB              := entry.o \
 			process.o \
 			virtio.o \
 			pageref.o \
+			wait.o \
 			file.o \
 			fsipc.o \
 			fd.o \
 			console.o \
 			pipe.o \
-			fprintf.o
+			fprintf.o \
+			spawn.o
 
 
-USERLIB := $(addprefix lib/, $(USERLIB)) $(wildcard ../lib/*.o)
+USERLIB := $(addprefix lib/, $(USERLIB))
+ULIB := $(addprefix lib/, $(ULIB)) $(wildcard ../lib/*.o)
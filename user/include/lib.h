@@ -7,6 +7,7 @@
 #include <pmap.h>
 #include <syscall.h>
 #include <trap.h>
+#include <ulib.h>
 
 // 用户空间对进程自身三级页表的只读访问，可直接由VPN索引
 #define vp3 ((const volatile Pte *)UVPT)
@@ -54,8 +55,18 @@ void _user_halt(const char *, int, const char *, ...) __attribute__((noreturn));
     } while (0)
 
 /// fork, spawn
+/*
+ * 概述：
+ *   读取文件系统中`prog`处的ELF可执行文件，以参数`argv`（以NULL结尾）创建子进程，
+ *   不复制当前进程的地址空间。参数字符串及argv数组须能放入子进程栈顶的一页中。
+ *
+ * Postcondition：
+ * - 成功时返回子进程的envid
+ * - 失败时返回错误码，如-E_NOT_FOUND（文件不存在）、-E_INVAL（不是可执行文件或参数过长）
+ */
 int spawn(char *prog, char **argv);
-int spawnl(char *prot, char *args, ...);
+// 同`spawn`，参数以NULL结尾的可变参数列表给出，`args`为argv[0]
+int spawnl(char *prog, char *args, ...);
 /*
  * 概述：
  *   用户级fork实现，创建子进程并复制父进程地址空间。
@@ -231,9 +242,10 @@ int syscall_set_tlb_mod_entry(uint32_t envid, void (*func)(struct Trapframe *));
  *   （含 TLB 操作）为指定进程分配物理内存页并建立虚拟地址映射。
  *   若目标虚拟地址已存在映射，则静默解除原映射后建立新映射。
  *   权限检查要求目标进程必须是调用者或其子进程（通过envid2env的checkperm实现）。
+ *   perm中含有MEM_HUGE_2M或MEM_HUGE_1G时，分配一个按其大小对齐的巨页。
  *
  * 实现差异：
- *   - 仅使用用户传入perm参数的低12位
+ *   - 仅使用用户传入perm参数的低12位（及巨页标志位）
  *   - 强制移除PTE_C_CACHEABLE和PTE_V标志（由page_insert内部添加）
  *
  * Precondition：
@@ -266,6 +278,7 @@ int syscall_mem_alloc(uint32_t envid, void *va, uint32_t perm);
  *   （含 TLB 操作）将源进程(srcid)地址空间中'srcva'处的物理页
  *   映射到目标进程(dstid)地址空间中'dstva'处，
  *   并设置权限位'perm'。映射后两个进程共享同一物理页。
+ *   perm中含有MEM_HUGE_2M或MEM_HUGE_1G时，'srcva'处须为对应大小的巨页，整体共享。
  *
  * 实现差异：
  * - 仅取用户传入的perm低12位，并手动移除PTE_C_CACHEABLE和PTE_V标志位，
@@ -465,7 +478,7 @@ void syscall_panic(const char *msg) __attribute__((noreturn));
  * - 如果'srcva'不为0，可能修改目标环境的页表（通过page_insert）
  *
  * 注意事项：
- * - 若srcva != 0但非法，将返回`-E_INVAL`，但此时接收者已被唤醒并继续执行
+ * - 若srcva != 0但未映射，将返回`-E_INVAL`，此时不修改目标环境，接收者仍在等待
  * - 若srcva != 0但合法，dstva = 0，将导致接收者的[0x00000000, 0x00000FFF]被映射
  *   这被认为是系统设计缺陷，但保留该效果
  */
@@ -577,12 +590,156 @@ int syscall_pageref(void *va);
 
 int syscall_is_dirty(void *va);
 
+/*
+ * 概述：
+ *   设置进程envid（0表示当前进程）在fork时的选项`flags`（FORK_*），由之后创建的子进程继承。
+ *   例如，FORK_SHARE_TABLES使得fork时父子进程共享三级页表，修改映射时才复制；
+ *   FORK_COW_COPY_AROUND使得写时复制缺页时一并复制同一组中仍被共享的相邻页。
+ *
+ * Postcondition：
+ * - 成功时返回0
+ * - -E_BAD_ENV：envid无效或不是当前进程及其子进程
+ * - -E_INVAL：`flags`含有未知的标志位
+ */
+int syscall_set_fork_flags(uint32_t envid, uint32_t flags);
+
+/*
+ * 概述：
+ *   设置进程envid（0表示当前进程）在缺页时一次最多填充的页数`max_pages`，由之后创建的子进程继承。
+ *   顺序访问新内存时，内核根据访问模式逐步增大填充的页数，直到`max_pages`；
+ *   `max_pages`不超过1时，每次缺页只分配一页。
+ *
+ * Postcondition：
+ * - 成功时返回0
+ * - -E_BAD_ENV：envid无效或不是当前进程及其子进程
+ * - -E_INVAL：`max_pages`超过FAULT_AROUND_MAX_PAGES
+ */
+int syscall_set_fault_around(uint32_t envid, uint32_t max_pages);
+
+/*
+ * 概述：
+ *   由当前进程中[binary, binary + size)处的ELF可执行镜像创建子进程，不复制当前进程的地址空间。
+ *   `stack`处的页被移动到子进程的栈顶页[USTACKTOP - PAGE_SIZE, USTACKTOP)，
+ *   子进程从`sp`开始使用该栈，`sp`处依次为 8 字节的argc及argv。
+ *   子进程的名称取自`name`处的MAXENVNAME字节。一般应使用`spawn`。
+ *
+ * Postcondition：
+ * - 成功时返回子进程的envid，`stack`处的页被取消映射
+ * - -E_INVAL：地址非法或未映射、`sp`不在栈页中或未按 16 字节对齐、镜像不是合法的ELF可执行文件
+ * - -E_INVAL：`stack`处的页既不可写也不是CoW页（如共享库的代码页）
+ * - -E_NO_FREE_ENV、-E_NO_MEM：资源不足
+ * - -E_QUOTA：子进程的页超出资源组的物理页限制
+ */
+int syscall_spawn(const void *binary, size_t size, void *stack, u_reg_t sp,
+                  const char *name);
+
+/*
+ * 概述：
+ *   获取各级调度队列的长度，以及调度器提升、降级、抢占进程的次数。
+ *   当前进程的调度级别见`env->env_sched_level`。
+ *
+ * Postcondition：
+ * - 成功时返回0
+ * - -E_INVAL：`stat`处的地址范围非法
+ */
+int syscall_get_sched_stat(struct SchedStat *stat);
+
+/*
+ * 概述：
+ *   将进程envid（0表示当前进程）加入EDF调度类：每`period`个时钟中断为一个周期，
+ *   每个周期最多运行`budget`个时钟中断，作业应在周期开始后`deadline`个时钟中断内
+ *   完成并调用`syscall_yield`，之后直到下一周期开始前不再运行。
+ *   `period`为0时，将进程移回多级反馈队列调度类。
+ *   错过截止时间的作业数见`envs[ENVX(envid)].env_edf_misses`。
+ *
+ * Postcondition：
+ * - 成功时返回0
+ * - -E_BAD_ENV：envid无效或不是当前进程及其子进程
+ * - -E_INVAL：不满足 0 < `budget` <= `deadline` <= `period`
+ * - -E_OVERLOAD：所有EDF进程的CPU利用率之和将超过SCHED_EDF_UTIL_MAX
+ */
+int syscall_set_edf(uint32_t envid, uint32_t period, uint32_t budget,
+                    uint32_t deadline);
+
+/*
+ * 概述：
+ *   阻塞当前进程，直到自启动以来经过的时间达到`ns`纳秒（见`syscall_get_time`）。
+ *   由内核的定时器队列唤醒，等待期间不占用CPU。
+ *
+ * Postcondition：
+ * - 返回0，指定时刻已过时立即返回
+ */
+int syscall_sleep_until(uint64_t ns);
+
+/*
+ * 概述：
+ *   同`syscall_ipc_recv`，但最多等待`timeout_ns`纳秒。
+ *   超时时刻超出表示范围时不会超时，如`timeout_ns`为UINT64_MAX时一直等待。
+ *
+ * Postcondition：
+ * - 在超时前收到消息时返回0
+ * - -E_TIMEOUT：超时前未收到消息，`timeout_ns`为0时立即返回
+ * - -E_INVAL：'dstva'既不是0也不是合法地址
+ */
+int syscall_ipc_recv_timeout(void *dstva, uint32_t from, uint64_t timeout_ns);
+
+/*
+ * 概述：
+ *   将自启动以来经过的纳秒数写入`ns`。
+ *
+ * Postcondition：
+ * - 成功时返回0
+ * - -E_INVAL：`ns`处的地址范围非法
+ */
+int syscall_get_time(uint64_t *ns);
+
+/*
+ * 概述：
+ *   创建资源组：组内进程每`cpu_period`个时钟中断最多共运行`cpu_quota`个时钟中断间隔，
+ *   用完后直到下一周期开始前不被调度；组内进程最多共使用`page_limit`个物理页，
+ *   超出时分配页的系统调用返回-E_QUOTA，缺页的进程被销毁。0表示不限制相应资源。
+ *   资源组在最后一个进程退出或离开时释放。
+ *
+ * Postcondition：
+ * - 成功时返回资源组编号
+ * - -E_INVAL：`cpu_quota`非0且大于`cpu_period`
+ * - -E_NO_MEM：没有空闲的资源组
+ */
+int syscall_group_create(uint32_t cpu_quota, uint32_t cpu_period,
+                         uint32_t page_limit);
+
+/*
+ * 概述：
+ *   将进程envid（0表示当前进程）移入资源组`gid`，之后fork、spawn创建的子进程继承
+ *   该资源组。0号资源组不受限制。
+ *
+ * Postcondition：
+ * - 成功时返回0
+ * - -E_BAD_ENV：envid无效或不是当前进程及其子进程
+ * - -E_INVAL：`gid`不是已创建的资源组
+ */
+int syscall_group_attach(uint32_t envid, uint32_t gid);
+
+/*
+ * 概述：
+ *   将资源组`gid`的配额及使用情况写入`stat`。
+ *
+ * Postcondition：
+ * - 成功时返回0
+ * - -E_INVAL：`gid`不是已创建的资源组，或`stat`处的地址范围非法
+ */
+int syscall_group_get_stat(uint32_t gid, struct GroupStat *stat);
+
 // ipc.c
 int ipc_send(uint32_t whom, uint64_t val, const void *srcva, uint32_t perm);
 int ipc_recv(uint32_t from, uint32_t *whom, uint64_t *out_val, void *dstva,
              uint32_t *perm);
+// 同`ipc_recv`，但最多等待`timeout_ns`纳秒，超时时返回-E_TIMEOUT
+int ipc_recv_timeout(uint32_t from, uint32_t *whom, uint64_t *out_val,
+                     void *dstva, uint32_t *perm, uint64_t timeout_ns);
 
 // wait.c
+// 让出CPU直到进程`envid`退出（其进程控制块被释放或被其它进程复用）
 void wait(uint32_t envid);
 
 // console.c
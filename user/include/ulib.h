@@ -0,0 +1,22 @@
+#ifndef ULIB_H
+#define ULIB_H
+
+// 共享用户库（ulib.b）首部中的魔数：“ULIB”
+#define ULIB_MAGIC 0x42494C55
+// 共享用户库的接口版本，库中的函数、全局变量的布局改变时须增加
+// 程序将其链接时的版本传递给`libmain`，与共享库的版本不一致时拒绝运行
+#define ULIB_VERSION 2
+
+#ifndef __ASSEMBLER__
+#include <types.h>
+
+// 位于共享用户库开始处（ULIB）的首部
+struct UlibHeader {
+    uint32_t magic;   // ULIB_MAGIC
+    uint32_t version; // ULIB_VERSION
+};
+
+extern const struct UlibHeader ulib_header;
+#endif
+
+#endif
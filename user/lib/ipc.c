@@ -52,3 +52,28 @@ int ipc_recv(uint32_t from, uint32_t *whom, uint64_t *out_val, void *dstva,
 
     return r;
 }
+
+// Like ipc_recv, but give up after timeout_ns nanoseconds and
+// return -E_TIMEOUT.
+int ipc_recv_timeout(uint32_t from, uint32_t *whom, uint64_t *out_val,
+                     void *dstva, uint32_t *perm, uint64_t timeout_ns) {
+    int r = syscall_ipc_recv_timeout(dstva, from, timeout_ns);
+
+    if (r != 0) {
+        return r;
+    }
+
+    if (whom) {
+        *whom = env->env_ipc_from;
+    }
+
+    if (perm) {
+        *perm = env->env_ipc_perm;
+    }
+
+    if (out_val) {
+        *out_val = env->env_ipc_value;
+    }
+
+    return r;
+}
@@ -14,14 +14,35 @@ void exit(void) {
 }
 
 const volatile struct Env *env;
-extern int main(int, char **);
 
-void libmain(int argc, char **argv) {
+// 共享用户库的首部，由链接脚本放置在库的开始处（ULIB）
+const struct UlibHeader ulib_header
+    __attribute__((section(".ulib_header"), used)) = {
+        .magic = ULIB_MAGIC,
+        .version = ULIB_VERSION,
+};
+
+/*
+ * 概述：
+ *   程序的入口（`_start`）调用的第一个库函数，位于共享用户库中。
+ *   共享用户库的各段由内核在首次访问时映射（见`env_image_fault`），.data及.bss为每个进程私有，
+ *   此处只需检查库与程序链接时使用的库版本`version`一致，然后调用程序的`main`（`umain`）。
+ *
+ * Panics：
+ * - 共享用户库的版本与`version`不一致
+ */
+void libmain(int argc, char **argv, int (*umain)(int, char **),
+             uint32_t version) {
     // set env to point at our env structure in envs[].
     env = &envs[ENVX(syscall_getenvid())];
 
+    if (ulib_header.magic != ULIB_MAGIC || ulib_header.version != version) {
+        user_panic("shared library version %u, program linked against %u",
+                   ulib_header.version, version);
+    }
+
     // call user main routine
-    main(argc, argv);
+    umain(argc, argv);
 
     // exit gracefully
     exit();
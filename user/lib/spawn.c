@@ -0,0 +1,137 @@
+#include <lib.h>
+#include <stdarg.h>
+
+// `spawnl`最多支持的参数个数（含argv[0]）
+#define SPAWNL_MAX_ARGS 32
+
+// 栈页在当前进程中的地址（UTEMP）转化为在子进程中的地址
+#define CHILD_STACK_VA(va) ((va) - UTEMP + (USTACKTOP - PAGE_SIZE))
+
+/*
+ * 概述：
+ *   在当前进程UTEMP处的页中构造子进程的初始栈：
+ *   页的顶部依次为各参数字符串、argv数组（以NULL结尾），其下为argc及argv（各 8 字节），
+ *   `*init_sp`为子进程中的栈指针（按 16 字节对齐）。argv中的指针均为子进程中的地址。
+ *
+ * Precondition：
+ * - UTEMP处已映射可写的页
+ *
+ * Postcondition：
+ * - 成功时返回 0
+ * - 参数过多或过长、无法放入一页时返回-E_INVAL
+ */
+static int init_stack(char **argv, u_reg_t *init_sp) {
+    size_t argc = 0;
+    size_t total = 0;
+
+    for (argc = 0; argv[argc] != NULL; argc++) {
+        total += strlen(argv[argc]) + 1;
+    }
+
+    u_reg_t strings = UTEMP + PAGE_SIZE - total;
+    u_reg_t argv_array = ROUNDDOWN(strings, sizeof(u_reg_t)) -
+                         (argc + 1) * sizeof(u_reg_t);
+    u_reg_t sp = ROUNDDOWN(argv_array - 2 * sizeof(u_reg_t), 16);
+
+    if (total > PAGE_SIZE || sp < UTEMP || sp >= argv_array) {
+        return -E_INVAL;
+    }
+
+    char *str = (char *)strings;
+    u_reg_t *child_argv = (u_reg_t *)argv_array;
+
+    for (size_t i = 0; i < argc; i++) {
+        child_argv[i] = CHILD_STACK_VA((u_reg_t)str);
+        strcpy(str, argv[i]);
+        str += strlen(argv[i]) + 1;
+    }
+
+    child_argv[argc] = 0;
+
+    ((u_reg_t *)sp)[0] = argc;
+    ((u_reg_t *)sp)[1] = CHILD_STACK_VA(argv_array);
+
+    *init_sp = CHILD_STACK_VA(sp);
+
+    return 0;
+}
+
+/*
+ * 概述：
+ *   读取文件系统中`prog`处的ELF可执行文件，以参数`argv`（以NULL结尾）创建子进程，
+ *   不复制当前进程的地址空间（见`syscall_spawn`）。
+ *   文件内容通过`open`映射到当前进程中，由内核直接复制到子进程；子进程的名称为`prog`的最后一级。
+ *
+ * Postcondition：
+ * - 成功时返回子进程的envid
+ * - 失败时返回`open`、`syscall_spawn`等的错误码
+ */
+int spawn(char *prog, char **argv) {
+    struct Fd *fd;
+    int fdnum;
+    int r;
+
+    if ((fdnum = open(prog, O_RDONLY)) < 0) {
+        return fdnum;
+    }
+
+    if ((r = fd_lookup(fdnum, &fd)) < 0) {
+        close(fdnum);
+        return r;
+    }
+
+    u_reg_t size = ((struct Filefd *)fd)->f_file.f_size;
+    u_reg_t sp;
+
+    if ((r = syscall_mem_alloc(0, (void *)UTEMP, PTE_RW)) < 0) {
+        close(fdnum);
+        return r;
+    }
+
+    char name[MAXENVNAME] = {0};
+    const char *base = prog;
+
+    for (const char *p = prog; *p != '\0'; p++) {
+        if (*p == '/') {
+            base = p + 1;
+        }
+    }
+
+    for (size_t i = 0; i < MAXENVNAME - 1 && base[i] != '\0'; i++) {
+        name[i] = base[i];
+    }
+
+    if ((r = init_stack(argv, &sp)) == 0) {
+        r = syscall_spawn(fd2data(fd), size, (void *)UTEMP, sp, name);
+    }
+
+    // 成功时栈页已移动到子进程中，取消映射不会出错
+    syscall_mem_unmap(0, (void *)UTEMP);
+    close(fdnum);
+
+    return r;
+}
+
+// 同`spawn`，参数以NULL结尾的可变参数列表给出，`args`为argv[0]
+int spawnl(char *prog, char *args, ...) {
+    char *argv[SPAWNL_MAX_ARGS + 1];
+    va_list ap;
+    size_t argc = 0;
+
+    va_start(ap, args);
+
+    for (char *arg = args; arg != NULL; arg = va_arg(ap, char *)) {
+        if (argc == SPAWNL_MAX_ARGS) {
+            va_end(ap);
+            return -E_INVAL;
+        }
+
+        argv[argc++] = arg;
+    }
+
+    va_end(ap);
+
+    argv[argc] = NULL;
+
+    return spawn(prog, argv);
+}
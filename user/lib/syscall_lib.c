@@ -99,4 +99,47 @@ u_reg_t syscall_get_physical_address(void *va) {
 
 int syscall_is_dirty(void *va) { return msyscall(SYS_is_dirty, (u_reg_t)va); }
 
-int syscall_pageref(void *va) { return msyscall(SYS_pageref, (u_reg_t)va); }
\ No newline at end of file
+int syscall_pageref(void *va) { return msyscall(SYS_pageref, (u_reg_t)va); }
+
+int syscall_set_fork_flags(uint32_t envid, uint32_t flags) {
+    return msyscall(SYS_set_fork_flags, envid, flags);
+}
+
+int syscall_set_fault_around(uint32_t envid, uint32_t max_pages) {
+    return msyscall(SYS_set_fault_around, envid, max_pages);
+}
+
+int syscall_spawn(const void *binary, size_t size, void *stack, u_reg_t sp,
+                  const char *name) {
+    return msyscall(SYS_spawn, binary, size, stack, sp, name);
+}
+
+int syscall_get_sched_stat(struct SchedStat *stat) {
+    return msyscall(SYS_get_sched_stat, stat);
+}
+
+int syscall_set_edf(uint32_t envid, uint32_t period, uint32_t budget,
+                    uint32_t deadline) {
+    return msyscall(SYS_set_edf, envid, period, budget, deadline);
+}
+
+int syscall_sleep_until(uint64_t ns) { return msyscall(SYS_sleep_until, ns); }
+
+int syscall_ipc_recv_timeout(void *dstva, uint32_t from, uint64_t timeout_ns) {
+    return msyscall(SYS_ipc_recv_timeout, dstva, from, timeout_ns);
+}
+
+int syscall_get_time(uint64_t *ns) { return msyscall(SYS_get_time, ns); }
+
+int syscall_group_create(uint32_t cpu_quota, uint32_t cpu_period,
+                         uint32_t page_limit) {
+    return msyscall(SYS_group_create, cpu_quota, cpu_period, page_limit);
+}
+
+int syscall_group_attach(uint32_t envid, uint32_t gid) {
+    return msyscall(SYS_group_attach, envid, gid);
+}
+
+int syscall_group_get_stat(uint32_t gid, struct GroupStat *stat) {
+    return msyscall(SYS_group_get_stat, gid, stat);
+}
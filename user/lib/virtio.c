@@ -10,6 +10,9 @@ char virtioipcbuf[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
 
 static uint32_t virtio_service_envid = 0;
 
+// virtio服务进程尚未等待请求时，重试发送前睡眠的纳秒数
+#define VIRTIO_RETRY_NS 100000ULL
+
 static void set_virtio_service_envid();
 
 int virtio_read_sector(uint32_t sector, void *buf) {
@@ -27,7 +30,11 @@ int virtio_read_sector(uint32_t sector, void *buf) {
                     virtio_service_envid, VIRTIOREQ_READ,
                     (const void *)virtioipcbuf, PTE_V | PTE_RW | PTE_USER)) ==
                -E_IPC_NOT_RECV) {
-            continue;
+            // 由定时器唤醒后重试，而非忙等占用CPU
+            uint64_t now = 0;
+
+            syscall_get_time(&now);
+            syscall_sleep_until(now + VIRTIO_RETRY_NS);
         }
 
         uint64_t ret = 0;
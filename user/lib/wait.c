@@ -0,0 +1,9 @@
+#include <lib.h>
+
+void wait(uint32_t envid) {
+    const volatile struct Env *e = &envs[ENVX(envid)];
+
+    while (e->env_id == envid && e->env_status != ENV_FREE) {
+        syscall_yield();
+    }
+}
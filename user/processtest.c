@@ -12,14 +12,17 @@ static const char *env_status_to_string[3] = {[ENV_FREE] = "ENV_FREE",
 void dump_process() {
     size_t process_count = get_process_list(NENV, process_list);
 
-    debugf("%16s\t%8s\t%8s\t%8s\t%8s\t%s\n", "NAME", "PID", "PPID", "PRI",
-           "RUNS", "STAT");
+    debugf("%16s\t%8s\t%8s\t%8s\t%8s\t%8s\t%8s\t%8s\t%8s\t%s\n", "NAME",
+           "PID", "PPID", "PRI", "RUNS", "USER(us)", "SYS(us)", "COWCOPY",
+           "COWREUSE", "STAT");
 
     for (size_t i = 0; i < process_count; i++) {
         struct Process *cur = &process_list[i];
-        debugf("%16s\t%08x\t%08x\t%8u\t%8lu\t%s\n", cur->env_name, cur->env_id,
-               cur->env_parent_id, cur->env_pri, cur->env_runs,
-               env_status_to_string[cur->env_status]);
+        debugf("%16s\t%08x\t%08x\t%8u\t%8lu\t%8lu\t%8lu\t%8lu\t%8lu\t%s\n",
+               cur->env_name, cur->env_id, cur->env_parent_id, cur->env_pri,
+               cur->env_runs, cur->env_user_time / 1000,
+               cur->env_kernel_time / 1000, cur->env_cow_copy,
+               cur->env_cow_reuse, env_status_to_string[cur->env_status]);
     }
 }
 